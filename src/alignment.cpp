@@ -1,5 +1,6 @@
 #include "alignment.hpp"
 #include "stream.hpp"
+#include "htslib/kstring.h"
 
 #include <regex>
 
@@ -722,6 +723,61 @@ bam1_t* alignment_to_bam(const string& sam_header,
 
 }
 
+bam1_t* alignment_to_bam_internal(bam_hdr_t* header,
+                                  const Alignment& alignment,
+                                  const string& refseq,
+                                  const int32_t refpos,
+                                  const bool refrev,
+                                  const string& cigar,
+                                  const string& mateseq,
+                                  const int32_t matepos,
+                                  const int32_t tlen,
+                                  bool paired) {
+
+    assert(header != nullptr);
+
+    string sam = alignment_to_sam_internal(alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, paired);
+    // The parser wants the record without its line ending
+    if (!sam.empty() && sam.back() == '\n') {
+        sam.pop_back();
+    }
+    kstring_t line = {0, 0, nullptr};
+    kputsn(sam.c_str(), sam.size(), &line);
+    bam1_t *aln = bam_init1();
+    if (sam_parse1(&line, header, aln) < 0) {
+        cerr << "[vg::alignment] Failure to parse SAM record" << endl
+             << sam << endl;
+        exit(1);
+    }
+    free(line.s);
+    return aln;
+}
+
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar,
+                         const string& mateseq,
+                         const int32_t matepos,
+                         const int32_t tlen) {
+
+    return alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, true);
+
+}
+
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar) {
+
+    return alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, "", -1, 0, false);
+
+}
+
 string cigar_string(vector<pair<int, char> >& cigar) {
     vector<pair<int, char> > cigar_comp;
     pair<int, char> cur = make_pair(0, '\0');
@@ -93,7 +93,39 @@ bam1_t* alignment_to_bam(const string& sam_header,
                         const int32_t refpos,
                         const bool refrev,
                         const string& cigar);
-                         
+
+/**
+ * Convert a paired Alignment to a BAM record, against an already-parsed
+ * header. This avoids re-reading the header text for every record. Safe to
+ * call from many threads at once on the same header, as long as its name
+ * lookup table has been built first (for example by one call to
+ * bam_name2id).
+ *
+ * Remember to clean up with bam_destroy1(b);
+ */
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar,
+                         const string& mateseq,
+                         const int32_t matepos,
+                         const int32_t tlen);
+
+/**
+ * Convert an unpaired Alignment to a BAM record, against an already-parsed
+ * header. The same threading rules apply as for the paired version.
+ *
+ * Remember to clean up with bam_destroy1(b);
+ */
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar);
+
 /**
  * Convert a paired Alignment to a SAM record. If the alignment is unmapped,
  * refpos must be -1. Otherwise, refpos must be the position on the reference
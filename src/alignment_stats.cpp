@@ -0,0 +1,339 @@
+/**
+ * \file alignment_stats.cpp
+ * Implementation of alignment summary statistics.
+ */
+
+#include "alignment_stats.hpp"
+#include "index_io.hpp"
+
+#include <set>
+#include <cassert>
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+/// The saved format
+static const IndexFormat STATS_FORMAT {"STAT", 1, "vg::AlignmentStats", "alignment stats file"};
+
+/// Write a list of edits and the nodes they are on
+static void write_edits(ostream& out, const vector<pair<id_t, Edit>>& edits) {
+    write_raw<uint64_t>(out, edits.size());
+    for (auto& id_and_edit : edits) {
+        write_raw<int64_t>(out, id_and_edit.first);
+        write_string(out, id_and_edit.second.SerializeAsString());
+    }
+}
+
+/// Read a list of edits written by write_edits
+static vector<pair<id_t, Edit>> read_edits(istream& in) {
+    vector<pair<id_t, Edit>> edits(read_raw<uint64_t>(in, STATS_FORMAT));
+    for (auto& id_and_edit : edits) {
+        id_and_edit.first = read_raw<int64_t>(in, STATS_FORMAT);
+        if (!id_and_edit.second.ParseFromString(read_string(in, STATS_FORMAT))) {
+            STATS_FORMAT.fail("corrupt edit in");
+        }
+    }
+    return edits;
+}
+
+void Histogram::add(size_t value, size_t count) {
+    if (value < DENSE_LIMIT) {
+        if (value >= dense_counts.size()) {
+            dense_counts.resize(value + 1, 0);
+        }
+        dense_counts[value] += count;
+    } else {
+        sparse_counts[value] += count;
+    }
+    total_count += count;
+}
+
+void Histogram::merge(const Histogram& other) {
+    if (other.dense_counts.size() > dense_counts.size()) {
+        dense_counts.resize(other.dense_counts.size(), 0);
+    }
+    for (size_t i = 0; i < other.dense_counts.size(); i++) {
+        dense_counts[i] += other.dense_counts[i];
+    }
+    for (auto& value_and_count : other.sparse_counts) {
+        sparse_counts[value_and_count.first] += value_and_count.second;
+    }
+    total_count += other.total_count;
+}
+
+size_t Histogram::count(size_t value) const {
+    if (value < DENSE_LIMIT) {
+        return value < dense_counts.size() ? dense_counts[value] : 0;
+    }
+    auto found = sparse_counts.find(value);
+    return found == sparse_counts.end() ? 0 : found->second;
+}
+
+size_t Histogram::total() const {
+    return total_count;
+}
+
+bool Histogram::empty() const {
+    return total_count == 0;
+}
+
+void Histogram::for_each(const function<void(size_t, size_t)>& lambda) const {
+    for (size_t i = 0; i < dense_counts.size(); i++) {
+        if (dense_counts[i]) {
+            lambda(i, dense_counts[i]);
+        }
+    }
+    for (auto& value_and_count : sparse_counts) {
+        lambda(value_and_count.first, value_and_count.second);
+    }
+}
+
+void Histogram::serialize(ostream& out) const {
+    write_raw<uint64_t>(out, total_count);
+    vector<uint64_t> dense(dense_counts.begin(), dense_counts.end());
+    write_vector(out, dense);
+    write_raw<uint64_t>(out, sparse_counts.size());
+    for (auto& value_and_count : sparse_counts) {
+        write_raw<uint64_t>(out, value_and_count.first);
+        write_raw<uint64_t>(out, value_and_count.second);
+    }
+}
+
+void Histogram::deserialize(istream& in) {
+    total_count = read_raw<uint64_t>(in, STATS_FORMAT);
+    vector<uint64_t> dense = read_vector<uint64_t>(in, STATS_FORMAT);
+    if (dense.size() > DENSE_LIMIT) {
+        STATS_FORMAT.fail("corrupt histogram in");
+    }
+    dense_counts.assign(dense.begin(), dense.end());
+    sparse_counts.clear();
+    size_t sparse_size = read_raw<uint64_t>(in, STATS_FORMAT);
+    for (size_t i = 0; i < sparse_size; i++) {
+        size_t value = read_raw<uint64_t>(in, STATS_FORMAT);
+        sparse_counts[value] = read_raw<uint64_t>(in, STATS_FORMAT);
+    }
+}
+
+void AlignmentStats::merge(const AlignmentStats& other) {
+    total_alignments += other.total_alignments;
+    total_aligned += other.total_aligned;
+    total_primary += other.total_primary;
+    total_secondary += other.total_secondary;
+
+    for (auto& id_and_count : other.node_visit_counts) {
+        node_visit_counts[id_and_count.first] += id_and_count.second;
+    }
+
+    total_insertions += other.total_insertions;
+    total_inserted_bases += other.total_inserted_bases;
+    total_deletions += other.total_deletions;
+    total_deleted_bases += other.total_deleted_bases;
+    total_substitutions += other.total_substitutions;
+    total_substituted_bases += other.total_substituted_bases;
+    total_softclips += other.total_softclips;
+    total_softclipped_bases += other.total_softclipped_bases;
+
+    mapping_qualities.merge(other.mapping_qualities);
+    insertion_lengths.merge(other.insertion_lengths);
+    deletion_lengths.merge(other.deletion_lengths);
+    softclip_lengths.merge(other.softclip_lengths);
+
+    for (auto& site_and_alleles : other.reads_on_allele) {
+        auto& alleles = reads_on_allele[site_and_alleles.first];
+        for (auto& allele_and_count : site_and_alleles.second) {
+            alleles[allele_and_count.first] += allele_and_count.second;
+        }
+    }
+
+    insertions.insert(insertions.end(), other.insertions.begin(), other.insertions.end());
+    deletions.insert(deletions.end(), other.deletions.begin(), other.deletions.end());
+    substitutions.insert(substitutions.end(), other.substitutions.begin(), other.substitutions.end());
+    softclips.insert(softclips.end(), other.softclips.begin(), other.softclips.end());
+}
+
+void AlignmentStats::serialize(ostream& out) const {
+    write_header(out, STATS_FORMAT);
+
+    for (size_t total : {total_alignments, total_aligned, total_primary, total_secondary,
+                         total_insertions, total_inserted_bases, total_deletions, total_deleted_bases,
+                         total_substitutions, total_substituted_bases, total_softclips, total_softclipped_bases}) {
+        write_raw<uint64_t>(out, total);
+    }
+
+    write_raw<uint64_t>(out, node_visit_counts.size());
+    for (auto& id_and_count : node_visit_counts) {
+        write_raw<int64_t>(out, id_and_count.first);
+        write_raw<uint64_t>(out, id_and_count.second);
+    }
+
+    mapping_qualities.serialize(out);
+    insertion_lengths.serialize(out);
+    deletion_lengths.serialize(out);
+    softclip_lengths.serialize(out);
+
+    write_raw<uint64_t>(out, reads_on_allele.size());
+    for (auto& site_and_alleles : reads_on_allele) {
+        write_string(out, site_and_alleles.first);
+        write_raw<uint64_t>(out, site_and_alleles.second.size());
+        for (auto& allele_and_count : site_and_alleles.second) {
+            write_string(out, allele_and_count.first);
+            write_raw<uint64_t>(out, allele_and_count.second);
+        }
+    }
+
+    write_edits(out, insertions);
+    write_edits(out, deletions);
+    write_edits(out, substitutions);
+    write_edits(out, softclips);
+}
+
+void AlignmentStats::deserialize(istream& in) {
+    read_header(in, STATS_FORMAT);
+
+    for (size_t* total : {&total_alignments, &total_aligned, &total_primary, &total_secondary,
+                          &total_insertions, &total_inserted_bases, &total_deletions, &total_deleted_bases,
+                          &total_substitutions, &total_substituted_bases, &total_softclips, &total_softclipped_bases}) {
+        *total = read_raw<uint64_t>(in, STATS_FORMAT);
+    }
+
+    node_visit_counts.clear();
+    size_t visited_nodes = read_raw<uint64_t>(in, STATS_FORMAT);
+    for (size_t i = 0; i < visited_nodes; i++) {
+        id_t id = read_raw<int64_t>(in, STATS_FORMAT);
+        node_visit_counts[id] = read_raw<uint64_t>(in, STATS_FORMAT);
+    }
+
+    mapping_qualities.deserialize(in);
+    insertion_lengths.deserialize(in);
+    deletion_lengths.deserialize(in);
+    softclip_lengths.deserialize(in);
+
+    reads_on_allele.clear();
+    size_t sites = read_raw<uint64_t>(in, STATS_FORMAT);
+    for (size_t i = 0; i < sites; i++) {
+        auto& alleles = reads_on_allele[read_string(in, STATS_FORMAT)];
+        size_t allele_count = read_raw<uint64_t>(in, STATS_FORMAT);
+        for (size_t j = 0; j < allele_count; j++) {
+            string allele = read_string(in, STATS_FORMAT);
+            alleles[allele] = read_raw<uint64_t>(in, STATS_FORMAT);
+        }
+    }
+
+    insertions = read_edits(in);
+    deletions = read_edits(in);
+    substitutions = read_edits(in);
+    softclips = read_edits(in);
+}
+
+AlignmentStatsAccumulator::AlignmentStatsAccumulator(const map<id_t, pair<string, string>>* allele_path_for_node,
+                                                     bool record_edits) :
+    allele_path_for_node(allele_path_for_node), record_edits(record_edits), shards(omp_get_max_threads()) {
+    // Nothing to do
+}
+
+void AlignmentStatsAccumulator::add(const Alignment& aln) {
+    size_t thread = omp_get_thread_num();
+    assert(thread < shards.size());
+    AlignmentStats& stats = shards[thread];
+
+    stats.total_alignments++;
+    if (aln.is_secondary()) {
+        stats.total_secondary++;
+        return;
+    }
+
+    stats.total_primary++;
+    if (aln.score() > 0) {
+        // We only count aligned primary reads in "total aligned"; the primary
+        // can't be unaligned if the secondary is aligned.
+        stats.total_aligned++;
+    }
+    stats.mapping_qualities.add(aln.mapping_quality());
+
+    // Which sites and alleles does this read support. TODO: if we hit unique
+    // nodes from multiple alleles of the same site, we should... do
+    // something. Discard the read? Not just count it on both sides like we do
+    // now.
+    set<pair<string, string>> alleles_supported;
+
+    const Path& path = aln.path();
+    for (size_t i = 0; i < path.mapping_size(); i++) {
+        auto& mapping = path.mapping(i);
+        id_t node_id = mapping.position().node_id();
+
+        if (allele_path_for_node != nullptr) {
+            auto found = allele_path_for_node->find(node_id);
+            if (found != allele_path_for_node->end()) {
+                // We hit a unique node for this allele.
+                alleles_supported.insert(found->second);
+            }
+        }
+
+        // Record that there was a visit to this node.
+        stats.node_visit_counts[node_id]++;
+
+        for (size_t j = 0; j < mapping.edit_size(); j++) {
+            // Go through edits and look for each type.
+            auto& edit = mapping.edit(j);
+
+            if (edit.to_length() > edit.from_length()) {
+                size_t length = edit.to_length() - edit.from_length();
+                if ((j == 0 && i == 0) || (j == mapping.edit_size() - 1 && i == path.mapping_size() - 1)) {
+                    // We're at the very end of the path, so this is a soft clip.
+                    stats.total_softclipped_bases += length;
+                    stats.total_softclips++;
+                    stats.softclip_lengths.add(length);
+                    if (record_edits) {
+                        stats.softclips.push_back(make_pair(node_id, edit));
+                    }
+                } else {
+                    stats.total_inserted_bases += length;
+                    stats.total_insertions++;
+                    stats.insertion_lengths.add(length);
+                    if (record_edits) {
+                        stats.insertions.push_back(make_pair(node_id, edit));
+                    }
+                }
+            } else if (edit.from_length() > edit.to_length()) {
+                size_t length = edit.from_length() - edit.to_length();
+                stats.total_deleted_bases += length;
+                stats.total_deletions++;
+                stats.deletion_lengths.add(length);
+                if (record_edits) {
+                    stats.deletions.push_back(make_pair(node_id, edit));
+                }
+            } else if (!edit.sequence().empty()) {
+                // TODO: a substitution might also occur as part of a deletion/insertion above!
+                stats.total_substituted_bases += edit.from_length();
+                stats.total_substitutions++;
+                if (record_edits) {
+                    stats.substitutions.push_back(make_pair(node_id, edit));
+                }
+            }
+        }
+    }
+
+    for (auto& site_and_allele : alleles_supported) {
+        // This read is informative for an allele of a site.
+        stats.reads_on_allele[site_and_allele.first][site_and_allele.second]++;
+    }
+}
+
+AlignmentStats AlignmentStatsAccumulator::reduce() {
+    // Merge the shards pairwise, in log2(shards) rounds of independent merges
+    for (size_t stride = 1; stride < shards.size(); stride *= 2) {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < shards.size() - stride; i += 2 * stride) {
+            shards[i].merge(shards[i + stride]);
+            shards[i + stride] = AlignmentStats();
+        }
+    }
+
+    AlignmentStats total = std::move(shards.front());
+    shards.front() = AlignmentStats();
+    return total;
+}
+
+}
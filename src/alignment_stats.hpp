@@ -0,0 +1,155 @@
+#ifndef VG_ALIGNMENT_STATS_HPP_INCLUDED
+#define VG_ALIGNMENT_STATS_HPP_INCLUDED
+
+/**
+ * \file alignment_stats.hpp
+ *
+ * Summary statistics over a set of alignments, as reported by vg stats -a,
+ * and a way to accumulate them from many threads at once.
+ */
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <functional>
+#include <iostream>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A histogram of non-negative integer values. Small values are counted in a
+ * dense array and large ones in a map. Histograms are merged by adding up
+ * their counts.
+ */
+class Histogram {
+public:
+    /// Count a value, the given number of times
+    void add(size_t value, size_t count = 1);
+
+    /// Add in all the counts from another histogram
+    void merge(const Histogram& other);
+
+    /// How many times was the given value counted?
+    size_t count(size_t value) const;
+
+    /// How many values were counted in total?
+    size_t total() const;
+
+    /// True if nothing was counted
+    bool empty() const;
+
+    /// Call the lambda with each value that was counted and its count, in
+    /// increasing order of value
+    void for_each(const function<void(size_t, size_t)>& lambda) const;
+
+    /// Write the counts to a stream, as part of an AlignmentStats file
+    void serialize(ostream& out) const;
+
+    /// Replace the counts with ones written by serialize. Throws a
+    /// runtime_error if the stream runs out.
+    void deserialize(istream& in);
+
+private:
+    /// Values below this are counted in the dense array
+    static const size_t DENSE_LIMIT = 1024;
+
+    vector<size_t> dense_counts;
+    map<size_t, size_t> sparse_counts;
+    size_t total_count = 0;
+};
+
+/**
+ * The statistics vg stats computes over a set of alignments. Stats for
+ * different sets of alignments (say, from different threads or different
+ * files) can be merged.
+ */
+struct AlignmentStats {
+    size_t total_alignments = 0;
+    size_t total_aligned = 0;
+    size_t total_primary = 0;
+    size_t total_secondary = 0;
+
+    /// How many times each node was visited by a primary alignment
+    unordered_map<id_t, size_t> node_visit_counts;
+
+    // Inserted bases don't count softclips
+    size_t total_insertions = 0;
+    size_t total_inserted_bases = 0;
+    size_t total_deletions = 0;
+    size_t total_deleted_bases = 0;
+    size_t total_substitutions = 0;
+    size_t total_substituted_bases = 0;
+    size_t total_softclips = 0;
+    size_t total_softclipped_bases = 0;
+
+    /// Mapping qualities of primary alignments
+    Histogram mapping_qualities;
+    /// Lengths of the events counted above, in bases
+    Histogram insertion_lengths;
+    Histogram deletion_lengths;
+    Histogram softclip_lengths;
+
+    /// How many primary alignments support each allele of each site, by site
+    /// name and then allele name. Only sites a read touched are present.
+    map<string, map<string, size_t>> reads_on_allele;
+
+    /// The individual edits and the nodes they are on, if they were recorded
+    vector<pair<id_t, Edit>> insertions;
+    vector<pair<id_t, Edit>> deletions;
+    vector<pair<id_t, Edit>> substitutions;
+    vector<pair<id_t, Edit>> softclips;
+
+    /// Add in the stats for another set of alignments
+    void merge(const AlignmentStats& other);
+
+    /// Write the stats to a stream in a binary format, so stats for parts of
+    /// a set of alignments can be computed separately and merged later.
+    void serialize(ostream& out) const;
+
+    /// Replace these stats with ones written by serialize. Throws a
+    /// runtime_error if the stream does not hold alignment stats.
+    void deserialize(istream& in);
+};
+
+/**
+ * Accumulates AlignmentStats from many OpenMP threads without any locking.
+ * Each thread counts into its own shard, and the shards are merged at the
+ * end.
+ */
+class AlignmentStatsAccumulator {
+public:
+    /**
+     * Make an accumulator. If allele_path_for_node is given, it maps each node
+     * unique to an allele path to the (site, allele) it belongs to, and reads
+     * visiting those nodes are counted in reads_on_allele. It must outlive the
+     * accumulator. If record_edits is set, the individual insertions,
+     * deletions, substitutions and softclips are kept as well as counted.
+     */
+    AlignmentStatsAccumulator(const map<id_t, pair<string, string>>* allele_path_for_node = nullptr,
+                              bool record_edits = false);
+
+    /// Count an alignment into the calling thread's shard
+    void add(const Alignment& aln);
+
+    /// Merge the shards, in parallel, and return the stats for everything
+    /// added. Leaves the accumulator empty. Must not be called while other
+    /// threads are adding.
+    AlignmentStats reduce();
+
+private:
+    const map<id_t, pair<string, string>>* allele_path_for_node;
+    bool record_edits;
+
+    /// One set of stats per thread
+    vector<AlignmentStats> shards;
+};
+
+}
+
+#endif
@@ -8,6 +8,10 @@
 #include "banded_global_aligner.hpp"
 #include "json2pb.h"
 
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+
 //#define debug_banded_aligner_objects
 //#define debug_banded_aligner_graph_processing
 //#define debug_banded_aligner_fill_matrix
@@ -16,6 +20,118 @@
 
 using namespace vg;
 
+namespace {
+
+/// Get the fastest column kernel the CPU supports for a score type, or null
+/// to use the scalar fill. Only the narrow score types have kernels.
+template<typename IntType>
+inline BandedColumnKernel<IntType> best_banded_column_kernel(IntType) {
+    return nullptr;
+}
+
+inline BandedColumnKernel<int8_t> best_banded_column_kernel(int8_t) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return &banded_fill_column_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return &banded_fill_column_sse41;
+    }
+#endif
+    return nullptr;
+}
+
+inline BandedColumnKernel<int16_t> best_banded_column_kernel(int16_t) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return &banded_fill_column_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return &banded_fill_column_sse41;
+    }
+#endif
+    return nullptr;
+}
+
+}
+
+const size_t BandedAlignerArena::MIN_BLOCK_SIZE;
+const size_t BandedAlignerArena::MAX_RETAINED_SIZE;
+
+BandedAlignerArena& BandedAlignerArena::for_this_thread() {
+    thread_local BandedAlignerArena arena;
+    return arena;
+}
+
+BandedAlignerArena::~BandedAlignerArena() {
+    for (auto& block : blocks) {
+        free(block.first);
+    }
+}
+
+void* BandedAlignerArena::allocate(size_t bytes) {
+    // keep everything aligned for the widest type we might put here
+    const size_t alignment = alignof(max_align_t);
+    bytes = ((bytes + alignment - 1) / alignment) * alignment;
+    
+    if (blocks.empty() || blocks.back().second - block_used < bytes) {
+        // start a new block, growing geometrically so large alignments don't need many
+        size_t block_size = max(bytes, blocks.empty() ? MIN_BLOCK_SIZE : 2 * blocks.back().second);
+        char* block = (char*) malloc(block_size);
+        if (block == nullptr) {
+            throw bad_alloc();
+        }
+        blocks.emplace_back(block, block_size);
+        block_used = 0;
+    }
+    
+    void* allocated = blocks.back().first + block_used;
+    block_used += bytes;
+    allocated_bytes += bytes;
+    return allocated;
+}
+
+size_t BandedAlignerArena::total_allocated() const {
+    return allocated_bytes;
+}
+
+size_t BandedAlignerArena::capacity() const {
+    size_t total = 0;
+    for (auto& block : blocks) {
+        total += block.second;
+    }
+    return total;
+}
+
+void BandedAlignerArena::reset() {
+    size_t total = capacity();
+    if (blocks.size() > 1 || total > MAX_RETAINED_SIZE) {
+        for (auto& block : blocks) {
+            free(block.first);
+        }
+        blocks.clear();
+        if (total <= MAX_RETAINED_SIZE) {
+            // replace the blocks with one that fits everything they did
+            char* block = (char*) malloc(total);
+            if (block != nullptr) {
+                blocks.emplace_back(block, total);
+            }
+        }
+    }
+    block_used = 0;
+}
+
+BandedAlignerArena::Lease::Lease(BandedAlignerArena& arena) : arena(arena) {
+    arena.lease_count++;
+}
+
+BandedAlignerArena::Lease::~Lease() {
+    arena.lease_count--;
+    if (arena.lease_count == 0) {
+        arena.reset();
+    }
+}
+
 template<class IntType>
 BandedGlobalAligner<IntType>::BABuilder::BABuilder(Alignment& alignment) :
                                                    alignment(alignment),
@@ -204,7 +320,7 @@ void BandedGlobalAligner<IntType>::BABuilder::finalize_alignment(const list<int6
 template <class IntType>
 BandedGlobalAligner<IntType>::BAMatrix::BAMatrix(Alignment& alignment, Node* node, int64_t top_diag,
                                                  int64_t bottom_diag, BAMatrix** seeds, int64_t num_seeds,
-                                                 int64_t cumulative_seq_len) :
+                                                 int64_t cumulative_seq_len, BandedAlignerArena& arena) :
                                                  node(node),
                                                  top_diag(top_diag),
                                                  bottom_diag(bottom_diag),
@@ -212,6 +328,7 @@ BandedGlobalAligner<IntType>::BAMatrix::BAMatrix(Alignment& alignment, Node* nod
                                                  alignment(alignment),
                                                  num_seeds(num_seeds),
                                                  cumulative_seq_len(cumulative_seq_len),
+                                                 arena(arena),
                                                  match(nullptr),
                                                  insert_col(nullptr),
                                                  insert_row(nullptr)
@@ -232,15 +349,14 @@ BandedGlobalAligner<IntType>::BAMatrix::~BAMatrix() {
         cerr << "[BAMatrix::~BAMatrix] destructing null matrix" << endl;
     }
 #endif
-    free(match);
-    free(insert_row);
-    free(insert_col);
-    free(seeds);
+    // the matrices and seeds are in the arena, which frees them all at once
 }
 
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
-                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf) {
+                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf,
+                                                         BandedColumnKernel<IntType> column_kernel,
+                                                         const IntType* score_profile, int64_t profile_stride) {
     
 #ifdef debug_banded_aligner_fill_matrix
     cerr << "[BAMatrix::fill_matrix] beginning DP on matrix for node " << node->id() << endl;;
@@ -259,9 +375,10 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     const string& read = alignment.sequence();
     const string& base_quality = alignment.quality();
     
-    match = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_col = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_row = (IntType*) malloc(sizeof(IntType) * band_size);
+    // take all three matrices in one piece from the arena
+    match = (IntType*) arena.allocate(3 * sizeof(IntType) * band_size);
+    insert_col = match + band_size;
+    insert_row = insert_col + band_size;
     /* these represent a band in a matrix, but we store it as a rectangle with chopped
      * corners
      *
@@ -567,6 +684,36 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     cerr << "[BAMatrix::fill_matrix]: seeding finished, moving to subsequent columns" << endl;
 #endif
     
+    // with a column kernel, we keep the previous and current columns contiguous so that
+    // the kernel can fill the interior of each column in vectors
+    IntType* col_match_prev = nullptr;
+    IntType* col_insert_row_prev = nullptr;
+    IntType* col_insert_col_prev = nullptr;
+    IntType* col_match = nullptr;
+    IntType* col_insert_row = nullptr;
+    IntType* col_insert_col = nullptr;
+    if (column_kernel && ncols > 1) {
+        // leave room for the kernel to run a vector past the end
+        int64_t col_size = band_height + BANDED_KERNEL_MAX_LANES + 1;
+        IntType* columns = (IntType*) arena.allocate(6 * sizeof(IntType) * col_size);
+        for (int64_t i = 0; i < 6 * col_size; i++) {
+            columns[i] = min_inf;
+        }
+        col_match_prev = columns;
+        col_insert_row_prev = col_match_prev + col_size;
+        col_insert_col_prev = col_insert_row_prev + col_size;
+        col_match = col_insert_col_prev + col_size;
+        col_insert_row = col_match + col_size;
+        col_insert_col = col_insert_row + col_size;
+        
+        for (int64_t i = iter_start; i < iter_stop; i++) {
+            idx = i * ncols;
+            col_match_prev[i] = match[idx];
+            col_insert_row_prev[i] = insert_row[idx];
+            col_insert_col_prev[i] = insert_col[idx];
+        }
+    }
+    
     // iterate through the rest of the columns
     for (int64_t j = 1; j < ncols; j++) {
         
@@ -620,8 +767,41 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             insert_col[idx] = min_inf;
         }
         
+        if (column_kernel) {
+            // the kernel fills the match and column insert values in the interior of the column,
+            // and then we run down it for the row inserts, which depend on the cell above
+            col_match[iter_start] = match[idx];
+            col_insert_row[iter_start] = insert_row[idx];
+            col_insert_col[iter_start] = insert_col[idx];
+            
+            if (iter_start + 1 < iter_stop - 1) {
+                BandedColumnFill<IntType> fill;
+                fill.match_prev = col_match_prev;
+                fill.insert_row_prev = col_insert_row_prev;
+                fill.insert_col_prev = col_insert_col_prev;
+                // the profile is indexed by read position, which is row + top_diag + j
+                fill.scores = score_profile + nt_table[node_seq[j]] * profile_stride + top_diag + j;
+                fill.match_cur = col_match;
+                fill.insert_col_cur = col_insert_col;
+                fill.begin = iter_start + 1;
+                fill.end = iter_stop - 1;
+                fill.gap_open = gap_open;
+                fill.gap_extend = gap_extend;
+                column_kernel(fill);
+                
+                for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
+                    col_insert_row[i] = max(max(col_match[i - 1] - gap_open, col_insert_row[i - 1] - gap_extend),
+                                            col_insert_col[i - 1] - gap_open);
+                    
+                    idx = i * ncols + j;
+                    match[idx] = col_match[i];
+                    insert_row[idx] = col_insert_row[i];
+                    insert_col[idx] = col_insert_col[i];
+                }
+            }
+        }
         
-        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
+        for (int64_t i = column_kernel ? iter_stop - 1 : iter_start + 1; i < iter_stop - 1; i++) {
             // indices of the current and previous cells in the rectangularized band
             idx = i * ncols + j;
             up_idx = (i - 1) * ncols + j;
@@ -679,6 +859,18 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                 // cell to the right is outside the band
                 insert_col[idx] = min_inf;
             }
+            
+            if (column_kernel) {
+                col_match[iter_stop - 1] = match[idx];
+                col_insert_row[iter_stop - 1] = insert_row[idx];
+                col_insert_col[iter_stop - 1] = insert_col[idx];
+            }
+        }
+        
+        if (column_kernel) {
+            swap(col_match, col_match_prev);
+            swap(col_insert_row, col_insert_row_prev);
+            swap(col_insert_col, col_insert_col_prev);
         }
     }
     
@@ -1791,7 +1983,8 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
                                                   alignment(alignment),
                                                   alt_alignments(alt_alignments),
                                                   max_multi_alns(max_multi_alns),
-                                                  adjust_for_base_quality(adjust_for_base_quality)
+                                                  adjust_for_base_quality(adjust_for_base_quality),
+                                                  arena_lease(BandedAlignerArena::for_this_thread())
 {
 #ifdef debug_banded_aligner_objects
     cerr << "[BandedGlobalAligner]: constructing BandedBlobalAligner with " << band_padding << " padding, " << permissive_banding << " permissive, " << adjust_for_base_quality << " quality adjusted" << endl;
@@ -1877,6 +2070,7 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
 #endif
     
     // initialize DP matrices for each node
+    size_t arena_bytes_before = arena_lease.arena.total_allocated();
     banded_matrices.resize(g.node_size());
     for (int64_t i = 0; i < g.node_size(); i++) {
         
@@ -1912,23 +2106,26 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
                 seeds = nullptr;
             }
             else {
-                seeds = (BAMatrix**) malloc(sizeof(BAMatrix**) * edges_in.size());
+                seeds = (BAMatrix**) arena_lease.arena.allocate(sizeof(BAMatrix*) * edges_in.size());
                 for (int64_t j = 0; j < edges_in.size(); j++) {
                     seeds[j] = banded_matrices[edges_in[j]];
                 }
             }
             
-            banded_matrices[node_idx] = new BAMatrix(alignment,
-                                                     node,
-                                                     band_ends[node_idx].first,
-                                                     band_ends[node_idx].second,
-                                                     seeds,
-                                                     edges_in.size(),
-                                                     shortest_seqs[node_idx]);
+            banded_matrices[node_idx] = new (arena_lease.arena.allocate(sizeof(BAMatrix))) BAMatrix(alignment,
+                                                                                                    node,
+                                                                                                    band_ends[node_idx].first,
+                                                                                                    band_ends[node_idx].second,
+                                                                                                    seeds,
+                                                                                                    edges_in.size(),
+                                                                                                    shortest_seqs[node_idx],
+                                                                                                    arena_lease.arena);
             
         }
     }
     
+    arena_bytes_used += arena_lease.arena.total_allocated() - arena_bytes_before;
+    
     if (!permissive_banding) {
         bool sinks_masked = true;
         for (Node* node : sink_nodes) {
@@ -1949,13 +2146,19 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
 template <class IntType>
 BandedGlobalAligner<IntType>::~BandedGlobalAligner() {
     
+    // the matrices live in the arena, so we only need to destruct them
     for (BAMatrix* banded_matrix : banded_matrices) {
         if (banded_matrix != nullptr) {
-            delete banded_matrix;
+            banded_matrix->~BAMatrix();
         }
     }
 }
 
+template <class IntType>
+size_t BandedGlobalAligner<IntType>::arena_bytes() const {
+    return arena_bytes_used;
+}
+
 // fills a vector with vectors ids that have edges to/from each node
 template <class IntType>
 void BandedGlobalAligner<IntType>::graph_edge_lists(Graph& g, bool outgoing_edges, vector<vector<int64_t>>& out_edge_list) {
@@ -2234,6 +2437,35 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
     
     
     // fill each nodes matrix in topological order
+    size_t arena_bytes_before = arena_lease.arena.total_allocated();
+    
+    // if we can fill in vectors, lay out the substitution scores of each base against the
+    // read, so that the kernel can load a column's worth at once
+    BandedColumnKernel<IntType> column_kernel = use_vector_kernel ? best_banded_column_kernel(IntType()) : nullptr;
+    IntType* score_profile = nullptr;
+    int64_t profile_stride = 0;
+    if (column_kernel) {
+        const string& read = alignment.sequence();
+        const string& base_quality = alignment.quality();
+        // pad so the kernel can run a vector past the end of the read
+        profile_stride = read.size() + BANDED_KERNEL_MAX_LANES;
+        score_profile = (IntType*) arena_lease.arena.allocate(5 * sizeof(IntType) * profile_stride);
+        for (int64_t base = 0; base < 5; base++) {
+            IntType* profile_row = score_profile + base * profile_stride;
+            for (int64_t i = 0; i < read.size(); i++) {
+                if (adjust_for_base_quality) {
+                    profile_row[i] = score_mat[25 * base_quality[i] + 5 * base + nt_table[read[i]]];
+                }
+                else {
+                    profile_row[i] = score_mat[5 * base + nt_table[read[i]]];
+                }
+            }
+            for (int64_t i = read.size(); i < profile_stride; i++) {
+                profile_row[i] = 0;
+            }
+        }
+    }
+    
     for (int64_t i = 0; i < topological_order.size(); i++) {
         Node* node = topological_order[i];
         int64_t node_idx = node_id_to_idx.at(node->id());
@@ -2252,8 +2484,10 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
 #ifdef debug_banded_aligner_fill_matrix
         cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf,
+                                 column_kernel, score_profile, profile_stride);
     }
+    arena_bytes_used += arena_lease.arena.total_allocated() - arena_bytes_before;
     
     traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
 }
@@ -17,6 +17,7 @@
 #include <list>
 #include <exception>
 #include "vg.pb.h"
+#include "banded_kernel.hpp"
 
 
 using namespace std;
@@ -32,6 +33,69 @@ namespace vg {
         static const string message;
     };
     
+    /**
+     * A per-thread pool of memory that banded aligners carve their dynamic programming
+     * matrices out of. Memory is handed out by bumping a pointer and is only given back
+     * all at once, when the last aligner using the arena on its thread is destroyed, so
+     * that repeated alignments reuse the same blocks instead of going back to malloc.
+     */
+    class BandedAlignerArena {
+    public:
+        
+        /// Get the arena for the calling thread
+        static BandedAlignerArena& for_this_thread();
+        
+        /// Get memory for at least this many bytes, aligned for any type. It stays valid
+        /// until every lease on the arena has been released.
+        void* allocate(size_t bytes);
+        
+        /// Total bytes handed out by allocate() over the life of the arena
+        size_t total_allocated() const;
+        
+        /// Bytes currently held in blocks, whether handed out or not
+        size_t capacity() const;
+        
+        /**
+         * Keeps the arena from being reset while it exists. Aligners hold one for their
+         * whole lifetime.
+         */
+        class Lease {
+        public:
+            Lease(BandedAlignerArena& arena);
+            ~Lease();
+            Lease(const Lease& other) = delete;
+            Lease& operator=(const Lease& other) = delete;
+            
+            BandedAlignerArena& arena;
+        };
+        
+        ~BandedAlignerArena();
+        
+    private:
+        
+        BandedAlignerArena() = default;
+        BandedAlignerArena(const BandedAlignerArena& other) = delete;
+        BandedAlignerArena& operator=(const BandedAlignerArena& other) = delete;
+        
+        /// Make all of the memory available again, coalescing the blocks into one so the
+        /// next alignment of the same size needs only one
+        void reset();
+        
+        /// Smallest block to get from malloc
+        static const size_t MIN_BLOCK_SIZE = 64 * 1024;
+        /// Don't hold on to more than this much memory between alignments
+        static const size_t MAX_RETAINED_SIZE = 256 * 1024 * 1024;
+        
+        /// Blocks of memory and their sizes, with the one being carved from last
+        vector<pair<char*, size_t>> blocks;
+        /// Bytes handed out from the last block
+        size_t block_used = 0;
+        /// Number of outstanding leases
+        size_t lease_count = 0;
+        /// Bytes handed out ever
+        size_t allocated_bytes = 0;
+    };
+    
     /**
      * The outward-facing interface for banded global graph alignment. It computes optimal alignment
      * of a DNA sequence to a DAG with POA. The alignment will start at any source node in the graph and
@@ -76,6 +140,10 @@ namespace vg {
         
         ~BandedGlobalAligner();
         
+        /// The DP matrices live in a shared arena, so aligners can't be copied
+        BandedGlobalAligner(const BandedGlobalAligner& other) = delete;
+        BandedGlobalAligner& operator=(const BandedGlobalAligner& other) = delete;
+        
         /// Adds path and score to the alignment object given in the constructor. If a multi-alignment
         /// vector was also supplied, fills the vector with the top scoring alignments as well.
         ///
@@ -91,6 +159,14 @@ namespace vg {
         ///              use QualAdjAligner's scaled penalty)
         void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
         
+        /// Bytes of arena memory used by this alignment so far, for the matrices and
+        /// their bookkeeping
+        size_t arena_bytes() const;
+        
+        /// Fill the matrices with a SIMD kernel when the CPU has one for this score
+        /// type (8 and 16 bit scores with SSE4.1 or AVX2). Turning it off forces the
+        /// scalar fill, which gives the same alignments.
+        bool use_vector_kernel = true;
         
     private:
         
@@ -110,6 +186,11 @@ namespace vg {
         /// Use base quality adjusted scoring for alignments?
         bool adjust_for_base_quality;
         
+        /// Holds the arena for this thread open while the matrices are in it
+        BandedAlignerArena::Lease arena_lease;
+        /// Bytes taken from the arena by this aligner
+        size_t arena_bytes_used = 0;
+        
         /// Dynamic programming matrices for each node
         vector<BAMatrix*> banded_matrices;
         
@@ -156,12 +237,17 @@ namespace vg {
         
     public:
         BAMatrix(Alignment& alignment, Node* node, int64_t top_diag, int64_t bottom_diag,
-                 BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
+                 BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len,
+                 BandedAlignerArena& arena);
         ~BAMatrix();
         
-        /// Use DP to fill the band with alignment scores
+        /// Use DP to fill the band with alignment scores. If a column kernel is given, it
+        /// fills the match and column insert values down each column, using a profile
+        /// of the substitution scores for each base code (at profile_stride apart) against
+        /// every read position.
         void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                         IntType min_inf);
+                         IntType min_inf, BandedColumnKernel<IntType> column_kernel = nullptr,
+                         const IntType* score_profile = nullptr, int64_t profile_stride = 0);
         
         /// Traceback through the band after using DP to fill it
         void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
@@ -189,6 +275,9 @@ namespace vg {
         BAMatrix** seeds;
         int64_t num_seeds;
         
+        /// Where the DP matrices are allocated
+        BandedAlignerArena& arena;
+        
         /// DP matrix
         IntType* match;
         /// DP matrix
@@ -0,0 +1,98 @@
+#ifndef VG_BANDED_KERNEL_HPP_INCLUDED
+#define VG_BANDED_KERNEL_HPP_INCLUDED
+
+/**
+ * \file banded_kernel.hpp
+ *
+ * The vectorizable part of the banded global aligner's fill: the match and
+ * column insert values of one column of a node's band. Both depend only on
+ * the previous column, so a whole column can be computed across the band at
+ * once. The row insert values run down the column and are left to the
+ * caller.
+ *
+ * As with the striped kernel, the same code is compiled once per instruction
+ * set in its own translation unit, and the entry points are only called after
+ * checking the CPU. This header avoids the standard library for the same
+ * reason.
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+namespace vg {
+
+/**
+ * The inputs and outputs of filling one band column. All of the arrays are
+ * indexed by row of the rectangularized band, and must have room for a full
+ * vector past end, since the kernel works in whole vectors.
+ */
+template<typename IntType>
+struct BandedColumnFill {
+    /// The previous column's match, row insert and column insert values
+    const IntType* match_prev;
+    const IntType* insert_row_prev;
+    const IntType* insert_col_prev;
+    /// Substitution score of each row's read base against this column's base
+    const IntType* scores;
+    /// Where to put this column's match and column insert values
+    IntType* match_cur;
+    IntType* insert_col_cur;
+    /// The rows to fill, end exclusive
+    size_t begin;
+    size_t end;
+    IntType gap_open;
+    IntType gap_extend;
+};
+
+/**
+ * Fill rows [begin, end) of a column with the recurrences
+ *
+ *     M[i][j] = s(i, j) + max(M[i][j-1], R[i][j-1], C[i][j-1])
+ *     C[i][j] = max(M[i+1][j-1] - gap_open, R[i+1][j-1] - gap_open, C[i+1][j-1] - gap_extend)
+ *
+ * where rows of the rectangularized band are diagonals, so the cell to the
+ * left of i in the full matrix is row i + 1 of the previous column.
+ * Arithmetic saturates.
+ *
+ * Ops must provide a vector type V, a score type T, a lanes count, and static
+ * set1, loadu, storeu, adds, subs and max.
+ */
+template<typename Ops>
+inline void banded_fill_column(BandedColumnFill<typename Ops::T>& fill) {
+    typedef typename Ops::V V;
+
+    const V v_open = Ops::set1(fill.gap_open);
+    const V v_extend = Ops::set1(fill.gap_extend);
+
+    for (size_t i = fill.begin; i < fill.end; i += Ops::lanes) {
+        V v_diag = Ops::max(Ops::max(Ops::loadu(fill.match_prev + i), Ops::loadu(fill.insert_row_prev + i)),
+                            Ops::loadu(fill.insert_col_prev + i));
+        Ops::storeu(fill.match_cur + i, Ops::adds(Ops::loadu(fill.scores + i), v_diag));
+
+        V v_left = Ops::max(Ops::max(Ops::subs(Ops::loadu(fill.match_prev + i + 1), v_open),
+                                     Ops::subs(Ops::loadu(fill.insert_row_prev + i + 1), v_open)),
+                            Ops::subs(Ops::loadu(fill.insert_col_prev + i + 1), v_extend));
+        Ops::storeu(fill.insert_col_cur + i, v_left);
+    }
+}
+
+/// A kernel entry point for some score type
+template<typename IntType>
+using BandedColumnKernel = void (*)(BandedColumnFill<IntType>&);
+
+/// The most rows a kernel can write past the end of a column
+const size_t BANDED_KERNEL_MAX_LANES = 32;
+
+/// Fill a column with 16 8-bit lanes. Only call if the CPU supports SSE4.1.
+void banded_fill_column_sse41(BandedColumnFill<int8_t>& fill);
+/// Fill a column with 8 16-bit lanes. Only call if the CPU supports SSE4.1.
+void banded_fill_column_sse41(BandedColumnFill<int16_t>& fill);
+
+/// Fill a column with 32 8-bit lanes. Only call if the CPU supports AVX2.
+void banded_fill_column_avx2(BandedColumnFill<int8_t>& fill);
+/// Fill a column with 16 16-bit lanes. Only call if the CPU supports AVX2.
+void banded_fill_column_avx2(BandedColumnFill<int16_t>& fill);
+
+}
+
+#endif
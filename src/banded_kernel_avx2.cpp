@@ -0,0 +1,54 @@
+/**
+ * \file banded_kernel_avx2.cpp
+ *
+ * AVX2 instantiations of the banded global aligner column kernel. This file
+ * is compiled with -mavx2 and must only be entered after a CPU check.
+ */
+
+#include <immintrin.h>
+
+#include "banded_kernel.hpp"
+
+namespace vg {
+
+namespace {
+
+/// 32 lanes of saturating 8-bit scores
+struct AVX2Ops8 {
+    typedef __m256i V;
+    typedef int8_t T;
+    static const size_t lanes = 32;
+
+    static inline V set1(T value) { return _mm256_set1_epi8(value); }
+    static inline V loadu(const T* ptr) { return _mm256_loadu_si256((const __m256i*) ptr); }
+    static inline void storeu(T* ptr, V v) { _mm256_storeu_si256((__m256i*) ptr, v); }
+    static inline V adds(V a, V b) { return _mm256_adds_epi8(a, b); }
+    static inline V subs(V a, V b) { return _mm256_subs_epi8(a, b); }
+    static inline V max(V a, V b) { return _mm256_max_epi8(a, b); }
+};
+
+/// 16 lanes of saturating 16-bit scores
+struct AVX2Ops16 {
+    typedef __m256i V;
+    typedef int16_t T;
+    static const size_t lanes = 16;
+
+    static inline V set1(T value) { return _mm256_set1_epi16(value); }
+    static inline V loadu(const T* ptr) { return _mm256_loadu_si256((const __m256i*) ptr); }
+    static inline void storeu(T* ptr, V v) { _mm256_storeu_si256((__m256i*) ptr, v); }
+    static inline V adds(V a, V b) { return _mm256_adds_epi16(a, b); }
+    static inline V subs(V a, V b) { return _mm256_subs_epi16(a, b); }
+    static inline V max(V a, V b) { return _mm256_max_epi16(a, b); }
+};
+
+}
+
+void banded_fill_column_avx2(BandedColumnFill<int8_t>& fill) {
+    banded_fill_column<AVX2Ops8>(fill);
+}
+
+void banded_fill_column_avx2(BandedColumnFill<int16_t>& fill) {
+    banded_fill_column<AVX2Ops16>(fill);
+}
+
+}
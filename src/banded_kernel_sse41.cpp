@@ -0,0 +1,54 @@
+/**
+ * \file banded_kernel_sse41.cpp
+ *
+ * SSE4.1 instantiations of the banded global aligner column kernel. This file
+ * is compiled with -msse4.1 and must only be entered after a CPU check.
+ */
+
+#include <smmintrin.h>
+
+#include "banded_kernel.hpp"
+
+namespace vg {
+
+namespace {
+
+/// 16 lanes of saturating 8-bit scores
+struct SSE41Ops8 {
+    typedef __m128i V;
+    typedef int8_t T;
+    static const size_t lanes = 16;
+
+    static inline V set1(T value) { return _mm_set1_epi8(value); }
+    static inline V loadu(const T* ptr) { return _mm_loadu_si128((const __m128i*) ptr); }
+    static inline void storeu(T* ptr, V v) { _mm_storeu_si128((__m128i*) ptr, v); }
+    static inline V adds(V a, V b) { return _mm_adds_epi8(a, b); }
+    static inline V subs(V a, V b) { return _mm_subs_epi8(a, b); }
+    static inline V max(V a, V b) { return _mm_max_epi8(a, b); }
+};
+
+/// 8 lanes of saturating 16-bit scores
+struct SSE41Ops16 {
+    typedef __m128i V;
+    typedef int16_t T;
+    static const size_t lanes = 8;
+
+    static inline V set1(T value) { return _mm_set1_epi16(value); }
+    static inline V loadu(const T* ptr) { return _mm_loadu_si128((const __m128i*) ptr); }
+    static inline void storeu(T* ptr, V v) { _mm_storeu_si128((__m128i*) ptr, v); }
+    static inline V adds(V a, V b) { return _mm_adds_epi16(a, b); }
+    static inline V subs(V a, V b) { return _mm_subs_epi16(a, b); }
+    static inline V max(V a, V b) { return _mm_max_epi16(a, b); }
+};
+
+}
+
+void banded_fill_column_sse41(BandedColumnFill<int8_t>& fill) {
+    banded_fill_column<SSE41Ops8>(fill);
+}
+
+void banded_fill_column_sse41(BandedColumnFill<int16_t>& fill) {
+    banded_fill_column<SSE41Ops16>(fill);
+}
+
+}
@@ -0,0 +1,505 @@
+#include "blocked_gzip.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+
+namespace stream {
+
+using namespace std;
+
+namespace {
+
+/// Size of the fixed part of a gzip header, up to and including XLEN
+const size_t GZIP_FIXED_HEADER_SIZE = 12;
+/// Size of the header of the blocks we write, which carry only the BC field
+const size_t BGZF_HEADER_SIZE = 18;
+/// Size of the CRC32 and ISIZE footer
+const size_t BGZF_FOOTER_SIZE = 8;
+
+inline void put_le16(string& out, uint16_t value) {
+    out.push_back((char) (value & 0xff));
+    out.push_back((char) ((value >> 8) & 0xff));
+}
+
+inline void put_le32(string& out, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        out.push_back((char) ((value >> (8 * i)) & 0xff));
+    }
+}
+
+inline uint16_t get_le16(const char* data) {
+    return (uint16_t) (unsigned char) data[0] | ((uint16_t) (unsigned char) data[1] << 8);
+}
+
+inline uint32_t get_le32(const char* data) {
+    return (uint32_t) get_le16(data) | ((uint32_t) get_le16(data + 2) << 16);
+}
+
+/**
+ * Read the gzip header at the current position of in, appending the bytes
+ * read to header. Returns 1 and fills in block_size if it is a BGZF header, 0
+ * at a clean EOF, and -1 if the data read was not a BGZF header.
+ */
+int read_bgzf_header(istream& in, string& header, size_t& block_size) {
+    size_t start = header.size();
+    header.resize(start + GZIP_FIXED_HEADER_SIZE);
+    in.read(&header[start], GZIP_FIXED_HEADER_SIZE);
+    size_t got = in.gcount();
+    if (got == 0) {
+        header.resize(start);
+        return 0;
+    }
+    if (got < GZIP_FIXED_HEADER_SIZE) {
+        header.resize(start + got);
+        return -1;
+    }
+    
+    const char* fixed = &header[start];
+    if ((unsigned char) fixed[0] != 0x1f || (unsigned char) fixed[1] != 0x8b ||
+        (unsigned char) fixed[2] != 8 || !(fixed[3] & 4)) {
+        // Not gzip, or no extra field to hold the block size
+        return -1;
+    }
+    
+    size_t extra_length = get_le16(fixed + 10);
+    size_t extra_start = header.size();
+    header.resize(extra_start + extra_length);
+    in.read(&header[extra_start], extra_length);
+    if ((size_t) in.gcount() < extra_length) {
+        header.resize(extra_start + in.gcount());
+        return -1;
+    }
+    
+    // Look through the extra subfields for BC
+    size_t cursor = extra_start;
+    while (cursor + 4 <= header.size()) {
+        size_t field_length = get_le16(&header[cursor + 2]);
+        if (header[cursor] == 'B' && header[cursor + 1] == 'C' && field_length == 2 &&
+            cursor + 6 <= header.size()) {
+            block_size = (size_t) get_le16(&header[cursor + 4]) + 1;
+            if (block_size < header.size() - start + BGZF_FOOTER_SIZE) {
+                return -1;
+            }
+            return 1;
+        }
+        cursor += 4 + field_length;
+    }
+    return -1;
+}
+
+}
+
+const string& bgzf_eof_marker() {
+    static const string marker("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00"
+                               "\x1b\x00\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00", 28);
+    return marker;
+}
+
+BlockedGzipOutputStream::BlockedGzipOutputStream(ostream& out, int64_t start_offset,
+                                                 int compression_level) :
+    out(out), compression_level(compression_level), buffer(BGZF_BLOCK_DATA_SIZE, '\0'),
+    block_offset(start_offset) {
+    
+    if (block_offset < 0) {
+        // This will still be -1 if the stream can't tell us
+        block_offset = out.tellp();
+    }
+}
+
+BlockedGzipOutputStream::~BlockedGzipOutputStream() {
+    Flush();
+}
+
+bool BlockedGzipOutputStream::Next(void** data, int* size) {
+    if (used == buffer.size()) {
+        Flush();
+        if (!out) {
+            return false;
+        }
+    }
+    *data = (void*) &buffer[used];
+    *size = buffer.size() - used;
+    total_bytes += *size;
+    used = buffer.size();
+    return true;
+}
+
+void BlockedGzipOutputStream::BackUp(int count) {
+    used -= count;
+    total_bytes -= count;
+}
+
+int64_t BlockedGzipOutputStream::ByteCount() const {
+    return total_bytes;
+}
+
+int64_t BlockedGzipOutputStream::Tell() {
+    if (used == buffer.size()) {
+        // The next byte will be in the next block
+        Flush();
+    }
+    if (block_offset < 0) {
+        return -1;
+    }
+    return (block_offset << 16) | (int64_t) used;
+}
+
+void BlockedGzipOutputStream::Flush() {
+    if (used == 0) {
+        return;
+    }
+    compressed.clear();
+    compress_block(buffer.data(), used, compressed, compression_level);
+    out.write(compressed.data(), compressed.size());
+    if (block_offset >= 0) {
+        block_offset += compressed.size();
+    }
+    used = 0;
+}
+
+void BlockedGzipOutputStream::EndFile() {
+    Flush();
+    const string& marker = bgzf_eof_marker();
+    out.write(marker.data(), marker.size());
+    if (block_offset >= 0) {
+        block_offset += marker.size();
+    }
+}
+
+void BlockedGzipOutputStream::compress_block(const char* data, size_t size, string& out,
+                                             int compression_level) {
+    assert(size <= BGZF_BLOCK_DATA_SIZE);
+    
+    size_t header_start = out.size();
+    out.append("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00", 16);
+    // Leave space for BSIZE, which we don't know yet
+    put_le16(out, 0);
+    
+    size_t data_start = out.size();
+    out.resize(data_start + BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE);
+    
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // Negative window bits mean raw deflate; we write our own gzip wrapper
+    if (deflateInit2(&zs, compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipOutputStream] could not initialize zlib");
+    }
+    zs.next_in = (Bytef*) data;
+    zs.avail_in = size;
+    zs.next_out = (Bytef*) &out[data_start];
+    zs.avail_out = out.size() - data_start;
+    int status = deflate(&zs, Z_FINISH);
+    size_t compressed_size = zs.total_out;
+    deflateEnd(&zs);
+    if (status != Z_STREAM_END) {
+        throw runtime_error("[stream::BlockedGzipOutputStream] could not compress block");
+    }
+    out.resize(data_start + compressed_size);
+    
+    put_le32(out, crc32(crc32(0L, Z_NULL, 0), (const Bytef*) data, size));
+    put_le32(out, size);
+    
+    uint16_t bsize = out.size() - header_start - 1;
+    out[header_start + 16] = (char) (bsize & 0xff);
+    out[header_start + 17] = (char) ((bsize >> 8) & 0xff);
+}
+
+BlockedGzipInputStream::BlockedGzipInputStream(istream& in) : in(in) {
+    
+    int64_t start = in.tellg();
+    
+    size_t block_size = 0;
+    int status = read_bgzf_header(in, raw_block, block_size);
+    
+    if (status == 1) {
+        // Finish reading the first block and hold on to it.
+        blocked = true;
+        size_t header_size = raw_block.size();
+        raw_block.resize(block_size);
+        in.read(&raw_block[header_size], block_size - header_size);
+        if ((size_t) in.gcount() < block_size - header_size) {
+            throw runtime_error("[stream::BlockedGzipInputStream] truncated BGZF block");
+        }
+        inflate_block(raw_block, buffer);
+        if (start >= 0) {
+            block_offset = start;
+            next_block_offset = start + block_size;
+        }
+    } else if (status == 0) {
+        // Empty input reads as an empty blocked file
+        blocked = true;
+        if (start >= 0) {
+            block_offset = start;
+            next_block_offset = start;
+        }
+    } else {
+        // Plain gzip, or garbage for GzipInputStream to complain about
+        start_gzip(raw_block);
+    }
+}
+
+void BlockedGzipInputStream::start_gzip(string& consumed) {
+    blocked = false;
+    buffer.clear();
+    position = 0;
+    decompressed.clear();
+    // Replay the bytes we already took off the stream ahead of the rest of it.
+    gzip_prefix.swap(consumed);
+    in.clear(in.rdstate() & ~(ios::failbit | ios::eofbit));
+    replay_in.reset(new ::google::protobuf::io::ArrayInputStream(gzip_prefix.data(), gzip_prefix.size()));
+    raw_in.reset(new ::google::protobuf::io::IstreamInputStream(&in));
+    concat_parts[0] = replay_in.get();
+    concat_parts[1] = raw_in.get();
+    concat_in.reset(new ::google::protobuf::io::ConcatenatingInputStream(concat_parts, 2));
+    gzip_in.reset(new ::google::protobuf::io::GzipInputStream(concat_in.get()));
+}
+
+bool BlockedGzipInputStream::Next(const void** data, int* size) {
+    while (blocked && position == buffer.size()) {
+        // Skip over any empty blocks, like EOF markers. We stop being blocked
+        // if we get to plain gzip.
+        if (!load_block() && blocked) {
+            return false;
+        }
+    }
+    if (!blocked) {
+        return gzip_in->Next(data, size);
+    }
+    *data = (const void*) &buffer[position];
+    *size = buffer.size() - position;
+    total_bytes += *size;
+    position = buffer.size();
+    return true;
+}
+
+void BlockedGzipInputStream::BackUp(int count) {
+    if (!blocked) {
+        gzip_in->BackUp(count);
+        return;
+    }
+    position -= count;
+    total_bytes -= count;
+}
+
+bool BlockedGzipInputStream::Skip(int count) {
+    if (!blocked) {
+        return gzip_in->Skip(count);
+    }
+    while (count > 0) {
+        const void* data;
+        int size;
+        if (!Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            BackUp(size - count);
+            size = count;
+        }
+        count -= size;
+    }
+    return true;
+}
+
+int64_t BlockedGzipInputStream::ByteCount() const {
+    if (!blocked) {
+        // Count anything we read as BGZF before we switched
+        return total_bytes + gzip_in->ByteCount();
+    }
+    return total_bytes;
+}
+
+bool BlockedGzipInputStream::IsBlocked() const {
+    return blocked;
+}
+
+int64_t BlockedGzipInputStream::Tell() const {
+    if (!blocked || block_offset < 0) {
+        return -1;
+    }
+    if (position == buffer.size() && next_block_offset >= 0) {
+        // Say we are at the start of the next block rather than the end of
+        // this one, so the offset is the same however the data was blocked.
+        return next_block_offset << 16;
+    }
+    return (block_offset << 16) | (int64_t) position;
+}
+
+bool BlockedGzipInputStream::Seek(int64_t virtual_offset) {
+    if (!blocked || virtual_offset < 0) {
+        return false;
+    }
+    int64_t target_block = virtual_offset >> 16;
+    size_t target_position = virtual_offset & 0xffff;
+    
+    if (target_block != block_offset || block_offset < 0) {
+        in.clear();
+        in.seekg(target_block);
+        if (!in) {
+            return false;
+        }
+        next_block_offset = target_block;
+        buffer.clear();
+        decompressed.clear();
+        position = 0;
+        if (!load_block() && target_position != 0) {
+            return false;
+        }
+    }
+    
+    if (target_position > buffer.size()) {
+        return false;
+    }
+    position = target_position;
+    return true;
+}
+
+void BlockedGzipInputStream::SetReadAhead(size_t blocks) {
+    read_ahead = blocks;
+}
+
+bool BlockedGzipInputStream::load_block() {
+    if (read_ahead > 1) {
+        if (decompressed.empty() && !fill_read_ahead()) {
+            if (gzip_follows) {
+                start_gzip(gzip_prefix);
+            }
+            return false;
+        }
+        DecompressedBlock& next = decompressed.front();
+        // Swap so both strings keep their capacity
+        buffer.swap(next.data);
+        block_offset = next.offset;
+        next_block_offset = next.offset >= 0 ? next.offset + next.raw_size : -1;
+        decompressed.pop_front();
+        position = 0;
+        return true;
+    }
+    
+    int status = read_raw_block(in, raw_block);
+    if (status < 0) {
+        // The rest is plain gzip
+        start_gzip(raw_block);
+    }
+    if (status <= 0) {
+        return false;
+    }
+    inflate_block(raw_block, buffer);
+    position = 0;
+    block_offset = next_block_offset;
+    if (next_block_offset >= 0) {
+        next_block_offset += raw_block.size();
+    }
+    return true;
+}
+
+bool BlockedGzipInputStream::fill_read_ahead() {
+    if (gzip_follows) {
+        // There are no more blocks
+        return false;
+    }
+    
+    // Reading stays on this thread, since the stream is sequential
+    raw_blocks.resize(read_ahead);
+    size_t count = 0;
+    int64_t offset = next_block_offset;
+    int status = 1;
+    while (count < read_ahead && (status = read_raw_block(in, raw_blocks[count])) > 0) {
+        decompressed.emplace_back();
+        decompressed.back().offset = offset;
+        decompressed.back().raw_size = raw_blocks[count].size();
+        if (offset >= 0) {
+            offset += raw_blocks[count].size();
+        }
+        count++;
+    }
+    next_block_offset = offset;
+    if (status < 0) {
+        // Plain gzip comes next; hold on to what we read of it until the
+        // blocks we have are used up
+        gzip_follows = true;
+        gzip_prefix.swap(raw_blocks[count]);
+    }
+    
+    // Inflate in parallel. A taskgroup only waits on these tasks, not on
+    // other work the calling thread may have queued.
+    std::vector<std::string>& raws = raw_blocks;
+    std::deque<DecompressedBlock>& outs = decompressed;
+    // Exceptions can't leave a task, so note failures and throw after
+    std::vector<char> failed(count, false);
+    #pragma omp taskgroup
+    {
+        for (size_t i = 0; i < count; i++) {
+            #pragma omp task default(none) firstprivate(i) shared(raws, outs, failed)
+            {
+                try {
+                    inflate_block(raws[i], outs[i].data);
+                } catch (const exception& e) {
+                    failed[i] = true;
+                }
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        if (failed[i]) {
+            throw runtime_error("[stream::BlockedGzipInputStream] corrupt BGZF block");
+        }
+    }
+    
+    return count > 0;
+}
+
+int BlockedGzipInputStream::read_raw_block(istream& in, string& block) {
+    block.clear();
+    size_t block_size = 0;
+    int status = read_bgzf_header(in, block, block_size);
+    if (status <= 0) {
+        return status;
+    }
+    size_t header_size = block.size();
+    block.resize(block_size);
+    in.read(&block[header_size], block_size - header_size);
+    if ((size_t) in.gcount() < block_size - header_size) {
+        throw runtime_error("[stream::BlockedGzipInputStream] truncated BGZF block");
+    }
+    return 1;
+}
+
+void BlockedGzipInputStream::inflate_block(const string& block, string& out) {
+    if (block.size() < GZIP_FIXED_HEADER_SIZE + BGZF_FOOTER_SIZE) {
+        throw runtime_error("[stream::BlockedGzipInputStream] BGZF block too short");
+    }
+    size_t data_start = GZIP_FIXED_HEADER_SIZE + get_le16(&block[10]);
+    size_t data_end = block.size() - BGZF_FOOTER_SIZE;
+    uint32_t expected_crc = get_le32(&block[data_end]);
+    uint32_t uncompressed_size = get_le32(&block[data_end + 4]);
+    if (data_start > data_end || uncompressed_size > BGZF_MAX_BLOCK_SIZE) {
+        throw runtime_error("[stream::BlockedGzipInputStream] corrupt BGZF block");
+    }
+    
+    out.resize(uncompressed_size);
+    if (uncompressed_size == 0) {
+        return;
+    }
+    
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipInputStream] could not initialize zlib");
+    }
+    zs.next_in = (Bytef*) &block[data_start];
+    zs.avail_in = data_end - data_start;
+    zs.next_out = (Bytef*) &out[0];
+    zs.avail_out = uncompressed_size;
+    int status = inflate(&zs, Z_FINISH);
+    size_t inflated = zs.total_out;
+    inflateEnd(&zs);
+    
+    if (status != Z_STREAM_END || inflated != uncompressed_size ||
+        crc32(crc32(0L, Z_NULL, 0), (const Bytef*) out.data(), out.size()) != expected_crc) {
+        throw runtime_error("[stream::BlockedGzipInputStream] corrupt BGZF block");
+    }
+}
+
+}
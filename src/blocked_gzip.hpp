@@ -0,0 +1,188 @@
+#ifndef VG_BLOCKED_GZIP_HPP_INCLUDED
+#define VG_BLOCKED_GZIP_HPP_INCLUDED
+
+/** \file
+ * Protobuf ZeroCopyStreams for the BGZF blocked gzip format. A BGZF file is a
+ * series of independent gzip members, each holding at most 64 KiB of data
+ * and recording its own compressed size, so blocks can be found without
+ * decompressing, inflated in parallel, and seeked to with "virtual offsets"
+ * ((compressed block start << 16) | offset within the uncompressed block).
+ *
+ * Because every block is an ordinary gzip member, blocked streams are also
+ * readable by plain gzip readers, including the protobuf GzipInputStream.
+ */
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <zlib.h>
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/gzip_stream.h"
+
+namespace stream {
+
+/// The most uncompressed data we put in one block. Chosen so that even
+/// incompressible data still fits in a 64 KiB block after deflate.
+const size_t BGZF_BLOCK_DATA_SIZE = 0xff00;
+/// The most bytes a BGZF block can occupy on disk
+const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+
+/// Get the 28-byte empty block that marks the end of a BGZF file.
+const std::string& bgzf_eof_marker();
+
+/**
+ * Compresses everything written to it into BGZF blocks on an ostream.
+ */
+class BlockedGzipOutputStream : public ::google::protobuf::io::ZeroCopyOutputStream {
+public:
+    /// Make a stream writing blocks to the given ostream. start_offset says
+    /// where in the file the first block will land, for virtual offsets; if
+    /// it is negative, the stream's current put position is used, if it has
+    /// one.
+    BlockedGzipOutputStream(std::ostream& out, int64_t start_offset = -1,
+                            int compression_level = Z_DEFAULT_COMPRESSION);
+    
+    /// Compress and write any buffered data.
+    virtual ~BlockedGzipOutputStream();
+    
+    virtual bool Next(void** data, int* size);
+    virtual void BackUp(int count);
+    virtual int64_t ByteCount() const;
+    
+    /// Get the virtual offset at which the next byte written will be found.
+    int64_t Tell();
+    
+    /// Compress and write out any partial block, so that the next byte starts
+    /// a new block.
+    void Flush();
+    
+    /// Flush and then write the BGZF end-of-file marker.
+    void EndFile();
+    
+    /// Compress the given data (at most BGZF_BLOCK_DATA_SIZE bytes) into a
+    /// complete BGZF block, appended to out.
+    static void compress_block(const char* data, size_t size, std::string& out,
+                               int compression_level = Z_DEFAULT_COMPRESSION);
+    
+private:
+    std::ostream& out;
+    int compression_level;
+    /// Uncompressed data for the block we are filling
+    std::string buffer;
+    /// How much of the buffer has been handed out and not backed up
+    size_t used = 0;
+    /// Where the next block will land in the file
+    int64_t block_offset;
+    /// Uncompressed bytes written so far, for ByteCount
+    int64_t total_bytes = 0;
+    /// Reused storage for compressed blocks
+    std::string compressed;
+};
+
+/**
+ * Reads a gzip stream as a ZeroCopyInputStream. If the stream is in BGZF
+ * format, it is read block by block, and Tell() and Seek() work with virtual
+ * offsets (Seek also needs a seekable istream). If it is ordinary gzip, it is
+ * read through a protobuf GzipInputStream and cannot seek. A BGZF stream
+ * with ordinary gzip concatenated after it switches over to the
+ * GzipInputStream when it gets there, and stops being blocked.
+ */
+class BlockedGzipInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+public:
+    BlockedGzipInputStream(std::istream& in);
+    virtual ~BlockedGzipInputStream() = default;
+    
+    virtual bool Next(const void** data, int* size);
+    virtual void BackUp(int count);
+    virtual bool Skip(int count);
+    virtual int64_t ByteCount() const;
+    
+    /// Return true if the input is in BGZF format
+    bool IsBlocked() const;
+    
+    /// Get the virtual offset of the next byte to be read, or -1 if the input
+    /// is not blocked or its position is unknown.
+    int64_t Tell() const;
+    
+    /// Go to the given virtual offset. Returns false if the input is not
+    /// blocked or not seekable, or the offset is invalid.
+    bool Seek(int64_t virtual_offset);
+    
+    /// Read this many blocks at a time and decompress them concurrently as
+    /// OpenMP tasks, so that inflate work is spread over the current team
+    /// instead of falling on the reading thread. 0 or 1 reads one block at a
+    /// time. Has no effect on plain gzip input.
+    void SetReadAhead(size_t blocks);
+    
+    /// Read the next raw (still compressed) BGZF block from the stream into
+    /// block. Returns 1 if a block was read and 0 at EOF. Returns -1 if the
+    /// data is not BGZF, in which case block holds the bytes that were taken
+    /// off the stream to find that out. Throws if a block is truncated.
+    static int read_raw_block(std::istream& in, std::string& block);
+    
+    /// Decompress a raw BGZF block into out, replacing its contents.
+    static void inflate_block(const std::string& block, std::string& out);
+    
+private:
+    
+    /// Load the next block into the buffer. Returns false at EOF.
+    bool load_block();
+    
+    /// Read and decompress up to read_ahead blocks into the decompressed
+    /// queue. Returns false if there were none left.
+    bool fill_read_ahead();
+    
+    /// Read the rest of the input as plain gzip, starting with the given
+    /// bytes that have already been taken off the stream.
+    void start_gzip(std::string& consumed);
+    
+    std::istream& in;
+    bool blocked = false;
+    
+    /// Decompressed data of the current block
+    std::string buffer;
+    /// Reused storage for the raw block
+    std::string raw_block;
+    /// How far into the buffer the reader has consumed
+    size_t position = 0;
+    /// Where in the file the current block started, or -1 if unknown
+    int64_t block_offset = -1;
+    /// Where in the file the next block will start, or -1 if unknown
+    int64_t next_block_offset = -1;
+    /// Bytes handed out and not backed up, for ByteCount
+    int64_t total_bytes = 0;
+    
+    /// How many blocks to decompress at once
+    size_t read_ahead = 0;
+    /// A block that has been read and decompressed but not yet used
+    struct DecompressedBlock {
+        int64_t offset;
+        size_t raw_size;
+        std::string data;
+    };
+    /// Blocks decompressed ahead of the current one, in file order
+    std::deque<DecompressedBlock> decompressed;
+    /// Reused storage for raw blocks being decompressed together
+    std::vector<std::string> raw_blocks;
+    
+    /// Set when read-ahead has run into plain gzip, which starts with the
+    /// bytes in gzip_prefix, and we have to switch once the queue runs out
+    bool gzip_follows = false;
+    
+    // Fallback machinery for plain gzip, which replays the bytes we consumed
+    // while sniffing the format before reading the rest of the stream.
+    std::string gzip_prefix;
+    std::unique_ptr<::google::protobuf::io::ArrayInputStream> replay_in;
+    std::unique_ptr<::google::protobuf::io::IstreamInputStream> raw_in;
+    ::google::protobuf::io::ZeroCopyInputStream* concat_parts[2];
+    std::unique_ptr<::google::protobuf::io::ConcatenatingInputStream> concat_in;
+    std::unique_ptr<::google::protobuf::io::GzipInputStream> gzip_in;
+};
+
+}
+
+#endif
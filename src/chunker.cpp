@@ -228,4 +228,71 @@ int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids,
 
 }
 
+int64_t PathChunker::extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, istream& gam,
+                                              ostream* out_stream,
+                                              bool only_fully_contained) {
+
+    bool contiguous = true;
+    vector<vg::id_t> graph_ids;
+    subgraph.for_each_node([&](Node* node) {
+        graph_ids.push_back(node->id());
+        contiguous = contiguous && (graph_ids.size() < 2 ||
+                                    graph_ids[graph_ids.size() - 1] == graph_ids[graph_ids.size() - 2] + 1);
+    });
+
+    return extract_gam_for_ids(graph_ids, index, gam, out_stream, contiguous, only_fully_contained);
+}
+
+int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index,
+                                         istream& gam, ostream* out_stream,
+                                         bool contiguous,
+                                         bool only_fully_contained) {
+
+    vector<Alignment> gam_buffer;
+    int64_t gam_count = 0;
+    
+    if (graph_ids.empty()) {
+        return gam_count;
+    }
+
+    // The index only returns alignments that touch the nodes, so we only need
+    // to check for full containment.
+    function<bool(vg::id_t)> check_id;
+    unordered_set<vg::id_t> id_lookup;
+    if (contiguous) {
+        check_id = [&](vg::id_t node_id) {
+            return node_id >= graph_ids.front() && node_id <= graph_ids.back();
+        };
+    } else {
+        id_lookup.insert(graph_ids.begin(), graph_ids.end());
+        check_id = [&](vg::id_t node_id) {
+            return id_lookup.count(node_id) == 1;
+        };
+    }
+
+    function<void(const Alignment&)> write_alignment = [&](const Alignment& alignment) {
+        if (only_fully_contained) {
+            for (size_t i = 0; i < alignment.path().mapping_size(); ++i) {
+                if (!check_id(alignment.path().mapping(i).position().node_id())) {
+                    return;
+                }
+            }
+        }
+        gam_buffer.push_back(alignment);
+        ++gam_count;
+        stream::write_buffered(*out_stream, gam_buffer, gam_buffer_size);
+    };
+
+    if (contiguous) {
+        index.for_alignment_in_range(gam, graph_ids.front(), graph_ids.back(), write_alignment);
+    } else {
+        index.for_alignment_to_nodes(gam, graph_ids, write_alignment);
+    }
+    
+    // flush buffer
+    stream::write_buffered(*out_stream, gam_buffer, 0);
+    
+    return gam_count;
+}
+
 }
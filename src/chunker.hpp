@@ -11,6 +11,7 @@
 #include "json2pb.h"
 #include "region.hpp"
 #include "index.hpp"
+#include "gam_index.hpp"
 
 namespace vg {
 
@@ -66,6 +67,19 @@ public:
                                 bool search_all_positions = false,
                                 bool unsorted_index = false);
     
+    /** Extract all alignments that touch a node in a subgraph from a sorted
+     * GAM, using its GAMIndex, and write them to an output stream. The gam
+     * stream must be seekable, and is only used by this call. */
+    int64_t extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, istream& gam,
+                                     ostream* out_stream,
+                                     bool only_fully_contained = false);
+    
+    /** Like above, but for a list of node IDs, which may be a contiguous range */
+    int64_t extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index,
+                                istream& gam, ostream* out_stream,
+                                bool contiguous_id_range = false,
+                                bool only_fully_contained = false);
+    
 };
 
 
@@ -391,9 +391,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     handle_memo_t* handle_memo,
+                                                     const DistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, nullptr, &aligner, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                              distance_index) {
     // nothing else to do
 }
 
@@ -406,9 +408,11 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     handle_memo_t* handle_memo,
+                                                     const DistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, &aligner, nullptr, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                              distance_index) {
     // nothing else to do
 }
 
@@ -422,7 +426,9 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      bool unstranded,
                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
+                                                     handle_memo_t* handle_memo,
+                                                     const DistanceIndex* distance_index) :
+    aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
     
     // there generally will be at least as many nodes as MEMs, so we can speed up the reallocation
     nodes.reserve(mems.size());
@@ -473,7 +479,8 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                                                                      },
                                                                                                      paths_of_node_memo,
                                                                                                      oriented_occurences_memo,
-                                                                                                     handle_memo);
+                                                                                                     handle_memo,
+                                                                                                     distance_index);
     
     // Flatten the trees to maps of relative position by node ID.
     vector<unordered_map<size_t, int64_t>> strand_relative_position = flatten_distance_tree(nodes.size(), recorded_finite_dists);
@@ -632,7 +639,8 @@ unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_s
                                                                                                     const function<int64_t(size_t)>& get_offset,
                                                                                                     paths_of_node_memo_t* paths_of_node_memo,
                                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                                    handle_memo_t* handle_memo) {
+                                                                                                    handle_memo_t* handle_memo,
+                                                                                                    const DistanceIndex* distance_index) {
     
     // for recording the distance of any pair that we check with a finite distance
     unordered_map<pair<size_t, size_t>, int64_t> recorded_finite_dists;
@@ -666,7 +674,7 @@ unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_s
     size_t nlogn = ceil(num_items * log(num_items));
     extend_dist_tree_by_permutations(max_failed_distance_probes, 50, nlogn, num_possible_merges_remaining, component_union_find,
                                      recorded_finite_dists, num_infinite_dists, unstranded, num_items, xgindex, get_position, get_offset, paths_of_node_memo,
-                                     oriented_occurences_memo, handle_memo);
+                                     oriented_occurences_memo, handle_memo, distance_index);
     
     return recorded_finite_dists;
 }
@@ -773,9 +781,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
     // enter which paths occur on the nodes of each hit into the memo
     for (size_t i = 0; i < num_items; i++) {
         pos_t pos = get_position(i);
-        if (!paths_of_node_memo->count(id(pos))) {
-            (*paths_of_node_memo)[id(pos)] = xgindex->paths_of_node(id(pos));
-        }
+        xgindex->memoized_paths_of_node(id(pos), paths_of_node_memo);
     }
     
     // reverse the memo so that it tells us which hits occur on a strand of a path and identify hits with no paths
@@ -808,9 +814,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
             function<bool(const handle_t&)> bucket_using_neighbors = [&](const handle_t& handle) {
                 id_t neighbor_id = xgindex->get_id(handle);
                 bool neighbor_rev = xgindex->get_is_reverse(handle);
-                if (!paths_of_node_memo->count(neighbor_id)) {
-                    (*paths_of_node_memo)[neighbor_id] = xgindex->paths_of_node(neighbor_id);
-                }
+                xgindex->memoized_paths_of_node(neighbor_id, paths_of_node_memo);
                 auto& neighbor_paths = paths_of_node_memo->at(neighbor_id);
                 for (size_t path : neighbor_paths) {
                     items_on_path[path].push_back(non_path_hit.first);
@@ -929,12 +933,9 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
         cerr << "adding position " << pos << " to memo" << endl;
 #endif
 
-        if (!paths_of_node_memo->count(id(pos))) {
-            (*paths_of_node_memo)[id(pos)] = xgindex->paths_of_node(id(pos));
-        }
-        for (size_t path : paths_of_node_memo->at(id(pos))) {
+        for (size_t path : xgindex->memoized_paths_of_node(id(pos), paths_of_node_memo)) {
             if (!oriented_occurences_memo->count(make_pair(id(pos), path))) {
-                (*oriented_occurences_memo)[make_pair(id(pos), path)] = xgindex->oriented_occurrences_on_path(id(pos), path);
+                xgindex->memoized_oriented_occurrences_on_path(id(pos), path, oriented_occurences_memo);
 #ifdef debug_od_clusterer
                 cerr << "node " << id(pos) << " has occurrences on path " << path << ":" << endl;
                 for (auto occurrence : (*oriented_occurences_memo)[make_pair(id(pos), path)]) {
@@ -984,9 +985,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
             function<bool(const handle_t&)> bucket_using_neighbors = [&](const handle_t& handle) {
                 id_t neighbor_id = xgindex->get_id(handle);
                 bool neighbor_rev = xgindex->get_is_reverse(handle);
-                if (!paths_of_node_memo->count(neighbor_id)) {
-                    (*paths_of_node_memo)[neighbor_id] = xgindex->paths_of_node(neighbor_id);
-                }
+                xgindex->memoized_paths_of_node(neighbor_id, paths_of_node_memo);
                 auto& neighbor_paths = paths_of_node_memo->at(neighbor_id);
                 for (size_t path : neighbor_paths) {
                     for (pair<size_t, bool>& node_occurence : xgindex->memoized_oriented_occurrences_on_path(neighbor_id, path, oriented_occurences_memo)) {
@@ -1096,7 +1095,8 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
                                                                  const function<int64_t(size_t)>& get_offset,
                                                                  paths_of_node_memo_t* paths_of_node_memo,
                                                                  oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                 handle_memo_t* handle_memo) {
+                                                                 handle_memo_t* handle_memo,
+                                                                 const DistanceIndex* distance_index) {
     
     // We want to run through all possible pairsets of node numbers in a permuted order.
     ShuffledPairs shuffled_pairs(num_items);
@@ -1169,7 +1169,14 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
         const pos_t& pos_2 = get_position(node_pair.second);
         
         int64_t oriented_dist;
-        if (unstranded) {
+        if (distance_index) {
+            // measure the exact minimum distance in the graph rather than along a path
+            oriented_dist = distance_index->oriented_distance(pos_1, pos_2);
+            if (unstranded && oriented_dist == numeric_limits<int64_t>::max()) {
+                oriented_dist = distance_index->oriented_distance(pos_1, reverse(pos_2, distance_index->node_length(id(pos_2))));
+            }
+        }
+        else if (unstranded) {
             oriented_dist = xgindex->closest_shared_path_unstranded_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
                                                                              max_search_distance_to_path, paths_of_node_memo,
@@ -1850,7 +1857,8 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                                                                                      bool unstranded,
                                                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                     handle_memo_t* handle_memo) {
+                                                                                     handle_memo_t* handle_memo,
+                                                                                     const DistanceIndex* distance_index) {
     
 #ifdef debug_od_clusterer
     cerr << "beginning clustering of MEM cluster pairs for " << left_clusters.size() << " left clusters and " << right_clusters.size() << " right clusters" << endl;
@@ -1882,7 +1890,7 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                  return alignment_2.sequence().end() - right_clusters[cluster_num - left_clusters.size()]->front().first->begin;
              }
          },
-         paths_of_node_memo, oriented_occurences_memo, handle_memo);
+         paths_of_node_memo, oriented_occurences_memo, handle_memo, distance_index);
     
     // Flatten the distance tree to a set of linear spaces, one per tree.
     vector<unordered_map<size_t, int64_t>> linear_spaces = flatten_distance_tree(total_clusters, distance_tree);
@@ -1992,6 +2000,8 @@ vector<pair<pos_t, size_t> > mem_node_start_positions(const xg::XG& xg, const vg
     unordered_set<pair<pos_t, size_t> > next; // handles and offsets of the exact match set we need to extend
     pos_t start_pos = make_pos_t(mem.nodes.front());
     next.insert(make_pair(start_pos, 0));
+    // reusable buffer for the part of each node we compare against
+    string node_seq;
     while (!next.empty()) {
         unordered_set<pair<pos_t, size_t> > todo;
         for (auto& h : next) {
@@ -1999,16 +2009,17 @@ vector<pair<pos_t, size_t> > mem_node_start_positions(const xg::XG& xg, const vg
             size_t query_offset = h.second;
             // check if we match each node in next
             auto handle = xg.get_handle(id(pos), is_rev(pos));
-            string h_seq = xg.get_sequence(handle);
             size_t mem_todo = mem_seq.size() - query_offset;
-            size_t overlap = min(mem_todo, h_seq.size()-offset(pos));
+            size_t overlap = min(mem_todo, xg.get_length(handle)-offset(pos));
+            node_seq.resize(overlap);
+            xg.get_subsequence(handle, offset(pos), overlap, &node_seq[0]);
             /*
             cerr << pos << " " << mem_todo << " " << overlap << endl
                  << mem_seq.substr(query_offset, overlap) << endl
-                 << h_seq.substr(offset(pos), overlap) << endl;
+                 << node_seq << endl;
             */
             // if we do, insert into nodes
-            if (mem_seq.substr(query_offset, overlap) == h_seq.substr(offset(pos), overlap)) {
+            if (mem_seq.compare(query_offset, overlap, node_seq) == 0) {
                 if (!seen_pos.count(h)) {
                     seen_pos.insert(h);
                     auto q = h;
@@ -10,6 +10,7 @@
 #include "mem.hpp"
 #include "xg.hpp"
 #include "handle.hpp"
+#include "distance_index.hpp"
 
 #include <functional>
 #include <string>
@@ -159,16 +160,18 @@ public:
     /// Each cluster is a vector of hits.
     using cluster_t = vector<hit_t>;
     
-    /// A memo for the results of XG::paths_of_node
-    using paths_of_node_memo_t = unordered_map<id_t, vector<size_t>>;
+    /// A memo for the results of XG::paths_of_node, optionally backed by a memo shared across reads
+    using paths_of_node_memo_t = xg::paths_of_node_memo_t;
     
-    /// A memo for the results of XG::oriented_occurrences_on_path
-    using oriented_occurences_memo_t = unordered_map<pair<id_t, size_t>, vector<pair<size_t, bool>>>;
+    /// A memo for the results of XG::oriented_occurrences_on_path, optionally backed by a memo shared
+    /// across reads
+    using oriented_occurences_memo_t = xg::oriented_occurrences_memo_t;
     
-    /// A memo for the results of XG::get_handle
-    using handle_memo_t = unordered_map<pair<int64_t, bool>, handle_t>;
+    /// A memo for the results of XG::get_handle, optionally backed by a memo shared across reads
+    using handle_memo_t = xg::handle_memo_t;
     
-    /// Constructor using QualAdjAligner, optionally memoizing succinct data structure operations
+    /// Constructor using QualAdjAligner, optionally memoizing succinct data structure operations.
+    /// If a distance index is given, it is used instead of paths to measure distances between hits.
     OrientedDistanceClusterer(const Alignment& alignment,
                               const vector<MaximalExactMatch>& mems,
                               const QualAdjAligner& aligner,
@@ -178,9 +181,11 @@ public:
                               bool unstranded = false,
                               paths_of_node_memo_t* paths_of_node_memo = nullptr,
                               oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              handle_memo_t* handle_memo = nullptr,
+                              const DistanceIndex* distance_index = nullptr);
     
-    /// Constructor using Aligner, optionally memoizing succinct data structure operations
+    /// Constructor using Aligner, optionally memoizing succinct data structure operations.
+    /// If a distance index is given, it is used instead of paths to measure distances between hits.
     OrientedDistanceClusterer(const Alignment& alignment,
                               const vector<MaximalExactMatch>& mems,
                               const Aligner& aligner,
@@ -190,7 +195,8 @@ public:
                               bool unstranded = false,
                               paths_of_node_memo_t* paths_of_node_memo = nullptr,
                               oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              handle_memo_t* handle_memo = nullptr,
+                              const DistanceIndex* distance_index = nullptr);
     
     /// Returns a vector of clusters. Each cluster is represented a vector of MEM hits. Each hit
     /// contains a pointer to the original MEM and the position of that particular hit in the graph.
@@ -199,7 +205,7 @@ public:
     /**
      * Given two vectors of clusters, an xg index, an bounds on the distance between clusters,
      * returns a vector of pairs of cluster numbers (one in each vector) matched with the estimated
-     * distance
+     * distance. If a distance index is given, it is used instead of paths to measure distances.
      */
     static vector<pair<pair<size_t, size_t>, int64_t>> pair_clusters(const Alignment& alignment_1,
                                                                      const Alignment& alignment_2,
@@ -211,7 +217,8 @@ public:
                                                                      bool unstranded,
                                                                      paths_of_node_memo_t* paths_of_node_memo = nullptr,
                                                                      oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                                                     handle_memo_t* handle_memo = nullptr);
+                                                                     handle_memo_t* handle_memo = nullptr,
+                                                                     const DistanceIndex* distance_index = nullptr);
     
     //static size_t PRUNE_COUNTER;
     //static size_t CLUSTER_TOTAL;
@@ -234,7 +241,8 @@ private:
                               bool unstranded,
                               paths_of_node_memo_t* paths_of_node_memo,
                               oriented_occurences_memo_t* oriented_occurences_memo,
-                              handle_memo_t* handle_memo);
+                              handle_memo_t* handle_memo,
+                              const DistanceIndex* distance_index);
     
     /**
      * Given a certain number of items, and a callback to get each item's
@@ -255,7 +263,8 @@ private:
                                                                                     const function<int64_t(size_t)>& get_offset,
                                                                                     paths_of_node_memo_t* paths_of_node_memo,
                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                    handle_memo_t* handle_memo);
+                                                                                    handle_memo_t* handle_memo,
+                                                                                    const DistanceIndex* distance_index);
     
     /**
      * Adds edges into the distance tree by estimating the distance between pairs
@@ -275,7 +284,8 @@ private:
                                                  const function<int64_t(size_t)>& get_offset,
                                                  paths_of_node_memo_t* paths_of_node_memo,
                                                  oriented_occurences_memo_t* oriented_occurences_memo,
-                                                 handle_memo_t* handle_memo);
+                                                 handle_memo_t* handle_memo,
+                                                 const DistanceIndex* distance_index);
     
     
     /**
@@ -0,0 +1,241 @@
+/**
+ * \file compact_alignment.cpp
+ * Implementation of the flat alignment candidate pool.
+ */
+
+#include "compact_alignment.hpp"
+#include "position.hpp"
+
+namespace vg {
+
+using namespace std;
+
+// mix a value into a running hash
+static inline void hash_in(size_t& hash, size_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+}
+
+size_t CompactAlignmentPool::add(const Alignment& aln) {
+    candidates.emplace_back();
+    CompactAlignment& candidate = candidates.back();
+    candidate.score = aln.score();
+    candidate.identity = aln.identity();
+    candidate.query_position = aln.query_position();
+    candidate.haplotype_scored = aln.haplotype_scored();
+    candidate.haplotype_logprob = aln.haplotype_logprob();
+    candidate.mapping_begin = node_ids.size();
+
+    size_t hash = 0;
+    for (const Mapping& mapping : aln.path().mapping()) {
+        const Position& position = mapping.position();
+        node_ids.push_back(position.node_id());
+        offsets.push_back(position.offset());
+        is_reverse.push_back(position.is_reverse());
+        ranks.push_back(mapping.rank());
+        edit_begin.push_back(from_lengths.size());
+
+        hash_in(hash, position.node_id());
+        hash_in(hash, position.offset());
+        hash_in(hash, position.is_reverse());
+
+        for (const Edit& edit : mapping.edit()) {
+            from_lengths.push_back(edit.from_length());
+            to_lengths.push_back(edit.to_length());
+            sequence_begin.push_back(sequences.size());
+            sequence_length.push_back(edit.sequence().size());
+            sequences.append(edit.sequence());
+
+            hash_in(hash, edit.from_length());
+            hash_in(hash, edit.to_length());
+            hash_in(hash, edit.sequence().size());
+        }
+        edit_end.push_back(from_lengths.size());
+    }
+
+    candidate.mapping_end = node_ids.size();
+    candidate.path_hash = hash;
+    return candidates.size() - 1;
+}
+
+size_t CompactAlignmentPool::size() const {
+    return candidates.size();
+}
+
+bool CompactAlignmentPool::empty() const {
+    return candidates.empty();
+}
+
+void CompactAlignmentPool::pop_back() {
+    const CompactAlignment& candidate = candidates.back();
+    size_t mappings = candidate.mapping_begin;
+    size_t edits = mappings < node_ids.size() ? edit_begin[mappings] : from_lengths.size();
+    size_t sequence = edits < from_lengths.size() ? sequence_begin[edits] : sequences.size();
+
+    node_ids.resize(mappings);
+    offsets.resize(mappings);
+    is_reverse.resize(mappings);
+    ranks.resize(mappings);
+    edit_begin.resize(mappings);
+    edit_end.resize(mappings);
+    from_lengths.resize(edits);
+    to_lengths.resize(edits);
+    sequence_begin.resize(edits);
+    sequence_length.resize(edits);
+    sequences.resize(sequence);
+    candidates.pop_back();
+}
+
+void CompactAlignmentPool::clear() {
+    candidates.clear();
+    node_ids.clear();
+    offsets.clear();
+    is_reverse.clear();
+    ranks.clear();
+    edit_begin.clear();
+    edit_end.clear();
+    from_lengths.clear();
+    to_lengths.clear();
+    sequence_begin.clear();
+    sequence_length.clear();
+    sequences.clear();
+}
+
+CompactAlignment& CompactAlignmentPool::operator[](size_t i) {
+    return candidates[i];
+}
+
+const CompactAlignment& CompactAlignmentPool::operator[](size_t i) const {
+    return candidates[i];
+}
+
+size_t CompactAlignmentPool::mapping_count(size_t i) const {
+    return candidates[i].mapping_end - candidates[i].mapping_begin;
+}
+
+pos_t CompactAlignmentPool::start(size_t i) const {
+    const CompactAlignment& candidate = candidates[i];
+    if (candidate.mapping_begin == candidate.mapping_end) {
+        return pos_t();
+    }
+    size_t m = candidate.mapping_begin;
+    return make_pos_t(node_ids[m], is_reverse[m], offsets[m]);
+}
+
+pos_t CompactAlignmentPool::end(size_t i) const {
+    const CompactAlignment& candidate = candidates[i];
+    if (candidate.mapping_begin == candidate.mapping_end) {
+        return pos_t();
+    }
+    size_t m = candidate.mapping_end - 1;
+    int64_t from_length = 0;
+    for (size_t e = edit_begin[m]; e < edit_end[m]; e++) {
+        from_length += from_lengths[e];
+    }
+    return make_pos_t(node_ids[m], is_reverse[m], offsets[m] + from_length);
+}
+
+bool CompactAlignmentPool::same_path(size_t i, size_t j) const {
+    const CompactAlignment& a = candidates[i];
+    const CompactAlignment& b = candidates[j];
+    if (a.path_hash != b.path_hash || a.mapping_end - a.mapping_begin != b.mapping_end - b.mapping_begin) {
+        return false;
+    }
+    for (size_t m = a.mapping_begin, n = b.mapping_begin; m < a.mapping_end; m++, n++) {
+        if (node_ids[m] != node_ids[n] || offsets[m] != offsets[n] || is_reverse[m] != is_reverse[n]
+            || ranks[m] != ranks[n] || edit_end[m] - edit_begin[m] != edit_end[n] - edit_begin[n]) {
+            return false;
+        }
+        for (size_t e = edit_begin[m], f = edit_begin[n]; e < edit_end[m]; e++, f++) {
+            if (from_lengths[e] != from_lengths[f] || to_lengths[e] != to_lengths[f]
+                || sequence_length[e] != sequence_length[f]
+                || sequences.compare(sequence_begin[e], sequence_length[e],
+                                     sequences, sequence_begin[f], sequence_length[f]) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CompactAlignmentPool::same_alignment(size_t i, size_t j) const {
+    const CompactAlignment& a = candidates[i];
+    const CompactAlignment& b = candidates[j];
+    return a.score == b.score && a.identity == b.identity && a.query_position == b.query_position
+        && a.haplotype_scored == b.haplotype_scored && a.haplotype_logprob == b.haplotype_logprob
+        && same_path(i, j);
+}
+
+void CompactAlignmentPool::fill_path(size_t i, Path& path) const {
+    const CompactAlignment& candidate = candidates[i];
+    path.Clear();
+    for (size_t m = candidate.mapping_begin; m < candidate.mapping_end; m++) {
+        Mapping* mapping = path.add_mapping();
+        Position* position = mapping->mutable_position();
+        position->set_node_id(node_ids[m]);
+        position->set_offset(offsets[m]);
+        position->set_is_reverse(is_reverse[m]);
+        mapping->set_rank(ranks[m]);
+        for (size_t e = edit_begin[m]; e < edit_end[m]; e++) {
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(from_lengths[e]);
+            edit->set_to_length(to_lengths[e]);
+            if (sequence_length[e]) {
+                edit->set_sequence(sequences.data() + sequence_begin[e], sequence_length[e]);
+            }
+        }
+    }
+}
+
+Alignment CompactAlignmentPool::to_alignment(size_t i, const Alignment& read) const {
+    const CompactAlignment& candidate = candidates[i];
+    Alignment aln = read;
+    if (candidate.mapping_begin == candidate.mapping_end) {
+        aln.clear_path();
+    }
+    else {
+        fill_path(i, *aln.mutable_path());
+    }
+    aln.set_score(candidate.score);
+    aln.set_identity(candidate.identity);
+    aln.set_query_position(candidate.query_position);
+    aln.set_haplotype_scored(candidate.haplotype_scored);
+    aln.set_haplotype_logprob(candidate.haplotype_logprob);
+    return aln;
+}
+
+// each thread's pool, and whether something is using it
+static thread_local CompactAlignmentPool thread_pool;
+static thread_local bool thread_pool_borrowed = false;
+
+CompactAlignmentPool::Borrow::Borrow() {
+    if (thread_pool_borrowed) {
+        pool = new CompactAlignmentPool();
+        owns_pool = true;
+    }
+    else {
+        thread_pool_borrowed = true;
+        pool = &thread_pool;
+        owns_pool = false;
+        pool->clear();
+    }
+}
+
+CompactAlignmentPool::Borrow::~Borrow() {
+    if (owns_pool) {
+        delete pool;
+    }
+    else {
+        pool->clear();
+        thread_pool_borrowed = false;
+    }
+}
+
+CompactAlignmentPool& CompactAlignmentPool::Borrow::operator*() {
+    return *pool;
+}
+
+CompactAlignmentPool* CompactAlignmentPool::Borrow::operator->() {
+    return pool;
+}
+
+}
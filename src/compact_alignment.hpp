@@ -0,0 +1,145 @@
+#ifndef VG_COMPACT_ALIGNMENT_HPP_INCLUDED
+#define VG_COMPACT_ALIGNMENT_HPP_INCLUDED
+
+/**
+ * \file compact_alignment.hpp
+ *
+ * A flat representation of alignment candidates, for the parts of mapping
+ * that juggle many candidate alignments for a read and only keep a few.
+ */
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * One candidate alignment in a CompactAlignmentPool. Holds the fields that
+ * differ between candidates for the same read; everything else (name,
+ * sequence, quality, ...) comes from the read when converting back to an
+ * Alignment.
+ */
+struct CompactAlignment {
+    int32_t score = 0;
+    double identity = 0.0;
+    int32_t query_position = 0;
+    bool haplotype_scored = false;
+    double haplotype_logprob = 0.0;
+
+    /// The range of this candidate's mappings in the pool
+    size_t mapping_begin = 0;
+    size_t mapping_end = 0;
+
+    /// A hash of the path, so most unequal paths can be told apart quickly
+    size_t path_hash = 0;
+};
+
+/**
+ * A set of candidate alignments for a read, stored as a struct of arrays. The
+ * mappings and edits of all the candidates share one set of flat vectors, so
+ * adding, copying around, sorting and deduplicating candidates doesn't touch
+ * the heap the way nested protobuf messages do. Clearing the pool keeps its
+ * capacity, so a pool that is reused from read to read stops allocating once
+ * it has seen a few reads.
+ *
+ * Paths are stored without their name, length, or circularity, and Positions
+ * without their name, since alignments produced by the aligners don't have
+ * them.
+ */
+class CompactAlignmentPool {
+public:
+
+    /// Add a candidate with the path and scores of the given Alignment, and
+    /// return its index
+    size_t add(const Alignment& aln);
+
+    /// The number of candidates
+    size_t size() const;
+
+    /// True if there are no candidates
+    bool empty() const;
+
+    /// Drop the most recently added candidate
+    void pop_back();
+
+    /// Drop all candidates, keeping the memory for reuse
+    void clear();
+
+    /// Get a candidate
+    CompactAlignment& operator[](size_t i);
+    const CompactAlignment& operator[](size_t i) const;
+
+    /// The number of mappings in a candidate's path
+    size_t mapping_count(size_t i) const;
+
+    /// The position at which a candidate's path starts, or an empty pos_t if
+    /// it has no path
+    pos_t start(size_t i) const;
+
+    /// The position just past the end of a candidate's path, or an empty
+    /// pos_t if it has no path
+    pos_t end(size_t i) const;
+
+    /// True if two candidates have the same path
+    bool same_path(size_t i, size_t j) const;
+
+    /// True if two candidates would convert to identical Alignments
+    bool same_alignment(size_t i, size_t j) const;
+
+    /// Write a candidate's path into the given Path, replacing its contents
+    void fill_path(size_t i, Path& path) const;
+
+    /// Convert a candidate back to an Alignment for the given read
+    Alignment to_alignment(size_t i, const Alignment& read) const;
+
+    /**
+     * Gives the caller this thread's pool, emptied, for as long as the Borrow
+     * exists. If the thread's pool is already borrowed further up the stack,
+     * gives out a private pool instead.
+     */
+    class Borrow {
+    public:
+        Borrow();
+        ~Borrow();
+        Borrow(const Borrow& other) = delete;
+        Borrow& operator=(const Borrow& other) = delete;
+
+        CompactAlignmentPool& operator*();
+        CompactAlignmentPool* operator->();
+
+    private:
+        CompactAlignmentPool* pool;
+        bool owns_pool;
+    };
+
+private:
+
+    vector<CompactAlignment> candidates;
+
+    // One entry per mapping
+    vector<id_t> node_ids;
+    vector<int64_t> offsets;
+    vector<bool> is_reverse;
+    vector<int64_t> ranks;
+    vector<size_t> edit_begin;
+    vector<size_t> edit_end;
+
+    // One entry per edit
+    vector<int32_t> from_lengths;
+    vector<int32_t> to_lengths;
+    vector<size_t> sequence_begin;
+    vector<size_t> sequence_length;
+
+    /// The replacement sequences of all the edits, back to back
+    string sequences;
+};
+
+}
+
+#endif
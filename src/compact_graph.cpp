@@ -0,0 +1,624 @@
+/**
+ * \file compact_graph.cpp
+ * Implementation of the array-backed mutable handle graph.
+ */
+
+#include "compact_graph.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+#include "path.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+const size_t CompactGraph::DEAD_SLOT;
+
+CompactGraph::CompactGraph(istream& in, bool warn_on_duplicates) {
+    // Parse the chunks in parallel, and take their nodes in order
+    unordered_map<string, size_t> path_by_name;
+    function<void(vector<Graph>&)> lambda = [&](vector<Graph>& batch) {
+        extend(batch, warn_on_duplicates, path_by_name);
+    };
+    stream::for_each_batch(in, lambda);
+
+    // Now that all the nodes are in, the edges can be attached
+    for (auto& edge : pending_edges) {
+        id_t from, to;
+        bool from_start, to_end;
+        tie(from, from_start, to, to_end) = edge;
+        if (!has_node(from) || !has_node(to)) {
+            cerr << "[vg] warning: edge " << from << (from_start ? " start" : " end") << " <-> "
+                 << to << (to_end ? " end" : " start") << " refers to a missing node. Skipping." << endl;
+            continue;
+        }
+        handle_t left = get_handle(from, from_start);
+        handle_t right = get_handle(to, to_end);
+        if (has_edge(left, right)) {
+            if (warn_on_duplicates) {
+                cerr << "[vg] warning: edge " << from << (from_start ? " start" : " end") << " <-> "
+                     << to << (to_end ? " end" : " start") << " appears multiple times. Skipping." << endl;
+            }
+            continue;
+        }
+        create_edge(left, right);
+    }
+    pending_edges.clear();
+    pending_edges.shrink_to_fit();
+
+    // A mapping from any chunk might fall anywhere in a path (because paths
+    // may loop around cycles), so we need to sort on ranks.
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < paths.size(); i++) {
+        auto* mappings = paths[i].mutable_mapping();
+        stable_sort(mappings->pointer_begin(), mappings->pointer_end(), [](const Mapping* a, const Mapping* b) {
+            return a->rank() < b->rank();
+        });
+        for (size_t j = 0; j < mappings->size(); j++) {
+            mappings->Mutable(j)->set_rank(j + 1);
+        }
+    }
+}
+
+void CompactGraph::extend(vector<Graph>& batch, bool warn_on_duplicates,
+                          unordered_map<string, size_t>& path_by_name) {
+
+    size_t batch_nodes = 0;
+    for (auto& graph : batch) {
+        batch_nodes += graph.node_size();
+    }
+
+    // Make room for everything up front
+    size_t max_slots = slot_ids.size() + batch_nodes;
+    slot_ids.reserve(max_slots);
+    sequence_starts.reserve(max_slots);
+    sequence_lengths.reserve(max_slots);
+    left_neighbors.reserve(max_slots);
+    right_neighbors.reserve(max_slots);
+    slot_ranks.reserve(max_slots);
+    order.reserve(order.size() + batch_nodes);
+    slot_by_id.resize(slot_by_id.size() + batch_nodes);
+
+    // Claim slots and sequence space for the new nodes, in order
+    vector<vector<size_t>> chunk_slots(batch.size());
+    size_t sequence_end = sequences.size();
+    for (size_t c = 0; c < batch.size(); c++) {
+        auto& graph = batch[c];
+        chunk_slots[c].resize(graph.node_size(), DEAD_SLOT);
+        for (size_t i = 0; i < graph.node_size(); i++) {
+            const Node& node = graph.node(i);
+            if (node.id() == 0) {
+                cerr << "[vg] warning: node ID 0 is not allowed. Skipping." << endl;
+            } else if (has_node(node.id())) {
+                if (warn_on_duplicates) {
+                    cerr << "[vg] warning: node ID " << node.id() << " appears multiple times. Skipping." << endl;
+                }
+            } else {
+                chunk_slots[c][i] = add_slot(node.id(), sequence_end, node.sequence().size());
+                sequence_end += node.sequence().size();
+            }
+        }
+    }
+
+    // Copy in the sequences in parallel
+    sequences.resize(sequence_end);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c = 0; c < batch.size(); c++) {
+        auto& graph = batch[c];
+        for (size_t i = 0; i < graph.node_size(); i++) {
+            size_t slot = chunk_slots[c][i];
+            if (slot != DEAD_SLOT) {
+                const string& sequence = graph.node(i).sequence();
+                copy(sequence.begin(), sequence.end(), sequences.begin() + sequence_starts[slot]);
+            }
+        }
+    }
+
+    for (auto& graph : batch) {
+        for (auto& edge : graph.edge()) {
+            pending_edges.emplace_back(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+        }
+
+        for (auto& path : *graph.mutable_path()) {
+            auto found = path_by_name.find(path.name());
+            if (found == path_by_name.end()) {
+                found = path_by_name.emplace(path.name(), paths.size()).first;
+                paths.emplace_back();
+                paths.back().set_name(path.name());
+            }
+            Path& into = paths[found->second];
+            into.set_is_circular(into.is_circular() || path.is_circular());
+            for (auto& mapping : path.mapping()) {
+                // Keep only what VG's paths keep, so we write the same paths
+                *into.add_mapping() = mapping_t(mapping).to_mapping();
+            }
+        }
+    }
+}
+
+size_t CompactGraph::add_slot(id_t id, size_t sequence_start, size_t sequence_length) {
+    size_t slot = slot_ids.size();
+    slot_ids.push_back(id);
+    sequence_starts.push_back(sequence_start);
+    sequence_lengths.push_back(sequence_length);
+    left_neighbors.emplace_back();
+    right_neighbors.emplace_back();
+    slot_ranks.push_back(order.size());
+    order.push_back(slot);
+    slot_by_id[id] = slot;
+    live_nodes++;
+    max_id = max(max_id, id);
+    return slot;
+}
+
+void CompactGraph::serialize_to_ostream(ostream& out, id_t chunk_size) const {
+    // Find the live nodes, in order
+    vector<size_t> live;
+    live.reserve(live_nodes);
+    for (size_t slot : order) {
+        if (slot != DEAD_SLOT) {
+            live.push_back(slot);
+        }
+    }
+    vector<size_t> live_rank(slot_ids.size(), DEAD_SLOT);
+    for (size_t i = 0; i < live.size(); i++) {
+        live_rank[live[i]] = i;
+    }
+
+    // Index the path mappings by the live node they are on, so each chunk can
+    // carry the mappings for its nodes. Mappings on missing nodes are dropped.
+    vector<size_t> mapping_starts(live.size() + 1, 0);
+    auto rank_of_mapping = [&](const Mapping& mapping) -> size_t {
+        auto found = slot_by_id.find(mapping.position().node_id());
+        return found == slot_by_id.end() ? DEAD_SLOT : live_rank[found->second];
+    };
+    for (auto& path : paths) {
+        for (auto& mapping : path.mapping()) {
+            size_t rank = rank_of_mapping(mapping);
+            if (rank != DEAD_SLOT) {
+                mapping_starts[rank + 1]++;
+            }
+        }
+    }
+    for (size_t i = 1; i < mapping_starts.size(); i++) {
+        mapping_starts[i] += mapping_starts[i - 1];
+    }
+    vector<pair<size_t, size_t>> mappings_by_node(mapping_starts.back());
+    {
+        vector<size_t> cursors(mapping_starts.begin(), mapping_starts.end() - 1);
+        for (size_t p = 0; p < paths.size(); p++) {
+            for (size_t m = 0; m < paths[p].mapping_size(); m++) {
+                size_t rank = rank_of_mapping(paths[p].mapping(m));
+                if (rank != DEAD_SLOT) {
+                    mappings_by_node[cursors[rank]++] = make_pair(p, m);
+                }
+            }
+        }
+    }
+
+    // Each edge is written once, in the orientation with the fewest reversed
+    // sides and then the smallest IDs, with the node it comes from.
+    auto orient_edge = [&](const handle_t& left, const handle_t& right) -> edge_t {
+        handle_t flipped_left = flip(right);
+        handle_t flipped_right = flip(left);
+        auto key = [&](const handle_t& a, const handle_t& b) {
+            return make_tuple(get_is_reverse(a) + get_is_reverse(b), get_id(a), get_is_reverse(a),
+                              get_id(b), get_is_reverse(b));
+        };
+        if (key(flipped_left, flipped_right) < key(left, right)) {
+            return make_pair(flipped_left, flipped_right);
+        }
+        return make_pair(left, right);
+    };
+
+    function<Graph(uint64_t, uint64_t)> lambda = [&](uint64_t element_start, uint64_t element_length) -> Graph {
+        Graph graph;
+        for (size_t i = element_start; i < element_start + element_length; i++) {
+            size_t slot = live[i];
+            handle_t handle = slot_handle(slot, false);
+            Node* node = graph.add_node();
+            node->set_id(slot_ids[slot]);
+            node->set_sequence(sequences.substr(sequence_starts[slot], sequence_lengths[slot]));
+
+            vector<edge_t> emitted;
+            auto emit = [&](const handle_t& left, const handle_t& right) {
+                edge_t edge = orient_edge(left, right);
+                if (slot_of(edge.first) != slot || find(emitted.begin(), emitted.end(), edge) != emitted.end()) {
+                    return;
+                }
+                emitted.push_back(edge);
+                Edge* e = graph.add_edge();
+                e->set_from(get_id(edge.first));
+                e->set_from_start(get_is_reverse(edge.first));
+                e->set_to(get_id(edge.second));
+                e->set_to_end(get_is_reverse(edge.second));
+            };
+            follow_edges(handle, false, [&](const handle_t& next) {
+                emit(handle, next);
+            });
+            follow_edges(handle, true, [&](const handle_t& prev) {
+                emit(prev, handle);
+            });
+        }
+
+        // Collect the path mappings on these nodes, in path and rank order
+        vector<pair<size_t, size_t>> chunk_mappings(mappings_by_node.begin() + mapping_starts[element_start],
+                                                    mappings_by_node.begin() + mapping_starts[element_start + element_length]);
+        sort(chunk_mappings.begin(), chunk_mappings.end());
+        Path* path = nullptr;
+        for (auto& path_and_mapping : chunk_mappings) {
+            const Path& from = paths[path_and_mapping.first];
+            if (path == nullptr || path->name() != from.name()) {
+                path = graph.add_path();
+                path->set_name(from.name());
+                path->set_is_circular(from.is_circular());
+            }
+            *path->add_mapping() = from.mapping(path_and_mapping.second);
+        }
+        if (element_start == 0) {
+            // The first chunk carries the empty paths
+            for (auto& from : paths) {
+                if (from.mapping_size() == 0) {
+                    Path* empty = graph.add_path();
+                    empty->set_name(from.name());
+                    empty->set_is_circular(from.is_circular());
+                }
+            }
+        }
+        return graph;
+    };
+
+    stream::write(out, live.size(), chunk_size, lambda);
+}
+
+handle_t CompactGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    auto found = slot_by_id.find(node_id);
+    if (found == slot_by_id.end()) {
+        throw runtime_error("No node " + to_string(node_id) + " in graph");
+    }
+    return slot_handle(found->second, is_reverse);
+}
+
+id_t CompactGraph::get_id(const handle_t& handle) const {
+    return slot_ids[slot_of(handle)];
+}
+
+bool CompactGraph::get_is_reverse(const handle_t& handle) const {
+    return as_integer(handle) & 1;
+}
+
+handle_t CompactGraph::flip(const handle_t& handle) const {
+    return as_handle(as_integer(handle) ^ 1);
+}
+
+size_t CompactGraph::get_length(const handle_t& handle) const {
+    return sequence_lengths[slot_of(handle)];
+}
+
+string CompactGraph::get_sequence(const handle_t& handle) const {
+    size_t slot = slot_of(handle);
+    string sequence = sequences.substr(sequence_starts[slot], sequence_lengths[slot]);
+    return get_is_reverse(handle) ? reverse_complement(sequence) : sequence;
+}
+
+bool CompactGraph::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    size_t slot = slot_of(handle);
+    bool is_reverse = get_is_reverse(handle);
+    // Going left on the reverse strand is going right on the forward strand
+    auto& neighbors = (go_left != is_reverse) ? left_neighbors[slot] : right_neighbors[slot];
+    for (auto& neighbor : neighbors) {
+        if (!iteratee(is_reverse ? flip(neighbor) : neighbor)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CompactGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i] != DEAD_SLOT) {
+                // We can't stop early in parallel
+                iteratee(slot_handle(order[i], false));
+            }
+        }
+    } else {
+        // Look at the order each time, since the iteratee may swap handles
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i] != DEAD_SLOT && !iteratee(slot_handle(order[i], false))) {
+                return;
+            }
+        }
+    }
+}
+
+size_t CompactGraph::node_size() const {
+    return live_nodes;
+}
+
+handle_t CompactGraph::create_handle(const string& sequence) {
+    return create_handle(sequence, max_id + 1);
+}
+
+handle_t CompactGraph::create_handle(const string& sequence, const id_t& id) {
+    if (has_node(id)) {
+        throw runtime_error("Node " + to_string(id) + " is already in the graph");
+    }
+    size_t slot = add_slot(id, sequences.size(), sequence.size());
+    sequences.append(sequence);
+    return slot_handle(slot, false);
+}
+
+void CompactGraph::destroy_handle(const handle_t& handle) {
+    size_t slot = slot_of(handle);
+    handle_t forward = slot_handle(slot, false);
+
+    // Find all the edges, including self loops
+    vector<edge_t> to_destroy;
+    follow_edges(forward, false, [&](const handle_t& next) {
+        to_destroy.emplace_back(forward, next);
+    });
+    follow_edges(forward, true, [&](const handle_t& prev) {
+        to_destroy.emplace_back(prev, forward);
+    });
+    for (auto& edge : to_destroy) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    slot_by_id.erase(slot_ids[slot]);
+    slot_ids[slot] = 0;
+    order[slot_ranks[slot]] = DEAD_SLOT;
+    vector<handle_t>().swap(left_neighbors[slot]);
+    vector<handle_t>().swap(right_neighbors[slot]);
+    live_nodes--;
+}
+
+void CompactGraph::add_neighbor(const handle_t& from, bool go_left, const handle_t& x) {
+    size_t slot = slot_of(from);
+    bool is_reverse = get_is_reverse(from);
+    auto& neighbors = (go_left != is_reverse) ? left_neighbors[slot] : right_neighbors[slot];
+    handle_t stored = is_reverse ? flip(x) : x;
+    if (find(neighbors.begin(), neighbors.end(), stored) == neighbors.end()) {
+        neighbors.push_back(stored);
+    }
+}
+
+bool CompactGraph::remove_neighbor(const handle_t& from, bool go_left, const handle_t& x) {
+    size_t slot = slot_of(from);
+    bool is_reverse = get_is_reverse(from);
+    auto& neighbors = (go_left != is_reverse) ? left_neighbors[slot] : right_neighbors[slot];
+    auto found = find(neighbors.begin(), neighbors.end(), is_reverse ? flip(x) : x);
+    if (found == neighbors.end()) {
+        return false;
+    }
+    neighbors.erase(found);
+    return true;
+}
+
+bool CompactGraph::has_edge(const handle_t& left, const handle_t& right) const {
+    bool found = false;
+    follow_edges(left, false, [&](const handle_t& next) {
+        found = (next == right);
+        return !found;
+    });
+    return found;
+}
+
+void CompactGraph::create_edge(const handle_t& left, const handle_t& right) {
+    if (has_edge(left, right)) {
+        return;
+    }
+    // A reversing self loop is the same entry from both ends, and
+    // add_neighbor won't add it twice
+    add_neighbor(left, false, right);
+    add_neighbor(right, true, left);
+    edges++;
+}
+
+void CompactGraph::destroy_edge(const handle_t& left, const handle_t& right) {
+    if (remove_neighbor(left, false, right)) {
+        remove_neighbor(right, true, left);
+        edges--;
+    }
+}
+
+void CompactGraph::swap_handles(const handle_t& a, const handle_t& b) {
+    size_t slot_a = slot_of(a);
+    size_t slot_b = slot_of(b);
+    swap(order[slot_ranks[slot_a]], order[slot_ranks[slot_b]]);
+    swap(slot_ranks[slot_a], slot_ranks[slot_b]);
+}
+
+handle_t CompactGraph::apply_orientation(const handle_t& handle) {
+    if (!get_is_reverse(handle)) {
+        // Nothing to do!
+        return handle;
+    }
+
+    // Find all the edges (including self loops), in terms of the handle
+    vector<handle_t> left_nodes;
+    vector<handle_t> right_nodes;
+    follow_edges(handle, true, [&](const handle_t& prev) {
+        left_nodes.push_back(prev);
+    });
+    follow_edges(handle, false, [&](const handle_t& next) {
+        right_nodes.push_back(next);
+    });
+    for (auto& left : left_nodes) {
+        destroy_edge(left, handle);
+    }
+    for (auto& right : right_nodes) {
+        destroy_edge(handle, right);
+    }
+
+    // Reverse complement the sequence in place
+    size_t slot = slot_of(handle);
+    string forward = reverse_complement(sequences.substr(sequence_starts[slot], sequence_lengths[slot]));
+    sequences.replace(sequence_starts[slot], sequence_lengths[slot], forward);
+
+    // Both orientations of the node trade places
+    auto reoriented = [&](const handle_t& other) {
+        return slot_of(other) == slot ? flip(other) : other;
+    };
+    handle_t new_handle = flip(handle);
+    for (auto& left : left_nodes) {
+        create_edge(reoriented(left), new_handle);
+    }
+    for (auto& right : right_nodes) {
+        create_edge(new_handle, reoriented(right));
+    }
+    return new_handle;
+}
+
+vector<handle_t> CompactGraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+    if (!paths.empty()) {
+        throw runtime_error("CompactGraph cannot divide nodes while it has paths");
+    }
+
+    size_t slot = slot_of(handle);
+    bool is_reverse = get_is_reverse(handle);
+    size_t length = sequence_lengths[slot];
+    handle_t forward = slot_handle(slot, false);
+
+    // Get the piece boundaries along the forward strand
+    vector<size_t> bounds{0};
+    if (is_reverse) {
+        for (auto it = offsets.rbegin(); it != offsets.rend(); ++it) {
+            bounds.push_back(length - *it);
+        }
+    } else {
+        bounds.insert(bounds.end(), offsets.begin(), offsets.end());
+    }
+    bounds.push_back(length);
+
+    // The edges on the right side move to the last piece
+    vector<handle_t> right_nodes;
+    follow_edges(forward, false, [&](const handle_t& next) {
+        right_nodes.push_back(next);
+    });
+    for (auto& right : right_nodes) {
+        destroy_edge(forward, right);
+    }
+
+    // The first piece stays in this slot, and the others point into the same
+    // stretch of sequence
+    vector<handle_t> pieces{forward};
+    size_t start = sequence_starts[slot];
+    sequence_lengths[slot] = bounds[1];
+    for (size_t i = 1; i + 1 < bounds.size(); i++) {
+        pieces.push_back(slot_handle(add_slot(max_id + 1, start + bounds[i], bounds[i + 1] - bounds[i]), false));
+    }
+    handle_t last = pieces.back();
+
+    for (auto& right : right_nodes) {
+        if (right == flip(forward)) {
+            // A reversing self loop on the right side stays on the right side
+            right = flip(last);
+        }
+        create_edge(last, right);
+    }
+    for (size_t i = 0; i + 1 < pieces.size(); i++) {
+        create_edge(pieces[i], pieces[i + 1]);
+    }
+
+    if (is_reverse) {
+        reverse(pieces.begin(), pieces.end());
+        for (auto& piece : pieces) {
+            piece = flip(piece);
+        }
+    }
+    return pieces;
+}
+
+bool CompactGraph::has_node(id_t node_id) const {
+    return slot_by_id.find(node_id) != slot_by_id.end();
+}
+
+size_t CompactGraph::edge_count() const {
+    return edges;
+}
+
+id_t CompactGraph::min_node_id() const {
+    id_t min_id = 0;
+    for (size_t slot : order) {
+        if (slot != DEAD_SLOT && (min_id == 0 || slot_ids[slot] < min_id)) {
+            min_id = slot_ids[slot];
+        }
+    }
+    return min_id;
+}
+
+id_t CompactGraph::max_node_id() const {
+    id_t found_max = 0;
+    for (size_t slot : order) {
+        if (slot != DEAD_SLOT && (found_max == 0 || slot_ids[slot] > found_max)) {
+            found_max = slot_ids[slot];
+        }
+    }
+    return found_max;
+}
+
+void CompactGraph::compact_ids() {
+    vector<id_t> new_ids(slot_ids.size(), 0);
+    id_t next_id = 1;
+    for (size_t slot : order) {
+        if (slot != DEAD_SLOT) {
+            new_ids[slot] = next_id++;
+        }
+    }
+    reassign_node_ids([&](id_t old_id) {
+        return new_ids[slot_by_id.find(old_id)->second];
+    });
+}
+
+void CompactGraph::increment_node_ids(id_t increment) {
+    reassign_node_ids([&](id_t old_id) {
+        return old_id + increment;
+    });
+}
+
+void CompactGraph::decrement_node_ids(id_t decrement) {
+    reassign_node_ids([&](id_t old_id) {
+        return old_id - decrement;
+    });
+}
+
+void CompactGraph::reassign_node_ids(const function<id_t(id_t)>& get_new_id) {
+    // Paths first, while we can still tell which of their nodes exist
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < paths.size(); i++) {
+        for (auto& mapping : *paths[i].mutable_mapping()) {
+            id_t old_id = mapping.position().node_id();
+            if (has_node(old_id)) {
+                mapping.mutable_position()->set_node_id(get_new_id(old_id));
+            }
+        }
+    }
+
+    hash_map<id_t, size_t> new_slot_by_id;
+    new_slot_by_id.resize(live_nodes);
+    max_id = 0;
+    for (size_t slot : order) {
+        if (slot != DEAD_SLOT) {
+            slot_ids[slot] = get_new_id(slot_ids[slot]);
+            new_slot_by_id[slot_ids[slot]] = slot;
+            max_id = max(max_id, slot_ids[slot]);
+        }
+    }
+    swap(slot_by_id, new_slot_by_id);
+}
+
+const vector<Path>& CompactGraph::get_paths() const {
+    return paths;
+}
+
+void CompactGraph::clear_paths() {
+    paths.clear();
+}
+
+}
@@ -0,0 +1,242 @@
+#ifndef VG_COMPACT_GRAPH_HPP_INCLUDED
+#define VG_COMPACT_GRAPH_HPP_INCLUDED
+
+/**
+ * \file compact_graph.hpp
+ *
+ * A MutableHandleGraph kept in flat arrays, for commands that only need to
+ * load a graph, rearrange it through the handle interface, and write it back
+ * out, without the per-node protobuf objects and pointer indexes of VG.
+ */
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <iostream>
+#include <tuple>
+#include <unordered_map>
+
+#include "handle.hpp"
+#include "hash_map.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A graph stored as arrays indexed by node slot: one array of IDs, the
+ * sequences of all the nodes back to back in a single string, and a list of
+ * neighbor handles for each side of each node. Handles are slot numbers with
+ * the orientation in the low bit, so they stay valid when nodes are swapped
+ * or renumbered.
+ *
+ * Paths read in with the graph are carried along and written back out. As in
+ * VG, each mapping is kept as a single match of its from length, with no
+ * offset, and its from and to lengths must agree. Paths follow node ID
+ * changes (compact_ids, increment_node_ids, ...), but not changes to node
+ * sequences: apply_orientation leaves them alone, as the interface allows,
+ * and divide_handle refuses to run while there are paths.
+ */
+class CompactGraph : public MutableHandleGraph {
+public:
+
+    /// Make an empty graph
+    CompactGraph() = default;
+
+    /// Load a graph from a stream of Graph chunks, as written by VG. Chunks are
+    /// parsed in parallel. Duplicate nodes and edges are skipped, with a
+    /// warning if warn_on_duplicates is set.
+    CompactGraph(istream& in, bool warn_on_duplicates = false);
+
+    /// Write the graph as a stream of Graph chunks, with about chunk_size
+    /// nodes in each, and the path mappings on each node in its chunk.
+    void serialize_to_ostream(ostream& out, id_t chunk_size = 1000) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    // Copy over the visit version which would otherwise be shadowed.
+    using HandleGraph::get_handle;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    // Copy over the template for nice calls
+    using HandleGraph::follow_edges;
+
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in their internal stored order. Stop if the iteratee returns false.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    // Copy over the template for nice calls
+    using HandleGraph::for_each_handle;
+
+    /// Return the number of nodes in the graph
+    virtual size_t node_size() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Mutable handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Create a new node with the given sequence and return the handle.
+    virtual handle_t create_handle(const string& sequence);
+
+    /// Create a new node with the given id and sequence, then return the handle.
+    virtual handle_t create_handle(const string& sequence, const id_t& id);
+
+    /// Remove the node belonging to the given handle and all of its edges.
+    /// Does not update any stored paths.
+    virtual void destroy_handle(const handle_t& handle);
+
+    /// Create an edge connecting the given handles in the given order and orientations.
+    /// Ignores existing edges.
+    virtual void create_edge(const handle_t& left, const handle_t& right);
+
+    /// Remove the edge connecting the given handles in the given order and orientations.
+    /// Ignores nonexistent edges.
+    /// Does not update any stored paths.
+    virtual void destroy_edge(const handle_t& left, const handle_t& right);
+
+    /// Swap the nodes corresponding to the given handles, in the ordering used
+    /// by for_each_handle when looping over the graph.
+    virtual void swap_handles(const handle_t& a, const handle_t& b);
+
+    /// Alter the node that the given handle corresponds to so the orientation
+    /// indicated by the handle becomes the node's local forward orientation.
+    /// Keeps the node's ID and the handle values: the returned forward handle
+    /// is the one that used to be reverse. Does not update any stored paths.
+    virtual handle_t apply_orientation(const handle_t& handle);
+
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. The first part keeps the node's ID and the rest get new
+    /// IDs. Throws if the graph has paths, since it can't update them.
+    virtual vector<handle_t> divide_handle(const handle_t& handle, const vector<size_t>& offsets);
+
+    // Pull in the single offset version
+    using MutableHandleGraph::divide_handle;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // ID and path management
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Return true if a node with the given ID exists
+    bool has_node(id_t node_id) const;
+
+    /// Return the number of edges in the graph
+    size_t edge_count() const;
+
+    /// Return the smallest and largest node IDs, or 0 if there are no nodes
+    id_t min_node_id() const;
+    id_t max_node_id() const;
+
+    /// Renumber the nodes 1 through node_size(), in their stored order,
+    /// updating the paths to match.
+    void compact_ids();
+
+    /// Add the given amount to all node IDs, updating the paths to match.
+    void increment_node_ids(id_t increment);
+
+    /// Subtract the given amount from all node IDs, updating the paths to match.
+    void decrement_node_ids(id_t decrement);
+
+    /// Change every node's ID to the one the given function gives for its old
+    /// ID, updating the paths to match. The new IDs must be distinct.
+    void reassign_node_ids(const function<id_t(id_t)>& get_new_id);
+
+    /// Return the stored paths
+    const vector<Path>& get_paths() const;
+
+    /// Drop all the stored paths
+    void clear_paths();
+
+private:
+
+    /// Add the nodes and path mappings of a batch of chunks. Edges are queued
+    /// in pending_edges, since they may refer to nodes in later chunks.
+    /// path_by_name remembers where each path is in paths.
+    void extend(vector<Graph>& batch, bool warn_on_duplicates,
+                unordered_map<string, size_t>& path_by_name);
+
+    /// Add a node in a new slot at the end of the order, and return the slot
+    size_t add_slot(id_t id, size_t sequence_start, size_t sequence_length);
+
+    /// Add x to the list of handles reached from the given handle going in
+    /// the given direction, unless it's there already
+    void add_neighbor(const handle_t& from, bool go_left, const handle_t& x);
+
+    /// Remove x from that list, if present. Returns true if it was there.
+    bool remove_neighbor(const handle_t& from, bool go_left, const handle_t& x);
+
+    /// Return true if there's an edge from left to right
+    bool has_edge(const handle_t& left, const handle_t& right) const;
+
+    /// Get the slot a handle refers to
+    inline size_t slot_of(const handle_t& handle) const {
+        return as_integer(handle) >> 1;
+    }
+
+    /// Get the handle for a slot in an orientation
+    inline handle_t slot_handle(size_t slot, bool is_reverse) const {
+        return as_handle((int64_t) ((slot << 1) | (is_reverse ? 1 : 0)));
+    }
+
+    /// Marks a removed entry in the order
+    static const size_t DEAD_SLOT = (size_t) -1;
+
+    // One entry per slot. Removed nodes leave their slots behind, with ID 0.
+    vector<id_t> slot_ids;
+    vector<size_t> sequence_starts;
+    vector<size_t> sequence_lengths;
+    /// The handles reached going left and right from each slot's forward
+    /// orientation
+    vector<vector<handle_t>> left_neighbors;
+    vector<vector<handle_t>> right_neighbors;
+    /// Where each slot is in the order
+    vector<size_t> slot_ranks;
+
+    /// The sequences of all the nodes, back to back
+    string sequences;
+
+    /// The slots in for_each_handle order, with DEAD_SLOT for removed nodes
+    vector<size_t> order;
+
+    /// Which slot holds each node
+    hash_map<id_t, size_t> slot_by_id;
+
+    size_t live_nodes = 0;
+    size_t edges = 0;
+    id_t max_id = 0;
+
+    /// The paths, with their mappings sorted by rank
+    vector<Path> paths;
+
+    /// Edges read in but not yet added, as (from, from_start, to, to_end)
+    vector<tuple<id_t, bool, id_t, bool>> pending_edges;
+};
+
+}
+
+#endif
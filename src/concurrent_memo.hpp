@@ -0,0 +1,179 @@
+#ifndef VG_CONCURRENT_MEMO_HPP_INCLUDED
+#define VG_CONCURRENT_MEMO_HPP_INCLUDED
+
+/**
+ * \file concurrent_memo.hpp
+ *
+ * A bounded memo that many threads can read and fill at once, for caching the
+ * answers to expensive index queries across reads.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A thread-safe, size-bounded memo from keys to values.
+ *
+ * The entries are split over shards by hash, each behind its own mutex, so
+ * threads looking up different keys rarely wait on each other. Each shard
+ * keeps two generations of entries: new entries go in the current one, and
+ * hits in the previous one are moved up to it. When the current generation
+ * fills up, the previous one is dropped and the current one takes its place.
+ * This keeps recently used entries at O(1) cost per operation, and holds at
+ * most twice the shard capacity in each shard.
+ *
+ * Keys must have a std::hash.
+ */
+template<typename Key, typename Value>
+class ConcurrentMemo {
+public:
+
+    /// Make a memo that holds about max_size entries
+    ConcurrentMemo(size_t max_size = 1 << 20, size_t num_shards = 64);
+
+    /// If the key is present, copy its value into value and return true.
+    /// Otherwise return false.
+    bool find(const Key& key, Value& value);
+
+    /// Record the value for a key, possibly evicting older entries
+    void insert(const Key& key, const Value& value);
+
+    /// Drop all of the entries. The counts of hits and misses are kept.
+    void clear();
+
+    /// The number of entries currently held
+    size_t size() const;
+
+    /// The number of finds that succeeded
+    size_t hits() const;
+
+    /// The number of finds that failed
+    size_t misses() const;
+
+    /// The fraction of finds that succeeded, or 0 if there were none
+    double hit_rate() const;
+
+private:
+
+    struct Shard {
+        mutable mutex shard_mutex;
+        unordered_map<Key, Value> current;
+        unordered_map<Key, Value> previous;
+    };
+
+    Shard& shard_for(const Key& key);
+
+    vector<Shard> shards;
+    size_t shard_capacity;
+
+    atomic<size_t> hit_count;
+    atomic<size_t> miss_count;
+};
+
+template<typename Key, typename Value>
+ConcurrentMemo<Key, Value>::ConcurrentMemo(size_t max_size, size_t num_shards) :
+    shards(num_shards == 0 ? 1 : num_shards), hit_count(0), miss_count(0) {
+
+    // the two generations hold up to twice the capacity together
+    shard_capacity = max<size_t>(1, max_size / (2 * shards.size()));
+}
+
+template<typename Key, typename Value>
+typename ConcurrentMemo<Key, Value>::Shard& ConcurrentMemo<Key, Value>::shard_for(const Key& key) {
+    // mix the hash, since the standard hash of an integer is the identity and
+    // neighboring node IDs would otherwise land in neighboring shards
+    size_t hash = std::hash<Key>()(key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return shards[hash % shards.size()];
+}
+
+template<typename Key, typename Value>
+bool ConcurrentMemo<Key, Value>::find(const Key& key, Value& value) {
+    Shard& shard = shard_for(key);
+    {
+        lock_guard<mutex> lock(shard.shard_mutex);
+
+        auto iter = shard.current.find(key);
+        if (iter != shard.current.end()) {
+            value = iter->second;
+            hit_count++;
+            return true;
+        }
+
+        iter = shard.previous.find(key);
+        if (iter != shard.previous.end()) {
+            value = iter->second;
+            // it's still in use, so promote it into the current generation
+            if (shard.current.size() < shard_capacity) {
+                shard.current.emplace(key, std::move(iter->second));
+                shard.previous.erase(iter);
+            }
+            hit_count++;
+            return true;
+        }
+    }
+    miss_count++;
+    return false;
+}
+
+template<typename Key, typename Value>
+void ConcurrentMemo<Key, Value>::insert(const Key& key, const Value& value) {
+    Shard& shard = shard_for(key);
+    lock_guard<mutex> lock(shard.shard_mutex);
+
+    if (shard.current.size() >= shard_capacity && !shard.current.count(key)) {
+        // age out the older generation
+        shard.previous.clear();
+        shard.previous.swap(shard.current);
+    }
+    shard.current[key] = value;
+}
+
+template<typename Key, typename Value>
+void ConcurrentMemo<Key, Value>::clear() {
+    for (Shard& shard : shards) {
+        lock_guard<mutex> lock(shard.shard_mutex);
+        shard.current.clear();
+        shard.previous.clear();
+    }
+}
+
+template<typename Key, typename Value>
+size_t ConcurrentMemo<Key, Value>::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        lock_guard<mutex> lock(shard.shard_mutex);
+        total += shard.current.size() + shard.previous.size();
+    }
+    return total;
+}
+
+template<typename Key, typename Value>
+size_t ConcurrentMemo<Key, Value>::hits() const {
+    return hit_count.load();
+}
+
+template<typename Key, typename Value>
+size_t ConcurrentMemo<Key, Value>::misses() const {
+    return miss_count.load();
+}
+
+template<typename Key, typename Value>
+double ConcurrentMemo<Key, Value>::hit_rate() const {
+    size_t found = hits();
+    size_t total = found + misses();
+    return total == 0 ? 0.0 : double(found) / double(total);
+}
+
+}
+
+#endif
@@ -14,6 +14,8 @@
 #include <algorithm>
 #include <memory>
 
+#include <omp.h>
+
 
 namespace vg {
 
@@ -1389,6 +1391,55 @@ namespace vg {
             callback(chunk.graph);
         };
 
+        // Chunks are cut at points with no variants over them, so they can be
+        // constructed independently. We queue up a batch of them, construct
+        // the batch in parallel, and then wire and emit them in order, so node
+        // IDs come out the same as if we had gone one at a time.
+        struct PendingChunk {
+            string reference_sequence;
+            vector<vcflib::Variant> variants;
+            size_t start;
+            size_t end;
+        };
+        vector<PendingChunk> pending_chunks;
+        size_t max_pending_chunks = chunks_in_parallel ? chunks_in_parallel : 2 * omp_get_max_threads();
+
+        auto construct_pending = [&]() {
+            vector<ConstructedChunk> constructed(pending_chunks.size());
+
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < pending_chunks.size(); i++) {
+                PendingChunk& pending = pending_chunks[i];
+                constructed[i] = construct_chunk(std::move(pending.reference_sequence), reference_contig,
+                                                 std::move(pending.variants), pending.start);
+            }
+
+            for (size_t i = 0; i < constructed.size(); i++) {
+                // Wire up and emit the chunk graph
+                wire_and_emit(constructed[i]);
+
+                // Say we've completed the chunk
+                update_progress(pending_chunks[i].end - leading_offset);
+            }
+
+            pending_chunks.clear();
+        };
+
+        // Queue up a chunk, and construct the queue if it's full
+        auto add_chunk = [&](size_t start, size_t end, vector<vcflib::Variant>& variants) {
+            // Get the ref sequence we need
+            pending_chunks.emplace_back();
+            pending_chunks.back().reference_sequence = reference.getSubSequence(reference_contig, start, end - start);
+            pending_chunks.back().variants = std::move(variants);
+            pending_chunks.back().start = start;
+            pending_chunks.back().end = end;
+            variants.clear();
+
+            if (pending_chunks.size() >= max_pending_chunks) {
+                construct_pending();
+            }
+        };
+
         bool do_external_insertions = false;
         FastaReference* insertion_fasta;
 
@@ -1491,22 +1542,12 @@ namespace vg {
                             min((size_t) reference_end,
                                 (size_t) (chunk_start + bases_per_chunk))));
 
-                // Get the ref sequence we need
-                auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-                // Call the construction
-                auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-                // Wire up and emit the chunk graph
-                wire_and_emit(result);
-
-                // Say we've completed the chunk
-                update_progress(chunk_end - leading_offset);
+                // Queue the chunk for construction
+                add_chunk(chunk_start, chunk_end, chunk_variants);
 
                 // Set up a new chunk
                 chunk_start = chunk_end;
                 chunk_end = 0;
-                chunk_variants.clear();
 
                 // Loop again on the same variant.
             }
@@ -1523,24 +1564,17 @@ namespace vg {
                     min((size_t) reference_end,
                         (size_t) (chunk_start + bases_per_chunk)));
 
-            // Get the ref sequence we need
-            auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-            // Call the construction
-            auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-            // Wire up and emit the chunk graph
-            wire_and_emit(result);
-
-            // Say we've completed the chunk
-            update_progress(chunk_end - leading_offset);
+            // Queue the chunk for construction
+            add_chunk(chunk_start, chunk_end, chunk_variants);
 
             // Set up a new chunk
             chunk_start = chunk_end;
             chunk_end = 0;
-            chunk_variants.clear();
         }
 
+        // Construct whatever is still queued
+        construct_pending();
+
         // All the chunks have been wired and emitted. Now emit the very last node, if any
         emit_reference_node(last_node_buffer);
         // Update the max ID with that last node, so the next call starts at the next ID
@@ -113,6 +113,10 @@ public:
     // How many bases do we want to have per chunk? We don't necessarily want to
     // load all of chr1 into an std::string, even if we have no variants on it.
     size_t bases_per_chunk = 1024 * 1024;
+
+    // How many chunks should we construct at once, using OpenMP threads? They
+    // are still emitted in order. If 0, use twice the number of threads.
+    size_t chunks_in_parallel = 0;
     
     // This set contains the set of VCF sequence names we want to build the
     // graph for. If empty, we will build the graph for all sequences in the
@@ -0,0 +1,713 @@
+#include "distance_index.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+
+#include "nodeside.hpp"
+#include "index_io.hpp"
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// The saved format
+const IndexFormat DIST_FORMAT {"DIST", 1, "vg::DistanceIndex", "distance index"};
+
+/// Stands in for an unreachable distance. Leaves room to add a few of them
+/// without overflowing.
+const int64_t INF = numeric_limits<int64_t>::max() / 4;
+
+/// Add distances, staying at INF if either is INF.
+inline int64_t add(int64_t a, int64_t b) {
+    if (a >= INF || b >= INF) {
+        return INF;
+    }
+    return min(a + b, INF);
+}
+
+/// An element of a level while the index is being built
+struct BuildElement {
+    /// Is this a child level? Otherwise it is a node.
+    bool is_level;
+    /// The child level's index or the node's ID
+    int64_t id;
+    /// For nodes in chains, whether the node is backward in the chain
+    bool backward;
+};
+
+/// What we need to know about a level while the index is being built
+struct BuildLevel {
+    /// The snarl, for snarl levels other than the root
+    const Snarl* snarl = nullptr;
+    vector<BuildElement> elements;
+    /// For snarls, the boundary node sides that face into the snarl. For
+    /// chains, the outward sides of the first and last node.
+    NodeSide port_sides[2];
+    /// How many of port_sides are used: 0 for the root, 1 for unary snarls
+    size_t port_count = 0;
+};
+
+}
+
+size_t DistanceIndex::Level::element_sides() const {
+    return element_cost.size() / 2;
+}
+
+size_t DistanceIndex::Level::side_count() const {
+    return element_sides() + 2;
+}
+
+DistanceIndex::DistanceIndex(const HandleGraph* graph, const SnarlManager* snarl_manager) {
+
+    // Find the range of node IDs
+    id_t max_id = 0;
+    bool first = true;
+    graph->for_each_handle([&](const handle_t& handle) {
+        id_t id = graph->get_id(handle);
+        if (first || id < min_id) {
+            min_id = id;
+        }
+        if (first || id > max_id) {
+            max_id = id;
+        }
+        first = false;
+        return true;
+    });
+    if (first) {
+        // Empty graph, so nothing to index but the root
+        levels.emplace_back();
+        for (auto& cost : levels.front().port_cost) {
+            cost = INF;
+        }
+        return;
+    }
+    nodes.resize(max_id - min_id + 1);
+    graph->for_each_handle([&](const handle_t& handle) {
+        NodeRecord& record = nodes[graph->get_id(handle) - min_id];
+        // Everything starts out in the root
+        record.level = 0;
+        record.length = graph->get_length(handle);
+        return true;
+    });
+
+    // Lay out the levels, parents before children
+    vector<BuildLevel> build;
+    levels.emplace_back();
+    build.emplace_back();
+
+    // Nodes that are in chains, which have their elements already
+    vector<bool> in_chain(nodes.size(), false);
+
+    function<void(int64_t, const Snarl*)> add_children;
+
+    auto add_snarl = [&](const Snarl* snarl, int64_t parent, bool backward) {
+        int64_t index = levels.size();
+        levels.emplace_back();
+        build.emplace_back();
+        levels[index].parent = parent;
+        levels[index].element = build[parent].elements.size();
+        levels[index].backward = backward;
+        build[parent].elements.push_back(BuildElement{true, index, false});
+
+        BuildLevel& built = build[index];
+        built.snarl = snarl;
+        built.port_sides[0] = NodeSide(snarl->start().node_id(), !snarl->start().backward());
+        built.port_sides[1] = NodeSide(snarl->end().node_id(), snarl->end().backward());
+        built.port_count = (built.port_sides[0] == built.port_sides[1]) ? 1 : 2;
+
+        add_children(index, snarl);
+    };
+
+    add_children = [&](int64_t parent, const Snarl* snarl) {
+        for (const Chain& chain : snarl_manager->chains_of(snarl)) {
+            // Find the node visits between the snarls, reading along the chain
+            vector<pair<const Snarl*, bool>> oriented;
+            for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
+                oriented.push_back(*it);
+            }
+            vector<Visit> boundaries;
+            bool linear = oriented.size() >= 2;
+            for (size_t i = 0; i < oriented.size() && linear; i++) {
+                const Snarl* child = oriented[i].first;
+                bool backward = oriented[i].second;
+                if (child->type() == UNARY) {
+                    linear = false;
+                    break;
+                }
+                Visit left = backward ? reverse(child->end()) : child->start();
+                Visit right = backward ? reverse(child->start()) : child->end();
+                if (i == 0) {
+                    boundaries.push_back(left);
+                } else if (left.node_id() != boundaries.back().node_id() ||
+                           left.backward() != boundaries.back().backward()) {
+                    linear = false;
+                }
+                boundaries.push_back(right);
+            }
+            if (linear && boundaries.front().node_id() == boundaries.back().node_id()) {
+                // Circular chains can't be handled with prefix sums
+                linear = false;
+            }
+
+            if (!linear) {
+                // Put the snarls right into the parent
+                for (const Snarl* child : chain) {
+                    add_snarl(child, parent, false);
+                }
+                continue;
+            }
+
+            int64_t index = levels.size();
+            levels.emplace_back();
+            build.emplace_back();
+            levels[index].is_chain = true;
+            levels[index].parent = parent;
+            levels[index].element = build[parent].elements.size();
+            build[parent].elements.push_back(BuildElement{true, index, false});
+
+            build[index].port_sides[0] = NodeSide(boundaries.front().node_id(), boundaries.front().backward());
+            build[index].port_sides[1] = NodeSide(boundaries.back().node_id(), !boundaries.back().backward());
+            build[index].port_count = 2;
+
+            for (size_t i = 0; i < boundaries.size(); i++) {
+                if (i != 0) {
+                    add_snarl(oriented[i - 1].first, index, oriented[i - 1].second);
+                }
+                id_t id = boundaries[i].node_id();
+                if (id >= min_id && id <= max_id) {
+                    NodeRecord& record = nodes[id - min_id];
+                    record.level = index;
+                    record.element = build[index].elements.size();
+                    record.backward = boundaries[i].backward();
+                    in_chain[id - min_id] = true;
+                }
+                build[index].elements.push_back(BuildElement{false, id, boundaries[i].backward()});
+            }
+        }
+    };
+
+    add_children(0, nullptr);
+
+    // Give each node not in a chain to the deepest snarl it is inside. Snarls
+    // come after their parents, so later searches overwrite earlier ones.
+    vector<int64_t> seen_by(nodes.size(), -1);
+    for (size_t i = 1; i < levels.size(); i++) {
+        const Snarl* snarl = build[i].snarl;
+        if (snarl == nullptr) {
+            continue;
+        }
+        id_t start_id = snarl->start().node_id();
+        id_t end_id = snarl->end().node_id();
+        vector<handle_t> stack;
+        auto visit = [&](const handle_t& next) {
+            id_t id = graph->get_id(next);
+            if (id != start_id && id != end_id && seen_by[id - min_id] != (int64_t) i) {
+                seen_by[id - min_id] = i;
+                if (!in_chain[id - min_id]) {
+                    nodes[id - min_id].level = i;
+                }
+                stack.push_back(next);
+            }
+            return true;
+        };
+        graph->follow_edges(graph->get_handle(start_id, snarl->start().backward()), false, visit);
+        while (!stack.empty()) {
+            handle_t here = stack.back();
+            stack.pop_back();
+            graph->follow_edges(here, false, visit);
+            graph->follow_edges(here, true, visit);
+        }
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].level != -1 && !in_chain[i]) {
+            BuildLevel& owner = build[nodes[i].level];
+            nodes[i].element = owner.elements.size();
+            owner.elements.push_back(BuildElement{false, (int64_t) (min_id + i), false});
+        }
+    }
+
+    // Find the level side that a node side is on, within a snarl level. Sides
+    // inside child snarls are reported as the element's index past the end of
+    // the level's sides, and sides that aren't visible from this level at all
+    // as numeric_limits<size_t>::max().
+    const size_t NOWHERE = numeric_limits<size_t>::max();
+    auto side_in_level = [&](int64_t level, const NodeSide& side) -> size_t {
+        const BuildLevel& built = build[level];
+        size_t element_sides = built.elements.size() * 2;
+        for (size_t port = 0; port < built.port_count; port++) {
+            if (side == built.port_sides[port]) {
+                return element_sides + port;
+            }
+        }
+        if (side.node < min_id || side.node - min_id >= (id_t) nodes.size()) {
+            return NOWHERE;
+        }
+        const NodeRecord& record = nodes[side.node - min_id];
+        if (record.level == level) {
+            return record.element * 2 + (side.is_end != record.backward);
+        }
+        int64_t child = record.level;
+        while (child != -1 && levels[child].parent != level) {
+            child = levels[child].parent;
+        }
+        if (child == -1) {
+            return NOWHERE;
+        }
+        if (levels[child].is_chain) {
+            for (size_t port = 0; port < 2; port++) {
+                if (side == build[child].port_sides[port]) {
+                    return levels[child].element * 2 + port;
+                }
+            }
+            return NOWHERE;
+        }
+        return element_sides + 2 + levels[child].element;
+    };
+
+    // Work out costs from the bottom up
+    for (int64_t i = levels.size() - 1; i >= 0; i--) {
+        Level& level = levels[i];
+        const BuildLevel& built = build[i];
+
+        level.element_cost.resize(built.elements.size() * 4);
+        for (size_t e = 0; e < built.elements.size(); e++) {
+            int64_t* cost = &level.element_cost[e * 4];
+            if (built.elements[e].is_level) {
+                const Level& child = levels[built.elements[e].id];
+                for (size_t in = 0; in < 2; in++) {
+                    for (size_t out = 0; out < 2; out++) {
+                        cost[in * 2 + out] = child.port_cost[(in != child.backward) * 2 + (out != child.backward)];
+                    }
+                }
+            } else {
+                id_t id = built.elements[e].id;
+                int64_t length = (id >= min_id && id <= max_id) ? nodes[id - min_id].length : 0;
+                cost[0] = INF;
+                cost[1] = length;
+                cost[2] = length;
+                cost[3] = INF;
+            }
+        }
+
+        if (level.is_chain) {
+            finish_chain(level);
+            continue;
+        }
+
+        // Connect up the sides of the snarl's elements through the graph's edges
+        size_t side_count = level.side_count();
+        vector<vector<size_t>> adjacency(side_count);
+        auto connect = [&](size_t a, size_t b) {
+            adjacency[a].push_back(b);
+            adjacency[b].push_back(a);
+        };
+
+        vector<NodeSide> candidates;
+        for (auto& element : built.elements) {
+            if (!element.is_level) {
+                candidates.emplace_back(element.id, false);
+                candidates.emplace_back(element.id, true);
+            } else if (levels[element.id].is_chain) {
+                candidates.push_back(build[element.id].port_sides[0]);
+                candidates.push_back(build[element.id].port_sides[1]);
+            }
+        }
+        for (size_t port = 0; port < built.port_count; port++) {
+            candidates.push_back(built.port_sides[port]);
+        }
+
+        for (const NodeSide& side : candidates) {
+            size_t from = side_in_level(i, side);
+            if (from >= side_count || get_node(side.node) == nullptr) {
+                continue;
+            }
+            // Read off this side of the node
+            handle_t handle = graph->get_handle(side.node, !side.is_end);
+            graph->follow_edges(handle, false, [&](const handle_t& next) {
+                NodeSide next_side(graph->get_id(next), graph->get_is_reverse(next));
+                size_t to = side_in_level(i, next_side);
+                if (to == NOWHERE) {
+                    return true;
+                }
+                if (to >= side_count) {
+                    // We went into a child snarl, through one of its ports
+                    size_t element = to - side_count;
+                    const BuildLevel& child = build[built.elements[element].id];
+                    for (size_t port = 0; port < child.port_count; port++) {
+                        if (side == child.port_sides[port]) {
+                            connect(from, element * 2 + port);
+                            break;
+                        }
+                    }
+                } else {
+                    connect(from, to);
+                }
+                return true;
+            });
+        }
+        for (auto& neighbors : adjacency) {
+            sort(neighbors.begin(), neighbors.end());
+            neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        }
+
+        finish_snarl(level, adjacency);
+    }
+}
+
+DistanceIndex::DistanceIndex(istream& in) {
+    load(in);
+}
+
+void DistanceIndex::finish_snarl(Level& level, const vector<vector<size_t>>& adjacency) {
+    size_t side_count = level.side_count();
+
+    level.adjacency_start.clear();
+    level.adjacency.clear();
+    level.adjacency_start.reserve(side_count + 1);
+    for (auto& neighbors : adjacency) {
+        level.adjacency_start.push_back(level.adjacency.size());
+        level.adjacency.insert(level.adjacency.end(), neighbors.begin(), neighbors.end());
+    }
+    level.adjacency_start.push_back(level.adjacency.size());
+
+    level.matrix.clear();
+    if (side_count <= MAX_MATRIX_SIDES) {
+        level.matrix.reserve(side_count * side_count);
+        for (size_t side = 0; side < side_count; side++) {
+            vector<int64_t> row = search_snarl(level, side);
+            level.matrix.insert(level.matrix.end(), row.begin(), row.end());
+        }
+        // The matrix has everything the adjacency could tell us
+        level.adjacency_start.clear();
+        level.adjacency.clear();
+        level.adjacency_start.shrink_to_fit();
+        level.adjacency.shrink_to_fit();
+    }
+
+    size_t ports = level.element_sides();
+    for (size_t in = 0; in < 2; in++) {
+        for (size_t out = 0; out < 2; out++) {
+            level.port_cost[in * 2 + out] = snarl_distance(level, ports + in, ports + out);
+        }
+    }
+}
+
+void DistanceIndex::finish_chain(Level& level) {
+    size_t count = level.element_cost.size() / 4;
+
+    level.through.resize(count);
+    level.prefix.assign(count + 1, 0);
+    level.blocked.assign(count + 1, 0);
+    for (size_t e = 0; e < count; e++) {
+        level.through[e] = level.element_cost[e * 4 + 1];
+        bool passable = level.through[e] < INF;
+        level.prefix[e + 1] = level.prefix[e] + (passable ? level.through[e] : 0);
+        level.blocked[e + 1] = level.blocked[e] + (passable ? 0 : 1);
+    }
+
+    // Going out one side of an element, we can turn around in the next
+    // element over, or cross it and turn around further on.
+    level.right_loop.assign(count + 1, INF);
+    for (int64_t e = (int64_t) count - 2; e >= -1; e--) {
+        size_t next = e + 1;
+        level.right_loop[e + 1] = min(level.element_cost[next * 4],
+                                      add(add(level.through[next], level.through[next]),
+                                          level.right_loop[e + 2]));
+    }
+    level.left_loop.assign(count + 1, INF);
+    for (size_t e = 1; e <= count; e++) {
+        size_t next = e - 1;
+        level.left_loop[e] = min(level.element_cost[next * 4 + 3],
+                                 add(add(level.through[next], level.through[next]),
+                                     level.left_loop[e - 1]));
+    }
+
+    size_t ports = count * 2;
+    for (size_t in = 0; in < 2; in++) {
+        for (size_t out = 0; out < 2; out++) {
+            level.port_cost[in * 2 + out] = chain_distance(level, ports + in, ports + out);
+        }
+    }
+}
+
+vector<int64_t> DistanceIndex::search_snarl(const Level& level, size_t from_side) const {
+    size_t side_count = level.side_count();
+    size_t element_sides = level.element_sides();
+
+    // States are a side and whether we are about to leave it (0) or have
+    // just come in through it (1)
+    vector<int64_t> best(side_count * 2, INF);
+    priority_queue<pair<int64_t, size_t>, vector<pair<int64_t, size_t>>, greater<pair<int64_t, size_t>>> queue;
+    best[from_side * 2] = 0;
+    queue.emplace(0, from_side * 2);
+
+    while (!queue.empty()) {
+        int64_t distance = queue.top().first;
+        size_t state = queue.top().second;
+        queue.pop();
+        if (distance > best[state]) {
+            continue;
+        }
+        size_t side = state / 2;
+        auto relax = [&](size_t next, int64_t next_distance) {
+            if (next_distance < best[next]) {
+                best[next] = next_distance;
+                queue.emplace(next_distance, next);
+            }
+        };
+        if (state % 2 == 0) {
+            // Cross an edge
+            for (size_t i = level.adjacency_start[side]; i < level.adjacency_start[side + 1]; i++) {
+                relax(level.adjacency[i] * 2 + 1, distance);
+            }
+        } else if (side < element_sides) {
+            // Cross an element
+            size_t element = side / 2;
+            size_t in = side % 2;
+            for (size_t out = 0; out < 2; out++) {
+                relax((element * 2 + out) * 2, add(distance, level.element_cost[element * 4 + in * 2 + out]));
+            }
+        }
+    }
+
+    vector<int64_t> arrived(side_count);
+    for (size_t side = 0; side < side_count; side++) {
+        arrived[side] = best[side * 2 + 1];
+    }
+    return arrived;
+}
+
+int64_t DistanceIndex::snarl_distance(const Level& level, size_t from_side, size_t to_side) const {
+    if (!level.matrix.empty()) {
+        return level.matrix[from_side * level.side_count() + to_side];
+    }
+    return search_snarl(level, from_side)[to_side];
+}
+
+int64_t DistanceIndex::chain_span(const Level& level, int64_t first, int64_t last) const {
+    first = max<int64_t>(first, 0);
+    last = min<int64_t>(last, level.through.size() - 1);
+    if (first > last) {
+        return 0;
+    }
+    if (level.blocked[last + 1] != level.blocked[first]) {
+        return INF;
+    }
+    return level.prefix[last + 1] - level.prefix[first];
+}
+
+int64_t DistanceIndex::chain_distance(const Level& level, size_t from_side, size_t to_side) const {
+    int64_t count = level.through.size();
+
+    // Treat the ports as the inner sides of imaginary elements just past
+    // each end of the chain
+    int64_t x, y;
+    bool from_right, to_right;
+    if (from_side >= (size_t) count * 2) {
+        from_right = (from_side == (size_t) count * 2);
+        x = from_right ? -1 : count;
+    } else {
+        x = from_side / 2;
+        from_right = from_side % 2;
+    }
+    if (to_side >= (size_t) count * 2) {
+        to_right = (to_side == (size_t) count * 2);
+        y = to_right ? -1 : count;
+    } else {
+        y = to_side / 2;
+        to_right = to_side % 2;
+    }
+
+    auto right_loop = [&](int64_t e) { return level.right_loop[e + 1]; };
+    auto left_loop = [&](int64_t e) { return level.left_loop[e]; };
+
+    if (from_right && !to_right) {
+        if (x < y) {
+            return chain_span(level, x + 1, y - 1);
+        }
+        return add(add(right_loop(x), chain_span(level, y, x)), left_loop(y));
+    } else if (from_right && to_right) {
+        if (y > x) {
+            return add(chain_span(level, x + 1, y), right_loop(y));
+        }
+        return add(right_loop(x), chain_span(level, y + 1, x));
+    } else if (!from_right && to_right) {
+        if (y < x) {
+            return chain_span(level, y + 1, x - 1);
+        }
+        return add(add(left_loop(x), chain_span(level, x, y)), right_loop(y));
+    } else {
+        if (y < x) {
+            return add(chain_span(level, y, x - 1), left_loop(y));
+        }
+        return add(left_loop(x), chain_span(level, x, y - 1));
+    }
+}
+
+int64_t DistanceIndex::level_distance(const Level& level, size_t from_side, size_t to_side) const {
+    if (level.is_chain) {
+        return chain_distance(level, from_side, to_side);
+    }
+    return snarl_distance(level, from_side, to_side);
+}
+
+const DistanceIndex::NodeRecord* DistanceIndex::get_node(id_t id) const {
+    if (id < min_id || id - min_id >= (id_t) nodes.size() || nodes[id - min_id].level == -1) {
+        return nullptr;
+    }
+    return &nodes[id - min_id];
+}
+
+vector<DistanceIndex::ClimbStep> DistanceIndex::climb(const NodeRecord& node, int64_t cost_0, int64_t cost_1,
+                                                      bool leaving) const {
+    vector<ClimbStep> steps;
+    steps.push_back(ClimbStep{node.level, node.element, {cost_0, cost_1}});
+
+    while (levels[steps.back().level].parent != -1) {
+        const ClimbStep& below = steps.back();
+        const Level& level = levels[below.level];
+        size_t ports = level.element_sides();
+
+        ClimbStep above{level.parent, level.element, {INF, INF}};
+        for (size_t port = 0; port < 2; port++) {
+            int64_t best = INF;
+            for (size_t side = 0; side < 2; side++) {
+                size_t element_side = below.element * 2 + side;
+                int64_t within = leaving ? level_distance(level, element_side, ports + port)
+                                         : level_distance(level, ports + port, element_side);
+                best = min(best, add(below.cost[side], within));
+            }
+            above.cost[port != level.backward] = best;
+        }
+        steps.push_back(above);
+    }
+    return steps;
+}
+
+int64_t DistanceIndex::min_distance(const pos_t& pos_1, const pos_t& pos_2) const {
+    const NodeRecord* node_1 = get_node(id(pos_1));
+    const NodeRecord* node_2 = get_node(id(pos_2));
+    if (node_1 == nullptr || node_2 == nullptr) {
+        return -1;
+    }
+
+    // Leaving pos_1 reading along its strand takes us out the far side of
+    // its node, and arriving at pos_2 brings us in the near side of its node.
+    int64_t leave = node_1->length - offset(pos_1);
+    int64_t leave_start = is_rev(pos_1) ? leave : INF;
+    int64_t leave_end = is_rev(pos_1) ? INF : leave;
+    int64_t arrive_start = is_rev(pos_2) ? INF : offset(pos_2);
+    int64_t arrive_end = is_rev(pos_2) ? offset(pos_2) : INF;
+
+    vector<ClimbStep> up_1 = node_1->backward ? climb(*node_1, leave_end, leave_start, true)
+                                              : climb(*node_1, leave_start, leave_end, true);
+    vector<ClimbStep> up_2 = node_2->backward ? climb(*node_2, arrive_end, arrive_start, false)
+                                              : climb(*node_2, arrive_start, arrive_end, false);
+
+    int64_t best = INF;
+    if (id(pos_1) == id(pos_2) && is_rev(pos_1) == is_rev(pos_2) && offset(pos_2) >= offset(pos_1)) {
+        // We can just read along the node
+        best = offset(pos_2) - offset(pos_1);
+    }
+
+    // Both climbs end at the root, so line them up from there. Every level
+    // they have in common might hold the shortest way around.
+    auto step_1 = up_1.rbegin();
+    auto step_2 = up_2.rbegin();
+    while (step_1 != up_1.rend() && step_2 != up_2.rend() && step_1->level == step_2->level) {
+        const Level& level = levels[step_1->level];
+        for (size_t side_1 = 0; side_1 < 2; side_1++) {
+            for (size_t side_2 = 0; side_2 < 2; side_2++) {
+                int64_t within = level_distance(level, step_1->element * 2 + side_1, step_2->element * 2 + side_2);
+                best = min(best, add(add(step_1->cost[side_1], within), step_2->cost[side_2]));
+            }
+        }
+        if (step_1->element != step_2->element) {
+            // Below here the two positions are in different elements
+            break;
+        }
+        ++step_1;
+        ++step_2;
+    }
+
+    return best >= INF ? -1 : best;
+}
+
+int64_t DistanceIndex::oriented_distance(const pos_t& pos_1, const pos_t& pos_2) const {
+    int64_t forward = min_distance(pos_1, pos_2);
+    int64_t backward = min_distance(pos_2, pos_1);
+    if (forward == -1 && backward == -1) {
+        return numeric_limits<int64_t>::max();
+    }
+    if (backward == -1 || (forward != -1 && forward <= backward)) {
+        return forward;
+    }
+    return -backward;
+}
+
+size_t DistanceIndex::node_length(id_t id) const {
+    const NodeRecord* record = get_node(id);
+    return record == nullptr ? 0 : record->length;
+}
+
+void DistanceIndex::save(ostream& out) const {
+    write_header(out, DIST_FORMAT);
+
+    write_raw<int64_t>(out, min_id);
+    write_vector(out, nodes);
+
+    write_raw<uint64_t>(out, levels.size());
+    for (auto& level : levels) {
+        write_raw<bool>(out, level.is_chain);
+        write_raw<int64_t>(out, level.parent);
+        write_raw<uint64_t>(out, level.element);
+        write_raw<bool>(out, level.backward);
+        for (auto& cost : level.port_cost) {
+            write_raw<int64_t>(out, cost);
+        }
+        write_vector(out, level.element_cost);
+        write_vector(out, level.matrix);
+        write_vector(out, level.adjacency_start);
+        write_vector(out, level.adjacency);
+        write_vector(out, level.through);
+        write_vector(out, level.prefix);
+        write_vector(out, level.blocked);
+        write_vector(out, level.right_loop);
+        write_vector(out, level.left_loop);
+    }
+}
+
+void DistanceIndex::load(istream& in) {
+    read_header(in, DIST_FORMAT);
+
+    min_id = read_raw<int64_t>(in, DIST_FORMAT);
+    nodes = read_vector<NodeRecord>(in, DIST_FORMAT);
+
+    levels.clear();
+    levels.resize(read_raw<uint64_t>(in, DIST_FORMAT));
+    for (auto& level : levels) {
+        level.is_chain = read_raw<bool>(in, DIST_FORMAT);
+        level.parent = read_raw<int64_t>(in, DIST_FORMAT);
+        level.element = read_raw<uint64_t>(in, DIST_FORMAT);
+        level.backward = read_raw<bool>(in, DIST_FORMAT);
+        for (auto& cost : level.port_cost) {
+            cost = read_raw<int64_t>(in, DIST_FORMAT);
+        }
+        level.element_cost = read_vector<int64_t>(in, DIST_FORMAT);
+        level.matrix = read_vector<int64_t>(in, DIST_FORMAT);
+        level.adjacency_start = read_vector<size_t>(in, DIST_FORMAT);
+        level.adjacency = read_vector<size_t>(in, DIST_FORMAT);
+        level.through = read_vector<int64_t>(in, DIST_FORMAT);
+        level.prefix = read_vector<int64_t>(in, DIST_FORMAT);
+        level.blocked = read_vector<size_t>(in, DIST_FORMAT);
+        level.right_loop = read_vector<int64_t>(in, DIST_FORMAT);
+        level.left_loop = read_vector<int64_t>(in, DIST_FORMAT);
+    }
+}
+
+}
@@ -0,0 +1,178 @@
+#ifndef VG_DISTANCE_INDEX_HPP_INCLUDED
+#define VG_DISTANCE_INDEX_HPP_INCLUDED
+
+/** \file
+ * An index of exact minimum distances between positions in a graph, built on
+ * its snarl decomposition.
+ *
+ * The graph is cut into a tree of levels. Every snarl's interior is a level,
+ * and so is every chain of two or more snarls. The root level holds
+ * everything outside the top-level snarls. A level is made up of elements,
+ * each with two sides: nodes that belong to the level directly, and child
+ * levels, which look like nodes with two ports from the outside. Snarl levels
+ * store the minimum distance between every pair of element sides, and chains
+ * store prefix sums along the chain, so a query only has to climb from the
+ * two positions to their common ancestor level and a little past it.
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+#include "handle.hpp"
+#include "snarls.hpp"
+#include "position.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class DistanceIndex {
+public:
+
+    /// Build the index for a graph from its snarl decomposition.
+    DistanceIndex(const HandleGraph* graph, const SnarlManager* snarl_manager);
+
+    /// Load a saved index.
+    DistanceIndex(istream& in);
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load the index from a stream. Throws if it isn't a distance index.
+    void load(istream& in);
+
+    /// Get the minimum distance from pos_1 to pos_2, reading forward along
+    /// pos_1's strand and arriving at pos_2 on its strand, so that a position
+    /// is at distance 0 from itself and 1 from the next base. Returns -1 if
+    /// pos_2 cannot be reached from pos_1.
+    int64_t min_distance(const pos_t& pos_1, const pos_t& pos_2) const;
+
+    /// Get the signed distance from pos_1 to pos_2 on the same strand:
+    /// positive if pos_2 is ahead of pos_1 and negative if behind, whichever
+    /// is closer. Returns numeric_limits<int64_t>::max() if they are not on a
+    /// common strand, like XG::closest_shared_path_oriented_distance.
+    int64_t oriented_distance(const pos_t& pos_1, const pos_t& pos_2) const;
+
+    /// Get the length of a node in the indexed graph.
+    size_t node_length(id_t id) const;
+
+    /// Snarl levels with more element sides than this store no distance
+    /// matrix, and search their elements when queried instead.
+    static const size_t MAX_MATRIX_SIDES = 512;
+
+private:
+
+    /// One level of the decomposition: the interior of a snarl, a chain of
+    /// snarls, or the root.
+    struct Level {
+        /// Is this a chain? Otherwise it is a snarl or the root.
+        bool is_chain = false;
+        /// Index of the level this is an element of, or -1 for the root.
+        int64_t parent = -1;
+        /// Which element of the parent this is.
+        size_t element = 0;
+        /// If set, this level's port 0 is its element's side 1 in the parent.
+        bool backward = false;
+        /// Cost to cross this level, from entering by one port to leaving by
+        /// another, indexed by [in_port * 2 + out_port].
+        int64_t port_cost[4];
+
+        // Element e has sides 2e and 2e + 1, and after the elements come 2
+        // sides for the ports. In snarls, the ports are where the snarl's
+        // boundary nodes face into it.
+
+        /// Cost to cross each element, 4 per element, indexed like port_cost.
+        vector<int64_t> element_cost;
+        /// Minimum distance from leaving any side to entering any side, with
+        /// side_count rows. Empty for levels too big to store.
+        vector<int64_t> matrix;
+        /// Adjacent sides of each side, in compressed sparse rows. Only kept
+        /// for levels without a matrix.
+        vector<size_t> adjacency_start;
+        vector<size_t> adjacency;
+
+        // For chains, elements alternate between boundary nodes and snarls,
+        // starting and ending with a node. Port 0 is the outward side of the
+        // first node and port 1 is the outward side of the last.
+
+        /// Cost to cross each element in chain order
+        vector<int64_t> through;
+        /// Sum of the finite through costs before each element
+        vector<int64_t> prefix;
+        /// Count of elements that cannot be crossed before each element
+        vector<size_t> blocked;
+        /// Minimum cost of leaving each element on its right and coming back
+        /// in that side, within the chain, and the same on the left. Indexed
+        /// from the left port, so right_loop has the left port's loop first
+        /// and left_loop has the right port's loop last.
+        vector<int64_t> right_loop;
+        vector<int64_t> left_loop;
+
+        /// Number of element sides, not counting ports
+        size_t element_sides() const;
+        /// Number of sides including the ports
+        size_t side_count() const;
+    };
+
+    /// Where a node lives in the index
+    struct NodeRecord {
+        /// The level it is an element of, or -1 if not in the graph
+        int64_t level = -1;
+        /// Its element in that level
+        size_t element = 0;
+        /// If set, the node's start is side 1 of its element
+        bool backward = false;
+        int64_t length = 0;
+    };
+
+    /// Get the record for a node, or null if it isn't in the graph.
+    const NodeRecord* get_node(id_t id) const;
+
+    /// The cost of getting between a position and the sides of an element
+    /// that contains it, at one level
+    struct ClimbStep {
+        int64_t level;
+        size_t element;
+        int64_t cost[2];
+    };
+
+    /// Work out the costs of getting from a position out through the sides
+    /// of every level above it (if leaving is set), or in through them to the
+    /// position, starting from the costs to the node's element sides.
+    vector<ClimbStep> climb(const NodeRecord& node, int64_t cost_0, int64_t cost_1, bool leaving) const;
+
+    /// Get the minimum distance, within a snarl level, from leaving side
+    /// from_side to entering side to_side.
+    int64_t snarl_distance(const Level& level, size_t from_side, size_t to_side) const;
+
+    /// Get the minimum distances, within a snarl level, from leaving a side to
+    /// entering every side, by searching the level's elements.
+    vector<int64_t> search_snarl(const Level& level, size_t from_side) const;
+
+    /// Get the minimum distance, within a chain, from leaving from_side to
+    /// entering to_side. Sides are numbered like in snarls, with the ports
+    /// after the element sides.
+    int64_t chain_distance(const Level& level, size_t from_side, size_t to_side) const;
+
+    /// Sum of through costs of chain elements first to last inclusive.
+    int64_t chain_span(const Level& level, int64_t first, int64_t last) const;
+
+    /// Get the minimum distance within a level of either kind.
+    int64_t level_distance(const Level& level, size_t from_side, size_t to_side) const;
+
+    /// Fill in a snarl level's costs and matrix once its elements and their
+    /// costs are known, from the given adjacency between its sides.
+    void finish_snarl(Level& level, const vector<vector<size_t>>& adjacency);
+
+    /// Fill in a chain level's costs once its elements' costs are known.
+    void finish_chain(Level& level);
+
+    vector<Level> levels;
+    vector<NodeRecord> nodes;
+    id_t min_id = 0;
+};
+
+}
+
+#endif
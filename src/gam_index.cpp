@@ -0,0 +1,293 @@
+#include "gam_index.hpp"
+#include "stream.hpp"
+#include "index_io.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// The saved format. Version 1 had no wide alignment index.
+const IndexFormat GAI_FORMAT {"GAI!", 2, "vg::GAMIndex", "GAM index"};
+
+/// Get the inclusive range of positive node IDs an alignment visits, or
+/// false if it visits none.
+bool visited_range(const Alignment& aln, id_t& min_id, id_t& max_id) {
+    bool found = false;
+    for (auto& mapping : aln.path().mapping()) {
+        id_t id = mapping.position().node_id();
+        if (id <= 0) {
+            continue;
+        }
+        if (!found) {
+            min_id = max_id = id;
+            found = true;
+        } else {
+            min_id = min(min_id, id);
+            max_id = max(max_id, id);
+        }
+    }
+    return found;
+}
+
+}
+
+GAMIndex::bin_t GAMIndex::common_bin(id_t min_id, id_t max_id) {
+    // IDs are positive, so only the low 63 bits can differ. Bins with a
+    // common prefix of c bits are numbered from 2^c - 1, so levels don't
+    // collide and bin 0 holds everything.
+    bin_t differing = (bin_t) min_id ^ (bin_t) max_id;
+    size_t prefix_bits = differing == 0 ? 63 : __builtin_clzll(differing) - 1;
+    return (((bin_t) 1 << prefix_bits) - 1) + ((bin_t) min_id >> (63 - prefix_bits));
+}
+
+GAMIndex::window_t GAMIndex::window_of(id_t id) {
+    return id >> WINDOW_SHIFT;
+}
+
+void GAMIndex::add_alignment(const Alignment& aln, int64_t group_offset) {
+    if (group_offset != last_group) {
+        previous_group = last_group;
+        last_group = group_offset;
+    }
+    
+    id_t min_id, max_id;
+    if (!visited_range(aln, min_id, max_id)) {
+        // Unmapped alignments can't be found by node, so don't index them
+        return;
+    }
+    
+    vector<chunk_t>& chunks = bin_to_chunks[common_bin(min_id, max_id)];
+    if (!chunks.empty() && chunks.back().second == group_offset) {
+        // Already covered
+    } else if (!chunks.empty() && chunks.back().second == previous_group) {
+        // Extend the chunk into this group, which comes right after
+        chunks.back().second = group_offset;
+    } else {
+        chunks.emplace_back(group_offset, group_offset);
+    }
+    
+    window_t first_window = window_of(min_id);
+    window_t last_window = window_of(max_id);
+    if ((uint64_t) (last_window - first_window) >= MAX_FILLED_WINDOWS) {
+        // Filling every window would take time and space proportional to the
+        // ID span, which can be huge, so just remember the span.
+        auto inserted = wide_window_to_start.emplace(first_window, make_pair(last_window, group_offset));
+        if (!inserted.second) {
+            // Groups come in file order, so keep the earliest group
+            inserted.first->second.first = max(inserted.first->second.first, last_window);
+        }
+        return;
+    }
+    
+    for (window_t window = first_window; window <= last_window; window++) {
+        // Groups come in file order, so the first one we see is the earliest
+        window_to_start.emplace(window, group_offset);
+    }
+}
+
+void GAMIndex::index(istream& gam) {
+    stream::for_each_with_group_offsets<Alignment>(gam, [&](int64_t group_offset, Alignment& aln) {
+        if (group_offset < 0) {
+            throw runtime_error("[vg::GAMIndex] can only index seekable, BGZF-compressed GAM files");
+        }
+        add_alignment(aln, group_offset);
+    });
+}
+
+vector<GAMIndex::chunk_t> GAMIndex::find(const vector<pair<id_t, id_t>>& ranges) const {
+    vector<chunk_t> found;
+    
+    // Nothing touching the ranges can start before the first group that
+    // touches any of their windows.
+    int64_t min_start = numeric_limits<int64_t>::max();
+    for (auto& range : ranges) {
+        auto end = window_to_start.upper_bound(window_of(range.second));
+        for (auto it = window_to_start.lower_bound(window_of(range.first)); it != end; ++it) {
+            min_start = min(min_start, it->second);
+        }
+        // Wide alignments are only recorded by their first window, so look
+        // at all the ones starting at or before the range.
+        auto wide_end = wide_window_to_start.upper_bound(window_of(range.second));
+        for (auto it = wide_window_to_start.begin(); it != wide_end; ++it) {
+            if (it->second.first >= window_of(range.first)) {
+                min_start = min(min_start, it->second.second);
+            }
+        }
+    }
+    if (min_start == numeric_limits<int64_t>::max()) {
+        // No alignments touch any of these windows
+        return found;
+    }
+    
+    for (auto& range : ranges) {
+        for (size_t prefix_bits = 0; prefix_bits < 64; prefix_bits++) {
+            // Bins of this level that can overlap the range are numbered
+            // contiguously.
+            bin_t level_start = ((bin_t) 1 << prefix_bits) - 1;
+            size_t shift = 63 - prefix_bits;
+            bin_t first_bin = level_start + ((bin_t) range.first >> shift);
+            bin_t last_bin = level_start + ((bin_t) range.second >> shift);
+            
+            auto end = bin_to_chunks.upper_bound(last_bin);
+            for (auto it = bin_to_chunks.lower_bound(first_bin); it != end; ++it) {
+                for (auto& chunk : it->second) {
+                    if (chunk.second >= min_start) {
+                        found.emplace_back(max(chunk.first, min_start), chunk.second);
+                    }
+                }
+            }
+        }
+    }
+    
+    // Merge overlapping chunks so nothing is scanned twice
+    sort(found.begin(), found.end());
+    vector<chunk_t> merged;
+    for (auto& chunk : found) {
+        if (!merged.empty() && chunk.first <= merged.back().second) {
+            merged.back().second = max(merged.back().second, chunk.second);
+        } else {
+            merged.push_back(chunk);
+        }
+    }
+    return merged;
+}
+
+void GAMIndex::scan_chunks(istream& gam, const vector<chunk_t>& chunks,
+                           const function<bool(const Alignment&)>& filter,
+                           const function<void(const Alignment&)>& lambda) const {
+    for (auto& chunk : chunks) {
+        stream::for_each_from<Alignment>(gam, chunk.first, [&](int64_t group_offset, Alignment& aln) {
+            if (group_offset > chunk.second) {
+                // Past the end of the chunk
+                return false;
+            }
+            if (filter(aln)) {
+                lambda(aln);
+            }
+            return true;
+        });
+    }
+}
+
+void GAMIndex::for_alignment_in_range(istream& gam, id_t min_id, id_t max_id,
+                                      const function<void(const Alignment&)>& lambda) const {
+    vector<chunk_t> chunks = find({make_pair(min_id, max_id)});
+    scan_chunks(gam, chunks, [&](const Alignment& aln) {
+        for (auto& mapping : aln.path().mapping()) {
+            id_t id = mapping.position().node_id();
+            if (id >= min_id && id <= max_id) {
+                return true;
+            }
+        }
+        return false;
+    }, lambda);
+}
+
+void GAMIndex::for_alignment_to_nodes(istream& gam, const vector<id_t>& ids,
+                                      const function<void(const Alignment&)>& lambda) const {
+    vector<id_t> sorted_ids = ids;
+    sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(unique(sorted_ids.begin(), sorted_ids.end()), sorted_ids.end());
+    
+    // Query runs of consecutive IDs together
+    vector<pair<id_t, id_t>> ranges;
+    for (id_t id : sorted_ids) {
+        if (!ranges.empty() && ranges.back().second + 1 == id) {
+            ranges.back().second = id;
+        } else {
+            ranges.emplace_back(id, id);
+        }
+    }
+    
+    vector<chunk_t> chunks = find(ranges);
+    scan_chunks(gam, chunks, [&](const Alignment& aln) {
+        for (auto& mapping : aln.path().mapping()) {
+            if (binary_search(sorted_ids.begin(), sorted_ids.end(), mapping.position().node_id())) {
+                return true;
+            }
+        }
+        return false;
+    }, lambda);
+}
+
+size_t GAMIndex::chunk_count() const {
+    size_t total = 0;
+    for (auto& kv : bin_to_chunks) {
+        total += kv.second.size();
+    }
+    return total;
+}
+
+void GAMIndex::save(ostream& out) const {
+    write_header(out, GAI_FORMAT);
+    
+    write_raw<uint64_t>(out, bin_to_chunks.size());
+    for (auto& kv : bin_to_chunks) {
+        write_raw<bin_t>(out, kv.first);
+        write_raw<uint64_t>(out, kv.second.size());
+        for (auto& chunk : kv.second) {
+            write_raw<int64_t>(out, chunk.first);
+            write_raw<int64_t>(out, chunk.second);
+        }
+    }
+    
+    write_raw<uint64_t>(out, window_to_start.size());
+    for (auto& kv : window_to_start) {
+        write_raw<window_t>(out, kv.first);
+        write_raw<int64_t>(out, kv.second);
+    }
+    
+    write_raw<uint64_t>(out, wide_window_to_start.size());
+    for (auto& kv : wide_window_to_start) {
+        write_raw<window_t>(out, kv.first);
+        write_raw<window_t>(out, kv.second.first);
+        write_raw<int64_t>(out, kv.second.second);
+    }
+    
+    if (!out) {
+        throw runtime_error("[vg::GAMIndex] could not write GAM index");
+    }
+}
+
+void GAMIndex::load(istream& in) {
+    uint32_t version = read_header(in, GAI_FORMAT);
+    
+    bin_to_chunks.clear();
+    window_to_start.clear();
+    wide_window_to_start.clear();
+    
+    uint64_t bin_count = read_raw<uint64_t>(in, GAI_FORMAT);
+    for (uint64_t i = 0; i < bin_count; i++) {
+        bin_t bin = read_raw<bin_t>(in, GAI_FORMAT);
+        vector<chunk_t>& chunks = bin_to_chunks[bin];
+        chunks.resize(read_raw<uint64_t>(in, GAI_FORMAT));
+        for (auto& chunk : chunks) {
+            chunk.first = read_raw<int64_t>(in, GAI_FORMAT);
+            chunk.second = read_raw<int64_t>(in, GAI_FORMAT);
+        }
+    }
+    
+    uint64_t window_count = read_raw<uint64_t>(in, GAI_FORMAT);
+    for (uint64_t i = 0; i < window_count; i++) {
+        window_t window = read_raw<window_t>(in, GAI_FORMAT);
+        window_to_start[window] = read_raw<int64_t>(in, GAI_FORMAT);
+    }
+    
+    if (version >= 2) {
+        // Version 1 filled every window, however many there were
+        uint64_t wide_count = read_raw<uint64_t>(in, GAI_FORMAT);
+        for (uint64_t i = 0; i < wide_count; i++) {
+            window_t window = read_raw<window_t>(in, GAI_FORMAT);
+            window_t last_window = read_raw<window_t>(in, GAI_FORMAT);
+            wide_window_to_start[window] = make_pair(last_window, read_raw<int64_t>(in, GAI_FORMAT));
+        }
+    }
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef VG_GAM_INDEX_HPP_INCLUDED
+#define VG_GAM_INDEX_HPP_INCLUDED
+
+/** \file
+ * A lightweight node ID index over a sorted, BGZF-compressed GAM file, in the
+ * spirit of tabix/CSI. Alignments are placed in bins by the range of node IDs
+ * they visit, and each bin records runs of compressed groups ("chunks") by
+ * BGZF virtual offset, so a query can seek straight to the parts of the GAM
+ * that can hold alignments touching the queried nodes. A linear index of
+ * fixed-size node ID windows lets queries skip the early part of big bins.
+ *
+ * The index is correct for any GAM written with BGZF, but is only compact
+ * and fast for GAMs sorted by GAMSorter.
+ */
+
+#include <iostream>
+#include <functional>
+#include <map>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class GAMIndex {
+public:
+    GAMIndex() = default;
+    
+    /// Bins identify runs of node IDs sharing a common binary prefix.
+    typedef uint64_t bin_t;
+    /// Windows are fixed-size runs of node IDs, for the linear index.
+    typedef int64_t window_t;
+    /// A range of groups in the GAM, by the virtual offsets of the first and
+    /// last group, both inclusive.
+    typedef pair<int64_t, int64_t> chunk_t;
+    
+    /// Node IDs per linear index window are 2^WINDOW_SHIFT.
+    static const size_t WINDOW_SHIFT = 8;
+    
+    /// Alignments touching more windows than this go in the sparse wide
+    /// alignment index instead of filling every window they touch.
+    static const size_t MAX_FILLED_WINDOWS = 64;
+    
+    /// Add an alignment that lives in the group starting at the given virtual
+    /// offset. Groups must be added in file order.
+    void add_alignment(const Alignment& aln, int64_t group_offset);
+    
+    /// Index all the alignments in a BGZF GAM stream.
+    void index(istream& gam);
+    
+    /// Get the chunks of the GAM that might contain alignments visiting any
+    /// node in the given inclusive ID ranges, sorted and merged.
+    vector<chunk_t> find(const vector<pair<id_t, id_t>>& ranges) const;
+    
+    /// Call the lambda on every alignment in the seekable GAM stream that
+    /// visits a node with ID in the inclusive range [min_id, max_id]. Each
+    /// alignment is reported once, in file order. Unlike
+    /// Index::for_alignment_in_range, which only looks at the first node, any
+    /// node in the range counts.
+    void for_alignment_in_range(istream& gam, id_t min_id, id_t max_id,
+                                const function<void(const Alignment&)>& lambda) const;
+    
+    /// Call the lambda on every alignment in the seekable GAM stream that
+    /// visits any of the given nodes. Each alignment is reported once, in
+    /// file order.
+    void for_alignment_to_nodes(istream& gam, const vector<id_t>& ids,
+                                const function<void(const Alignment&)>& lambda) const;
+    
+    /// Save the index to a stream
+    void save(ostream& out) const;
+    
+    /// Load the index from a stream. Throws if it isn't a GAM index.
+    void load(istream& in);
+    
+    /// Get the bin for alignments visiting only node IDs between min_id and
+    /// max_id inclusive: the bin of their longest common prefix.
+    static bin_t common_bin(id_t min_id, id_t max_id);
+    
+    /// Get the window that a node ID falls in.
+    static window_t window_of(id_t id);
+    
+    /// Get the total number of chunks across all bins, for reporting
+    size_t chunk_count() const;
+    
+private:
+    
+    /// Scan the given chunks of the GAM, calling the lambda on alignments the
+    /// filter accepts.
+    void scan_chunks(istream& gam, const vector<chunk_t>& chunks,
+                     const function<bool(const Alignment&)>& filter,
+                     const function<void(const Alignment&)>& lambda) const;
+    
+    /// Chunks of groups holding alignments in each bin
+    map<bin_t, vector<chunk_t>> bin_to_chunks;
+    
+    /// For each window, the first group holding an alignment that touches it
+    map<window_t, int64_t> window_to_start;
+    
+    /// For alignments touching too many windows to fill, by the first window
+    /// they touch, the last window any of them touches and the first group
+    /// holding one of them.
+    map<window_t, pair<window_t, int64_t>> wide_window_to_start;
+    
+    /// The last group offset seen while indexing, and the one before it, so we
+    /// can tell when a bin's next alignment is in the very next group.
+    int64_t last_group = -1;
+    int64_t previous_group = -1;
+};
+
+}
+
+#endif
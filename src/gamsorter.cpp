@@ -1,4 +1,10 @@
 #include "gamsorter.hpp"
+#include "gam_index.hpp"
+#include "utility.hpp"
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <omp.h>
 /*
 *  GAMSorter: sort a gam by position and offset
 *  dumbly store unmapped reads at the end.
@@ -8,64 +14,6 @@ using namespace std;
 using namespace vg;
 
 
-class AlnSorter{
-    bool invert = false;
-public:
-  bool mycomparison(const bool& reverse=false)
-  {invert = reverse;}
-  bool operator() (const Alignment& a_one, const Alignment& a_two) const
-  {
-
-        // Unmapped case
-        int xf_size = a_one.path().mapping_size();
-        int xb_size = a_two.path().mapping_size();
-        
-        if (xf_size == 0 || xb_size == 0){
-            bool both_zero = (xf_size == xb_size);
-            if (both_zero){
-                return false;
-            }
-            else{
-                return (xf_size > xb_size) ? false : true;
-            }
-        }
-
-        Position x_front = a_one.path().mapping(0).position();
-        Position x_back = a_one.path().mapping(a_one.path().mapping_size() - 1).position();
-
-        Position lhs;
-        Position rhs;
-        if (x_front.node_id() < x_back.node_id())
-        {
-            lhs = x_front;
-        }
-        else
-        {
-            lhs = x_back;
-        }
-        Position y_front = a_two.path().mapping(0).position();
-        Position y_back = a_two.path().mapping(a_two.path().mapping_size() - 1).position();
-        if (y_front.node_id() < y_back.node_id())
-        {
-            rhs = y_front;
-        }
-        else
-        {
-            rhs = y_back;
-        }
-
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
-        }
-  }
-};
-
-
 struct custom_pos_sort_key
 {
     bool operator()(const Position lhs, const Position rhs)
@@ -81,60 +29,306 @@ struct custom_pos_sort_key
     }
 } possortkey;
 
-struct custom_aln_sort_key
-{
-    bool operator()(const Alignment a_one, const Alignment a_two)
+namespace {
+
+/**
+ * What alignments are sorted by: mapped reads come first, ordered by the
+ * position at whichever end of the path is on the lower node ID, then
+ * unmapped reads. Extracted once per alignment so that sorting and merging
+ * never have to compare or even parse whole Alignments.
+ */
+struct SortKey {
+    int64_t unmapped;
+    int64_t node_id;
+    int64_t offset;
+    
+    inline bool operator<(const SortKey& other) const {
+        return std::tie(unmapped, node_id, offset) < std::tie(other.unmapped, other.node_id, other.offset);
+    }
+};
+
+SortKey get_sort_key(const Alignment& aln) {
+    SortKey key {0, 0, 0};
+    const Path& path = aln.path();
+    if (path.mapping_size() == 0) {
+        key.unmapped = 1;
+        return key;
+    }
+    const Position& front = path.mapping(0).position();
+    const Position& back = path.mapping(path.mapping_size() - 1).position();
+    const Position& lowest = front.node_id() < back.node_id() ? front : back;
+    key.node_id = lowest.node_id();
+    key.offset = lowest.offset();
+    return key;
+}
+
+/// Most alignments to put in one compressed group
+const size_t GROUP_MAX_COUNT = 1024;
+/// Most serialized bytes to put in one compressed group, so that readers can
+/// use one CodedInputStream for a whole group.
+const size_t GROUP_MAX_BYTES = stream::MAX_PROTOBUF_SIZE / 2;
+
+/// Run the given function over [0, count) in chunks, as OpenMP tasks on the
+/// current team, and wait for them. Rethrows the first exception a chunk
+/// throws, since exceptions can't leave a task.
+void parallel_chunks(size_t count, size_t chunk_size, const function<void(size_t, size_t)>& body) {
+    exception_ptr error;
+    #pragma omp taskgroup
     {
-        int xf_size = a_one.path().mapping_size();
-        int xb_size = a_two.path().mapping_size();
-        
-        if (xf_size == 0 || xb_size == 0){
-            bool both_zero = (xf_size == xb_size);
-            if (both_zero){
-                return false;
-            }
-            else{
-                return (xf_size > xb_size) ? false : true;
+        for (size_t start = 0; start < count; start += chunk_size) {
+            size_t end = min(count, start + chunk_size);
+            #pragma omp task default(none) firstprivate(start, end) shared(body, error)
+            {
+                try {
+                    body(start, end);
+                } catch (...) {
+                    #pragma omp critical (gamsort_error)
+                    if (!error) {
+                        error = current_exception();
+                    }
+                }
             }
         }
-        Position x_front = a_one.path().mapping(0).position();
-        Position x_back = a_one.path().mapping(a_one.path().mapping_size() - 1).position();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
 
-        Position lhs;
-        Position rhs;
-        if (x_front.node_id() < x_back.node_id())
-        {
-            lhs = x_front;
+/// Compute the stable sorted order of the given keys. Sorts chunks as tasks,
+/// then merges pairs of sorted ranges as tasks until one range is left.
+vector<size_t> parallel_sort_order(const vector<SortKey>& keys) {
+    vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    auto compare = [&keys](size_t a, size_t b) {
+        return keys[a] < keys[b];
+    };
+    
+    size_t parts = max<size_t>(1, min<size_t>(2 * omp_get_num_threads(), keys.size() / 4096));
+    size_t width = (keys.size() + parts - 1) / max<size_t>(parts, 1);
+    if (width == 0) {
+        return order;
+    }
+    
+    parallel_chunks(order.size(), width, [&](size_t start, size_t end) {
+        std::stable_sort(order.begin() + start, order.begin() + end, compare);
+    });
+    
+    for (; width < order.size(); width *= 2) {
+        // Merge each adjacent pair of sorted ranges
+        parallel_chunks(order.size(), width * 2, [&](size_t start, size_t end) {
+            if (start + width < end) {
+                std::inplace_merge(order.begin() + start, order.begin() + start + width,
+                                   order.begin() + end, compare);
+            }
+        });
+    }
+    
+    return order;
+}
+
+/**
+ * Collects serialized alignments into groups, compresses waves of groups in
+ * parallel as OpenMP tasks, and writes them out in order. Optionally also
+ * writes each alignment's sort key to a key file.
+ */
+class GroupWriter {
+public:
+    GroupWriter(ostream& out, ostream* key_out = nullptr) : out(out), key_out(key_out) {
+        wave_size = max<size_t>(1, 2 * omp_get_num_threads());
+        groups.emplace_back();
+    }
+    
+    /// Add the next alignment, taking its serialized bytes.
+    void add(string& message, const SortKey& key) {
+        if (groups.back().size() >= GROUP_MAX_COUNT ||
+            group_bytes + message.size() > GROUP_MAX_BYTES) {
+            if (groups.size() >= wave_size) {
+                write_wave();
+            }
+            groups.emplace_back();
+            group_bytes = 0;
         }
-        else
-        {
-            lhs = x_back;
+        group_bytes += message.size();
+        groups.back().emplace_back(std::move(message));
+        if (key_out) {
+            key_out->write((const char*) &key, sizeof(SortKey));
         }
-        Position y_front = a_two.path().mapping(0).position();
-        Position y_back = a_two.path().mapping(a_two.path().mapping_size() - 1).position();
-        if (y_front.node_id() < y_back.node_id())
-        {
-            rhs = y_front;
+        count++;
+    }
+    
+    /// Write everything still buffered.
+    void finish() {
+        write_wave();
+        out.flush();
+        if (key_out) {
+            key_out->flush();
         }
-        else
-        {
-            rhs = y_back;
+        if (!out || (key_out && !*key_out)) {
+            throw runtime_error("[vg::GAMSorter] could not write sorted alignments");
         }
+    }
+    
+    size_t count = 0;
+    
+private:
+    void write_wave() {
+        vector<string> compressed(groups.size());
+        vector<vector<string>>& to_compress = groups;
+        parallel_chunks(groups.size(), 1, [&](size_t i, size_t) {
+            compressed[i] = stream::compress_serialized_group(to_compress[i]);
+        });
+        for (auto& data : compressed) {
+            out.write(data.data(), data.size());
+        }
+        groups.clear();
+        groups.emplace_back();
+        group_bytes = 0;
+    }
+    
+    ostream& out;
+    ostream* key_out;
+    size_t wave_size;
+    vector<vector<string>> groups;
+    size_t group_bytes = 0;
+};
 
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
+/// A sorted run in temporary files: the alignments, and their sort keys.
+struct SortedRun {
+    string gam_filename;
+    string key_filename;
+};
+
+/// Reads a sorted run back one alignment at a time, with its key.
+class RunReader {
+public:
+    RunReader(const SortedRun& run) : gam_in(run.gam_filename, ios::binary),
+        key_in(run.key_filename, ios::binary), bgzip_in(gam_in) {
+        advance();
+    }
+    
+    /// Move to the next alignment. Sets has_next to false at the end.
+    void advance() {
+        while (group_remaining == 0) {
+            // Each group gets a fresh CodedInputStream, for its byte limit.
+            // The old one has to give back what it read ahead first.
+            coded_in.reset();
+            coded_in.reset(new ::google::protobuf::io::CodedInputStream(&bgzip_in));
+            coded_in->SetTotalBytesLimit(stream::MAX_PROTOBUF_SIZE * 2, stream::MAX_PROTOBUF_SIZE * 2);
+            if (!coded_in->ReadVarint64((::google::protobuf::uint64*) &group_remaining)) {
+                has_next = false;
+                return;
+            }
         }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
+        uint32_t size;
+        if (!coded_in->ReadVarint32(&size) || !coded_in->ReadString(&message, size) ||
+            !key_in.read((char*) &key, sizeof(SortKey))) {
+            throw runtime_error("[vg::GAMSorter] corrupt temporary sorted run");
         }
+        group_remaining--;
+        has_next = true;
     }
-} alnsortkey;
+    
+    bool has_next = false;
+    string message;
+    SortKey key;
+    
+private:
+    ifstream gam_in;
+    ifstream key_in;
+    stream::BlockedGzipInputStream bgzip_in;
+    unique_ptr<::google::protobuf::io::CodedInputStream> coded_in;
+    uint64_t group_remaining = 0;
+};
+
+/// Merge sorted runs into the given writer. Ties go to the earlier run, so
+/// the sort stays stable.
+void merge_runs(const vector<SortedRun>& runs, GroupWriter& writer) {
+    vector<unique_ptr<RunReader>> readers;
+    // Min-heap of (key, run number)
+    typedef pair<SortKey, size_t> HeapEntry;
+    auto heap_compare = [](const HeapEntry& a, const HeapEntry& b) {
+        return b.first < a.first || (!(a.first < b.first) && b.second < a.second);
+    };
+    priority_queue<HeapEntry, vector<HeapEntry>, decltype(heap_compare)> heap(heap_compare);
+    for (size_t i = 0; i < runs.size(); i++) {
+        readers.emplace_back(new RunReader(runs[i]));
+        if (readers.back()->has_next) {
+            heap.emplace(readers.back()->key, i);
+        }
+    }
+    
+    while (!heap.empty()) {
+        size_t i = heap.top().second;
+        heap.pop();
+        RunReader& reader = *readers[i];
+        writer.add(reader.message, reader.key);
+        reader.advance();
+        if (reader.has_next) {
+            heap.emplace(reader.key, i);
+        }
+    }
+}
+
+/// Get a fresh pair of temporary files for a run
+SortedRun make_run() {
+    return SortedRun {temp_file::create("vg-gamsort-"), temp_file::create("vg-gamsort-keys-")};
+}
+
+void remove_run(const SortedRun& run) {
+    temp_file::remove(run.gam_filename);
+    temp_file::remove(run.key_filename);
+}
+
+/// Sort serialized alignments by key and write them to out, and their keys to
+/// key_out if given. Uses tasks on the current team.
+void sort_and_write(vector<string>& messages, ostream& out, ostream* key_out) {
+    vector<SortKey> keys(messages.size());
+    // Parsing is the expensive part, and every alignment is independent
+    parallel_chunks(messages.size(), 1024, [&](size_t start, size_t end) {
+        Alignment aln;
+        for (size_t i = start; i < end; i++) {
+            if (!aln.ParseFromString(messages[i])) {
+                throw runtime_error("[vg::GAMSorter] obsolete, invalid, or corrupt protobuf input");
+            }
+            keys[i] = get_sort_key(aln);
+        }
+    });
+    
+    vector<size_t> order = parallel_sort_order(keys);
+    
+    GroupWriter writer(out, key_out);
+    for (size_t i : order) {
+        writer.add(messages[i], keys[i]);
+    }
+    writer.finish();
+}
+
+double seconds_since(const chrono::steady_clock::time_point& start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+}
+
+GAMSorter::GAMSorter(bool show_progress) : show_progress(show_progress) {
+    // Nothing to do
+}
 
 void GAMSorter::sort(vector<Alignment> &alns)
 {
-    std::sort(alns.begin(), alns.end(), alnsortkey);
+    vector<SortKey> keys(alns.size());
+    for (size_t i = 0; i < alns.size(); i++) {
+        keys[i] = get_sort_key(alns[i]);
+    }
+    vector<size_t> order = parallel_sort_order(keys);
+    vector<Alignment> sorted;
+    sorted.reserve(alns.size());
+    for (size_t i : order) {
+        sorted.emplace_back(std::move(alns[i]));
+    }
+    alns = std::move(sorted);
 }
 
 void GAMSorter::paired_sort(string gamfile)
@@ -181,16 +375,6 @@ void GAMSorter::paired_sort(string gamfile)
     }
 }
 
-void GAMSorter::write_temp(vector<Alignment>& alns)
-{
-    string t_name = "tmp_sort_" + std::to_string(tmp_filenames.size());
-    tmp_filenames.push_back(t_name);
-    ofstream t_file;
-    t_file.open(t_name);
-    stream::write_buffered(t_file, alns, 0);
-    t_file.close();
-}
-
 void GAMSorter::dumb_sort(string gamfile)
 {
     std::vector<Alignment> buf;
@@ -203,7 +387,7 @@ void GAMSorter::dumb_sort(string gamfile)
     gammy.open(gamfile);
     stream::for_each(gammy, presort);
 
-    std::sort(buf.begin(), buf.end(), alnsortkey);
+    sort(buf);
 
     std::function<void(uint64_t)> x_buf_func = [&](uint64_t) {
 
@@ -215,175 +399,201 @@ void GAMSorter::dumb_sort(string gamfile)
 }
 
 void GAMSorter::stream_sort(string gamfile){
+    ifstream gam_in(gamfile, ios::binary);
+    if (!gam_in) {
+        throw runtime_error("[vg::GAMSorter] could not open " + gamfile);
+    }
+    ofstream gam_out(gamfile + ".sorted.gam", ios::binary);
+    if (!gam_out) {
+        throw runtime_error("[vg::GAMSorter] could not write " + gamfile + ".sorted.gam");
+    }
+    stream_sort(gam_in, gam_out);
+}
 
-    std::vector<Alignment> buffer;
-    buffer.reserve(1000);
-    std::function<void(Alignment&)> firstpass_bufsort = [&](Alignment& a){
-        #pragma omp critical
-        buffer.push_back(a);
-        if (buffer.size() == max_buf_size){
-                sort(buffer);
-                write_temp(buffer);
-                buffer.clear();
-        }
-    };
+void GAMSorter::stream_sort(istream& in, ostream& out) {
 
+    auto start_time = chrono::steady_clock::now();
     
-
-
-    ifstream gammy;
-    gammy.open(gamfile);
-    stream::for_each(gammy, firstpass_bufsort);
-
-    sort(buffer);
-    write_temp(buffer);
-    buffer.clear();
-
-
-
-   
-    int num_valid = tmp_filenames.size();
-    vector<bool> still_valid(tmp_filenames.size());
-    vector<uint64_t> curr_file_count (tmp_filenames.size());
-    typedef priority_queue<Alignment,std::vector<Alignment>, AlnSorter> AlnHeap;
+    // Each run gets half the budget, so one can be read while another sorts
+    size_t run_bytes = max<size_t>(1, max_buf_bytes / 2);
     
-
-    for (int i = 0; i < tmp_filenames.size(); ++i){
-        ifstream tfile;
-        tfile.open(tmp_filenames[i]);
-        tmp_files.emplace_back(&tfile);
-    }
-
-
+    vector<SortedRun> runs;
+    size_t total_count = 0;
+    size_t total_bytes = 0;
+    // Errors from inside the parallel regions, which can't throw
+    exception_ptr error;
     
-
-    vector<::google::protobuf::io::CodedInputStream*> protostreams;
-    vector<::google::protobuf::io::GzipInputStream*> zipstreams;
-
-    for (auto x : tmp_files){
-        ::google::protobuf::io::ZeroCopyInputStream *raw_in =
-          new ::google::protobuf::io::IstreamInputStream(x);
-        ::google::protobuf::io::GzipInputStream *gzip_in =
-          new ::google::protobuf::io::GzipInputStream(raw_in);
-        ::google::protobuf::io::CodedInputStream *pstream =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
-
-        protostreams.push_back(pstream);
-        zipstreams.push_back(gzip_in);
+    #pragma omp parallel default(none) shared(in, out, runs, total_count, total_bytes, error, run_bytes)
+    #pragma omp single
+    {
+        try {
+            // Phase 1: cut the input into sorted runs. The reader fills one
+            // buffer while a task sorts and writes the previous one.
+            vector<string>* buffer = new vector<string>();
+            size_t buffer_bytes = 0;
+            
+            auto dispatch = [&]() {
+                // Wait for the last run to be written before starting another
+                #pragma omp taskwait
+                SortedRun run = make_run();
+                runs.push_back(run);
+                vector<string>* to_sort = buffer;
+                #pragma omp task default(none) firstprivate(to_sort, run) shared(error)
+                {
+                    try {
+                        ofstream run_out(run.gam_filename, ios::binary);
+                        ofstream key_out(run.key_filename, ios::binary);
+                        sort_and_write(*to_sort, run_out, &key_out);
+                    } catch (...) {
+                        #pragma omp critical (gamsort_error)
+                        if (!error) {
+                            error = current_exception();
+                        }
+                    }
+                    delete to_sort;
+                }
+                buffer = new vector<string>();
+                buffer_bytes = 0;
+            };
+            
+            stream::for_each_serialized(in, [&](string& message) {
+                buffer_bytes += message.size();
+                total_bytes += message.size();
+                total_count++;
+                buffer->emplace_back(std::move(message));
+                if (buffer_bytes >= run_bytes) {
+                    dispatch();
+                }
+            });
+            
+            if (runs.empty()) {
+                // Everything fit in memory, so skip the temporary files
+                sort_and_write(*buffer, out, nullptr);
+            } else if (!buffer->empty()) {
+                dispatch();
+            }
+            #pragma omp taskwait
+            delete buffer;
+        } catch (...) {
+            #pragma omp taskwait
+            #pragma omp critical (gamsort_error)
+            if (!error) {
+                error = current_exception();
+            }
+        }
     }
-
-    std::function<bool(int)> handle_count_line = [&](int tmp_index){
-        uint64_t count;
-        protostreams[tmp_index]->ReadVarint64((::google::protobuf::uint64*) &count);
-        curr_file_count[tmp_index] = count;
-        cerr << std::to_string(count) << endl;
-        if (!count){
-            return false;
+    
+    if (error) {
+        for (auto& run : runs) {
+            remove_run(run);
         }
-        return true;
-    };
-
-    for (int i = 0; i < protostreams.size(); i++){
-        handle_count_line(i);
+        rethrow_exception(error);
     }
-
     
+    if (show_progress) {
+        double elapsed = seconds_since(start_time);
+        cerr << "[vg gamsort] read and sorted " << total_count << " alignments ("
+             << total_bytes / (1024 * 1024) << " MiB) into " << max<size_t>(runs.size(), 1)
+             << " run(s) in " << elapsed << " s: " << total_count / max(elapsed, 1e-9)
+             << " alignments/s" << endl;
+    }
     
-    std::function<bool(int, Alignment&)> read_dat_buf = [&](int tmp_index, Alignment& ret){
-
-        // Read our message of size count.
-        std::string s;
-        //for (uint64_t i = 0; i < count; ++i) {
-            (curr_file_count[tmp_index])--;
-            if (curr_file_count[tmp_index] <= 0){
-                return handle_count_line(tmp_index);
-            }
-            uint32_t msgSize = 0;
-            delete (protostreams[tmp_index]);
-            (protostreams[tmp_index]) = new ::google::protobuf::io::CodedInputStream( (zipstreams[tmp_index]));
-            // the messages are prefixed by their size
-            (protostreams[tmp_index])->ReadVarint32(&msgSize);
-            if ((msgSize > 0) &&
-                (protostreams[tmp_index]->ReadString(&s, msgSize))) {
-                ret.ParseFromString(s);
-                return true;
-            }
-        //}
-     };
-
-
-    // Heap of size (tmp_files.size())
-    AlnHeap lil_heap;
-    for(int i = 0; i < tmp_files.size(); i++){
-        Alignment a;
-        read_dat_buf(i, a);
-        lil_heap.push( a );
+    if (runs.empty()) {
+        return;
     }
-
     
-    // Rotating index within the tmp_files array,
-    // for accessing the ifstream and associated Proto readers/writers
-    int tmp_file_index = 0;
-
-    // This is just an output buffer.
-    vector<Alignment> sorted_out_buf;
-    sorted_out_buf.reserve(1000);
-
-    // Our output stream
-    string outname = gamfile + ".sorted.gam";
-    ofstream ofile;
-    ofile.open(outname);
-
-    cerr << "in the loop" << endl;
-
-    while(!lil_heap.empty()){
-
-        Alignment a;
-        bool valid = read_dat_buf(tmp_file_index, a);
-        if (valid){
-            lil_heap.push(a);
-        }
-        else{
-            //handle_count_line(tmp_file_index);
-        }
-        
-
-        
-        sorted_out_buf.push_back(lil_heap.top());
-        cerr << "writing " << lil_heap.top().name() << endl;
-        if (sorted_out_buf.size() % 100 == 0){
-            cerr << "Done " << sorted_out_buf.size() << " records" << endl;
+    // Phase 2: merge at most max_fan_in runs at a time, in as many levels as
+    // it takes, with the merges in each level running in parallel.
+    auto merge_start = chrono::steady_clock::now();
+    size_t fan_in = max<size_t>(2, max_fan_in);
+    size_t levels = 0;
+    
+    #pragma omp parallel default(none) shared(out, runs, error, fan_in, levels)
+    #pragma omp single
+    {
+        try {
+            while (runs.size() > fan_in) {
+                vector<SortedRun> merged_runs;
+                for (size_t start = 0; start < runs.size(); start += fan_in) {
+                    merged_runs.push_back(make_run());
+                }
+                parallel_chunks(runs.size(), fan_in, [&](size_t start, size_t end) {
+                    SortedRun& merged = merged_runs[start / fan_in];
+                    ofstream run_out(merged.gam_filename, ios::binary);
+                    ofstream key_out(merged.key_filename, ios::binary);
+                    GroupWriter writer(run_out, &key_out);
+                    merge_runs(vector<SortedRun>(runs.begin() + start, runs.begin() + end), writer);
+                    writer.finish();
+                });
+                for (auto& run : runs) {
+                    remove_run(run);
+                }
+                runs = std::move(merged_runs);
+                levels++;
+            }
+            
+            GroupWriter writer(out);
+            merge_runs(runs, writer);
+            writer.finish();
+            levels++;
+        } catch (...) {
+            error = current_exception();
         }
-        lil_heap.pop();
-        stream::write_buffered(ofile, sorted_out_buf, 1000);
-        tmp_file_index = (tmp_file_index + 1) % tmp_files.size();
-
     }
-    cerr << "out the loop" << endl;
-
-    // write any remaining records in our buffer
-    stream::write_buffered(ofile, sorted_out_buf, 0);
-
+    
+    for (auto& run : runs) {
+        remove_run(run);
+    }
+    
+    if (error) {
+        rethrow_exception(error);
+    }
+    
+    if (show_progress) {
+        double merge_elapsed = seconds_since(merge_start);
+        double total_elapsed = seconds_since(start_time);
+        cerr << "[vg gamsort] merged runs in " << levels << " level(s) in " << merge_elapsed << " s" << endl;
+        cerr << "[vg gamsort] sorted " << total_count << " alignments in " << total_elapsed << " s: "
+             << total_count / max(total_elapsed, 1e-9) << " alignments/s, "
+             << total_bytes / (1024.0 * 1024.0) / max(total_elapsed, 1e-9) << " MiB/s" << endl;
+    }
 }
 
 void GAMSorter::write_index(string gamfile, string outfile, bool isSorted)
 {
-
-    map<int64_t, vector<string>> node_to_alns;
-
-    std::function<void(Alignment &)> node_grabber = [&](Alignment &aln) {
-        vector<int64_t> ret;
-        Path p = aln.path();
-        for (int i = 0; i < p.mapping_size(); i++)
-        {
-            Mapping m = p.mapping(i);
-            ret.push_back(m.position().node_id());
+    ifstream gam_in(gamfile, ios::binary);
+    if (!gam_in) {
+        throw runtime_error("[vg::GAMSorter] could not open " + gamfile);
+    }
+    
+    GAMIndex index;
+    // The index works on any order, but is only compact for sorted input
+    bool warned = isSorted;
+    SortKey last_key {0, 0, 0};
+    stream::for_each_with_group_offsets<Alignment>(gam_in, [&](int64_t group_offset, Alignment& aln) {
+        if (group_offset < 0) {
+            throw runtime_error("[vg::GAMSorter] can only index BGZF-compressed GAM files; sort "
+                                + gamfile + " with this version of vg first");
         }
-        for (auto x : ret)
-        {
-            node_to_alns[x].push_back(aln.name());
+        SortKey key = get_sort_key(aln);
+        if (!warned && key < last_key) {
+            cerr << "warning:[vg::GAMSorter] " << gamfile << " is not sorted, so its index "
+                 << "will be large and queries will be slow" << endl;
+            warned = true;
         }
-    };
+        last_key = key;
+        index.add_alignment(aln, group_offset);
+    });
+    
+    ofstream index_out(outfile, ios::binary);
+    if (!index_out) {
+        throw runtime_error("[vg::GAMSorter] could not write " + outfile);
+    }
+    index.save(index_out);
+    
+    if (show_progress) {
+        cerr << "[vg gamsort] wrote index " << outfile << " with " << index.chunk_count() << " chunks" << endl;
+    }
 }
 
 bool GAMSorter::min_aln_first(Alignment &a, Alignment &b)
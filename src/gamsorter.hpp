@@ -34,18 +34,34 @@ class GAMSorter
 
   
   public:
+    /// Make a sorter. If show_progress is set, stream_sort reports how long
+    /// each stage took and how fast it went on stderr.
+    GAMSorter(bool show_progress = false);
+
+    /// Bytes of serialized alignments stream_sort may hold in memory at once.
+    /// Half goes to the run being read and half to the run being sorted.
+    size_t max_buf_bytes = 2048UL * 1024 * 1024;
+
+    /// Most sorted runs to merge together in one pass. More runs than this are
+    /// merged in several levels.
+    size_t max_fan_in = 64;
+
     // vector<Alignment> merge(vector<vector<Alignment>> a);
 
     // void merge(map<int, vector<Alignment>> m, map<int, int> split_to_sz);
 
+    /// Sort alignments in memory, stably, by their sort keys.
     void sort(vector<Alignment>& alns);
 
     void paired_sort(string gamfile);
 
-    void write_temp(vector<Alignment>& alns);
-
+    /// Sort a GAM file into <gamfile>.sorted.gam.
     void stream_sort(string gamfile);
 
+    /// Sort the GAM on in, writing the result to out. Sorted runs beyond the
+    /// memory budget are kept in temporary files in temp_file's directory.
+    void stream_sort(istream& in, ostream& out);
+
     void dumb_sort(string gamfile);
 
     // vector<Alignment> split(vector<Alignment> a, int s);
@@ -56,6 +72,9 @@ class GAMSorter
 
     Position get_min_position(Path p);
 
+    /// Write a GAMIndex for a BGZF GAM file, which should be sorted, to
+    /// outfile. Warns if the file turns out not to be sorted, unless isSorted
+    /// promises that it is.
     void write_index(string gamfile, string outfile, bool isSorted = false);
 
     bool equal_to(Position a, Position b);
@@ -65,10 +84,8 @@ class GAMSorter
     bool greater_than(Position a, Position b);
 
   private:
+    bool show_progress;
     map<int, int> split_to_split_size;
-    vector<string> tmp_filenames;
-    vector<ifstream*> tmp_files;
-    int max_buf_size = 20000;
     /**
     * We want to keep pairs together, with the lowest-coordinate pair coming first.
     * If one read is unmapped, it follows its partner in the sorted GAM file.
@@ -0,0 +1,368 @@
+/**
+ * \file gfa.cpp
+ * Implementation of streaming GFA1 input and output.
+ */
+
+#include "gfa.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <tuple>
+#include <cstdlib>
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// A segment name in a parsed block that isn't a number, and so has to be
+/// given an ID in file order once the block's turn comes.
+struct NameReference {
+    enum Kind {NODE, EDGE_FROM, EDGE_TO, MAPPING};
+    Kind kind;
+    /// The node or edge index, or the path index for a mapping
+    size_t index;
+    /// The mapping index in the path
+    size_t mapping;
+    string name;
+};
+
+/// A block of GFA lines and what was parsed from it
+struct GFABlock {
+    string text;
+    Graph graph;
+    vector<NameReference> references;
+    /// The first malformed line, if any
+    string bad_line;
+};
+
+/// Split a line on tabs, into views of the line
+void split_tabs(const char* begin, const char* end, vector<pair<const char*, const char*>>& fields) {
+    fields.clear();
+    const char* field_start = begin;
+    for (const char* c = begin; c != end; ++c) {
+        if (*c == '\t') {
+            fields.emplace_back(field_start, c);
+            field_start = c + 1;
+        }
+    }
+    fields.emplace_back(field_start, end);
+}
+
+/// Get the ID for a numeric segment name, or 0 if it isn't a number
+id_t numeric_id(const string& name) {
+    return is_number(name) ? stoll(name) : 0;
+}
+
+/// Parse an orientation field, or return false if it isn't one
+bool parse_orientation(const string& field, bool& is_reverse) {
+    if (field == "+" || field == "-") {
+        is_reverse = (field == "-");
+        return true;
+    }
+    return false;
+}
+
+/// Parse the lines of a block into its graph. Stops at the first malformed
+/// line, which is saved in bad_line.
+void parse_block(GFABlock& block) {
+    Graph& graph = block.graph;
+    vector<pair<const char*, const char*>> views;
+    vector<string> fields;
+
+    // Name a segment on a node, edge, or mapping, deferring non-numeric names
+    auto reference = [&](NameReference::Kind kind, size_t index, size_t mapping, const string& name) -> id_t {
+        id_t id = numeric_id(name);
+        if (id == 0) {
+            block.references.push_back(NameReference{kind, index, mapping, name});
+        }
+        return id;
+    };
+
+    const char* line_start = block.text.data();
+    const char* text_end = line_start + block.text.size();
+    while (line_start < text_end) {
+        const char* line_end = find(line_start, text_end, '\n');
+        const char* content_end = line_end;
+        if (content_end != line_start && *(content_end - 1) == '\r') {
+            --content_end;
+        }
+        auto bad = [&]() {
+            block.bad_line = string(line_start, content_end);
+        };
+
+        if (content_end != line_start && (*line_start == 'S' || *line_start == 'L' || *line_start == 'P')) {
+            split_tabs(line_start, content_end, views);
+            fields.clear();
+            for (auto& view : views) {
+                fields.emplace_back(view.first, view.second);
+            }
+
+            if (fields[0] == "S") {
+                // S name sequence [tags]
+                if (fields.size() < 3) {
+                    bad();
+                    return;
+                }
+                Node* node = graph.add_node();
+                node->set_id(reference(NameReference::NODE, graph.node_size() - 1, 0, fields[1]));
+                node->set_name(fields[1]);
+                if (fields[2] != "*") {
+                    node->set_sequence(fields[2]);
+                }
+            } else if (fields[0] == "L") {
+                // L from from_orient to to_orient overlap [tags]
+                bool from_start, to_end;
+                if (fields.size() < 6 || !parse_orientation(fields[2], from_start)
+                    || !parse_orientation(fields[4], to_end)) {
+                    bad();
+                    return;
+                }
+                size_t index = graph.edge_size();
+                Edge* edge = graph.add_edge();
+                edge->set_from(reference(NameReference::EDGE_FROM, index, 0, fields[1]));
+                edge->set_from_start(from_start);
+                edge->set_to(reference(NameReference::EDGE_TO, index, 0, fields[3]));
+                edge->set_to_end(to_end);
+                // Only a single match operation is an overlap we can use
+                const string& cigar = fields[5];
+                if (cigar.size() > 1 && cigar.back() == 'M' && is_number(cigar.substr(0, cigar.size() - 1))) {
+                    size_t overlap = stoull(cigar.substr(0, cigar.size() - 1));
+                    if (overlap > 0) {
+                        edge->set_overlap(overlap);
+                    }
+                }
+            } else if (fields[0] == "P") {
+                bool is_reverse;
+                if ((fields.size() == 5 && parse_orientation(fields[3], is_reverse))
+                    || (fields.size() == 6 && is_number(fields[3]) && parse_orientation(fields[4], is_reverse))) {
+                    // The old one-step form: P segment path [rank] orientation overlap
+                    size_t path_index = graph.path_size();
+                    Path* path = graph.add_path();
+                    path->set_name(fields[2]);
+                    Mapping* mapping = path->add_mapping();
+                    mapping->mutable_position()->set_node_id(reference(NameReference::MAPPING, path_index, 0, fields[1]));
+                    mapping->mutable_position()->set_is_reverse(is_reverse);
+                    if (fields.size() == 6) {
+                        mapping->set_rank(stoll(fields[3]));
+                    }
+                } else if (fields.size() >= 4) {
+                    // P name segment+,segment-,... overlaps [tags]
+                    size_t path_index = graph.path_size();
+                    Path* path = graph.add_path();
+                    path->set_name(fields[1]);
+                    const string& steps = fields[2];
+                    size_t step_start = 0;
+                    while (step_start < steps.size()) {
+                        size_t step_end = steps.find(',', step_start);
+                        if (step_end == string::npos) {
+                            step_end = steps.size();
+                        }
+                        if (step_end - step_start < 2
+                            || !parse_orientation(steps.substr(step_end - 1, 1), is_reverse)) {
+                            bad();
+                            return;
+                        }
+                        Mapping* mapping = path->add_mapping();
+                        mapping->mutable_position()->set_node_id(reference(NameReference::MAPPING, path_index,
+                            path->mapping_size() - 1, steps.substr(step_start, step_end - step_start - 1)));
+                        mapping->mutable_position()->set_is_reverse(is_reverse);
+                        step_start = step_end + 1;
+                    }
+                } else {
+                    bad();
+                    return;
+                }
+            }
+        }
+
+        line_start = line_end + 1;
+    }
+}
+
+}
+
+void for_each_gfa_chunk(istream& in, const function<void(Graph&)>& lambda, size_t block_bytes) {
+
+    // Segment names that aren't numbers get IDs in order of first appearance
+    unordered_map<string, id_t> id_by_name;
+    id_t next_id = 1;
+    auto id_for_name = [&](const string& name) {
+        auto found = id_by_name.find(name);
+        if (found == id_by_name.end()) {
+            found = id_by_name.emplace(name, next_id++).first;
+        }
+        return found->second;
+    };
+    // How many steps we've seen in each path, to rank unranked steps
+    unordered_map<string, int64_t> path_length;
+
+    size_t batch_size = 2 * omp_get_max_threads();
+    vector<GFABlock> batch;
+
+    while (in) {
+        // Read a batch of line-aligned blocks
+        batch.clear();
+        while (batch.size() < batch_size && in) {
+            batch.emplace_back();
+            string& text = batch.back().text;
+            text.resize(block_bytes);
+            in.read(&text[0], block_bytes);
+            text.resize(in.gcount());
+            string rest;
+            if (!text.empty() && text.back() != '\n' && getline(in, rest)) {
+                text.append(rest);
+                text.push_back('\n');
+            }
+            if (text.empty()) {
+                batch.pop_back();
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            parse_block(batch[i]);
+            // We're done with the text
+            string().swap(batch[i].text);
+        }
+
+        // Hand back the blocks in order, now that we can name their segments
+        for (auto& block : batch) {
+            if (!block.bad_line.empty()) {
+                cerr << "[vg] error: malformed GFA line " << endl << block.bad_line << endl;
+                exit(1);
+            }
+
+            Graph& graph = block.graph;
+            for (auto& ref : block.references) {
+                id_t id = id_for_name(ref.name);
+                switch (ref.kind) {
+                case NameReference::NODE:
+                    graph.mutable_node(ref.index)->set_id(id);
+                    break;
+                case NameReference::EDGE_FROM:
+                    graph.mutable_edge(ref.index)->set_from(id);
+                    break;
+                case NameReference::EDGE_TO:
+                    graph.mutable_edge(ref.index)->set_to(id);
+                    break;
+                case NameReference::MAPPING:
+                    graph.mutable_path(ref.index)->mutable_mapping(ref.mapping)->mutable_position()->set_node_id(id);
+                    break;
+                }
+            }
+
+            for (auto& path : *graph.mutable_path()) {
+                int64_t& length = path_length[path.name()];
+                for (auto& mapping : *path.mutable_mapping()) {
+                    if (mapping.rank() == 0) {
+                        mapping.set_rank(++length);
+                    } else {
+                        length = max(length, mapping.rank());
+                    }
+                }
+            }
+
+            lambda(graph);
+        }
+    }
+}
+
+void write_gfa_header(ostream& out) {
+    out << "H\tVN:Z:1.0" << "\n";
+}
+
+void write_gfa_nodes_and_edges(const Graph& graph, ostream& out) {
+    // Sort so that the same graph always gives the same GFA, however its
+    // nodes and edges happen to be stored
+    vector<const Node*> nodes;
+    nodes.reserve(graph.node_size());
+    for (auto& node : graph.node()) {
+        nodes.push_back(&node);
+    }
+    sort(nodes.begin(), nodes.end(), [](const Node* a, const Node* b) {
+        return a->id() < b->id();
+    });
+    vector<const Edge*> edges;
+    edges.reserve(graph.edge_size());
+    for (auto& edge : graph.edge()) {
+        edges.push_back(&edge);
+    }
+    sort(edges.begin(), edges.end(), [](const Edge* a, const Edge* b) {
+        return make_tuple(a->from(), a->from_start(), a->to(), a->to_end())
+            < make_tuple(b->from(), b->from_start(), b->to(), b->to_end());
+    });
+
+    for (auto* node : nodes) {
+        out << "S\t" << node->id() << "\t" << node->sequence() << "\n";
+    }
+    for (auto* edge : edges) {
+        out << "L\t" << edge->from() << "\t" << (edge->from_start() ? "-" : "+") << "\t"
+            << edge->to() << "\t" << (edge->to_end() ? "-" : "+") << "\t" << edge->overlap() << "M" << "\n";
+    }
+}
+
+void write_gfa_path(const string& name, const vector<pair<id_t, bool>>& steps, ostream& out) {
+    if (steps.empty()) {
+        return;
+    }
+    out << "P\t" << name << "\t";
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (i != 0) {
+            out << ",";
+        }
+        out << steps[i].first << (steps[i].second ? "-" : "+");
+    }
+    out << "\t*" << "\n";
+}
+
+void graph_stream_to_gfa(istream& in, ostream& out) {
+    write_gfa_header(out);
+
+    // The steps of each path, with their ranks, as they come in
+    map<string, vector<pair<int64_t, pair<id_t, bool>>>> path_steps;
+
+    function<void(vector<Graph>&)> lambda = [&](vector<Graph>& batch) {
+        vector<string> formatted(batch.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            stringstream s;
+            write_gfa_nodes_and_edges(batch[i], s);
+            formatted[i] = s.str();
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            out << formatted[i];
+            for (auto& path : batch[i].path()) {
+                auto& steps = path_steps[path.name()];
+                for (auto& mapping : path.mapping()) {
+                    steps.emplace_back(mapping.rank(), make_pair(mapping.position().node_id(),
+                                                                 mapping.position().is_reverse()));
+                }
+            }
+        }
+    };
+    stream::for_each_batch(in, lambda);
+
+    for (auto& name_and_steps : path_steps) {
+        auto& ranked = name_and_steps.second;
+        // Mappings from any chunk can fall anywhere in the path
+        stable_sort(ranked.begin(), ranked.end(), [](const pair<int64_t, pair<id_t, bool>>& a,
+                                                     const pair<int64_t, pair<id_t, bool>>& b) {
+            return a.first < b.first;
+        });
+        vector<pair<id_t, bool>> steps;
+        steps.reserve(ranked.size());
+        for (auto& step : ranked) {
+            steps.push_back(step.second);
+        }
+        write_gfa_path(name_and_steps.first, steps, out);
+    }
+}
+
+}
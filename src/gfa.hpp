@@ -0,0 +1,62 @@
+#ifndef VG_GFA_HPP_INCLUDED
+#define VG_GFA_HPP_INCLUDED
+
+/**
+ * \file gfa.hpp
+ *
+ * Streaming conversion between GFA1 and Graph chunks. The reader parses
+ * blocks of lines on many threads and hands back Graph chunks in file order,
+ * ready for VG::extend or XG::from_callback. The writer formats Graph chunks
+ * as they come and only holds on to the paths.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Read GFA1 S, L, and P records from a stream, and call the lambda with a
+ * Graph chunk for each block of about block_bytes of input, in file order.
+ * Blocks are parsed in parallel, a batch at a time, so only a batch of blocks
+ * is ever in memory.
+ *
+ * Segments with numeric names keep them as IDs. Other names are given IDs
+ * from 1 up in order of first appearance, and are kept as node names. Links
+ * with a single nM CIGAR keep it as the edge overlap. Paths can be GFA1 P
+ * lines or the older one-line-per-step form; their mappings are ranked in
+ * file order unless the step gives a rank. Edges and path steps may refer to
+ * segments in other chunks. Other record types are ignored.
+ *
+ * Exits with an error message on a malformed line.
+ */
+void for_each_gfa_chunk(istream& in, const function<void(Graph&)>& lambda,
+                        size_t block_bytes = 1 << 22);
+
+/// Write the GFA1 header line.
+void write_gfa_header(ostream& out);
+
+/// Write S lines for the nodes of a graph, in ID order, and then L lines for
+/// its edges, sorted by their ends.
+void write_gfa_nodes_and_edges(const Graph& graph, ostream& out);
+
+/// Write a P line for a path, given as (node ID, is_reverse) steps. Empty
+/// paths have no GFA1 representation and are skipped.
+void write_gfa_path(const string& name, const vector<pair<id_t, bool>>& steps, ostream& out);
+
+/// Convert a stream of Graph chunks, as from a .vg file, to GFA1. Chunks are
+/// formatted in parallel and written in order; only the paths are held until
+/// the end.
+void graph_stream_to_gfa(istream& in, ostream& out);
+
+}
+
+#endif
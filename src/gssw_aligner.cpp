@@ -1,4 +1,5 @@
 #include "gssw_aligner.hpp"
+#include "striped_aligner.hpp"
 #include "json2pb.h"
 
 static const double quality_scale_factor = 10.0 / log(10.0);
@@ -1002,6 +1003,12 @@ void Aligner::align(Alignment& alignment, Graph& g, bool traceback_aln, bool pri
     align_internal(alignment, nullptr, g, false, false, 1, traceback_aln, print_score_matrices);
 }
 
+void Aligner::align(Alignment& alignment, const HandleGraph& g, bool traceback_aln) {
+    
+    StripedGraphAligner striped(score_matrix, nt_table, gap_open, gap_extension, full_length_bonus);
+    striped.align(alignment, g, traceback_aln);
+}
+
 void Aligner::align_pinned(Alignment& alignment, Graph& g, bool pin_left) {
     
     align_internal(alignment, nullptr, g, true, pin_left, 1, true, false);
@@ -1418,6 +1425,12 @@ void QualAdjAligner::align(Alignment& alignment, Graph& g, bool traceback_aln, b
     align_internal(alignment, nullptr, g, false, false, 1, traceback_aln, print_score_matrices);
 }
 
+void QualAdjAligner::align(Alignment& alignment, const HandleGraph& g, bool traceback_aln) {
+    
+    StripedGraphAligner striped(score_matrix, nt_table, gap_open, gap_extension, full_length_bonus, true);
+    striped.align(alignment, g, traceback_aln);
+}
+
 void QualAdjAligner::align_pinned(Alignment& alignment, Graph& g, bool pin_left) {
 
     align_internal(alignment, nullptr, g, true, pin_left, 1, true, false);
@@ -1432,11 +1445,11 @@ void QualAdjAligner::align_pinned_multi(Alignment& alignment, vector<Alignment>&
 void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
                                          int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
+    BandedGlobalAligner<int16_t> band_graph(alignment,
+                                            g,
+                                            band_padding,
+                                            permissive_banding,
+                                            true);
     
     band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
 }
@@ -1444,13 +1457,13 @@ void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
 void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           alt_alignments,
-                                                                           max_alt_alns,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
+    BandedGlobalAligner<int16_t> band_graph(alignment,
+                                            g,
+                                            alt_alignments,
+                                            max_alt_alns,
+                                            band_padding,
+                                            permissive_banding,
+                                            true);
     
     band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
 }
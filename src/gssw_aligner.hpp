@@ -15,6 +15,7 @@
 #include "path.hpp"
 #include "utility.hpp"
 #include "banded_global_aligner.hpp"
+#include "handle.hpp"
 
 namespace vg {
 
@@ -84,6 +85,12 @@ namespace vg {
         /// Assumes that graph is topologically sorted by node index.
         virtual void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices) = 0;
         
+        /// Store optimal local alignment against a directed acyclic HandleGraph in the Alignment object,
+        /// using the striped SIMD graph aligner instead of gssw. Scores the same way as the Graph version,
+        /// but reads the graph directly instead of needing it converted. Edges that would make a cycle are
+        /// ignored.
+        virtual void align(Alignment& alignment, const HandleGraph& g, bool traceback_aln) = 0;
+        
         // store optimal alignment against a graph in the Alignment object with one end of the sequence
         // guaranteed to align to a source/sink node
         //
@@ -250,6 +257,10 @@ namespace vg {
         /// Assumes that graph is topologically sorted by node index.
         void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices);
         
+        /// Store optimal local alignment against a directed acyclic HandleGraph in the Alignment object,
+        /// using the striped SIMD graph aligner.
+        void align(Alignment& alignment, const HandleGraph& g, bool traceback_aln);
+        
         // store optimal alignment against a graph in the Alignment object with one end of the sequence
         // guaranteed to align to a source/sink node
         //
@@ -315,6 +326,7 @@ namespace vg {
 
         // base quality adjusted counterparts to functions of same name from Aligner
         void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices);
+        void align(Alignment& alignment, const HandleGraph& g, bool traceback_aln);
         void align_global_banded(Alignment& alignment, Graph& g,
                                  int32_t band_padding = 0, bool permissive_banding = true);
         void align_pinned(Alignment& alignment, Graph& g, bool pin_left);
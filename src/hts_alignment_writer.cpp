@@ -0,0 +1,310 @@
+/**
+ * \file hts_alignment_writer.cpp
+ * Implementation of threaded, optionally sorted, SAM/BAM/CRAM output.
+ */
+
+#include "hts_alignment_writer.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+#include <stdexcept>
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// Read a SAM header from its text
+bam_hdr_t* parse_header(const string& header) {
+    string sam = "data:," + header;
+    samFile *in = sam_open(sam.c_str(), "r");
+    bam_hdr_t *h = sam_hdr_read(in);
+    sam_close(in);
+    return h;
+}
+
+}
+
+HTSAlignmentWriter::HTSAlignmentWriter(const string& format, const map<string, int64_t>& path_length,
+                                       int compress_level, int thread_count, bool sort_by_position,
+                                       size_t max_sort_bytes, const string& filename) :
+    format(format), path_length(path_length), compress_level(compress_level), thread_count(thread_count),
+    sort_by_position(sort_by_position), max_sort_bytes(max_sort_bytes), filename(filename) {
+
+    if (format != "sam" && format != "bam" && format != "cram") {
+        throw runtime_error("Unknown HTS output format: " + format);
+    }
+    if (compress_level < -1 || compress_level > 9) {
+        throw runtime_error("HTS compression level must be from 0 to 9");
+    }
+
+    pool.pool = hts_tpool_init(max(thread_count, 1));
+    if (pool.pool == nullptr) {
+        cerr << "[vg::hts_alignment_writer] error: could not start compression threads" << endl;
+        exit(1);
+    }
+}
+
+HTSAlignmentWriter::~HTSAlignmentWriter() {
+    finish();
+}
+
+void HTSAlignmentWriter::write(vector<Surjector::surjection_t>& surjected, bool paired) {
+
+    if (paired && surjected.size() % 2 != 0) {
+        throw runtime_error("Paired HTS output needs an even number of alignments");
+    }
+
+    {
+        lock_guard<mutex> lock(output_mutex);
+        if (out == nullptr) {
+            open(surjected);
+        }
+    }
+
+    // Compute all the CIGARs first, since they can move the positions that
+    // the mates refer to
+    vector<string> cigars(surjected.size());
+#pragma omp parallel for schedule(dynamic, 64) if (!omp_in_parallel())
+    for (size_t i = 0; i < surjected.size(); i++) {
+        auto& s = surjected[i];
+        if (!get<0>(s).empty()) {
+            cigars[i] = cigar_against_path(get<3>(s), get<2>(s), get<1>(s), path_length.at(get<0>(s)), 0);
+        }
+    }
+
+    vector<bam1_t*> records(surjected.size());
+#pragma omp parallel for schedule(dynamic, 64) if (!omp_in_parallel())
+    for (size_t i = 0; i < surjected.size(); i++) {
+        auto& s = surjected[i];
+        if (paired) {
+            // Mates are next to each other
+            auto& mate = surjected[i ^ 1];
+            // TODO: compute template length based on
+            // pair distance and alignment content.
+            int template_length = 0;
+            records[i] = alignment_to_bam(hdr, get<3>(s), get<0>(s), get<1>(s), get<2>(s), cigars[i],
+                                          get<0>(mate), get<1>(mate), template_length);
+        } else {
+            records[i] = alignment_to_bam(hdr, get<3>(s), get<0>(s), get<1>(s), get<2>(s), cigars[i]);
+        }
+    }
+
+    lock_guard<mutex> lock(output_mutex);
+    if (sort_by_position) {
+        for (bam1_t* record : records) {
+            sort_buffer.push_back(record);
+            sort_buffer_bytes += sizeof(bam1_t) + record->m_data;
+        }
+        if (sort_buffer_bytes > max_sort_bytes) {
+            spill();
+        }
+    } else {
+        for (bam1_t* record : records) {
+            write_record(out, record);
+            bam_destroy1(record);
+        }
+    }
+}
+
+void HTSAlignmentWriter::finish() {
+    lock_guard<mutex> lock(output_mutex);
+    if (finished) {
+        return;
+    }
+    finished = true;
+
+    // Make sure there's a header even if there were no reads
+    if (out == nullptr) {
+        open(vector<Surjector::surjection_t>());
+    }
+
+    if (sort_by_position) {
+        merge();
+    }
+
+    if (sam_close(out) != 0) {
+        cerr << "[vg::hts_alignment_writer] error: failed to finish writing HTS output" << endl;
+        exit(1);
+    }
+    out = nullptr;
+    bam_hdr_destroy(hdr);
+    hdr = nullptr;
+    hts_tpool_destroy(pool.pool);
+    pool.pool = nullptr;
+}
+
+void HTSAlignmentWriter::open(const vector<Surjector::surjection_t>& surjected) {
+
+    // We don't know the read groups ahead of time, so we take the ones in the
+    // first batch
+    map<string, string> rg_sample;
+    for (auto& s : surjected) {
+        const Alignment& surj = get<3>(s);
+        if (!surj.read_group().empty() && !surj.sample_name().empty()) {
+            rg_sample[surj.read_group()] = surj.sample_name();
+        }
+    }
+
+    string header;
+    hdr = hts_string_header(header, path_length, rg_sample);
+    if (sort_by_position) {
+        // Say that the records are sorted
+        size_t sort_order = header.find("SO:unknown");
+        if (sort_order != string::npos) {
+            header.replace(sort_order, string("SO:unknown").size(), "SO:coordinate");
+            bam_hdr_destroy(hdr);
+            hdr = parse_header(header);
+        }
+    }
+    // Build the reference name lookup table now, so that record conversion
+    // on many threads only ever reads it
+    bam_name2id(hdr, "");
+
+    string mode = "w";
+    if (format == "bam") {
+        mode += "b";
+    } else if (format == "cram") {
+        mode += "c";
+    }
+    if (format != "sam" && compress_level >= 0) {
+        mode += to_string(compress_level);
+    }
+
+    if ((out = sam_open(filename.c_str(), mode.c_str())) == 0) {
+        cerr << "[vg::hts_alignment_writer] error: failed to open " << (filename == "-" ? "stdout" : filename)
+             << " for writing HTS output" << endl;
+        exit(1);
+    }
+    hts_set_opt(out, HTS_OPT_THREAD_POOL, &pool);
+    if (sam_hdr_write(out, hdr) != 0) {
+        cerr << "[vg::hts_alignment_writer] error: failed to write the SAM header" << endl;
+        exit(1);
+    }
+}
+
+void HTSAlignmentWriter::write_record(samFile* file, bam1_t* record) {
+    if (sam_write1(file, hdr, record) < 0) {
+        cerr << "[vg::hts_alignment_writer] error: writing HTS output failed" << endl;
+        exit(1);
+    }
+}
+
+bool HTSAlignmentWriter::position_less(const bam1_t* a, const bam1_t* b) {
+    // Unplaced reads have tid -1, which comes last as an unsigned number
+    return make_tuple((uint32_t) a->core.tid, a->core.pos, bam_is_rev(a))
+        < make_tuple((uint32_t) b->core.tid, b->core.pos, bam_is_rev(b));
+}
+
+void HTSAlignmentWriter::spill() {
+    stable_sort(sort_buffer.begin(), sort_buffer.end(), position_less);
+
+    // Runs only live until the merge, so spend little time compressing them
+    string run = temp_file::create("vg-hts-sort-");
+    samFile* file = sam_open(run.c_str(), "wb1");
+    if (file == nullptr) {
+        cerr << "[vg::hts_alignment_writer] error: failed to open temporary file " << run << endl;
+        exit(1);
+    }
+    hts_set_opt(file, HTS_OPT_THREAD_POOL, &pool);
+    if (sam_hdr_write(file, hdr) != 0) {
+        cerr << "[vg::hts_alignment_writer] error: failed to write to temporary file " << run << endl;
+        exit(1);
+    }
+    for (bam1_t* record : sort_buffer) {
+        write_record(file, record);
+        bam_destroy1(record);
+    }
+    if (sam_close(file) != 0) {
+        cerr << "[vg::hts_alignment_writer] error: failed to write to temporary file " << run << endl;
+        exit(1);
+    }
+
+    sorted_runs.push_back(run);
+    sort_buffer.clear();
+    sort_buffer_bytes = 0;
+}
+
+void HTSAlignmentWriter::merge() {
+    stable_sort(sort_buffer.begin(), sort_buffer.end(), position_less);
+
+    // Open the spilled runs. What's still in memory was written last, so it
+    // acts as the last run.
+    vector<samFile*> runs;
+    vector<bam1_t*> heads;
+    for (auto& run : sorted_runs) {
+        samFile* file = sam_open(run.c_str(), "r");
+        if (file == nullptr) {
+            cerr << "[vg::hts_alignment_writer] error: failed to reopen temporary file " << run << endl;
+            exit(1);
+        }
+        hts_set_opt(file, HTS_OPT_THREAD_POOL, &pool);
+        // The runs have our header, so we can skip theirs
+        bam_hdr_destroy(sam_hdr_read(file));
+        runs.push_back(file);
+        heads.push_back(bam_init1());
+    }
+    size_t memory_run = runs.size();
+    size_t memory_next = 0;
+
+    auto head = [&](size_t run) -> bam1_t* {
+        return run == memory_run ? sort_buffer[memory_next] : heads[run];
+    };
+    // Move a run on to its next record, and return false if it has run out
+    auto advance = [&](size_t run) -> bool {
+        if (run == memory_run) {
+            return memory_next < sort_buffer.size();
+        }
+        int status = sam_read1(runs[run], hdr, heads[run]);
+        if (status < -1) {
+            cerr << "[vg::hts_alignment_writer] error: failed to read temporary file " << sorted_runs[run] << endl;
+            exit(1);
+        }
+        return status >= 0;
+    };
+
+    // Take records in position order, and in run order at the same position,
+    // so ties stay in the order they were written
+    auto later = [&](size_t a, size_t b) {
+        bam1_t* record_a = head(a);
+        bam1_t* record_b = head(b);
+        if (position_less(record_b, record_a)) {
+            return true;
+        }
+        return !position_less(record_a, record_b) && a > b;
+    };
+    priority_queue<size_t, vector<size_t>, decltype(later)> queue(later);
+    for (size_t run = 0; run <= memory_run; run++) {
+        if (advance(run)) {
+            queue.push(run);
+        }
+    }
+
+    while (!queue.empty()) {
+        size_t run = queue.top();
+        queue.pop();
+        write_record(out, head(run));
+        if (run == memory_run) {
+            bam_destroy1(sort_buffer[memory_next]);
+            memory_next++;
+        }
+        if (advance(run)) {
+            queue.push(run);
+        }
+    }
+
+    for (size_t i = 0; i < runs.size(); i++) {
+        sam_close(runs[i]);
+        bam_destroy1(heads[i]);
+        temp_file::remove(sorted_runs[i]);
+    }
+    sorted_runs.clear();
+    sort_buffer.clear();
+    sort_buffer_bytes = 0;
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef VG_HTS_ALIGNMENT_WRITER_HPP_INCLUDED
+#define VG_HTS_ALIGNMENT_WRITER_HPP_INCLUDED
+
+/**
+ * \file hts_alignment_writer.hpp
+ *
+ * SAM/BAM/CRAM output for surjected alignments, shared by the commands that
+ * can write them. Records are built on the threads that hand them over, and
+ * compression runs on an htslib thread pool, so the only serialized work is
+ * queueing finished records for the compressor.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "alignment.hpp"
+#include "surjector.hpp"
+#include "htslib/thread_pool.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Writes surjected alignments to a SAM, BAM, or CRAM file. The header lists
+ * the given paths as reference sequences, and the read groups of the first
+ * alignments written.
+ *
+ * write() may be called from many threads at once. Called from outside of a
+ * parallel region, it converts the batch to BAM records in parallel itself.
+ *
+ * Output is in the order batches are written unless sorting by position is
+ * on. Then records are buffered, sorted, and spilled to temporary BAM files
+ * when the buffer gets too big; finish() merges the spilled runs into the
+ * output. Records at the same position stay in the order they were written.
+ */
+class HTSAlignmentWriter {
+public:
+
+    /// Set up to write the given format ("sam", "bam", or "cram") to the given
+    /// file, or to stdout for "-". The compression level is from 0 to 9, or
+    /// -1 for htslib's default. Compression uses a pool of the given number
+    /// of threads. When sorting, up to max_sort_bytes of records are held in
+    /// memory at once. Nothing is written until the first batch, or finish().
+    /// Throws if the format is not known.
+    HTSAlignmentWriter(const string& format, const map<string, int64_t>& path_length,
+                       int compress_level = -1, int thread_count = 1, bool sort_by_position = false,
+                       size_t max_sort_bytes = 512 * 1024 * 1024, const string& filename = "-");
+
+    /// Finish writing, if that hasn't been done already.
+    ~HTSAlignmentWriter();
+
+    HTSAlignmentWriter(const HTSAlignmentWriter& other) = delete;
+    HTSAlignmentWriter& operator=(const HTSAlignmentWriter& other) = delete;
+
+    /// Write a batch of surjected alignments. If paired is set, the batch
+    /// holds pairs of mates one after the other, and each record refers to
+    /// its mate. CIGAR computation may adjust the positions in the batch.
+    void write(vector<Surjector::surjection_t>& surjected, bool paired = false);
+
+    /// Write out anything buffered and close the output. No more batches may
+    /// be written after this.
+    void finish();
+
+private:
+
+    /// Make the header and open the output, using the read groups of the
+    /// given batch. Must be called with the output mutex held.
+    void open(const vector<Surjector::surjection_t>& surjected);
+
+    /// Write a record to a file, exiting on an error
+    void write_record(samFile* file, bam1_t* record);
+
+    /// Sort the buffered records and write them out as a run in a temporary
+    /// file. Must be called with the output mutex held.
+    void spill();
+
+    /// Sort the buffered records and write them, together with any spilled
+    /// runs, to the output.
+    void merge();
+
+    /// True if a sorts before b in coordinate order, with unplaced reads last
+    static bool position_less(const bam1_t* a, const bam1_t* b);
+
+    string format;
+    map<string, int64_t> path_length;
+    int compress_level;
+    int thread_count;
+    bool sort_by_position;
+    size_t max_sort_bytes;
+    string filename;
+
+    /// Guards the output, the header, and the sort buffer
+    mutex output_mutex;
+
+    samFile* out = nullptr;
+    bam_hdr_t* hdr = nullptr;
+    /// The compression threads, shared by the output and the sort runs
+    htsThreadPool pool = {nullptr, 0};
+    bool finished = false;
+
+    /// Records waiting to be sorted, and about how much memory they use
+    vector<bam1_t*> sort_buffer;
+    size_t sort_buffer_bytes = 0;
+    /// Temporary files holding sorted runs of records
+    vector<string> sorted_runs;
+};
+
+}
+
+#endif
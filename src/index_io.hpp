@@ -0,0 +1,112 @@
+#ifndef VG_INDEX_IO_HPP_INCLUDED
+#define VG_INDEX_IO_HPP_INCLUDED
+
+/**
+ * \file index_io.hpp
+ *
+ * Helpers for the simple binary formats of vg's own small indexes: a magic
+ * number and version, then fixed-width values and vectors of them, in host
+ * byte order.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Describes one binary index format, so errors can say what was being read.
+ */
+struct IndexFormat {
+    /// The 4 magic bytes that start the file
+    const char* magic;
+    /// The newest version we write. Versions 1 through this can be read.
+    uint32_t version;
+    /// Who is reading, like "vg::GAMIndex"
+    const char* owner;
+    /// What is being read, like "GAM index"
+    const char* description;
+
+    /// Throw a runtime_error about the file, like "[vg::GAMIndex] truncated GAM index".
+    [[noreturn]] void fail(const string& problem) const {
+        throw runtime_error(string("[") + owner + "] " + problem + " " + description);
+    }
+};
+
+/// Write a fixed-width value
+template<typename T>
+void write_raw(ostream& out, const T& value) {
+    out.write((const char*) &value, sizeof(T));
+}
+
+/// Read a fixed-width value. Throws if the stream runs out.
+template<typename T>
+T read_raw(istream& in, const IndexFormat& format) {
+    T value;
+    if (!in.read((char*) &value, sizeof(T))) {
+        format.fail("truncated");
+    }
+    return value;
+}
+
+/// Write a vector of fixed-width values, preceded by its length
+template<typename T>
+void write_vector(ostream& out, const vector<T>& values) {
+    write_raw<uint64_t>(out, values.size());
+    out.write((const char*) values.data(), values.size() * sizeof(T));
+}
+
+/// Read a vector written by write_vector. Throws if the stream runs out.
+template<typename T>
+vector<T> read_vector(istream& in, const IndexFormat& format) {
+    vector<T> values(read_raw<uint64_t>(in, format));
+    if (!in.read((char*) values.data(), values.size() * sizeof(T))) {
+        format.fail("truncated");
+    }
+    return values;
+}
+
+/// Write a string, preceded by its length
+inline void write_string(ostream& out, const string& value) {
+    write_raw<uint64_t>(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+/// Read a string written by write_string. Throws if the stream runs out.
+inline string read_string(istream& in, const IndexFormat& format) {
+    string value(read_raw<uint64_t>(in, format), '\0');
+    if (!in.read(&value[0], value.size())) {
+        format.fail("truncated");
+    }
+    return value;
+}
+
+/// Write the magic bytes and current version of a format
+inline void write_header(ostream& out, const IndexFormat& format) {
+    out.write(format.magic, 4);
+    write_raw<uint32_t>(out, format.version);
+}
+
+/// Check the magic bytes of a format and read its version. Throws if the
+/// stream doesn't hold the format or has a version we can't read.
+inline uint32_t read_header(istream& in, const IndexFormat& format) {
+    char magic[4];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, format.magic, sizeof(magic)) != 0) {
+        format.fail("not a");
+    }
+    uint32_t version = read_raw<uint32_t>(in, format);
+    if (version < 1 || version > format.version) {
+        format.fail("unsupported version " + to_string(version) + " of");
+    }
+    return version;
+}
+
+}
+
+#endif
@@ -257,48 +257,26 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
     return mems;
 }
 
-// Use the GCSA2 index to find super-maximal exact matches (and optionally sub-MEMs).
-vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_begin,
-                                                     string::const_iterator seq_end,
-                                                     double& longest_lcp,
-                                                     double& fraction_filtered,
-                                                     int max_mem_length,
-                                                     int min_mem_length,
-                                                     int reseed_length,
-                                                     bool use_lcp_reseed_heuristic,
-                                                     bool use_diff_based_fast_reseed,
-                                                     bool include_parent_in_sub_mem_count,
-                                                     bool record_max_lcp,
-                                                     int reseed_below) {
-#ifdef debug_mapper
-#pragma omp critical
-    {
-        cerr << "find_mems: sequence ";
-        for (auto iter = seq_begin; iter != seq_end; iter++) {
-            cerr << *iter;
-        }
-        cerr << ", max mem length " << max_mem_length << ", min mem length " <<
-        min_mem_length << ", reseed length " << reseed_length << endl;
-    }
-#endif
-
-    if (!gcsa) {
-        cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
-        exit(1);
-    }
-    
-    if (min_mem_length > reseed_length && reseed_length) {
-        cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
-        exit(1);
-    }
-    vector<MaximalExactMatch> mems;
+SMEMSearchState::SMEMSearchState(string::const_iterator seq_begin,
+                                 string::const_iterator seq_end,
+                                 gcsa::range_type full_range) :
+    seq_begin(seq_begin),
+    seq_end(seq_end),
+    cursor(seq_end - 1),
+    full_range(full_range),
+    last_range(full_range),
+    match(seq_end - 1, seq_end, full_range) {
     
-    gcsa::range_type full_range = gcsa::range_type(0, gcsa->size() - 1);
-
     // an empty sequence matches the entire bwt
     if (seq_begin == seq_end) {
         mems.push_back(MaximalExactMatch(seq_begin, seq_end, full_range));
     }
+}
+
+bool BaseMapper::advance_smem_search(SMEMSearchState& search,
+                                     int max_mem_length,
+                                     int min_mem_length,
+                                     bool record_max_lcp) {
     
     // find SMEMs using GCSA+LCP array
     // algorithm sketch:
@@ -314,40 +292,28 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     //           (effectively, this steps up the suffix tree)
     //           and calculate the new end point using the LCP of the parent node
     // emit the final MEM, if we finished in a matching state
+    //
+    // each call does one iteration of the loop, and the search state maintains
+    // the invariant that match.range contains the hits for seq[cursor+1:match.end]
     
-    // next position we will extend matches to
-    string::const_iterator cursor = seq_end - 1;
-    
-    // range of the last iteration
-    gcsa::range_type last_range = full_range;
+    if (search.done) {
+        return false;
+    }
     
-    // the temporary MEM we'll build up in this process
-    MaximalExactMatch match(cursor, seq_end, full_range);
+    MaximalExactMatch& match = search.match;
+    string::const_iterator& cursor = search.cursor;
     
-    // did we move the cursor or the end of the match last iteration?
-    bool prev_iter_jumped_lcp = false;
-
-    int filtered_mems = 0;
-    int total_mems = 0;
-    int max_lcp = 0;
-    size_t mem_length = 0;
-    vector<int> lcp_maxima;
-    
-
-    // loop maintains invariant that match.range contains the hits for seq[cursor+1:match.end]
-    while (cursor >= seq_begin) {
+    if (cursor >= search.seq_begin) {
         
         // break the MEM on N; which for DNA we assume is non-informative
         // this *will* match many places in assemblies, but it isn't helpful
         if (*cursor == 'N') {
             match.begin = cursor + 1;
             
-            mem_length = match.length();
-            
-            if (mem_length >= min_mem_length) {
+            if (match.length() >= min_mem_length) {
 
-                mems.push_back(match);
-                lcp_maxima.push_back(max_lcp);
+                search.mems.push_back(match);
+                search.lcp_maxima.push_back(search.max_lcp);
                 
 #ifdef debug_mapper
 #pragma omp critical
@@ -368,19 +334,19 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
             }
             
             match.end = cursor;
-            match.range = full_range;
+            match.range = search.full_range;
             --cursor;
             
-            prev_iter_jumped_lcp = false;
+            search.prev_iter_jumped_lcp = false;
 
-            max_lcp = 0;
+            search.max_lcp = 0;
 
             // skip looking for matches since they are non-informative
-            continue;
+            return true;
         }
         
         // hold onto our previous range
-        last_range = match.range;
+        search.last_range = match.range;
         
         // execute one step of LF mapping
         match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
@@ -398,30 +364,29 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                 // entire index (b/c then advancing the LCP doesn't move the search forward
                 // at all, need to move the cursor instead)
                 match.begin = cursor + 1;
-                match.range = last_range;
+                match.range = search.last_range;
                 
                 if (match.end - match.begin >= min_mem_length) {
-                    mems.push_back(match);
-                    lcp_maxima.push_back(max_lcp);
+                    search.mems.push_back(match);
+                    search.lcp_maxima.push_back(search.max_lcp);
                 }
                 
                 match.end = cursor;
-                match.range = full_range;
+                match.range = search.full_range;
                 --cursor;
                 
                 // don't reseed in empty MEMs
-                prev_iter_jumped_lcp = false;
-                max_lcp = 0;
+                search.prev_iter_jumped_lcp = false;
+                search.max_lcp = 0;
             }
             else {
                 match.begin = cursor + 1;
-                match.range = last_range;
-                mem_length = match.end - match.begin;
+                match.range = search.last_range;
                 // record the last MEM, but check to make sure were not actually still searching
                 // for the end of the next MEM
-                if (mem_length >= min_mem_length && !prev_iter_jumped_lcp) {
-                    mems.push_back(match);
-                    lcp_maxima.push_back(max_lcp);
+                if (match.end - match.begin >= min_mem_length && !search.prev_iter_jumped_lcp) {
+                    search.mems.push_back(match);
+                    search.lcp_maxima.push_back(search.max_lcp);
                     
 #ifdef debug_mapper
 #pragma omp critical
@@ -442,35 +407,36 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                 }
                 
                 // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
-                gcsa::STNode parent = lcp->parent(last_range);
+                gcsa::STNode parent = lcp->parent(search.last_range);
                 // set the MEM to be the longest prefix that is shared with another MEM
                 match.end = match.begin + parent.lcp();
                 // and set up the next MEM using the parent node range
                 match.range = parent.range();
                 // record our max lcp
-                if (record_max_lcp) max_lcp = (int)parent.lcp();
-                prev_iter_jumped_lcp = true;
+                if (record_max_lcp) search.max_lcp = (int)parent.lcp();
+                search.prev_iter_jumped_lcp = true;
             }
         }
         else {
-            prev_iter_jumped_lcp = false;
-            if (record_max_lcp) max_lcp = max(max_lcp, (int)lcp->parent(match.range).lcp());
-            ++mem_length;
+            search.prev_iter_jumped_lcp = false;
+            if (record_max_lcp) search.max_lcp = max(search.max_lcp, (int)lcp->parent(match.range).lcp());
             // just step to the next position
             --cursor;
         }
+        
+        return true;
     }
+    
     // TODO: is this where the bug with the duplicated MEMs is occurring? (when the prefix of a read
     // contains multiple non SMEM hits so that the iteration will loop through the LCP routine multiple
     // times before escaping out of the loop?
     
     // if we have a MEM at the beginning of the read, record it
-    match.begin = seq_begin;
-    mem_length = match.end - match.begin;
-    if (mem_length >= min_mem_length) {
-        if (record_max_lcp) max_lcp = (int)lcp->parent(match.range).lcp();
-        mems.push_back(match);
-        lcp_maxima.push_back(max_lcp);
+    match.begin = search.seq_begin;
+    if (match.end - match.begin >= min_mem_length) {
+        if (record_max_lcp) search.max_lcp = (int)lcp->parent(match.range).lcp();
+        search.mems.push_back(match);
+        search.lcp_maxima.push_back(search.max_lcp);
 #ifdef debug_mapper
 #pragma omp critical
         {
@@ -488,6 +454,168 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         }
 #endif
     }
+    
+    search.done = true;
+    return false;
+}
+
+void BaseMapper::run_smem_searches(vector<SMEMSearchState>& searches,
+                                   int max_mem_length,
+                                   int min_mem_length,
+                                   bool record_max_lcp) {
+    
+    // indexes of the searches that are still going
+    vector<size_t> active(searches.size());
+    for (size_t i = 0; i < searches.size(); i++) {
+        active[i] = i;
+    }
+    
+    // round-robin one LF step at a time over all the unfinished searches, so
+    // that the index lookups for different reads are independent and their
+    // cache misses can overlap instead of each one stalling the next
+    while (!active.empty()) {
+        size_t still_active = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            if (advance_smem_search(searches[active[i]], max_mem_length, min_mem_length, record_max_lcp)) {
+                active[still_active++] = active[i];
+            }
+        }
+        active.resize(still_active);
+    }
+}
+
+// Use the GCSA2 index to find super-maximal exact matches (and optionally sub-MEMs).
+vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_begin,
+                                                     string::const_iterator seq_end,
+                                                     double& longest_lcp,
+                                                     double& fraction_filtered,
+                                                     int max_mem_length,
+                                                     int min_mem_length,
+                                                     int reseed_length,
+                                                     bool use_lcp_reseed_heuristic,
+                                                     bool use_diff_based_fast_reseed,
+                                                     bool include_parent_in_sub_mem_count,
+                                                     bool record_max_lcp,
+                                                     int reseed_below) {
+#ifdef debug_mapper
+#pragma omp critical
+    {
+        cerr << "find_mems: sequence ";
+        for (auto iter = seq_begin; iter != seq_end; iter++) {
+            cerr << *iter;
+        }
+        cerr << ", max mem length " << max_mem_length << ", min mem length " <<
+        min_mem_length << ", reseed length " << reseed_length << endl;
+    }
+#endif
+
+    if (!gcsa) {
+        cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
+        exit(1);
+    }
+    
+    if (min_mem_length > reseed_length && reseed_length) {
+        cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
+        exit(1);
+    }
+    
+    SMEMSearchState search(seq_begin, seq_end, gcsa::range_type(0, gcsa->size() - 1));
+    while (advance_smem_search(search, max_mem_length, min_mem_length, record_max_lcp)) {
+        // keep stepping
+    }
+    
+    return find_mems_deep_from_smems(search, longest_lcp, fraction_filtered, min_mem_length,
+                                     reseed_length, use_lcp_reseed_heuristic, use_diff_based_fast_reseed,
+                                     include_parent_in_sub_mem_count, record_max_lcp, reseed_below);
+}
+
+vector<vector<MaximalExactMatch>>
+BaseMapper::find_mems_deep_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                                 vector<double>& longest_lcps,
+                                 vector<double>& fractions_filtered,
+                                 int max_mem_length,
+                                 int min_mem_length,
+                                 int reseed_length,
+                                 bool use_lcp_reseed_heuristic,
+                                 bool use_diff_based_fast_reseed,
+                                 bool include_parent_in_sub_mem_count,
+                                 bool record_max_lcp,
+                                 int reseed_below) {
+    
+    if (!gcsa) {
+        cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
+        exit(1);
+    }
+    
+    if (min_mem_length > reseed_length && reseed_length) {
+        cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
+        exit(1);
+    }
+    
+    gcsa::range_type full_range(0, gcsa->size() - 1);
+    vector<SMEMSearchState> searches;
+    searches.reserve(seqs.size());
+    for (auto& seq : seqs) {
+        searches.emplace_back(seq.first, seq.second, full_range);
+    }
+    
+    // do the backward searches for all the sequences together
+    run_smem_searches(searches, max_mem_length, min_mem_length, record_max_lcp);
+    
+    // then finish each sequence's MEMs on its own
+    longest_lcps.resize(seqs.size());
+    fractions_filtered.resize(seqs.size());
+    vector<vector<MaximalExactMatch>> mems(seqs.size());
+    for (size_t i = 0; i < searches.size(); i++) {
+        mems[i] = find_mems_deep_from_smems(searches[i], longest_lcps[i], fractions_filtered[i], min_mem_length,
+                                            reseed_length, use_lcp_reseed_heuristic, use_diff_based_fast_reseed,
+                                            include_parent_in_sub_mem_count, record_max_lcp, reseed_below);
+    }
+    return mems;
+}
+
+vector<BaseMapper::ReadSeeds>
+BaseMapper::find_seeds_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                             int max_mem_length) {
+    vector<ReadSeeds> seeds(seqs.size());
+    if (minimizer_index) {
+        for (size_t i = 0; i < seqs.size(); i++) {
+            // minimizer seeds are all k long, which stands in for the LCP
+            seeds[i].longest_lcp = minimizer_index->k();
+            seeds[i].mems = find_minimizer_seeds(seqs[i].first, seqs[i].second, seeds[i].fraction_filtered);
+        }
+    } else {
+        vector<double> longest_lcps, fractions_filtered;
+        vector<vector<MaximalExactMatch>> mems = find_mems_deep_batch(seqs, longest_lcps, fractions_filtered,
+                                                                      max_mem_length, min_mem_length,
+                                                                      mem_reseed_length, false, true, true, false);
+        for (size_t i = 0; i < seqs.size(); i++) {
+            seeds[i].mems = std::move(mems[i]);
+            seeds[i].longest_lcp = longest_lcps[i];
+            seeds[i].fraction_filtered = fractions_filtered[i];
+        }
+    }
+    return seeds;
+}
+
+vector<MaximalExactMatch> BaseMapper::find_mems_deep_from_smems(SMEMSearchState& search,
+                                                                double& longest_lcp,
+                                                                double& fraction_filtered,
+                                                                int min_mem_length,
+                                                                int reseed_length,
+                                                                bool use_lcp_reseed_heuristic,
+                                                                bool use_diff_based_fast_reseed,
+                                                                bool include_parent_in_sub_mem_count,
+                                                                bool record_max_lcp,
+                                                                int reseed_below) {
+    
+    string::const_iterator seq_begin = search.seq_begin;
+    string::const_iterator seq_end = search.seq_end;
+    vector<MaximalExactMatch> mems = move(search.mems);
+    vector<int>& lcp_maxima = search.lcp_maxima;
+    
+    int filtered_mems = 0;
+    int total_mems = 0;
 
     if (record_max_lcp) longest_lcp = lcp_maxima.empty() ? 0 : *max_element(lcp_maxima.begin(), lcp_maxima.end());
 
@@ -1278,6 +1406,46 @@ void BaseMapper::precollapse_order_length_runs(string::const_iterator seq_begin,
     }
 }
 
+vector<MaximalExactMatch>
+BaseMapper::find_minimizer_seeds(string::const_iterator seq_begin,
+                                 string::const_iterator seq_end,
+                                 double& fraction_filtered) {
+    
+    if (!minimizer_index) {
+        cerr << "error:[vg::Mapper] a minimizer index is required to query minimizer seeds" << endl;
+        exit(1);
+    }
+    
+    vector<MaximalExactMatch> seeds;
+    fraction_filtered = 0.0;
+    
+    auto minimizers = minimizer_index->minimizers(seq_begin, seq_end);
+    size_t k = minimizer_index->k();
+    size_t filtered = 0;
+    for (auto& minimizer : minimizers) {
+        auto hits = minimizer_index->find(minimizer.key);
+        if (hits.second == 0) {
+            continue;
+        }
+        if (hit_max && hits.second > hit_max) {
+            filtered++;
+            continue;
+        }
+        
+        // there's no suffix array range behind these, so leave it empty
+        auto begin = seq_begin + minimizer.offset;
+        seeds.emplace_back(begin, begin + k, gcsa::range_type(1, 0), hits.second);
+        seeds.back().primary = true;
+        seeds.back().nodes.assign(hits.first, hits.first + hits.second);
+    }
+    
+    if (!minimizers.empty()) {
+        fraction_filtered = (double) filtered / (double) minimizers.size();
+    }
+    
+    return seeds;
+}
+
 void BaseMapper::rescue_high_count_order_length_mems(vector<MaximalExactMatch>& mems,
                                                      size_t max_rescue_hit_count) {
     
@@ -1620,21 +1788,22 @@ void BaseMapper::load_scoring_matrix(std::ifstream& matrix_stream){
     if(qual_adj_aligner) get_qual_adj_aligner()->load_scoring_matrix(matrix_stream);
 }
 
-void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& alns) {
+bool BaseMapper::score_haplotype_consistency(size_t count, const function<const Path&(size_t)>& get_path,
+                                             vector<double>& haplotype_logprobs) {
     if (haplo_score_provider == nullptr) {
         // There's no haplotype data available, so we can't add consistency scores.
-        return;
+        return false;
     }
     
     if (xindex == nullptr) {
         // There's no database of haplotype names/counts available.
         // So we don't know how many haplotypes we should be looking for.
-        return;
+        return false;
     }
     
     if (haplotype_consistency_exponent == 0) {
         // It won't matter either way
-        return;
+        return false;
     }
     
     size_t haplotype_count = xindex->get_haplotype_count();
@@ -1652,13 +1821,14 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
     haplo::haploMath::RRMemo haplo_memo(NEG_LOG_PER_BASE_RECOMB_PROB, haplotype_count);
     
     // This holds all the computed haplotype logprobs
-    vector<double> haplotype_logprobs;
-    haplotype_logprobs.reserve(alns.size());
+    haplotype_logprobs.clear();
+    haplotype_logprobs.reserve(count);
     
-    for (auto* aln : alns) {
+    for (size_t i = 0; i < count; i++) {
         // On a first pass through, compute all the scores and make sure they all can be computed
+        const Path& path = get_path(i);
         
-        if (aln->path().mapping_size() == 0) {
+        if (path.mapping_size() == 0) {
             // Alignments with no actual mappings don't need scoring. But we
             // don't want to treat them as scoring failures, because we expect
             // some due to e.g. read pair mapping locations where one read maps
@@ -1675,7 +1845,7 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
         // This is a logprob (so, negative), and expresses the probability of the haplotype path being followed
         double haplotype_logprob;
         bool path_valid;
-        std::tie(haplotype_logprob, path_valid) = haplo_score_provider->score(aln->path(), haplo_memo);
+        std::tie(haplotype_logprob, path_valid) = haplo_score_provider->score(path, haplo_memo);
         
         if (!path_valid) {
             // Our path does something the scorer doesn't like.
@@ -1683,7 +1853,7 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
             if (debug) {
                 cerr << "Not applying haplotype consistency due to scoring failure" << endl;
             }
-            return;
+            return false;
         }
         
         // Otherwise we haven't had a scoring failure yet, so keep going
@@ -1691,21 +1861,36 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
     }
     
     if (debug) {
-        cerr << "Applying haplotype consistency to " << alns.size() << " alignment candidates" << endl;
+        cerr << "Applying haplotype consistency to " << count << " alignment candidates" << endl;
+    }
+    
+    return true;
+}
+
+int64_t BaseMapper::haplotype_consistency_score_penalty(double haplotype_logprob, bool quality_adjusted) {
+    // Get the aligner so we can convert from logprob to score points
+    // TODO: This should always be the same aligner!
+    auto* aligner = get_aligner(quality_adjusted);
+    assert(aligner->log_base != 0);
+    
+    // Convert to points, raise to haplotype consistency exponent power
+    return round(haplotype_consistency_exponent * (haplotype_logprob / aligner->log_base));
+}
+
+void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& alns) {
+    vector<double> haplotype_logprobs;
+    if (!score_haplotype_consistency(alns.size(), [&](size_t i) -> const Path& { return alns[i]->path(); },
+                                     haplotype_logprobs)) {
+        return;
     }
     
     for (size_t i = 0; i < alns.size(); i++) {
-        // Get the aligner so we can convert from logprob to score points
-        // TODO: This should always be the same aligner!
-        auto* aligner = get_aligner(!alns[i]->quality().empty());
-        assert(aligner->log_base != 0);
-        
         if (alns[i]->path().mapping_size() != 0) {
             // We actually did rescore this one
             
-            int64_t score_penalty = round(haplotype_consistency_exponent * (haplotype_logprobs[i] / aligner->log_base));
+            int64_t score_penalty = haplotype_consistency_score_penalty(haplotype_logprobs[i], !alns[i]->quality().empty());
 
-            // Convert to points, raise to haplotype consistency exponent power, and apply
+            // Apply the penalty
             alns[i]->set_score(max((int64_t)0, alns[i]->score() + score_penalty));
             // Note that we successfully corrected the score
             alns[i]->set_haplotype_scored(true);
@@ -1721,6 +1906,28 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
         // Otherwise leave haplotype_scored as false, the default.
     }
 }
+
+void BaseMapper::apply_haplotype_consistency_scores(CompactAlignmentPool& candidates, bool quality_adjusted) {
+    // Reuse one Path for looking at all the candidates
+    Path path;
+    vector<double> haplotype_logprobs;
+    if (!score_haplotype_consistency(candidates.size(), [&](size_t i) -> const Path& {
+                candidates.fill_path(i, path);
+                return path;
+            }, haplotype_logprobs)) {
+        return;
+    }
+    
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (candidates.mapping_count(i) != 0) {
+            CompactAlignment& candidate = candidates[i];
+            int64_t score_penalty = haplotype_consistency_score_penalty(haplotype_logprobs[i], quality_adjusted);
+            candidate.score = max((int64_t)0, candidate.score + score_penalty);
+            candidate.haplotype_scored = true;
+            candidate.haplotype_logprob = haplotype_logprobs[i];
+        }
+    }
+}
     
 double BaseMapper::estimate_gc_content(void) {
     
@@ -2319,25 +2526,14 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     }
 
     pair<vector<Alignment>, vector<Alignment>> results;
-    double longest_lcp1, longest_lcp2, fraction_filtered1, fraction_filtered2;
-    // find the MEMs for the alignments
-    vector<MaximalExactMatch> mems1 = find_mems_deep(read1.sequence().begin(),
-                                                     read1.sequence().end(),
-                                                     longest_lcp1,
-                                                     fraction_filtered1,
-                                                     max_mem_length,
-                                                     min_mem_length,
-                                                     mem_reseed_length,
-                                                     false, true, true, false);
-
-    vector<MaximalExactMatch> mems2 = find_mems_deep(read2.sequence().begin(),
-                                                     read2.sequence().end(),
-                                                     longest_lcp2,
-                                                     fraction_filtered2,
-                                                     max_mem_length,
-                                                     min_mem_length,
-                                                     mem_reseed_length,
-                                                     false, true, true, false);
+    // find the MEMs for both alignments together
+    vector<ReadSeeds> pair_seeds = find_seeds_batch({make_pair(read1.sequence().begin(), read1.sequence().end()),
+                                                     make_pair(read2.sequence().begin(), read2.sequence().end())},
+                                                    max_mem_length);
+    vector<MaximalExactMatch>& mems1 = pair_seeds[0].mems;
+    vector<MaximalExactMatch>& mems2 = pair_seeds[1].mems;
+    double longest_lcp1 = pair_seeds[0].longest_lcp, longest_lcp2 = pair_seeds[1].longest_lcp;
+    double fraction_filtered1 = pair_seeds[0].fraction_filtered, fraction_filtered2 = pair_seeds[1].fraction_filtered;
 
     double mq_cap1, mq_cap2;
     mq_cap1 = mq_cap2 = max_mapping_quality;
@@ -3227,95 +3423,79 @@ Mapper::align_mem_multi(const Alignment& aln,
 
     // for up to our required number of multimaps
     // make the perfect-match alignment for the SMEM cluster
-    // then fix it up with DP on the little bits between the alignments
-    vector<Alignment> alns;
-    vector<vector<MaximalExactMatch>*> used_clusters;
-    set<string> seen_alignments;
-    int multimaps = 0;
+    // then fix it up with DP on the little bits between the alignments.
+    // The candidates are held in a flat pool, and only the ones that survive
+    // deduplication are turned back into Alignments.
+    CompactAlignmentPool::Borrow candidates;
+    set<pair<pos_t, pos_t>> seen_alignments;
     int filled = 0;
     for (auto& cluster : clusters) {
-        if (alns.size() >= total_multimaps) { break; }
+        if (candidates->size() >= total_multimaps) { break; }
         // skip if we've filtered the cluster
         if (to_drop.count(&cluster) && filled >= min_multimaps) {
-            alns.push_back(aln);
-            used_clusters.push_back(&cluster);
+            candidates->add(aln);
             continue;
         }
         ++filled;
-        Alignment candidate = align_cluster(aln, cluster, true);
-        string sig = signature(candidate);
+        size_t candidate = candidates->add(align_cluster(aln, cluster, true));
+        // the start and end positions of the path, like signature()
+        pair<pos_t, pos_t> sig = make_pair(candidates->start(candidate), candidates->end(candidate));
 
 #ifdef debug_mapper
 #pragma omp critical
         {
             if (debug) {
-                cerr << "Alignment with signature " << sig << " (seen: " << seen_alignments.count(sig) << ")" << endl;
-                cerr << "\t" << pb2json(candidate) << endl;
+                cerr << "Alignment from " << sig.first << " to " << sig.second << " (seen: " << seen_alignments.count(sig) << ")" << endl;
+                cerr << "\t" << pb2json(candidates->to_alignment(candidate, aln)) << endl;
             }
         }
 #endif
 
         if (!seen_alignments.count(sig)) {
-            alns.push_back(candidate);
-            used_clusters.push_back(&cluster);
             seen_alignments.insert(sig);
+        } else {
+            candidates->pop_back();
         }
     }
     
-    assert(alns.size() == used_clusters.size());
 #ifdef debug_mapper
 #pragma omp critical
     if (debug) {
         cerr << "alignments" << endl;
-        for (auto& aln : alns) {
-            cerr << aln.score();
-            if (aln.score()) cerr << " pos1 " << aln.path().mapping(0).position().node_id() << " ";
+        for (size_t i = 0; i < candidates->size(); ++i) {
+            cerr << (*candidates)[i].score;
+            if ((*candidates)[i].score) cerr << " pos1 " << id(candidates->start(i)) << " ";
             cerr << endl;
         }
     }
 #endif
-
-    // Prepare a sortable vector of alignment pointers
-    vector<Alignment*> aln_ptrs;
-    map<Alignment*, int> aln_index;
-    int idx = 0;
-    for (auto& aln : alns) {
-        aln_ptrs.push_back(&aln);
-        aln_index[&aln] = idx++;
-    }
     
     // Apply haplotype consistency scoring if possible
-    apply_haplotype_consistency_scores(aln_ptrs);
+    apply_haplotype_consistency_scores(*candidates, !aln.quality().empty());
     
     // sort alignments by score
-    std::sort(aln_ptrs.begin(), aln_ptrs.end(),
-              [&](Alignment* a1, Alignment* a2) {
-                  return a1->score() > a2->score();
-              });
+    vector<size_t> order(candidates->size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t i, size_t j) {
+                         return (*candidates)[i].score > (*candidates)[j].score;
+                     });
     // remove likely perfect duplicates
-    aln_ptrs.erase(
+    order.erase(
         std::unique(
-            aln_ptrs.begin(), aln_ptrs.end(),
-            [&](Alignment* aln1,
-                Alignment* aln2) {
+            order.begin(), order.end(),
+            [&](size_t i, size_t j) {
                 return
-                    aln1->score() == aln2->score()
-                    && (aln1->score() == 0
-                        || make_pos_t(aln1->path().mapping(0).position())
-                        == make_pos_t(aln2->path().mapping(0).position()));
+                    (*candidates)[i].score == (*candidates)[j].score
+                    && ((*candidates)[i].score == 0
+                        || candidates->start(i) == candidates->start(j));
             }),
-        aln_ptrs.end());
-    if (aln_ptrs.size()) {
-        vector<Alignment> best_alns;
-        int i = 0;
-        for ( ; i < min((int)aln_ptrs.size(), keep_multimaps); ++i) {
-            Alignment* alnp = aln_ptrs.at(i);
-            best_alns.push_back(*alnp);
-        }
-        for ( ; i < aln_ptrs.size(); ++i) {
-            best_alns.push_back(*aln_ptrs[i]);
-        }
-        alns = score_sort_and_deduplicate_alignments(best_alns, aln);
+        order.end());
+    vector<Alignment> alns;
+    if (!order.empty()) {
+        alns = score_sort_and_deduplicate_alignments(*candidates, order, aln);
     }
     // compute the mapping quality
     compute_mapping_qualities(alns, cluster_mq, maybe_mq, mq_cap);
@@ -4175,6 +4355,43 @@ vector<Alignment> Mapper::score_sort_and_deduplicate_alignments(vector<Alignment
     return sorted_unique_alignments;
 }
 
+vector<Alignment> Mapper::score_sort_and_deduplicate_alignments(const CompactAlignmentPool& candidates,
+                                                                vector<size_t>& order,
+                                                                const Alignment& original_alignment) {
+    if (order.empty()) {
+        vector<Alignment> unaligned(1, original_alignment);
+        unaligned.back().clear_path();
+        unaligned.back().set_score(0);
+        return unaligned;
+    }
+    
+    // Put the candidates in descending score order, keeping the given order within a score
+    std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+        return candidates[i].score > candidates[j].score;
+    });
+    
+    // Collect all the unique alignments (to compute mapping quality), only
+    // converting those back to Alignments
+    vector<Alignment> sorted_unique_alignments;
+    size_t score_start = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        if (candidates[order[k]].score != candidates[order[score_start]].score) {
+            // Duplicates can only have the same score
+            score_start = k;
+        }
+        
+        bool seen = false;
+        for (size_t prev = score_start; prev < k && !seen; prev++) {
+            seen = candidates.same_alignment(order[prev], order[k]);
+        }
+        
+        if (!seen) {
+            sorted_unique_alignments.push_back(candidates.to_alignment(order[k], original_alignment));
+        }
+    }
+    return sorted_unique_alignments;
+}
+
 // filters down to requested number of alignments and marks
 void Mapper::filter_and_process_multimaps(vector<Alignment>& sorted_unique_alignments, int total_multimaps) {
     if (sorted_unique_alignments.size() > total_multimaps){
@@ -4196,6 +4413,39 @@ vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int s
     clean_aln.set_quality(aln.quality());
     return align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, cluster_mq, max_multimaps, extra_multimaps, nullptr);
 }
+
+vector<vector<Alignment>> Mapper::align_multi_batch(const vector<Alignment>& alns, int kmer_size, int stride, int max_mem_length, int band_width) {
+    // the MEMs will point into these, so make them first
+    vector<Alignment> clean_alns(alns.size());
+    for (size_t i = 0; i < alns.size(); i++) {
+        clean_alns[i].set_name(alns[i].name());
+        clean_alns[i].set_sequence(alns[i].sequence());
+        clean_alns[i].set_quality(alns[i].quality());
+    }
+    
+    // reads longer than a band get split up and seeded band by band, so leave them out
+    vector<size_t> seeded;
+    vector<pair<string::const_iterator, string::const_iterator>> seqs;
+    for (size_t i = 0; i < clean_alns.size(); i++) {
+        if (clean_alns[i].sequence().size() <= band_width) {
+            seeded.push_back(i);
+            seqs.emplace_back(clean_alns[i].sequence().begin(), clean_alns[i].sequence().end());
+        }
+    }
+    vector<ReadSeeds> seeds = find_seeds_batch(seqs, max_mem_length);
+    
+    vector<vector<Alignment>> results(alns.size());
+    for (size_t i = 0, j = 0; i < clean_alns.size(); i++) {
+        ReadSeeds* read_seeds = nullptr;
+        if (j < seeded.size() && seeded[j] == i) {
+            read_seeds = &seeds[j++];
+        }
+        double cluster_mq = 0;
+        results[i] = align_multi_internal(true, clean_alns[i], kmer_size, stride, max_mem_length, band_width, cluster_mq,
+                                          max_multimaps, extra_multimaps, nullptr, read_seeds);
+    }
+    return results;
+}
     
 vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
                                                const Alignment& aln,
@@ -4205,7 +4455,8 @@ vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
                                                double& cluster_mq,
                                                int keep_multimaps,
                                                int additional_multimaps,
-                                               vector<MaximalExactMatch>* restricted_mems) {
+                                               vector<MaximalExactMatch>* restricted_mems,
+                                               ReadSeeds* found_seeds) {
     
     if(debug) {
 #pragma omp critical
@@ -4255,6 +4506,20 @@ vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
         // mem hits will already have been queried
         alignments = align_mem_multi(aln, *restricted_mems, cluster_mq, longest_lcp, fraction_filtered, max_mem_length, keep_multimaps, additional_multimaps_for_quality);
     }
+    else if (found_seeds != nullptr) {
+        // the seeds were found along with the rest of a batch
+        longest_lcp = found_seeds->longest_lcp;
+        fraction_filtered = found_seeds->fraction_filtered;
+        alignments = align_mem_multi(aln, found_seeds->mems, cluster_mq, longest_lcp, fraction_filtered, max_mem_length, keep_multimaps, additional_multimaps_for_quality);
+    }
+    else if (minimizer_index) {
+        longest_lcp = minimizer_index->k();
+        vector<MaximalExactMatch> mems = find_minimizer_seeds(aln.sequence().begin(),
+                                                              aln.sequence().end(),
+                                                              fraction_filtered);
+        // query mem hits
+        alignments = align_mem_multi(aln, mems, cluster_mq, longest_lcp, fraction_filtered, max_mem_length, keep_multimaps, additional_multimaps_for_quality);
+    }
     else {
         vector<MaximalExactMatch> mems = find_mems_deep(aln.sequence().begin(),
                                                         aln.sequence().end(),
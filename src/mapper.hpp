@@ -21,6 +21,8 @@
 #include "entropy.hpp"
 #include "gssw_aligner.hpp"
 #include "mem.hpp"
+#include "compact_alignment.hpp"
+#include "minimizer_index.hpp"
 #include "cluster.hpp"
 #include "graph.hpp"
 #include "translator.hpp"
@@ -145,6 +147,37 @@ private:
     void estimate_distribution();
 };
     
+/**
+ * The state of one sequence's backward search for SMEMs in a GCSA2 index. The
+ * search advances one LF-mapping step at a time, so that the searches for
+ * several sequences can be interleaved and their index lookups overlapped.
+ */
+struct SMEMSearchState {
+    SMEMSearchState(string::const_iterator seq_begin,
+                    string::const_iterator seq_end,
+                    gcsa::range_type full_range);
+    
+    string::const_iterator seq_begin;
+    string::const_iterator seq_end;
+    /// next position we will extend matches to
+    string::const_iterator cursor;
+    gcsa::range_type full_range;
+    /// range of the last iteration
+    gcsa::range_type last_range;
+    /// the temporary MEM we build up in the search
+    MaximalExactMatch match;
+    /// did we move the cursor or the end of the match last iteration?
+    bool prev_iter_jumped_lcp = false;
+    int max_lcp = 0;
+    /// have we passed the start of the sequence?
+    bool done = false;
+    
+    /// the SMEMs found so far, right to left
+    vector<MaximalExactMatch> mems;
+    /// the max LCP seen inside each SMEM, if recorded
+    vector<int> lcp_maxima;
+};
+
 class BaseMapper : public Progressive {
     
 public:
@@ -203,6 +236,39 @@ public:
                    bool record_max_lcp = false,
                    int reseed_below_count = 0);
     
+    /// Find MEMs for several sequences at once, with the same semantics as
+    /// find_mems_deep. The GCSA2 backward searches for all the sequences are
+    /// interleaved step by step, so that the cache misses of independent
+    /// searches overlap. Fills in one longest LCP and filtered fraction per
+    /// sequence.
+    vector<vector<MaximalExactMatch>>
+    find_mems_deep_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                         vector<double>& longest_lcps,
+                         vector<double>& fractions_filtered,
+                         int max_mem_length = 0,
+                         int min_mem_length = 1,
+                         int reseed_length = 0,
+                         bool use_lcp_reseed_heuristic = false,
+                         bool use_diff_based_fast_reseed = false,
+                         bool include_parent_in_sub_mem_count = false,
+                         bool record_max_lcp = false,
+                         int reseed_below_count = 0);
+    
+    /// The seeds found for one read, with the statistics about them that
+    /// find_mems_deep reports alongside.
+    struct ReadSeeds {
+        vector<MaximalExactMatch> mems;
+        double longest_lcp = 0;
+        double fraction_filtered = 0;
+    };
+    
+    /// Find seeds for several reads the way the mappers seed a single read:
+    /// from the minimizer index if there is one, and otherwise with
+    /// find_mems_deep_batch, so the GCSA2 searches for all the reads are
+    /// interleaved. The MEMs point into the given sequences.
+    vector<ReadSeeds> find_seeds_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                                       int max_mem_length = 0);
+    
     // Use the GCSA2 index to find super-maximal exact matches.
     vector<MaximalExactMatch>
     find_mems_simple(string::const_iterator seq_begin,
@@ -211,6 +277,15 @@ public:
                      int min_mem_length = 1,
                      int reseed_length = 0);
     
+    /// Use the minimizer index instead of GCSA2 to find seeds. Each minimizer
+    /// of the read that is in the index becomes a k-length MEM, filled with
+    /// its hits, in order of read position. Minimizers with more than hit_max
+    /// hits are dropped and counted in fraction_filtered.
+    vector<MaximalExactMatch>
+    find_minimizer_seeds(string::const_iterator seq_begin,
+                         string::const_iterator seq_end,
+                         double& fraction_filtered);
+    
     /// identifies tracts of order-length MEMs that were unfilled because their hit count was above the max
     /// and fills one MEM in the tract (the one with the smallest hit count), assumes MEMs are lexicographically
     /// ordered by read index
@@ -236,6 +311,7 @@ public:
     bool adaptive_reseed_diff = true; // use an adaptive length difference algorithm in reseed algorithm
     double adaptive_diff_exponent = 0.065; // exponent that describes limiting behavior of adaptive diff algorithm
     int hit_max = 0;       // ignore or MEMs with more than this many hits
+    MinimizerIndex* minimizer_index = nullptr; // if set, seed with minimizers instead of GCSA2 MEMs
     bool use_approx_sub_mem_count = false;
     bool prefilter_redundant_hits = true;
     int max_sub_mem_recursion_depth = 1;
@@ -255,6 +331,32 @@ public:
     bool debug = false;
     
 protected:
+    /// Do one step of an SMEM search. Returns false once the search has
+    /// reached the start of the sequence and recorded its last SMEM.
+    bool advance_smem_search(SMEMSearchState& search,
+                             int max_mem_length,
+                             int min_mem_length,
+                             bool record_max_lcp);
+    
+    /// Run all the given SMEM searches to completion, interleaving their steps.
+    void run_smem_searches(vector<SMEMSearchState>& searches,
+                           int max_mem_length,
+                           int min_mem_length,
+                           bool record_max_lcp);
+    
+    /// Fill, reseed, and filter the SMEMs from a finished search the way
+    /// find_mems_deep does. Consumes the search's MEMs.
+    vector<MaximalExactMatch> find_mems_deep_from_smems(SMEMSearchState& search,
+                                                        double& longest_lcp,
+                                                        double& fraction_filtered,
+                                                        int min_mem_length,
+                                                        int reseed_length,
+                                                        bool use_lcp_reseed_heuristic,
+                                                        bool use_diff_based_fast_reseed,
+                                                        bool include_parent_in_sub_mem_count,
+                                                        bool record_max_lcp,
+                                                        int reseed_below);
+    
     /// Locate the sub-MEMs contained in the last MEM of the mems vector that have ending positions
     /// before the end the next SMEM, label each of the sub-MEMs with the indices of all of the SMEMs
     /// that contain it
@@ -321,6 +423,11 @@ protected:
     /// leave the alignment scores alone.
     void apply_haplotype_consistency_scores(const vector<Alignment*>& alns);
     
+    /// Score all of the candidates in the pool for haplotype consistency, in
+    /// the same way. All of the candidates are for the same read, which is or
+    /// is not using the quality-adjusted aligner.
+    void apply_haplotype_consistency_scores(CompactAlignmentPool& candidates, bool quality_adjusted);
+    
     // thread_local to allow alternating reads/writes
     thread_local static vector<size_t> adaptive_reseed_length_memo;
     
@@ -354,6 +461,16 @@ protected:
     // that expects one or the other.
     QualAdjAligner* get_qual_adj_aligner() const;
     Aligner* get_regular_aligner() const;
+    
+    /// Score count alignments, whose paths come from get_path, for haplotype
+    /// consistency. Returns false if haplotype scores should not be applied,
+    /// and otherwise fills in the log probability of each path (0 for empty
+    /// ones).
+    bool score_haplotype_consistency(size_t count, const function<const Path&(size_t)>& get_path,
+                                     vector<double>& haplotype_logprobs);
+    
+    /// Get the score adjustment for a path with the given haplotype log probability
+    int64_t haplotype_consistency_score_penalty(double haplotype_logprob, bool quality_adjusted);
 
 private:
     // GSSW aligners
@@ -425,10 +542,16 @@ private:
                                            double& cluster_mq,
                                            int keep_multimaps = 0,
                                            int additional_multimaps = 0,
-                                           vector<MaximalExactMatch>* restricted_mems = nullptr);
+                                           vector<MaximalExactMatch>* restricted_mems = nullptr,
+                                           ReadSeeds* found_seeds = nullptr);
     void compute_mapping_qualities(vector<Alignment>& alns, double cluster_mq, double mq_estimate, double mq_cap);
     void compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns, double cluster_mq, double mq_estmate1, double mq_estimate2, double mq_cap1, double mq_cap2);
     vector<Alignment> score_sort_and_deduplicate_alignments(vector<Alignment>& all_alns, const Alignment& original_alignment);
+    /// Sort the candidates listed in order by descending score, drop exact
+    /// duplicates, and convert the rest to Alignments of the original read
+    vector<Alignment> score_sort_and_deduplicate_alignments(const CompactAlignmentPool& candidates,
+                                                            vector<size_t>& order,
+                                                            const Alignment& original_alignment);
     void filter_and_process_multimaps(vector<Alignment>& all_alns, int total_multimaps);
     // Return the one best banded alignment.
     vector<Alignment> align_banded(const Alignment& read,
@@ -562,6 +685,15 @@ public:
                                   int max_mem_length = 0,
                                   int band_width = 1000);
     
+    // Align a batch of reads with multi-mapping, giving the same results as
+    // align_multi on each read in turn. The MEMs for all the reads that fit
+    // in one band are found together, with their GCSA2 searches interleaved.
+    vector<vector<Alignment>> align_multi_batch(const vector<Alignment>& alns,
+                                                int kmer_size = 0,
+                                                int stride = 0,
+                                                int max_mem_length = 0,
+                                                int band_width = 1000);
+    
     // paired-end based
     
     // Both vectors of alignments will be sorted in order of increasing score.
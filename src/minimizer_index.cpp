@@ -0,0 +1,402 @@
+#include "minimizer_index.hpp"
+#include "index_io.hpp"
+#include "xg.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// The saved format
+const IndexFormat MIN_FORMAT {"MIN!", 1, "vg::MinimizerIndex", "minimizer index"};
+
+/// Get the 2-bit code for a base, or 4 if it isn't ACGT.
+inline uint64_t base_code(char base) {
+    switch (base) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return 4;
+    }
+}
+
+}
+
+/**
+ * Keeps the keys of the kmers along a sequence with a rolling 2-bit encoding,
+ * and the minimum of the current window with a deque of kmers whose orders
+ * never decrease from front to back. Adding a base costs amortized O(1)
+ * along a sequence and remembers what it changed, so taking it back off is
+ * O(1), and walks through the graph that share a prefix share the work for
+ * it.
+ */
+class MinimizerIndex::WindowScanner {
+public:
+    WindowScanner(size_t k, size_t w) : k(k), w(w), mask(((uint64_t) 1 << (2 * k)) - 1) {
+        // Nothing to do
+    }
+
+    /// The number of bases in the sequence
+    size_t size() const {
+        return bases.size();
+    }
+
+    /// Forget the sequence, but keep the buffers
+    void clear() {
+        bases.clear();
+        head = tail = 0;
+    }
+
+    /// Add a base to the end of the sequence
+    void push(char base) {
+        Base added;
+        added.head = head;
+        added.tail = tail;
+        uint64_t code = base_code(base);
+        if (code > 3) {
+            // Kmers can't span an N
+            added.key = 0;
+            added.run = 0;
+        } else {
+            added.key = bases.empty() ? code : ((bases.back().key << 2) | code) & mask;
+            added.run = bases.empty() ? 1 : bases.back().run + 1;
+        }
+
+        size_t end = bases.size();
+        if (added.run >= k) {
+            // A kmer ends here. Anything behind it in the deque that comes
+            // later in the order can never be a minimizer again.
+            added.order = order(added.key);
+            while (tail > head && bases[deque[tail - 1]].order > added.order) {
+                tail--;
+            }
+            if (deque.size() <= tail) {
+                deque.resize(tail + 1);
+            }
+            added.slot = tail;
+            added.replaced = deque[tail];
+            deque[tail++] = end;
+        }
+        // Drop kmers that have slid out of the window ending here
+        while (head < tail && deque[head] + w <= end) {
+            head++;
+        }
+        bases.push_back(added);
+    }
+
+    /// Take the last base back off the sequence
+    void pop() {
+        const Base& removed = bases.back();
+        if (removed.run >= k) {
+            deque[removed.slot] = removed.replaced;
+        }
+        head = removed.head;
+        tail = removed.tail;
+        bases.pop_back();
+    }
+
+    /// Call back with the key and start of each minimizer of the window that
+    /// ends at the end of the sequence, if there is a whole window.
+    template<typename Iteratee>
+    void for_each_window_minimizer(const Iteratee& iteratee) const {
+        if (bases.size() < k + w - 1 || head == tail) {
+            return;
+        }
+        // Report every tie, so that the read and graph sides agree
+        uint64_t best = bases[deque[head]].order;
+        for (size_t i = head; i < tail && bases[deque[i]].order == best; i++) {
+            iteratee(bases[deque[i]].key, deque[i] + 1 - k);
+        }
+    }
+
+private:
+
+    /// What we know about each base of the sequence
+    struct Base {
+        /// The key of the kmer ending here, if run is at least k
+        uint64_t key;
+        /// The order of that kmer
+        uint64_t order;
+        /// How many bases without an N end here
+        size_t run;
+        /// The deque bounds before this base was added
+        size_t head;
+        size_t tail;
+        /// The deque slot this base's kmer went in, and what it replaced
+        size_t slot;
+        size_t replaced;
+    };
+
+    size_t k;
+    size_t w;
+    uint64_t mask;
+    vector<Base> bases;
+    /// Ends of kmers that could be minimizers, in deque[head] to deque[tail - 1]
+    vector<size_t> deque;
+    size_t head = 0;
+    size_t tail = 0;
+};
+
+const size_t MinimizerIndex::MAX_K;
+const size_t MinimizerIndex::DEFAULT_MAX_WALKS;
+const uint64_t MinimizerIndex::EMPTY;
+const uint64_t MinimizerIndex::MULTIPLE;
+
+MinimizerIndex::MinimizerIndex(const HandleGraph& graph, size_t k, size_t w, size_t max_walks) :
+    kmer_length(k), window_length(w) {
+    if (k == 0 || k > MAX_K || w == 0) {
+        throw runtime_error("[vg::MinimizerIndex] kmer length must be 1 to " + to_string(MAX_K) +
+                            " and window length at least 1");
+    }
+    if (max_walks == 0) {
+        throw runtime_error("[vg::MinimizerIndex] must follow at least one walk from each node");
+    }
+
+    // Each thread collects the hits it finds, and squashes out repeats when
+    // its buffer has doubled since the last time
+    size_t window_bases = k + w - 1;
+    vector<vector<pair<uint64_t, gcsa::node_type>>> buffers(omp_get_max_threads());
+    vector<size_t> compacted_sizes(buffers.size(), 0);
+    auto compact = [](vector<pair<uint64_t, gcsa::node_type>>& hits) {
+        sort(hits.begin(), hits.end());
+        hits.erase(unique(hits.begin(), hits.end()), hits.end());
+    };
+
+    // Positions are GCSA2 node_types, which only have room for short offsets.
+    // Check before going parallel, so we can throw.
+    graph.for_each_handle([&](const handle_t& node) {
+        if (graph.get_length(node) > 1024) {
+            throw runtime_error("[vg::MinimizerIndex] node " + to_string(graph.get_id(node)) +
+                                " is longer than 1024 bp; chop the graph first with vg mod -X");
+        }
+        return true;
+    });
+
+    // Each thread walks with its own scanner and buffers. Reading an XG's
+    // sequences straight into a buffer saves allocating a string per node.
+    vector<WindowScanner> scanners(buffers.size(), WindowScanner(k, w));
+    vector<vector<gcsa::node_type>> walk_positions(buffers.size());
+    vector<string> fetched_bases(buffers.size());
+    const xg::XG* xg_index = dynamic_cast<const xg::XG*>(&graph);
+
+    graph.for_each_handle([&](const handle_t& node) {
+        size_t thread = omp_get_thread_num();
+        auto& hits = buffers[thread];
+        auto& scanner = scanners[thread];
+        auto& positions = walk_positions[thread];
+        auto& fetched = fetched_bases[thread];
+
+        // Walk out far enough to see every window that starts on this node,
+        // on either strand, and collect the minimizers of each window as its
+        // last base is added. Every walk ends in covering all those windows,
+        // a dead end, or too many nodes, and we count them all. Nodes with
+        // sequence add at least a base each, so only empty nodes can make a
+        // walk longer than a window.
+        size_t walk_bases = 0;
+        size_t walks = 0;
+        function<void(const handle_t&, size_t)> extend = [&](const handle_t& handle, size_t depth) {
+            if (walks >= max_walks) {
+                return;
+            }
+            if (depth > window_bases) {
+                // Too long to be worth finishing
+                walks++;
+                return;
+            }
+            size_t take = min(graph.get_length(handle), walk_bases - scanner.size());
+            if (xg_index != nullptr) {
+                fetched.resize(take);
+                xg_index->get_subsequence(handle, 0, take, &fetched[0]);
+            } else {
+                fetched = graph.get_sequence(handle);
+            }
+            id_t id = graph.get_id(handle);
+            bool is_rev = graph.get_is_reverse(handle);
+            for (size_t i = 0; i < take; i++) {
+                scanner.push(fetched[i]);
+                positions.push_back(gcsa::Node::encode(id, i, is_rev));
+                scanner.for_each_window_minimizer([&](uint64_t key, size_t offset) {
+                    hits.emplace_back(key, positions[offset]);
+                });
+            }
+            if (scanner.size() == walk_bases) {
+                walks++;
+            } else {
+                bool dead_end = true;
+                graph.follow_edges(handle, false, [&](const handle_t& next) {
+                    dead_end = false;
+                    extend(next, depth + 1);
+                    return walks < max_walks;
+                });
+                if (dead_end) {
+                    walks++;
+                }
+            }
+            for (size_t i = 0; i < take; i++) {
+                scanner.pop();
+            }
+            positions.resize(positions.size() - take);
+        };
+
+        for (const handle_t& handle : {node, graph.flip(node)}) {
+            if (graph.get_length(handle) == 0) {
+                // No windows start here
+                continue;
+            }
+            walk_bases = graph.get_length(handle) + window_bases - 1;
+            walks = 0;
+            scanner.clear();
+            positions.clear();
+            extend(handle, 1);
+        }
+
+        if (hits.size() > 2 * compacted_sizes[thread] + (1 << 20)) {
+            compact(hits);
+            compacted_sizes[thread] = hits.size();
+        }
+        return true;
+    }, true);
+
+    vector<pair<uint64_t, gcsa::node_type>> hits;
+    for (auto& buffer : buffers) {
+        hits.insert(hits.end(), buffer.begin(), buffer.end());
+        vector<pair<uint64_t, gcsa::node_type>>().swap(buffer);
+    }
+    compact(hits);
+
+    // Lay out a table at most half full
+    key_count = 0;
+    for (size_t i = 0; i < hits.size(); i++) {
+        if (i == 0 || hits[i].first != hits[i - 1].first) {
+            key_count++;
+        }
+    }
+    size_t capacity = 1;
+    while (capacity < 2 * key_count) {
+        capacity *= 2;
+    }
+    table.assign(capacity, Cell{EMPTY, 0});
+
+    for (size_t i = 0; i < hits.size();) {
+        size_t j = i;
+        while (j < hits.size() && hits[j].first == hits[i].first) {
+            j++;
+        }
+        Cell& cell = table[locate(hits[i].first)];
+        cell.key = hits[i].first;
+        if (j - i == 1) {
+            cell.value = hits[i].second;
+        } else {
+            cell.value = occurrences.size() | MULTIPLE;
+            occurrences.push_back(j - i);
+            for (size_t h = i; h < j; h++) {
+                occurrences.push_back(hits[h].second);
+            }
+        }
+        i = j;
+    }
+}
+
+MinimizerIndex::MinimizerIndex(istream& in) {
+    load(in);
+}
+
+uint64_t MinimizerIndex::order(uint64_t key) {
+    // A 64-bit finalizer, so that minimizers aren't biased toward low
+    // complexity kmers like poly-A
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+size_t MinimizerIndex::locate(uint64_t key) const {
+    size_t mask = table.size() - 1;
+    size_t slot = order(key) & mask;
+    while (table[slot].key != EMPTY && table[slot].key != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void MinimizerIndex::for_each_minimizer(string::const_iterator begin, string::const_iterator end,
+                                        const function<void(uint64_t, size_t)>& iteratee) const {
+    WindowScanner scanner(kmer_length, window_length);
+    for (auto it = begin; it != end; ++it) {
+        scanner.push(*it);
+        scanner.for_each_window_minimizer(iteratee);
+    }
+}
+
+vector<MinimizerIndex::Minimizer> MinimizerIndex::minimizers(string::const_iterator begin,
+                                                              string::const_iterator end) const {
+    vector<Minimizer> found;
+    for_each_minimizer(begin, end, [&](uint64_t key, size_t offset) {
+        found.push_back(Minimizer{key, offset});
+    });
+    // A kmer is the minimizer of each window it wins, so report it once
+    sort(found.begin(), found.end(), [](const Minimizer& a, const Minimizer& b) {
+        return a.offset < b.offset;
+    });
+    found.erase(unique(found.begin(), found.end(), [](const Minimizer& a, const Minimizer& b) {
+        return a.offset == b.offset;
+    }), found.end());
+    return found;
+}
+
+pair<const gcsa::node_type*, size_t> MinimizerIndex::find(uint64_t key) const {
+    if (table.empty()) {
+        return make_pair(nullptr, 0);
+    }
+    const Cell& cell = table[locate(key)];
+    if (cell.key != key) {
+        return make_pair(nullptr, 0);
+    }
+    if (cell.value & MULTIPLE) {
+        size_t start = cell.value & ~MULTIPLE;
+        return make_pair(&occurrences[start + 1], (size_t) occurrences[start]);
+    }
+    return make_pair(&cell.value, 1);
+}
+
+size_t MinimizerIndex::k() const {
+    return kmer_length;
+}
+
+size_t MinimizerIndex::w() const {
+    return window_length;
+}
+
+size_t MinimizerIndex::size() const {
+    return key_count;
+}
+
+void MinimizerIndex::save(ostream& out) const {
+    write_header(out, MIN_FORMAT);
+    write_raw<uint64_t>(out, kmer_length);
+    write_raw<uint64_t>(out, window_length);
+    write_raw<uint64_t>(out, key_count);
+    write_vector(out, table);
+    write_vector(out, occurrences);
+}
+
+void MinimizerIndex::load(istream& in) {
+    read_header(in, MIN_FORMAT);
+    kmer_length = read_raw<uint64_t>(in, MIN_FORMAT);
+    window_length = read_raw<uint64_t>(in, MIN_FORMAT);
+    key_count = read_raw<uint64_t>(in, MIN_FORMAT);
+    table = read_vector<Cell>(in, MIN_FORMAT);
+    occurrences = read_vector<gcsa::node_type>(in, MIN_FORMAT);
+}
+
+}
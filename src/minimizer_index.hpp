@@ -0,0 +1,118 @@
+#ifndef VG_MINIMIZER_INDEX_HPP_INCLUDED
+#define VG_MINIMIZER_INDEX_HPP_INCLUDED
+
+/** \file
+ * A (w, k)-minimizer index of a graph, for seeding reads without GCSA2.
+ *
+ * A window is w consecutive kmers, and its minimizers are the kmers in it
+ * that come first in a hash order. The index stores every kmer occurrence in
+ * the graph that is a minimizer of some window along some walk on either
+ * strand, so the minimizers of a read can be looked up directly and each hit
+ * is where that kmer starts in the graph.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+#include <gcsa/gcsa.h>
+
+#include "handle.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class MinimizerIndex {
+public:
+
+    /// A minimizer of a sequence
+    struct Minimizer {
+        /// The kmer, 2 bits per base
+        uint64_t key;
+        /// Where it starts in the sequence
+        size_t offset;
+    };
+
+    /// Index the minimizers of every window of w k-mers in a graph. Nodes
+    /// must be at most 1024 bp long, as with GCSA2. At most max_walks walks
+    /// are followed out from each strand of each node, and walks that would
+    /// visit more nodes than a window has bases are dropped, so complex
+    /// regions can't blow up the build. Windows past those limits go
+    /// unindexed.
+    MinimizerIndex(const HandleGraph& graph, size_t k = 21, size_t w = 11,
+                   size_t max_walks = DEFAULT_MAX_WALKS);
+
+    /// Load a saved index.
+    MinimizerIndex(istream& in);
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load the index from a stream. Throws if it isn't a minimizer index.
+    void load(istream& in);
+
+    /// Get the minimizers of a sequence, each once, in order of offset.
+    vector<Minimizer> minimizers(string::const_iterator begin, string::const_iterator end) const;
+
+    /// Get the graph positions where a kmer starts, as GCSA2 node_types, and
+    /// how many there are. Returns a count of 0 if the kmer isn't indexed.
+    pair<const gcsa::node_type*, size_t> find(uint64_t key) const;
+
+    /// The kmer length
+    size_t k() const;
+
+    /// The window length, in kmers
+    size_t w() const;
+
+    /// Number of distinct minimizers in the index
+    size_t size() const;
+
+    /// Longest kmer that fits in a key
+    static const size_t MAX_K = 31;
+
+    /// Walks to follow from each node strand, by default
+    static const size_t DEFAULT_MAX_WALKS = 1024;
+
+private:
+
+    /// A slot of the hash table. Keys that occur once keep their position in
+    /// value, and others have the MULTIPLE bit set and point into
+    /// occurrences, where the count comes before the positions.
+    struct Cell {
+        uint64_t key;
+        uint64_t value;
+    };
+
+    /// Marks an unused cell. Never a valid key, since keys use 2k bits.
+    static const uint64_t EMPTY = ~(uint64_t) 0;
+    /// Marks a value that points into occurrences
+    static const uint64_t MULTIPLE = (uint64_t) 1 << 63;
+
+    /// The order that minimizers are chosen in
+    static uint64_t order(uint64_t key);
+
+    /// Find the cell for a key, or the empty cell where it would go.
+    size_t locate(uint64_t key) const;
+
+    /// Finds the minimizers of windows along a sequence that grows and
+    /// shrinks at its end, as a walk through the graph does.
+    class WindowScanner;
+
+    /// Call back with each minimizer of each window of a sequence, with its
+    /// key and start, possibly more than once.
+    void for_each_minimizer(string::const_iterator begin, string::const_iterator end,
+                            const function<void(uint64_t, size_t)>& iteratee) const;
+
+    size_t kmer_length;
+    size_t window_length;
+    size_t key_count = 0;
+    vector<Cell> table;
+    vector<gcsa::node_type> occurrences;
+};
+
+}
+
+#endif
@@ -37,21 +37,51 @@ namespace vg {
         multipath_map_internal(alignment, mapping_quality_method, multipath_alns_out, max_alt_mappings);
     }
     
+    void MultipathMapper::multipath_map_batch(const vector<Alignment>& alignments,
+                                              vector<vector<MultipathAlignment>>& multipath_alns_out,
+                                              size_t max_alt_mappings) {
+        
+        vector<pair<string::const_iterator, string::const_iterator>> seqs;
+        seqs.reserve(alignments.size());
+        for (const Alignment& alignment : alignments) {
+            seqs.emplace_back(alignment.sequence().begin(), alignment.sequence().end());
+        }
+        vector<ReadSeeds> seeds = find_seeds_batch(seqs);
+        
+        multipath_alns_out.clear();
+        multipath_alns_out.resize(alignments.size());
+        for (size_t i = 0; i < alignments.size(); i++) {
+            multipath_map_internal(alignments[i], mapping_quality_method, multipath_alns_out[i], max_alt_mappings,
+                                   &seeds[i]);
+        }
+    }
+    
     void MultipathMapper::multipath_map_internal(const Alignment& alignment,
                                                  MappingQualityMethod mapq_method,
                                                  vector<MultipathAlignment>& multipath_alns_out,
-                                                 size_t max_alt_mappings) {
+                                                 size_t max_alt_mappings,
+                                                 ReadSeeds* found_seeds) {
         
 #ifdef debug_multipath_mapper
         cerr << "multipath mapping read " << pb2json(alignment) << endl;
         cerr << "querying MEMs..." << endl;
 #endif
     
-        // query MEMs using GCSA2
+        // query MEMs using GCSA2, or seeds from the minimizer index, unless they were found
+        // along with the rest of a batch
         double dummy1; double dummy2;
-        vector<MaximalExactMatch> mems = find_mems_deep(alignment.sequence().begin(), alignment.sequence().end(),
-                                                        dummy1, dummy2, 0, min_mem_length, mem_reseed_length,
-                                                        false, true, true, false);
+        vector<MaximalExactMatch> mems;
+        if (found_seeds) {
+            mems = std::move(found_seeds->mems);
+        }
+        else if (minimizer_index) {
+            mems = find_minimizer_seeds(alignment.sequence().begin(), alignment.sequence().end(), dummy2);
+        }
+        else {
+            mems = find_mems_deep(alignment.sequence().begin(), alignment.sequence().end(),
+                                  dummy1, dummy2, 0, min_mem_length, mem_reseed_length,
+                                  false, true, true, false);
+        }
         
 #ifdef debug_multipath_mapper
         cerr << "obtained MEMs:" << endl;
@@ -66,19 +96,21 @@ namespace vg {
         // cluster the MEMs
         vector<memcluster_t> clusters;
         // memos for the results of expensive succinct operations that we may need to do multiple times
-        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
-        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
-        OrientedDistanceClusterer::handle_memo_t handle_memo;
+        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo(&shared_paths_of_node_memo);
+        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo(&shared_oriented_occurences_memo);
+        OrientedDistanceClusterer::handle_memo_t handle_memo(&shared_handle_memo);
         // TODO: Making OrientedDistanceClusterers is the only place we actually
         // need to distinguish between regular_aligner and qual_adj_aligner
         if (adjust_alignments_for_base_quality) {
             OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                distance_index);
             clusters = clusterer.clusters(max_mapping_quality, log_likelihood_approx_factor);
         }
         else {
             OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                distance_index);
             clusters = clusterer.clusters(max_mapping_quality, log_likelihood_approx_factor);
         }
         
@@ -227,11 +259,13 @@ namespace vg {
         
         // compute single ended mappings, and make sure we also compute mapping qualities to assess
         // mapping ambiguity
+        vector<ReadSeeds> pair_seeds = find_seeds_batch({make_pair(alignment1.sequence().begin(), alignment1.sequence().end()),
+                                                         make_pair(alignment2.sequence().begin(), alignment2.sequence().end())});
         vector<MultipathAlignment> multipath_alns_1, multipath_alns_2;
         multipath_map_internal(alignment1, mapping_quality_method == None ? Approx : mapping_quality_method,
-                               multipath_alns_1, 1);
+                               multipath_alns_1, 1, &pair_seeds[0]);
         multipath_map_internal(alignment2, mapping_quality_method == None ? Approx : mapping_quality_method,
-                               multipath_alns_2, 1);
+                               multipath_alns_2, 1, &pair_seeds[1]);
         
         bool is_ambiguous = true;
         
@@ -570,6 +604,17 @@ namespace vg {
 #ifdef debug_multipath_mapper
         cerr << "measuring left-to-" << (full_fragment ? "right" : "left") << " end distance between " << pos_1 << " and " << pos_2 << endl;
 #endif
+        if (distance_index) {
+            // Like the path distance, this is negative when pos_2 is behind
+            // pos_1, as for dovetailed mates
+            int64_t distance = distance_index->oriented_distance(pos_1, pos_2);
+            if (forward_strand && distance != numeric_limits<int64_t>::max() && is_rev(pos_1)) {
+                // The index has no paths to take a forward strand from, so
+                // take it from the nodes, which usually run along the paths
+                distance = -distance;
+            }
+            return distance;
+        }
         return xindex->closest_shared_path_oriented_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
                                                              forward_strand);
@@ -1104,12 +1149,11 @@ namespace vg {
         
         // the fragment length distribution has been estimated, so we can do full-fledged paired mode
     
-        // query MEMs using GCSA2
-        double dummy1, dummy2;
-        vector<MaximalExactMatch> mems1 = find_mems_deep(alignment1.sequence().begin(), alignment1.sequence().end(), dummy1, dummy2,
-                                                         0, min_mem_length, mem_reseed_length, false, true, true, false);
-        vector<MaximalExactMatch> mems2 = find_mems_deep(alignment2.sequence().begin(), alignment2.sequence().end(), dummy1, dummy2,
-                                                         0, min_mem_length, mem_reseed_length, false, true, true, false);
+        // query MEMs for both reads together using GCSA2, or seeds from the minimizer index
+        vector<ReadSeeds> pair_seeds = find_seeds_batch({make_pair(alignment1.sequence().begin(), alignment1.sequence().end()),
+                                                         make_pair(alignment2.sequence().begin(), alignment2.sequence().end())});
+        vector<MaximalExactMatch>& mems1 = pair_seeds[0].mems;
+        vector<MaximalExactMatch>& mems2 = pair_seeds[1].mems;
         
 #ifdef debug_multipath_mapper
         cerr << "obtained read1 MEMs:" << endl;
@@ -1138,9 +1182,9 @@ namespace vg {
         vector<pair<pair<size_t, size_t>, int64_t>> cluster_pairs;
         
         // intialize memos for the results of expensive succinct operations that we may need to do multiple times
-        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
-        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
-        OrientedDistanceClusterer::handle_memo_t handle_memo;
+        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo(&shared_paths_of_node_memo);
+        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo(&shared_oriented_occurences_memo);
+        OrientedDistanceClusterer::handle_memo_t handle_memo(&shared_handle_memo);
         
         // do we want to try to only cluster one read end and rescue the other?
         bool do_repeat_rescue_from_1 = min_match_count_2 > rescue_only_min && min_match_count_1 <= rescue_only_anchor_max;
@@ -1188,12 +1232,14 @@ namespace vg {
                 // do the clustering
                 if (adjust_alignments_for_base_quality) {
                     OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                         distance_index);
                     clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
                 }
                 else {
                     OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                         distance_index);
                     clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
                 }
                 
@@ -1217,12 +1263,14 @@ namespace vg {
                 // do the clustering
                 if (adjust_alignments_for_base_quality) {
                     OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                         distance_index);
                     clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
                 }
                 else {
                     OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                         distance_index);
                     clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
                 }
                 
@@ -1250,18 +1298,22 @@ namespace vg {
             // do the clustering
             if (adjust_alignments_for_base_quality) {
                 OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                     distance_index);
                 clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
                 OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                     distance_index);
                 clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
             }
             else {
                 OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                     distance_index);
                 clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
                 OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                     distance_index);
                 clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
             }
             
@@ -1316,7 +1368,8 @@ namespace vg {
             // Compute the pairs of cluster graphs and their approximate distances from each other
             cluster_pairs = OrientedDistanceClusterer::pair_clusters(alignment1, alignment2, cluster_mems_1, cluster_mems_2,
                                                                      xindex, min_separation, max_separation, unstranded_clustering,
-                                                                     &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                                     &paths_of_node_memo, &oriented_occurences_memo, &handle_memo,
+                                                                     distance_index);
 #ifdef debug_multipath_mapper
             cerr << "obtained cluster pairs:" << endl;
             for (int i = 0; i < cluster_pairs.size(); i++) {
@@ -1491,12 +1544,14 @@ namespace vg {
             // get the clusters for the non repeat
             if (adjust_alignments_for_base_quality) {
                 OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                                                     distance_index);
                 clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
             }
             else {
                 OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                                                     distance_index);
                 clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
             }
             
@@ -1535,12 +1590,14 @@ namespace vg {
             // get the clusters for the non repeat
             if (adjust_alignments_for_base_quality) {
                 OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                                                     distance_index);
                 clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
             }
             else {
                 OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo,
+                                                     distance_index);
                 clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
             }
             
@@ -20,6 +20,7 @@
 #include "edit.hpp"
 #include "snarls.hpp"
 #include "haplotypes.hpp"
+#include "distance_index.hpp"
 
 #include "algorithms/extract_containing_graph.hpp"
 #include "algorithms/extract_connecting_graph.hpp"
@@ -53,6 +54,13 @@ namespace vg {
         void multipath_map(const Alignment& alignment,
                            vector<MultipathAlignment>& multipath_alns_out,
                            size_t max_alt_mappings);
+        
+        /// Map a batch of reads as multipath_map does for each one, filling in one vector of
+        /// multipath alignments per read. The MEMs for all the reads are found together, with
+        /// their GCSA2 searches interleaved.
+        void multipath_map_batch(const vector<Alignment>& alignments,
+                                 vector<vector<MultipathAlignment>>& multipath_alns_out,
+                                 size_t max_alt_mappings);
                            
         /// Map a paired read to the graph and make paired multipath alignments. Assumes reads are on the
         /// same strand of the DNA/RNA molecule. If the fragment length distribution is still being estimated
@@ -98,6 +106,14 @@ namespace vg {
         size_t rescue_only_min = 128;
         size_t rescue_only_anchor_max = 16;
         size_t order_length_repeat_hit_max = 0;
+        // If set, distances for clustering and pair consistency come from this index instead of paths
+        const DistanceIndex* distance_index = nullptr;
+        
+        /// Memos for the results of succinct path queries, shared by all reads and threads for the
+        /// life of the mapper so that frequently hit nodes don't go back to the XG every time
+        OrientedDistanceClusterer::paths_of_node_memo_t::shared_memo_t shared_paths_of_node_memo;
+        OrientedDistanceClusterer::oriented_occurences_memo_t::shared_memo_t shared_oriented_occurences_memo;
+        OrientedDistanceClusterer::handle_memo_t::shared_memo_t shared_handle_memo;
         
         //static size_t PRUNE_COUNTER;
         //static size_t SUBGRAPH_TOTAL;
@@ -115,10 +131,13 @@ namespace vg {
         
         /// Wrapped internal function that allows some code paths to circumvent the current
         /// mapping quality method option.
+        /// If seeds are given, they must point into the alignment's sequence, and they are used up
+        /// instead of querying MEMs again.
         void multipath_map_internal(const Alignment& alignment,
                                     MappingQualityMethod mapq_method,
                                     vector<MultipathAlignment>& multipath_alns_out,
-                                    size_t max_alt_mappings);
+                                    size_t max_alt_mappings,
+                                    ReadSeeds* found_seeds = nullptr);
         
         /// Before the fragment length distribution has been estimated, look for an unambiguous mapping of
         /// the reads using the single ended routine. If we find one record the fragment length and report
@@ -4,8 +4,14 @@ namespace vg {
 
 Packer::Packer(void) : xgidx(nullptr) { }
 
-Packer::Packer(xg::XG* xidx, size_t binsz) : xgidx(xidx), bin_size(binsz) {
-    coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+Packer::Packer(xg::XG* xidx, size_t binsz, bool threadsafe) : xgidx(xidx), thread_safe(threadsafe), bin_size(binsz) {
+    if (thread_safe) {
+        coverage_shared.resize(xgidx->seq_length, 0);
+        edit_buffers.resize(omp_get_max_threads());
+        edit_buffered_bytes.resize(omp_get_max_threads(), 0);
+    } else {
+        coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+    }
     if (binsz) n_bins = xgidx->seq_length / bin_size + 1;
 }
 
@@ -42,23 +48,31 @@ void Packer::merge_from_files(const vector<string>& file_names) {
 #endif
     
     // load into our dynamic structures, then compact
+    // the files are loaded in parallel, a group at a time, but merged in order
+    size_t group_size = omp_get_max_threads();
     bool first = true;
-    for (auto& file_name : file_names) {
-        Packer c;
-        ifstream f(file_name);
-        c.load(f);
-        // take bin size and counts from the first, assume they are all the same
-        if (first) {
-            bin_size = c.get_bin_size();
-            n_bins = c.get_n_bins();
-            ensure_edit_tmpfiles_open();
-            first = false;
-        } else {
-            assert(bin_size == c.get_bin_size());
-            assert(n_bins == c.get_n_bins());
+    for (size_t group_start = 0; group_start < file_names.size(); group_start += group_size) {
+        size_t group_end = min(group_start + group_size, file_names.size());
+        vector<Packer> group(group_end - group_start);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = group_start; i < group_end; ++i) {
+            ifstream f(file_names[i]);
+            group[i - group_start].load(f);
+        }
+        for (auto& c : group) {
+            // take bin size and counts from the first, assume they are all the same
+            if (first) {
+                bin_size = c.get_bin_size();
+                n_bins = c.get_n_bins();
+                ensure_edit_tmpfiles_open();
+                first = false;
+            } else {
+                assert(bin_size == c.get_bin_size());
+                assert(n_bins == c.get_n_bins());
+            }
+            c.write_edits(tmpfstreams);
+            collect_coverage(c);
         }
-        c.write_edits(tmpfstreams);
-        collect_coverage(c);
     }
 }
 
@@ -120,8 +134,27 @@ void Packer::write_edits(ostream& out, size_t bin) const {
 void Packer::collect_coverage(const Packer& c) {
     // assume the same basis vector
     assert(!is_compacted);
-    for (size_t i = 0; i < c.graph_length(); ++i) {
-        coverage_dynamic.increment(i, c.coverage_at_position(i));
+    size_t length = c.graph_length();
+    if (thread_safe) {
+#pragma omp parallel for
+        for (size_t i = 0; i < length; ++i) {
+            size_t count = c.coverage_at_position(i);
+            if (count) increment_coverage(i, count);
+        }
+    } else {
+        for (size_t i = 0; i < length; ++i) {
+            size_t count = c.coverage_at_position(i);
+            if (count) increment_coverage(i, count);
+        }
+    }
+}
+
+void Packer::increment_coverage(size_t i, size_t count) {
+    if (thread_safe) {
+#pragma omp atomic
+        coverage_shared[i] += count;
+    } else {
+        coverage_dynamic.increment(i, count);
     }
 }
 
@@ -154,14 +187,20 @@ void Packer::make_compact(void) {
 #endif
     }
     // sync edit file
+    if (thread_safe && edit_tmpfile_names.empty()) {
+        // threads only open the files when they have edits; make the empty bins
+        ensure_edit_tmpfiles_open();
+    }
     close_edit_tmpfiles();
     // temporaries for construction
-    size_t basis_length = coverage_dynamic.size();
+    size_t basis_length = graph_length();
     int_vector<> coverage_iv;
     util::assign(coverage_iv, int_vector<>(basis_length));
-    for (size_t i = 0; i < coverage_dynamic.size(); ++i) {
-        coverage_iv[i] = coverage_dynamic[i];
+    for (size_t i = 0; i < basis_length; ++i) {
+        coverage_iv[i] = coverage_at_position(i);
     }
+    coverage_shared.clear();
+    coverage_shared.shrink_to_fit();
     edit_csas.resize(edit_tmpfile_names.size());
     util::assign(coverage_civ, coverage_iv);
     construct_config::byte_algo_sa = SE_SAIS;
@@ -177,7 +216,23 @@ void Packer::make_compact(void) {
 void Packer::make_dynamic(void) {
     if (!is_compacted) return;
     // unpack the compact represenation into the countarray
-    assert(false); // not implemented
+    size_t basis_length = coverage_civ.size();
+    if (thread_safe) {
+        coverage_shared.assign(basis_length, 0);
+        for (size_t i = 0; i < basis_length; ++i) {
+            coverage_shared[i] = coverage_civ[i];
+        }
+    } else {
+        coverage_dynamic = gcsa::CounterArray(basis_length, 8);
+        for (size_t i = 0; i < basis_length; ++i) {
+            if (coverage_civ[i]) coverage_dynamic.increment(i, coverage_civ[i]);
+        }
+    }
+    // and the edits back into the temp files
+    ensure_edit_tmpfiles_open();
+    write_edits(tmpfstreams);
+    util::clear(coverage_civ);
+    edit_csas.clear();
     is_compacted = false;
 }
 
@@ -202,7 +257,27 @@ void Packer::ensure_edit_tmpfiles_open(void) {
     }
 }
 
+void Packer::flush_edit_buffers(size_t thread) {
+    auto& buffers = edit_buffers[thread];
+#pragma omp critical (packer_edits)
+    {
+        ensure_edit_tmpfiles_open();
+        for (size_t bin = 0; bin < buffers.size(); ++bin) {
+            if (!buffers[bin].empty()) {
+                *tmpfstreams[bin] << buffers[bin];
+                buffers[bin].clear();
+            }
+        }
+    }
+    edit_buffered_bytes[thread] = 0;
+}
+
 void Packer::close_edit_tmpfiles(void) {
+    for (size_t thread = 0; thread < edit_buffers.size(); ++thread) {
+        if (edit_buffered_bytes[thread]) {
+            flush_edit_buffers(thread);
+        }
+    }
     if (!tmpfstreams.empty()) {
         for (auto& tmpfstream : tmpfstreams) {
             *tmpfstream << delim1; // pad
@@ -223,8 +298,19 @@ void Packer::remove_edit_tmpfiles(void) {
 }
 
 void Packer::add(const Alignment& aln, bool record_edits) {
-    // open tmpfile if needed
-    ensure_edit_tmpfiles_open();
+    // a loaded packer has to be made dynamic before anything is added to it
+    assert(!is_compacted);
+    // in thread-safe mode, edits go through this thread's buffers
+    size_t thread = omp_get_thread_num();
+    if (thread_safe) {
+        assert(thread < edit_buffers.size());
+        if (edit_buffers[thread].size() != n_bins) {
+            edit_buffers[thread].resize(n_bins);
+        }
+    } else {
+        // open tmpfile if needed
+        ensure_edit_tmpfiles_open();
+    }
     // count the nodes, edges, and edits
     for (auto& mapping : aln.path().mapping()) {
         if (!mapping.has_position()) {
@@ -245,11 +331,11 @@ void Packer::add(const Alignment& aln, bool record_edits) {
 #endif
                 if (mapping.position().is_reverse()) {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i-j);
+                        increment_coverage(i-j);
                     }
                 } else {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i+j);
+                        increment_coverage(i+j);
                     }
                 }
             } else if (record_edits) {
@@ -257,7 +343,12 @@ void Packer::add(const Alignment& aln, bool record_edits) {
                 string pos_repr = pos_key(i);
                 string edit_repr = edit_value(edit, mapping.position().is_reverse());
                 size_t bin = bin_for_position(i);
-                *tmpfstreams[bin] << pos_repr << edit_repr;
+                if (thread_safe) {
+                    edit_buffers[thread][bin].append(pos_repr).append(edit_repr);
+                    edit_buffered_bytes[thread] += pos_repr.size() + edit_repr.size();
+                } else {
+                    *tmpfstreams[bin] << pos_repr << edit_repr;
+                }
             }
             if (mapping.position().is_reverse()) {
                 i -= edit.from_length();
@@ -266,6 +357,9 @@ void Packer::add(const Alignment& aln, bool record_edits) {
             }
         }
     }
+    if (thread_safe && edit_buffered_bytes[thread] > MAX_BUFFERED_EDIT_BYTES) {
+        flush_edit_buffers(thread);
+    }
 }
 
 // find the position on the forward strand in the sequence vector
@@ -322,15 +416,11 @@ string Packer::escape_delim(const string& s, char d) const {
 
 string Packer::unescape_delim(const string& s, char d) const {
     string unescaped; unescaped.reserve(s.size());
-    for (size_t i = 0; i < s.size()-1; ++i) {
+    for (size_t i = 0; i < s.size(); ++i) {
         char c = s[i];
-        char b = s[i+1];
-        if (c == d && b == d) {
-            unescaped.push_back(c);
-        } else {
-            unescaped.push_back(c);
-            if (i == s.size()-2) unescaped.push_back(b);
-        }
+        unescaped.push_back(c);
+        // skip the second of a doubled delimiter
+        if (c == d && i+1 < s.size() && s[i+1] == d) ++i;
     }
     return unescaped;
 }
@@ -338,6 +428,8 @@ string Packer::unescape_delim(const string& s, char d) const {
 size_t Packer::graph_length(void) const {
     if (is_compacted) {
         return coverage_civ.size();
+    } else if (thread_safe) {
+        return coverage_shared.size();
     } else {
         return coverage_dynamic.size();
     }
@@ -346,6 +438,8 @@ size_t Packer::graph_length(void) const {
 size_t Packer::coverage_at_position(size_t i) const {
     if (is_compacted) {
         return coverage_civ[i];
+    } else if (thread_safe) {
+        return coverage_shared[i];
     } else {
         return coverage_dynamic[i];
     }
@@ -353,9 +447,9 @@ size_t Packer::coverage_at_position(size_t i) const {
 
 vector<Edit> Packer::edits_at_position(size_t i) const {
     vector<Edit> edits;
-    if (i == 0) return edits;
-    string key = pos_key(i);
     size_t bin = bin_for_position(i);
+    if (bin >= edit_csas.size()) return edits;
+    string key = pos_key(i);
     auto& edit_csa = edit_csas[bin];
     auto occs = locate(edit_csa, key);
     for (size_t i = 0; i < occs.size(); ++i) {
@@ -383,7 +477,113 @@ vector<Edit> Packer::edits_at_position(size_t i) const {
     return edits;
 }
 
+void Packer::for_each_edit_in_range(size_t begin, size_t end,
+                                    const function<void(size_t, const Edit&)>& lambda) const {
+    end = min(end, graph_length());
+    if (begin >= end || edit_csas.empty()) return;
+    for (size_t bin = bin_for_position(begin); bin <= bin_for_position(end-1) && bin < edit_csas.size(); ++bin) {
+        auto& edit_csa = edit_csas[bin];
+        if (edit_csa.size() < 2) continue;
+        // pull the bin out a block at a time, leaving off the trailing null,
+        // and keep only the records that haven't been finished yet
+        size_t text_length = edit_csa.size() - 1;
+        size_t extracted = 0;
+        string text;
+        while (extracted < text_length) {
+            size_t block_end = min(text_length, extracted + EDIT_EXTRACT_BLOCK_SIZE);
+            text.append(extract(edit_csa, extracted, block_end - 1));
+            extracted = block_end;
+            text.erase(0, for_each_edit_in_text(text, extracted == text_length, begin, end, lambda));
+        }
+    }
+}
+
+size_t Packer::find_record_start(const string& text, size_t from, bool at_end) const {
+    // Escaping doubles every delimiter in the content, so a lone delim2 can
+    // only start a record. A run that reaches the end of the text might
+    // still be continued.
+    size_t r = text.find(delim2, from);
+    while (r != string::npos) {
+        size_t run_end = r;
+        while (run_end < text.size() && text[run_end] == delim2) ++run_end;
+        if (run_end == text.size() && !at_end) {
+            return string::npos;
+        }
+        if (run_end - r == 1) {
+            return r;
+        }
+        r = text.find(delim2, run_end);
+    }
+    return r;
+}
+
+size_t Packer::for_each_edit_in_text(const string& text, bool at_end, size_t begin, size_t end,
+                                     const function<void(size_t, const Edit&)>& lambda) const {
+    // Each record is delim1 delim2 delim1, the escaped position key, a
+    // single delim1, and the escaped edit. The first odd run of delim1 after
+    // the key separates it from the edit. Serialized edits never end in
+    // delim1, so any run of delim1 at the end of a record is padding.
+    size_t r = find_record_start(text, 0, at_end);
+    while (r != string::npos) {
+        size_t next = find_record_start(text, r + 1, at_end);
+        if (next == string::npos && !at_end) {
+            // this record may go on into the next block
+            return r;
+        }
+        size_t record_end = next == string::npos ? text.size() : next;
+        size_t key_begin = r + 2;
+        size_t key_end = key_begin;
+        while (key_end < record_end) {
+            if (text[key_end] != delim1) {
+                ++key_end;
+                continue;
+            }
+            size_t run_end = key_end;
+            while (run_end < record_end && text[run_end] == delim1) ++run_end;
+            if ((run_end - key_end) % 2 != 0) break;
+            key_end = run_end;
+        }
+        size_t edit_begin = key_end + 1;
+        size_t edit_end = record_end;
+        while (edit_end > edit_begin && text[edit_end-1] == delim1) --edit_end;
+        if (edit_begin <= record_end) {
+            Position pos;
+            pos.ParseFromString(unescape_delims(text.substr(key_begin, key_end - key_begin)));
+            // keys are offset by 2, see pos_key
+            size_t i = pos.node_id() - 2;
+            if (i >= begin && i < end) {
+                Edit edit;
+                edit.ParseFromString(unescape_delims(text.substr(edit_begin, edit_end - edit_begin)));
+                lambda(i, edit);
+            }
+        }
+        r = next;
+    }
+    // no record is open, so only a run of delim2 at the end may be needed
+    size_t keep = text.find_last_not_of(delim2);
+    return keep == string::npos ? 0 : keep + 1;
+}
+
+void Packer::write_table_row(ostream& out, size_t i, bool show_edits, const vector<Edit>& edits) const {
+    id_t node_id = xgidx->node_at_seq_pos(i+1);
+    size_t offset = i - xgidx->node_start(node_id);
+    out << i << "\t" << node_id << "\t" << offset << "\t" << coverage_at_position(i);
+    if (show_edits) {
+        // order the edits so the table doesn't depend on how they were merged
+        vector<string> edit_strings;
+        for (auto& edit : edits) edit_strings.push_back(pb2json(edit));
+        std::sort(edit_strings.begin(), edit_strings.end());
+        out << "\t" << edits.size();
+        for (auto& edit_string : edit_strings) out << " " << edit_string;
+    }
+    out << endl;
+}
+
 ostream& Packer::as_table(ostream& out, bool show_edits) {
+    return as_table(out, show_edits, 0, graph_length());
+}
+
+ostream& Packer::as_table(ostream& out, bool show_edits, size_t begin, size_t end) {
 #ifdef debug
     cerr << "Packer table of " << coverage_civ.size() << " rows:" << endl;
 #endif
@@ -394,17 +594,35 @@ ostream& Packer::as_table(ostream& out, bool show_edits) {
         << "coverage";
     if (show_edits) out << "\t" << "edits";
     out << endl;
-    // write the coverage as a vector
-    for (size_t i = 0; i < coverage_civ.size(); ++i) {
-        id_t node_id = xgidx->node_at_seq_pos(i+1);
-        size_t offset = i - xgidx->node_start(node_id);
-        out << i << "\t" << node_id << "\t" << offset << "\t" << coverage_civ[i];
-        if (show_edits) {
-            out << "\t" << count(edit_csas[bin_for_position(i)], pos_key(i));
-            for (auto& edit : edits_at_position(i)) out << " " << pb2json(edit);
+    end = min(end, graph_length());
+    // write the coverage as a vector, reading the edits a bin at a time
+    size_t chunk_begin = begin;
+    while (chunk_begin < end) {
+        size_t bin_begin = bin_size ? bin_for_position(chunk_begin) * bin_size : 0;
+        size_t bin_end = bin_size ? min(graph_length(), bin_begin + bin_size) : graph_length();
+        size_t chunk_end = min(end, bin_end);
+        if (show_edits && (chunk_begin > bin_begin || chunk_end < bin_end)) {
+            // we only want part of the bin, so look up each position rather
+            // than decompressing all of it
+            for (size_t i = chunk_begin; i < chunk_end; ++i) {
+                write_table_row(out, i, show_edits, edits_at_position(i));
+            }
+        } else {
+            map<size_t, vector<Edit>> edits;
+            if (show_edits) {
+                for_each_edit_in_range(chunk_begin, chunk_end, [&](size_t i, const Edit& edit) {
+                        edits[i].push_back(edit);
+                    });
+            }
+            vector<Edit> no_edits;
+            for (size_t i = chunk_begin; i < chunk_end; ++i) {
+                auto found = edits.find(i);
+                write_table_row(out, i, show_edits, found == edits.end() ? no_edits : found->second);
+            }
         }
-        out << endl;
+        chunk_begin = chunk_end;
     }
+    return out;
 }
 
 ostream& Packer::show_structure(ostream& out) {
@@ -23,9 +23,14 @@ using namespace sdsl;
 class Packer {
 public:
     Packer(void);
-    Packer(xg::XG* xidx, size_t bin_size);
+    /// Make a packer for the graph in the given XG index. If thread_safe is
+    /// set, many threads may call add() at once; coverage is then kept in
+    /// atomically updated counters over the whole sequence space, and edits
+    /// are buffered per thread.
+    Packer(xg::XG* xidx, size_t bin_size, bool thread_safe = false);
     ~Packer(void);
     xg::XG* xgidx;
+    /// Merge in compacted packs from files, loading a thread's worth at a time in parallel
     void merge_from_files(const vector<string>& file_names);
     void merge_from_dynamic(vector<Packer*>& packers);
     void load_from_file(const string& file_name);
@@ -35,6 +40,7 @@ public:
                      sdsl::structure_tree_node* s = NULL,
                      std::string name = "");
     void make_compact(void);
+    /// Unpack a loaded packer so more alignments can be added to it
     void make_dynamic(void);
     void add(const Alignment& aln, bool record_edits = true);
     size_t graph_length(void) const;
@@ -42,9 +48,18 @@ public:
     string pos_key(size_t i) const;
     string edit_value(const Edit& edit, bool revcomp) const;
     vector<Edit> edits_at_position(size_t i) const;
+    /// Call the lambda on the position and edit of every edit recorded in
+    /// [begin, end) of the sequence basis. Only the bins overlapping the range
+    /// are read, each in one streaming pass, so this is much faster than
+    /// asking for the edits at each position of a whole bin. The edits for a
+    /// position come in no particular order.
+    void for_each_edit_in_range(size_t begin, size_t end,
+                                const function<void(size_t, const Edit&)>& lambda) const;
     size_t coverage_at_position(size_t i) const;
     void collect_coverage(const Packer& c);
     ostream& as_table(ostream& out, bool show_edits = true);
+    /// Write the table for only the positions in [begin, end) of the sequence basis
+    ostream& as_table(ostream& out, bool show_edits, size_t begin, size_t end);
     ostream& show_structure(ostream& out); // debugging
     void write_edits(vector<ofstream*>& out) const; // for merge
     void write_edits(ostream& out, size_t bin) const; // for merge
@@ -60,6 +75,16 @@ private:
     gcsa::CounterArray coverage_dynamic;
     vector<string> edit_tmpfile_names;
     vector<ofstream*> tmpfstreams;
+    // thread-safe dynamic model, used instead of coverage_dynamic
+    bool thread_safe = false;
+    vector<uint32_t> coverage_shared;
+    // per-thread, per-bin edit records waiting to go to the temp files
+    vector<vector<string>> edit_buffers;
+    vector<size_t> edit_buffered_bytes;
+    // write out a thread's buffered edits; takes the lock on the temp files
+    void flush_edit_buffers(size_t thread);
+    // add to the dynamic coverage at a position
+    void increment_coverage(size_t i, size_t count = 1);
     // which bin should we use
     size_t bin_for_position(size_t i) const;
     size_t n_bins = 1;
@@ -78,6 +103,19 @@ private:
     // take each double delimiter back to a single
     string unescape_delim(const string& s, char d) const;
     string unescape_delims(const string& s) const;
+    // find the delim2 starting the next edit record at or after from, or npos
+    // if there isn't one yet
+    size_t find_record_start(const string& text, size_t from, bool at_end) const;
+    // call the lambda on the edits in [begin, end) among the complete records
+    // in text, and return where the unfinished part of the text starts
+    size_t for_each_edit_in_text(const string& text, bool at_end, size_t begin, size_t end,
+                                 const function<void(size_t, const Edit&)>& lambda) const;
+    // how many characters of a bin's edits to decompress at once
+    static const size_t EDIT_EXTRACT_BLOCK_SIZE = 1024 * 1024;
+    // write one row of the table
+    void write_table_row(ostream& out, size_t i, bool show_edits, const vector<Edit>& edits) const;
+    // how many bytes of edits a thread may buffer before writing them out
+    static const size_t MAX_BUFFERED_EDIT_BYTES = 1024 * 1024;
 };
 
 // for making a combined matrix output and maybe doing other fun operations
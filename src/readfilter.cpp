@@ -737,7 +737,7 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             update_buffers(tid, aln, aln_chunks);
         }
     };
-    stream::for_each_parallel(*alignment_stream, lambda);
+    stream::for_each_parallel_arena(*alignment_stream, lambda);
 
     for (int tid = 0; tid < buffer.size(); ++tid) {
         for (int chunk = 0; chunk < buffer[tid].size(); ++chunk) {
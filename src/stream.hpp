@@ -3,19 +3,28 @@
 
 // de/serialization of protobuf objects from/to a length-prefixed, gzipped binary stream
 // from http://www.mail-archive.com/protobuf@googlegroups.com/msg03417.html
+//
+// Output is written in the BGZF blocked gzip format (see blocked_gzip.hpp), so
+// it can be decompressed in parallel and seeked into by virtual offset. Input
+// may be either BGZF or ordinary gzip.
 
 #include <cassert>
 #include <iostream>
 #include <istream>
 #include <fstream>
+#include <sstream>
 #include <functional>
 #include <vector>
 #include <list>
+#include <memory>
+#include <omp.h>
 #include "google/protobuf/stubs/common.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
+#include "blocked_gzip.hpp"
 
 namespace stream {
 
@@ -23,6 +32,77 @@ namespace stream {
 const size_t MAX_PROTOBUF_SIZE = 67108864;
 /// We aim to generate messages that are this size
 const size_t TARGET_PROTOBUF_SIZE = MAX_PROTOBUF_SIZE/2;
+/// Arena-backed readers keep up to this much of their arena's first block
+/// around per thread between batches
+const size_t MAX_KEPT_ARENA_BLOCK = 16 * 1024 * 1024;
+
+/**
+ * A protobuf Arena for parsing a batch of objects into, whose first block is
+ * a buffer kept by the thread. All the fields of all the objects come out of
+ * the arena, and are freed together when it is destroyed, so a batch costs a
+ * handful of allocations instead of several per object. The thread's buffer
+ * grows to fit the batches it sees, so later batches usually fit in it
+ * without allocating at all.
+ */
+class BatchArena {
+public:
+    BatchArena() {
+        ::google::protobuf::ArenaOptions arena_options;
+        if (!thread_block_in_use()) {
+            // Start in this thread's block. If another BatchArena on this
+            // thread already has it, we just use fresh blocks instead.
+            thread_block_in_use() = true;
+            block = &thread_block();
+            arena_options.initial_block = block->data();
+            arena_options.initial_block_size = block->size();
+        }
+        // Batches that outgrow the block get big blocks rather than many small ones
+        arena_options.start_block_size = thread_block().size();
+        arena_options.max_block_size = std::max(thread_block().size(), MAX_KEPT_ARENA_BLOCK);
+        arena.reset(new ::google::protobuf::Arena(arena_options));
+    }
+    
+    ~BatchArena() {
+        // Remember how much the batch needed, for the next one
+        size_t allocated = arena->SpaceAllocated();
+        arena.reset();
+        if (block) {
+            // The arena is gone, so the block can move
+            if (allocated > block->size() && block->size() < MAX_KEPT_ARENA_BLOCK) {
+                block->resize(std::min(allocated, MAX_KEPT_ARENA_BLOCK));
+            }
+            thread_block_in_use() = false;
+        }
+    }
+    
+    BatchArena(const BatchArena& other) = delete;
+    BatchArena& operator=(const BatchArena& other) = delete;
+    
+    /// Make a new, empty object in the arena
+    template <typename T>
+    T* make() {
+        return ::google::protobuf::Arena::CreateMessage<T>(arena.get());
+    }
+    
+    /// Free all of the objects, keeping the first block
+    void reset() {
+        arena->Reset();
+    }
+    
+private:
+    std::vector<char>* block = nullptr;
+    std::unique_ptr<::google::protobuf::Arena> arena;
+    
+    static std::vector<char>& thread_block() {
+        thread_local std::vector<char> block(64 * 1024);
+        return block;
+    }
+    
+    static bool& thread_block_in_use() {
+        thread_local bool in_use = false;
+        return in_use;
+    }
+};
 
 /// Write objects using adaptive chunking. Takes a stream to write to, a total
 /// element count to write, a guess at how manye elements should be in a chunk,
@@ -38,9 +118,8 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
     // How many elements have we serialized so far
     size_t serialized = 0;
     
-    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    BlockedGzipOutputStream bgzip_out(out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
 
     auto handle = [](bool ok) {
         if (!ok) throw std::runtime_error("stream::write: I/O error writing protobuf");
@@ -93,8 +172,7 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
         }
     }
     
-    
-
+    return true;
 }
 
 // write objects
@@ -105,9 +183,8 @@ template <typename T>
 bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
 
     // Make all our streams on the stack, in case of error.
-    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    BlockedGzipOutputStream bgzip_out(out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -138,6 +215,77 @@ bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>&
     return !count || written == count;
 }
 
+/// Serialize a group of objects into complete, self-contained BGZF blocks
+/// holding one count-prefixed group, in the same format that write()
+/// produces. Members made this way can be compressed on any thread and
+/// concatenated in any order; for_each reads the concatenation back.
+template <typename T>
+std::string compress_group(const std::vector<T>& objects) {
+    std::ostringstream compressed;
+    {
+        // Offsets within the string would be meaningless after concatenation
+        BlockedGzipOutputStream bgzip_out(compressed, 0);
+        ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
+
+        auto handle = [](bool ok) {
+            if (!ok) {
+                throw std::runtime_error("stream::compress_group: error serializing protobuf");
+            }
+        };
+        
+        if (!objects.empty()) {
+            coded_out.WriteVarint64(objects.size());
+            handle(!coded_out.HadError());
+        }
+        
+        for (auto& object : objects) {
+            // Serialize straight into the compressor, rather than through a string
+            size_t size = object.ByteSizeLong();
+            if (size > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("stream::compress_group: message too large error writing protobuf");
+            }
+            coded_out.WriteVarint32(size);
+            handle(!coded_out.HadError());
+            object.SerializeWithCachedSizes(&coded_out);
+            handle(!coded_out.HadError());
+        }
+        // The streams flush into the string as they are destroyed
+    }
+    return compressed.str();
+}
+
+/// Compress a group of already-serialized objects into BGZF blocks, in the
+/// same format as compress_group.
+inline std::string compress_serialized_group(const std::vector<std::string>& messages) {
+    std::ostringstream compressed;
+    {
+        BlockedGzipOutputStream bgzip_out(compressed, 0);
+        ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
+
+        auto handle = [](bool ok) {
+            if (!ok) {
+                throw std::runtime_error("stream::compress_serialized_group: error writing protobuf");
+            }
+        };
+        
+        if (!messages.empty()) {
+            coded_out.WriteVarint64(messages.size());
+            handle(!coded_out.HadError());
+        }
+        
+        for (auto& message : messages) {
+            if (message.size() > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("stream::compress_serialized_group: message too large error writing protobuf");
+            }
+            coded_out.WriteVarint32(message.size());
+            handle(!coded_out.HadError());
+            coded_out.WriteRaw(message.data(), message.size());
+            handle(!coded_out.HadError());
+        }
+    }
+    return compressed.str();
+}
+
 template <typename T>
 bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_limit) {
     bool wrote = false;
@@ -155,13 +303,13 @@ bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_l
 // takes a callback function to be called on the objects, and another to be called per object group.
 
 template <typename T>
-void for_each(std::istream& in,
-              const std::function<void(T&)>& lambda,
-              const std::function<void(uint64_t)>& handle_count) {
+void for_each_impl(std::istream& in,
+                   const std::function<void(T&)>& lambda,
+                   const std::function<void(uint64_t)>& handle_count,
+                   bool use_arena) {
 
-    ::google::protobuf::io::IstreamInputStream raw_in(&in);
-    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-    ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+    BlockedGzipInputStream bgzip_in(in);
+    ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -177,13 +325,14 @@ void for_each(std::istream& in,
         handle_count(count);
 
         std::string s;
+        std::unique_ptr<BatchArena> arena(use_arena ? new BatchArena() : nullptr);
         for (uint64_t i = 0; i < count; ++i) {
             uint32_t msgSize = 0;
             // Reconstruct the CodedInputStream in place to reset its maximum-
             // bytes-ever-read counter, because it thinks it's reading a single
             // message.
             coded_in.~CodedInputStream();
-            new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
             // Alot space for size, and for reading next chunk's length
             coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
             
@@ -197,15 +346,28 @@ void for_each(std::istream& in,
             
             if (msgSize) {
                 handle(coded_in.ReadString(&s, msgSize));
-                T object;
-                handle(object.ParseFromString(s));
-                lambda(object);
+                if (arena) {
+                    // The object lives until we reset the arena for the next one
+                    T* object = arena->make<T>();
+                    handle(object->ParseFromString(s));
+                    lambda(*object);
+                    arena->reset();
+                } else {
+                    T object;
+                    handle(object.ParseFromString(s));
+                    lambda(object);
+                }
             }
         }
     }
 }
-    
-    
+
+template <typename T>
+void for_each(std::istream& in,
+              const std::function<void(T&)>& lambda,
+              const std::function<void(uint64_t)>& handle_count) {
+    for_each_impl(in, lambda, handle_count, false);
+}
 
 template <typename T>
 void for_each(std::istream& in,
@@ -214,8 +376,241 @@ void for_each(std::istream& in,
     for_each(in, lambda, noop);
 }
 
+/// Like for_each, but parses the objects into a protobuf Arena instead of
+/// allocating each of their fields on the heap. The object passed to the
+/// lambda is freed when the lambda returns, so the lambda must copy anything
+/// it wants to keep; moving or swapping out of it also copies.
+template <typename T>
+void for_each_arena(std::istream& in,
+                    const std::function<void(T&)>& lambda) {
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    for_each_impl(in, lambda, noop, true);
+}
+
+
+/// Like for_each, but passes each object's serialized bytes to the lambda
+/// without parsing them. The lambda may move the string away. Blocks are
+/// decompressed as OpenMP tasks if called from inside a parallel region.
+inline void for_each_serialized(std::istream& in,
+                                const std::function<void(std::string&)>& lambda,
+                                const std::function<void(uint64_t)>& handle_count = [](uint64_t) {}) {
+
+    BlockedGzipInputStream bgzip_in(in);
+    bgzip_in.SetReadAhead(2 * omp_get_num_threads());
+    ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_serialized] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+
+    uint64_t count;
+    while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+        handle_count(count);
+        std::string s;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t msgSize = 0;
+            // Reset the byte limit, as in for_each
+            coded_in.~CodedInputStream();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+            
+            handle(coded_in.ReadVarint32(&msgSize));
+            
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_serialized] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+            
+            if (msgSize) {
+                handle(coded_in.ReadString(&s, msgSize));
+                lambda(s);
+            }
+        }
+    }
+}
+
+/// Read the objects a batch at a time, parse each batch in parallel, and pass
+/// the batches to the lambda in stream order, on the calling thread. For
+/// objects that are expensive to parse but have to be consumed in order, like
+/// the chunks of a graph. The batch size defaults to a few objects per thread.
+template <typename T>
+void for_each_batch(std::istream& in,
+                    const std::function<void(std::vector<T>&)>& lambda,
+                    const std::function<void(uint64_t)>& handle_count = [](uint64_t) {},
+                    size_t batch_size = 0) {
+    if (batch_size == 0) {
+        batch_size = 4 * omp_get_max_threads();
+    }
+
+    std::vector<std::string> serialized;
+    serialized.reserve(batch_size);
+    auto parse_and_handle = [&]() {
+        std::vector<T> batch(serialized.size());
+        bool ok = true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < serialized.size(); i++) {
+            if (!batch[i].ParseFromString(serialized[i])) {
+#pragma omp critical (stream_for_each_batch)
+                ok = false;
+            }
+        }
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_batch] obsolete, invalid, or corrupt protobuf input");
+        }
+        serialized.clear();
+        lambda(batch);
+    };
+
+    for_each_serialized(in, [&](std::string& s) {
+        serialized.emplace_back(std::move(s));
+        if (serialized.size() >= batch_size) {
+            parse_and_handle();
+        }
+    }, handle_count);
+    if (!serialized.empty()) {
+        parse_and_handle();
+    }
+}
+
+/// Internal implementation for the offset-aware for_each variants. Reads
+/// groups from the given BGZF stream and passes each object to the lambda,
+/// with the virtual offset of the start of its group. Stops early if the
+/// lambda returns false.
+template <typename T>
+void for_each_with_group_offsets_impl(BlockedGzipInputStream& bgzip_in,
+                                      const std::function<bool(int64_t, T&)>& lambda) {
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+    
+    // We make a CodedInputStream for each message, and destroy it to give
+    // back what it read ahead before asking the stream where we are.
+    std::unique_ptr<::google::protobuf::io::CodedInputStream> coded_in;
+
+    while (true) {
+        coded_in.reset();
+        int64_t group_offset = bgzip_in.Tell();
+        coded_in.reset(new ::google::protobuf::io::CodedInputStream(&bgzip_in));
+        
+        uint64_t count;
+        if (!coded_in->ReadVarint64((::google::protobuf::uint64*) &count)) {
+            break;
+        }
+
+        std::string s;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t msgSize = 0;
+            // The old stream has to back up before the new one reads ahead
+            coded_in.reset();
+            coded_in.reset(new ::google::protobuf::io::CodedInputStream(&bgzip_in));
+            coded_in->SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+            
+            handle(coded_in->ReadVarint32(&msgSize));
+            
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+            
+            if (msgSize) {
+                handle(coded_in->ReadString(&s, msgSize));
+                T object;
+                handle(object.ParseFromString(s));
+                if (!lambda(group_offset, object)) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/// Like for_each, but also passes the virtual offset of the group each object
+/// came from, which can later be passed to for_each_from. Offsets are -1 if
+/// the input is not BGZF or is not seekable.
+template <typename T>
+void for_each_with_group_offsets(std::istream& in,
+                                 const std::function<void(int64_t, T&)>& lambda) {
+    BlockedGzipInputStream bgzip_in(in);
+    std::function<bool(int64_t, T&)> keep_going = [&](int64_t group_offset, T& object) {
+        lambda(group_offset, object);
+        return true;
+    };
+    for_each_with_group_offsets_impl(bgzip_in, keep_going);
+}
+
+/// Seek a BGZF input stream to the given virtual offset, which must be the
+/// start of a group, and iterate over objects from there until the lambda
+/// returns false or the stream ends. The lambda also gets the virtual offset
+/// of each object's group.
+template <typename T>
+void for_each_from(std::istream& in, int64_t virtual_offset,
+                   const std::function<bool(int64_t, T&)>& lambda) {
+    // Start at the right block, since the stream sniffs the format from
+    // wherever the istream is now
+    in.clear();
+    in.seekg(virtual_offset >> 16);
+    if (in.fail()) {
+        throw std::runtime_error("[stream::for_each_from] could not seek input");
+    }
+    BlockedGzipInputStream bgzip_in(in);
+    if (!bgzip_in.Seek(virtual_offset)) {
+        throw std::runtime_error("[stream::for_each_from] could not seek to virtual offset " +
+            std::to_string(virtual_offset) + "; input must be seekable BGZF");
+    }
+    for_each_with_group_offsets_impl(bgzip_in, lambda);
+}
+
 // Parallelized versions of for_each
 
+/// Parse a batch of serialized objects and call lambda2 on each pair of them,
+/// and lambda1 on an odd one at the end. Either parses every object into a
+/// BatchArena, or reuses the same two heap objects for the whole batch.
+template <typename T>
+void parse_batch(const std::vector<std::string>& batch,
+                 const std::function<void(T&,T&)>& lambda2,
+                 const std::function<void(T&)>& lambda1,
+                 bool use_arena) {
+    
+    auto handle = [](bool retval) -> void {
+        if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
+    };
+    
+    if (use_arena) {
+        BatchArena arena;
+        size_t i = 0;
+        for (; i + 1 < batch.size(); i += 2) {
+            T* obj1 = arena.make<T>();
+            T* obj2 = arena.make<T>();
+            handle(obj1->ParseFromString(batch[i]));
+            handle(obj2->ParseFromString(batch[i+1]));
+            lambda2(*obj1, *obj2);
+        }
+        if (i < batch.size()) { // odd last object
+            T* obj1 = arena.make<T>();
+            handle(obj1->ParseFromString(batch[i]));
+            lambda1(*obj1);
+        }
+    } else {
+        T obj1, obj2;
+        size_t i = 0;
+        for (; i + 1 < batch.size(); i += 2) {
+            // parse protobuf objects and invoke lambda on the pair
+            handle(obj1.ParseFromString(batch[i]));
+            handle(obj2.ParseFromString(batch[i+1]));
+            lambda2(obj1, obj2);
+        }
+        if (i < batch.size()) { // odd last object
+            handle(obj1.ParseFromString(batch[i]));
+            lambda1(obj1);
+        }
+    }
+}
+
 // First, an internal implementation underlying several variants below.
 // lambda2 is invoked on interleaved pairs of elements from the stream. The
 // elements of each pair are in order, but the overall order in which lambda2
@@ -226,32 +621,44 @@ void for_each_parallel_impl(std::istream& in,
                             const std::function<void(T&,T&)>& lambda2,
                             const std::function<void(T&)>& lambda1,
                             const std::function<void(uint64_t)>& handle_count,
-                            const std::function<bool(void)>& single_threaded_until_true) {
-
-    // objects will be handed off to worker threads in batches of this many
-    const uint64_t batch_size = 256;
-    static_assert(batch_size % 2 == 0, "stream::for_each_parallel::batch_size must be even");
+                            const std::function<bool(void)>& single_threaded_until_true,
+                            bool use_arena = false) {
+
+    // objects will be handed off to worker threads in batches of about this
+    // many serialized bytes, so that small records make batches big enough to
+    // be worth a task and large records don't pile up in memory
+    const uint64_t batch_bytes = 256 * 1024;
+    // but no fewer or more than this many objects
+    const uint64_t min_batch_size = 2;
+    const uint64_t max_batch_size = 4096;
+    static_assert(min_batch_size % 2 == 0 && max_batch_size % 2 == 0,
+                  "stream::for_each_parallel batch sizes must be even");
     // max # of such batches to be holding in memory
     uint64_t max_batches_outstanding = 256;
     // max # we will ever increase the batch buffer to
-    const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
+    const uint64_t max_max_batches_outstanding = 1 << 11; // 2048
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
 
     // this loop handles a chunked file with many pieces
     // such as we might write in a multithreaded process
-    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true)
+    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true, use_arena)
     #pragma omp single
     {
         auto handle = [](bool retval) -> void {
             if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
         };
 
-        ::google::protobuf::io::IstreamInputStream raw_in(&in);
-        ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+        BlockedGzipInputStream bgzip_in(in);
+        // Decompress blocks on the whole team rather than just this thread
+        bgzip_in.SetReadAhead(2 * omp_get_num_threads());
+        ::google::protobuf::io::CodedInputStream coded_in(&bgzip_in);
 
         std::vector<std::string> *batch = nullptr;
+        // serialized bytes in the current batch
+        uint64_t batch_used_bytes = 0;
+        // objects per batch to reserve space for, tracking recent batches
+        uint64_t batch_size_guess = 256;
         
         // process chunks prefixed by message count
         uint64_t count;
@@ -260,14 +667,15 @@ void for_each_parallel_impl(std::istream& in,
             for (uint64_t i = 0; i < count; ++i) {
                 if (!batch) {
                      batch = new std::vector<std::string>();
-                     batch->reserve(batch_size);
+                     batch->reserve(batch_size_guess);
+                     batch_used_bytes = 0;
                 }
                 
                 // Reconstruct the CodedInputStream in place to reset its maximum-
                 // bytes-ever-read counter, because it thinks it's reading a single
                 // message.
                 coded_in.~CodedInputStream();
-                new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+                new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
                 // Allot space for size, and for reading next chunk's length
                 coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
                 
@@ -285,9 +693,12 @@ void for_each_parallel_impl(std::istream& in,
                     std::string s;
                     handle(coded_in.ReadString(&s, msgSize));
                     batch->push_back(std::move(s));
+                    batch_used_bytes += msgSize;
                 }
 
-                if (batch->size() == batch_size) {
+                if (batch->size() % 2 == 0 && batch->size() >= min_batch_size &&
+                    (batch_used_bytes >= batch_bytes || batch->size() >= max_batch_size)) {
+                    batch_size_guess = batch->size();
                     // time to enqueue this batch for processing. first, block if
                     // we've hit max_batches_outstanding.
                     uint64_t b;
@@ -298,15 +709,7 @@ void for_each_parallel_impl(std::istream& in,
                     if (b >= max_batches_outstanding || do_single_threaded) {
                         
                         // process this batch in the current thread
-                        {
-                            T obj1, obj2;
-                            for (int i = 0; i<batch_size; i+=2) {
-                                // parse protobuf objects and invoke lambda on the pair
-                                handle(obj1.ParseFromString(batch->at(i)));
-                                handle(obj2.ParseFromString(batch->at(i+1)));
-                                lambda2(obj1,obj2);
-                            }
-                        } // scope obj1 & obj2
+                        parse_batch(*batch, lambda2, lambda1, use_arena);
                         delete batch;
 #pragma omp atomic capture
                         b = --batches_outstanding;
@@ -324,17 +727,9 @@ void for_each_parallel_impl(std::istream& in,
                     }
                     else {
                         // spawn a task in another thread to process this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda2, handle, single_threaded_until_true)
+#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda1, lambda2, use_arena)
                         {
-                            {
-                                T obj1, obj2;
-                                for (int i = 0; i<batch_size; i+=2) {
-                                    // parse protobuf objects and invoke lambda on the pair
-                                    handle(obj1.ParseFromString(batch->at(i)));
-                                    handle(obj2.ParseFromString(batch->at(i+1)));
-                                    lambda2(obj1,obj2);
-                                }
-                            } // scope obj1 & obj2
+                            parse_batch(*batch, lambda2, lambda1, use_arena);
                             delete batch;
 #pragma omp atomic update
                             batches_outstanding--;
@@ -349,19 +744,7 @@ void for_each_parallel_impl(std::istream& in,
         #pragma omp taskwait
         // process final batch
         if (batch) {
-            {
-                T obj1, obj2;
-                int i = 0;
-                for (; i < batch->size()-1; i+=2) {
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    handle(obj2.ParseFromString(batch->at(i+1)));
-                    lambda2(obj1, obj2);
-                }
-                if (i == batch->size()-1) { // odd last object
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    lambda1(obj1);
-                }
-            } // scope obj1 & obj2
+            parse_batch(*batch, lambda2, lambda1, use_arena);
             delete batch;
         }
     }
@@ -407,6 +790,32 @@ void for_each_parallel(std::istream& in,
     for_each_parallel(in, lambda, noop);
 }
 
+/// Like for_each_parallel, but parses each batch of objects into a protobuf
+/// Arena, which is freed all at once when the batch is done. The objects
+/// passed to the lambda must not be kept after it returns; copy out anything
+/// that needs to outlive the call. Moving or swapping out of them also copies.
+template <typename T>
+void for_each_parallel_arena(std::istream& in,
+                             const std::function<void(T&)>& lambda1) {
+    std::function<void(T&,T&)> lambda2 = [&lambda1](T& o1, T& o2) { lambda1(o1); lambda1(o2); };
+    std::function<void(uint64_t)> no_count = [](uint64_t i) {};
+    std::function<bool(void)> no_wait = [](void) {return true;};
+    for_each_parallel_impl(in, lambda2, lambda1, no_count, no_wait, true);
+}
+
+/// Like for_each_interleaved_pair_parallel, but with the objects in a
+/// protobuf Arena, as in for_each_parallel_arena.
+template <typename T>
+void for_each_interleaved_pair_parallel_arena(std::istream& in,
+                                              const std::function<void(T&,T&)>& lambda2) {
+    std::function<void(T&)> err1 = [](T&){
+        throw std::runtime_error("stream::for_each_interleaved_pair_parallel: expected input stream of interleaved pairs, but it had odd number of elements");
+    };
+    std::function<void(uint64_t)> no_count = [](uint64_t i) {};
+    std::function<bool(void)> no_wait = [](void) {return true;};
+    for_each_parallel_impl(in, lambda2, err1, no_count, no_wait, true);
+}
+
     
 /*
  * Refactored stream::for_each function that follows the unidirectional iterator interface
@@ -419,9 +828,8 @@ public:
         where(0),
         chunk_count(0),
         chunk_idx(0),
-        raw_in(&in),
-        gzip_in(&raw_in),
-        coded_in(&gzip_in)
+        bgzip_in(in),
+        coded_in(&bgzip_in)
     {
         get_next();
     }
@@ -433,8 +841,7 @@ public:
 //        where = other.where;
 //        chunk_count = other.chunk_count;
 //        chunk_idx = other.chunk_idx;
-//        raw_in = other.raw_in;
-//        gzip_in = other.gzip_in;
+//        bgzip_in = other.bgzip_in;
 //        coded_in = other.coded_in;
 //    }
 
@@ -461,7 +868,7 @@ public:
         // bytes-ever-read counter, because it thinks it's reading a single
         // message.
         coded_in.~CodedInputStream();
-        new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+        new (&coded_in) ::google::protobuf::io::CodedInputStream(&bgzip_in);
         // Alot space for size, and for reading next chunk's length
         coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
         
@@ -506,8 +913,7 @@ private:
     uint64_t chunk_count;
     uint64_t chunk_idx;
     
-    ::google::protobuf::io::IstreamInputStream raw_in;
-    ::google::protobuf::io::GzipInputStream gzip_in;
+    BlockedGzipInputStream bgzip_in;
     ::google::protobuf::io::CodedInputStream coded_in;
     
     void handle(bool ok) {
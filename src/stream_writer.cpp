@@ -0,0 +1,124 @@
+#include "stream_writer.hpp"
+
+namespace stream {
+
+AsyncWriter::AsyncWriter(std::ostream& out, bool preserve_order, size_t max_queued_bytes) :
+    out(out), preserve_order(preserve_order), max_queued_bytes(max_queued_bytes) {
+    
+    writer_thread = std::thread(&AsyncWriter::write_loop, this);
+}
+
+AsyncWriter::~AsyncWriter() {
+    if (!finished) {
+        // Don't throw out of a destructor; callers who care about errors
+        // should call finish() themselves.
+        try {
+            finish();
+        } catch (const std::exception& e) {
+            std::cerr << "error:[stream::AsyncWriter] " << e.what() << std::endl;
+        }
+    }
+}
+
+void AsyncWriter::write_compressed(std::string&& compressed, int64_t sequence_number) {
+    if (preserve_order && sequence_number < 0) {
+        throw std::runtime_error("stream::AsyncWriter: ordered output requires a sequence number");
+    }
+    
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    
+    if (finishing) {
+        throw std::runtime_error("stream::AsyncWriter: cannot write after finishing");
+    }
+    
+    // Wait for room, unless the writer is waiting on this very group, in which
+    // case holding it back would deadlock.
+    space_ready.wait(lock, [&]() {
+        return queued_bytes < max_queued_bytes ||
+            (preserve_order && sequence_number == next_sequence_number);
+    });
+    
+    queued_bytes += compressed.size();
+    if (preserve_order) {
+        ordered_queue.emplace(sequence_number, std::move(compressed));
+    } else {
+        unordered_queue.emplace_back(std::move(compressed));
+    }
+    
+    lock.unlock();
+    work_ready.notify_one();
+}
+
+void AsyncWriter::write_loop() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        
+        // Collect whatever we can write right now
+        std::vector<std::string> to_write;
+        if (preserve_order) {
+            auto next = ordered_queue.begin();
+            while (next != ordered_queue.end() && next->first == next_sequence_number) {
+                to_write.emplace_back(std::move(next->second));
+                next = ordered_queue.erase(next);
+                next_sequence_number++;
+            }
+        } else {
+            while (!unordered_queue.empty()) {
+                to_write.emplace_back(std::move(unordered_queue.front()));
+                unordered_queue.pop_front();
+            }
+        }
+        
+        if (to_write.empty()) {
+            if (finishing) {
+                // Anything left in the ordered queue is stuck behind a
+                // missing group; finish() reports that.
+                break;
+            }
+            work_ready.wait(lock);
+            continue;
+        }
+        
+        // Do the actual writing without holding up the producers
+        lock.unlock();
+        size_t written_bytes = 0;
+        for (auto& compressed : to_write) {
+            if (!write_failed) {
+                out.write(compressed.data(), compressed.size());
+                // Keep draining after an error so producers can't block
+                // forever; finish() reports it.
+                write_failed = !out;
+            }
+            written_bytes += compressed.size();
+        }
+        lock.lock();
+        
+        queued_bytes -= written_bytes;
+        // Producers may be waiting for room, or for their turn
+        space_ready.notify_all();
+    }
+}
+
+void AsyncWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (finished) {
+            return;
+        }
+        finishing = true;
+    }
+    work_ready.notify_one();
+    writer_thread.join();
+    out.flush();
+    finished = true;
+    
+    if (write_failed || !out) {
+        throw std::runtime_error("stream::AsyncWriter: I/O error writing protobuf");
+    }
+    if (!ordered_queue.empty()) {
+        throw std::runtime_error("stream::AsyncWriter: missing group " +
+            std::to_string(next_sequence_number) + " in ordered output");
+    }
+}
+
+}
@@ -0,0 +1,116 @@
+#ifndef VG_STREAM_WRITER_HPP_INCLUDED
+#define VG_STREAM_WRITER_HPP_INCLUDED
+
+/** \file
+ * A background output stage for protobuf streams. Worker threads compress
+ * their own groups of objects into independent gzip members and hand them
+ * off; a single writer thread puts them on the output stream, optionally in
+ * the order the groups were numbered.
+ */
+
+#include <string>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <ostream>
+#include <vector>
+#include "stream.hpp"
+
+namespace stream {
+
+/**
+ * Writes compressed groups of protobuf objects to an ostream from a dedicated
+ * thread, so that compression happens outside of any critical section and the
+ * only serialized work is the write itself.
+ *
+ * In unordered mode, groups are written in the order they arrive. In ordered
+ * mode, every group must carry a sequence number, numbered from 0 with no
+ * gaps, and groups are written in sequence number order.
+ *
+ * Producers block if too much compressed data is waiting to be written.
+ */
+class AsyncWriter {
+public:
+    /// Start a writer thread for the given stream. The stream must outlive the
+    /// writer and not be written to by anyone else until finish() is called.
+    AsyncWriter(std::ostream& out, bool preserve_order = false,
+                size_t max_queued_bytes = 256 * 1024 * 1024);
+    
+    /// Finish writing everything and stop the writer thread.
+    ~AsyncWriter();
+    
+    AsyncWriter(const AsyncWriter& other) = delete;
+    AsyncWriter& operator=(const AsyncWriter& other) = delete;
+    
+    /// Compress the buffered objects on the calling thread, queue them for
+    /// writing, and clear the buffer. In ordered mode, sequence_number gives
+    /// the group's place in the output. Empty buffers are skipped in
+    /// unordered mode, but still fill their place in ordered mode.
+    template<typename T>
+    void write(std::vector<T>& buffer, int64_t sequence_number = -1);
+    
+    /// Compress and queue the buffered objects, but only if there are at least
+    /// buffer_limit of them. Works like stream::write_buffered.
+    template<typename T>
+    void write_buffered(std::vector<T>& buffer, size_t buffer_limit);
+    
+    /// Queue an already-compressed gzip member for writing.
+    void write_compressed(std::string&& compressed, int64_t sequence_number = -1);
+    
+    /// Write out everything that has been queued, flush the stream, and stop
+    /// the writer thread. No more groups may be written after this.
+    void finish();
+    
+private:
+    
+    /// Main loop of the writer thread
+    void write_loop();
+    
+    std::ostream& out;
+    bool preserve_order;
+    size_t max_queued_bytes;
+    
+    std::mutex queue_mutex;
+    /// Signaled when there is something new for the writer thread
+    std::condition_variable work_ready;
+    /// Signaled when the writer has made room in the queue
+    std::condition_variable space_ready;
+    
+    /// Groups waiting to be written in unordered mode
+    std::deque<std::string> unordered_queue;
+    /// Groups waiting to be written in ordered mode, by sequence number
+    std::map<int64_t, std::string> ordered_queue;
+    /// The next sequence number to write in ordered mode
+    int64_t next_sequence_number = 0;
+    /// Total compressed bytes waiting
+    size_t queued_bytes = 0;
+    /// Set when no more groups are coming
+    bool finishing = false;
+    bool finished = false;
+    /// Set by the writer thread if the stream goes bad
+    bool write_failed = false;
+    
+    std::thread writer_thread;
+};
+
+template<typename T>
+void AsyncWriter::write(std::vector<T>& buffer, int64_t sequence_number) {
+    if (buffer.empty() && !preserve_order) {
+        return;
+    }
+    write_compressed(compress_group(buffer), sequence_number);
+    buffer.clear();
+}
+
+template<typename T>
+void AsyncWriter::write_buffered(std::vector<T>& buffer, size_t buffer_limit) {
+    if (!buffer.empty() && buffer.size() >= buffer_limit) {
+        write(buffer);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,587 @@
+#include "striped_aligner.hpp"
+#include "algorithms/topological_sort.hpp"
+#include "path.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// Scalar stand-in for the vector operations, with one lane. Used when the
+/// CPU has no supported vector unit, and with 32-bit scores when a read is
+/// long enough that 16-bit scores could overflow.
+template<typename IntType>
+struct ScalarOps {
+    typedef IntType V;
+    typedef IntType T;
+    static const size_t lanes = 1;
+
+    static inline V set1(T value) { return value; }
+    static inline V load(const T* ptr) { return *ptr; }
+    static inline void store(T* ptr, V v) { *ptr = v; }
+    static inline V saturate(int64_t value) {
+        return (V) std::max<int64_t>(numeric_limits<T>::min(), std::min<int64_t>(numeric_limits<T>::max(), value));
+    }
+    static inline V adds(V a, V b) { return saturate((int64_t) a + b); }
+    static inline V subs(V a, V b) { return saturate((int64_t) a - b); }
+    static inline V max(V a, V b) { return a > b ? a : b; }
+    static inline V shift_in(V v, T fill) { return fill; }
+    static inline bool any_gt(V a, V b) { return a > b; }
+    static inline T hmax(V v) { return v; }
+};
+
+template<typename IntType>
+void striped_fill_node_scalar(StripedNodeFill<IntType>& fill) {
+    striped_fill_node<ScalarOps<IntType>>(fill);
+}
+
+/// The value used as negative infinity for each score type. It has to leave
+/// room for subtracting gap penalties from it without wrapping around.
+template<typename IntType>
+inline IntType neg_inf();
+
+template<>
+inline int16_t neg_inf<int16_t>() {
+    // 16-bit kernels use saturating arithmetic
+    return numeric_limits<int16_t>::min();
+}
+
+template<>
+inline int32_t neg_inf<int32_t>() {
+    return numeric_limits<int32_t>::min() / 2;
+}
+
+/**
+ * A growable buffer aligned for vector loads. We keep one of each kind per
+ * thread so that aligning a read doesn't need to allocate score matrices.
+ */
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+    AlignedBuffer(const AlignedBuffer& other) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer& other) = delete;
+    ~AlignedBuffer() {
+        free(data);
+    }
+
+    /// Get at least the given number of bytes. Previous contents are not
+    /// preserved.
+    void* get(size_t bytes) {
+        if (bytes > capacity) {
+            // Grow geometrically so a run of slightly longer reads doesn't
+            // reallocate every time
+            size_t new_capacity = std::max(bytes, capacity * 2);
+            free(data);
+            data = nullptr;
+            capacity = 0;
+            if (posix_memalign(&data, 64, new_capacity) != 0) {
+                data = nullptr;
+                throw bad_alloc();
+            }
+            capacity = new_capacity;
+        }
+        return data;
+    }
+
+private:
+    void* data = nullptr;
+    size_t capacity = 0;
+};
+
+thread_local AlignedBuffer profile_buffer;
+thread_local AlignedBuffer matrix_buffer;
+thread_local AlignedBuffer boundary_buffer;
+
+/// Encode a graph base as 0-4, treating anything that isn't ACGT as N, the
+/// way create_gssw_graph does.
+inline uint8_t encode_ref_base(char base, const int8_t* nt_table) {
+    switch (base) {
+    case 'A':
+    case 'C':
+    case 'G':
+    case 'T':
+        return nt_table[(uint8_t) base];
+    default:
+        return 4;
+    }
+}
+
+/// Encode a read base as 0-4.
+inline uint8_t encode_read_base(char base, const int8_t* nt_table) {
+    return (uint8_t) base < 128 ? nt_table[(uint8_t) base] : 4;
+}
+
+}
+
+StripedGraphAligner::StripedGraphAligner(const int8_t* score_matrix, const int8_t* nt_table,
+                                         int8_t gap_open, int8_t gap_extension,
+                                         int8_t full_length_bonus, bool quality_adjusted) :
+    engine(best_engine()), score_matrix(score_matrix), nt_table(nt_table), gap_open(gap_open),
+    gap_extension(gap_extension), full_length_bonus(full_length_bonus),
+    quality_adjusted(quality_adjusted) {
+    // Nothing to do
+}
+
+StripedGraphAligner::Engine StripedGraphAligner::best_engine() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SSE41;
+    }
+#endif
+    return SCALAR;
+}
+
+inline int32_t StripedGraphAligner::substitution_score(uint8_t ref_code, uint8_t read_code,
+                                                       uint8_t quality) const {
+    return score_matrix[(quality_adjusted ? 25 * quality : 0) + 5 * ref_code + read_code];
+}
+
+void StripedGraphAligner::align(Alignment& alignment, const HandleGraph& graph, bool traceback_aln) const {
+
+    const string& sequence = alignment.sequence();
+    if (quality_adjusted && alignment.quality().size() != sequence.size()) {
+        cerr << "error:[StripedGraphAligner] Read " << alignment.name() << " has sequence and quality strings "
+             << "with different lengths. Cannot perform base quality adjusted alignment." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Find the best score the read could possibly get, to see if 16 bits are
+    // enough to hold it
+    int64_t max_possible_score = 0;
+    for (size_t i = 0; i < sequence.size(); i++) {
+        uint8_t read_code = encode_read_base(sequence[i], nt_table);
+        uint8_t quality = quality_adjusted ? alignment.quality()[i] : 0;
+        int32_t best_substitution = 0;
+        for (uint8_t ref_code = 0; ref_code < 5; ref_code++) {
+            best_substitution = max(best_substitution, substitution_score(ref_code, read_code, quality));
+        }
+        max_possible_score += best_substitution;
+    }
+    max_possible_score += 2 * full_length_bonus;
+
+    if (max_possible_score < numeric_limits<int16_t>::max()) {
+        switch (engine) {
+        case AVX2:
+            align_internal<int16_t>(alignment, graph, traceback_aln, 16, &striped_fill_node_avx2);
+            break;
+        case SSE41:
+            align_internal<int16_t>(alignment, graph, traceback_aln, 8, &striped_fill_node_sse41);
+            break;
+        default:
+            align_internal<int16_t>(alignment, graph, traceback_aln, 1, &striped_fill_node_scalar<int16_t>);
+            break;
+        }
+    } else {
+        align_internal<int32_t>(alignment, graph, traceback_aln, 1, &striped_fill_node_scalar<int32_t>);
+    }
+}
+
+template<typename IntType>
+void StripedGraphAligner::align_internal(Alignment& alignment, const HandleGraph& graph, bool traceback_aln,
+                                         size_t lanes, void (*fill_node)(StripedNodeFill<IntType>&)) const {
+
+    const string& sequence = alignment.sequence();
+    const string& quality = alignment.quality();
+
+    alignment.clear_path();
+    alignment.set_score(0);
+    alignment.set_query_position(0);
+    alignment.set_identity(0);
+
+    // Lay the graph out in topological order, skipping empty nodes and
+    // connecting their predecessors through to their successors instead
+    vector<handle_t> order = algorithms::topological_sort(&graph);
+    if (sequence.empty() || order.empty()) {
+        return;
+    }
+
+    unordered_map<handle_t, size_t> rank;
+    rank.reserve(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        rank[order[k]] = k;
+    }
+
+    vector<string> node_sequences(order.size());
+    vector<size_t> ref_start(order.size() + 1, 0);
+    vector<vector<size_t>> predecessors(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        node_sequences[k] = graph.get_sequence(order[k]);
+        ref_start[k + 1] = ref_start[k] + node_sequences[k].size();
+
+        graph.follow_edges(order[k], true, [&](const handle_t& prev) {
+            auto found = rank.find(prev);
+            if (found != rank.end() && found->second < k) {
+                if (node_sequences[found->second].empty()) {
+                    predecessors[k].insert(predecessors[k].end(), predecessors[found->second].begin(),
+                                           predecessors[found->second].end());
+                } else {
+                    predecessors[k].push_back(found->second);
+                }
+            }
+        });
+        sort(predecessors[k].begin(), predecessors[k].end());
+        predecessors[k].erase(unique(predecessors[k].begin(), predecessors[k].end()), predecessors[k].end());
+    }
+
+    vector<uint8_t> ref_codes(ref_start.back());
+    for (size_t k = 0; k < order.size(); k++) {
+        for (size_t j = 0; j < node_sequences[k].size(); j++) {
+            ref_codes[ref_start[k] + j] = encode_ref_base(node_sequences[k][j], nt_table);
+        }
+    }
+
+    // Build the striped query profile, with the full length bonus on both
+    // ends of the read and negative infinity in the padding past its end
+    const size_t read_length = sequence.size();
+    const size_t seg_len = (read_length + lanes - 1) / lanes;
+    const size_t step = seg_len * lanes;
+    auto striped_index = [&](size_t i) {
+        return (i % seg_len) * lanes + i / seg_len;
+    };
+
+    IntType* profile = (IntType*) profile_buffer.get(5 * step * sizeof(IntType));
+    for (uint8_t ref_code = 0; ref_code < 5; ref_code++) {
+        IntType* column = profile + ref_code * step;
+        for (size_t i = 0; i < step; i++) {
+            column[i] = neg_inf<IntType>();
+        }
+        for (size_t i = 0; i < read_length; i++) {
+            int32_t score = substitution_score(ref_code, encode_read_base(sequence[i], nt_table),
+                                               quality_adjusted ? quality[i] : 0);
+            if (i == 0) {
+                score += full_length_bonus;
+            }
+            if (i + 1 == read_length) {
+                score += full_length_bonus;
+            }
+            column[striped_index(i)] = score;
+        }
+    }
+
+    // With a traceback we keep every column. Without one, each node is
+    // computed in place in a single column, which ends up holding the last
+    // column that its successors need.
+    vector<size_t> column_start(order.size(), 0);
+    size_t total_columns = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        column_start[k] = total_columns;
+        if (!node_sequences[k].empty()) {
+            total_columns += traceback_aln ? node_sequences[k].size() : 1;
+        }
+    }
+
+    IntType* H_matrix = (IntType*) matrix_buffer.get(2 * total_columns * step * sizeof(IntType));
+    IntType* E_matrix = H_matrix + total_columns * step;
+
+    IntType* boundary = (IntType*) boundary_buffer.get(4 * step * sizeof(IntType));
+    IntType* H_source = boundary;
+    IntType* E_source = boundary + step;
+    IntType* H_merged = boundary + 2 * step;
+    IntType* E_merged = boundary + 3 * step;
+    for (size_t i = 0; i < step; i++) {
+        H_source[i] = 0;
+        E_source[i] = neg_inf<IntType>();
+    }
+
+    auto last_column = [&](size_t k) {
+        return column_start[k] + (traceback_aln ? node_sequences[k].size() - 1 : 0);
+    };
+
+    IntType best_score = 0;
+    size_t best_node = 0;
+    size_t best_column = 0;
+    bool found_best = false;
+
+    StripedNodeFill<IntType> fill;
+    fill.profile = profile;
+    fill.seg_len = seg_len;
+    fill.gap_open = gap_open;
+    fill.gap_extension = gap_extension;
+    fill.neg_inf = neg_inf<IntType>();
+    fill.col_stride = traceback_aln ? step : 0;
+
+    for (size_t k = 0; k < order.size(); k++) {
+        if (node_sequences[k].empty()) {
+            continue;
+        }
+
+        // Merge the last columns of the predecessors
+        const vector<size_t>& preds = predecessors[k];
+        if (preds.empty()) {
+            fill.H_in = H_source;
+            fill.E_in = E_source;
+        } else if (preds.size() == 1) {
+            fill.H_in = H_matrix + last_column(preds.front()) * step;
+            fill.E_in = E_matrix + last_column(preds.front()) * step;
+        } else {
+            const IntType* H_first = H_matrix + last_column(preds.front()) * step;
+            const IntType* E_first = E_matrix + last_column(preds.front()) * step;
+            copy(H_first, H_first + step, H_merged);
+            copy(E_first, E_first + step, E_merged);
+            for (size_t p = 1; p < preds.size(); p++) {
+                const IntType* H_pred = H_matrix + last_column(preds[p]) * step;
+                const IntType* E_pred = E_matrix + last_column(preds[p]) * step;
+                for (size_t i = 0; i < step; i++) {
+                    H_merged[i] = max(H_merged[i], H_pred[i]);
+                    E_merged[i] = max(E_merged[i], E_pred[i]);
+                }
+            }
+            fill.H_in = H_merged;
+            fill.E_in = E_merged;
+        }
+
+        fill.ref = ref_codes.data() + ref_start[k];
+        fill.ref_len = node_sequences[k].size();
+        fill.H_out = H_matrix + column_start[k] * step;
+        fill.E_out = E_matrix + column_start[k] * step;
+
+        fill_node(fill);
+
+        if (!found_best || fill.best > best_score) {
+            best_score = fill.best;
+            best_node = k;
+            best_column = fill.best_col;
+            found_best = true;
+        }
+    }
+
+    if (!found_best) {
+        // The graph is all empty nodes
+        return;
+    }
+
+    alignment.set_score(best_score);
+
+    if (!traceback_aln) {
+        // Just mark the end position, like gssw does
+        Mapping* mapping = alignment.mutable_path()->add_mapping();
+        Position* position = mapping->mutable_position();
+        position->set_node_id(graph.get_id(order[best_node]));
+        position->set_is_reverse(graph.get_is_reverse(order[best_node]));
+        position->set_offset(best_column);
+        return;
+    }
+
+    if (best_score <= 0) {
+        // No local alignment
+        return;
+    }
+
+    auto H_at = [&](size_t k, size_t j, size_t i) -> int64_t {
+        return H_matrix[(column_start[k] + j) * step + striped_index(i)];
+    };
+    auto E_at = [&](size_t k, size_t j, size_t i) -> int64_t {
+        return E_matrix[(column_start[k] + j) * step + striped_index(i)];
+    };
+    auto substitution_at = [&](size_t k, size_t j, size_t i) -> int64_t {
+        return profile[ref_codes[ref_start[k] + j] * step + striped_index(i)];
+    };
+
+    // Find the read position that the best score ends at
+    size_t end_offset = read_length;
+    for (size_t i = 0; i < read_length; i++) {
+        if (H_at(best_node, best_column, i) == best_score) {
+            end_offset = i;
+            break;
+        }
+    }
+    if (end_offset == read_length) {
+        throw runtime_error("error:[StripedGraphAligner] could not locate the end of the optimal alignment");
+    }
+
+    // Trace back from the end, collecting the steps in reverse. Matches and
+    // deletions record the node base they use; insertions record the base
+    // they follow.
+    struct TraceStep {
+        size_t node;
+        size_t offset;
+        char op;
+    };
+    vector<TraceStep> trace;
+
+    enum {STATE_H, STATE_E, STATE_F} state = STATE_H;
+    size_t k = best_node;
+    size_t j = best_column;
+    size_t i = end_offset;
+    int64_t value = best_score;
+    bool done = false;
+    while (!done) {
+        if (state == STATE_H) {
+            int64_t substitution = substitution_at(k, j, i);
+            if (value - substitution == 0) {
+                // The match starts the local alignment
+                trace.push_back(TraceStep{k, j, 'M'});
+                break;
+            }
+            bool moved = false;
+            if (i > 0) {
+                if (j > 0) {
+                    int64_t diag = H_at(k, j - 1, i - 1);
+                    if (diag + substitution == value) {
+                        trace.push_back(TraceStep{k, j, 'M'});
+                        j--;
+                        moved = true;
+                    }
+                } else {
+                    for (size_t pred : predecessors[k]) {
+                        int64_t diag = H_at(pred, node_sequences[pred].size() - 1, i - 1);
+                        if (diag + substitution == value) {
+                            trace.push_back(TraceStep{k, j, 'M'});
+                            k = pred;
+                            j = node_sequences[pred].size() - 1;
+                            moved = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (moved) {
+                i--;
+                value = H_at(k, j, i);
+            } else if (E_at(k, j, i) == value) {
+                state = STATE_E;
+            } else {
+                state = STATE_F;
+            }
+        } else if (state == STATE_E) {
+            // A deletion of this node base, opened from a match or extended
+            // from a deletion of the base before
+            trace.push_back(TraceStep{k, j, 'D'});
+            bool moved = false;
+            auto try_column = [&](size_t prev_k, size_t prev_j) {
+                int64_t H_prev = H_at(prev_k, prev_j, i);
+                int64_t E_prev = E_at(prev_k, prev_j, i);
+                if (H_prev - gap_open == value) {
+                    state = STATE_H;
+                    value = H_prev;
+                } else if (E_prev - gap_extension == value) {
+                    value = E_prev;
+                } else {
+                    return false;
+                }
+                k = prev_k;
+                j = prev_j;
+                return true;
+            };
+            if (j > 0) {
+                moved = try_column(k, j - 1);
+            } else {
+                for (size_t pred : predecessors[k]) {
+                    if (try_column(pred, node_sequences[pred].size() - 1)) {
+                        moved = true;
+                        break;
+                    }
+                }
+            }
+            if (!moved) {
+                throw runtime_error("error:[StripedGraphAligner] traceback failed in a deletion");
+            }
+        } else {
+            // An insertion of the read bases above this one
+            bool moved = false;
+            for (size_t length = 1; length <= i; length++) {
+                int64_t H_prev = H_at(k, j, i - length);
+                if (H_prev - gap_open - (int64_t) (length - 1) * gap_extension == value) {
+                    for (size_t l = 0; l < length; l++) {
+                        trace.push_back(TraceStep{k, j, 'I'});
+                    }
+                    i -= length;
+                    value = H_prev;
+                    state = STATE_H;
+                    moved = true;
+                    break;
+                }
+            }
+            if (!moved) {
+                throw runtime_error("error:[StripedGraphAligner] traceback failed in an insertion");
+            }
+        }
+    }
+    reverse(trace.begin(), trace.end());
+    size_t start_offset = i;
+
+    // Convert the trace into a Path, with soft clips on the ends
+    Path* path = alignment.mutable_path();
+    Mapping* mapping = nullptr;
+    size_t current_node = numeric_limits<size_t>::max();
+    size_t read_pos = start_offset;
+    for (const TraceStep& trace_step : trace) {
+        if (trace_step.node != current_node) {
+            current_node = trace_step.node;
+            mapping = path->add_mapping();
+            Position* position = mapping->mutable_position();
+            position->set_node_id(graph.get_id(order[current_node]));
+            position->set_is_reverse(graph.get_is_reverse(order[current_node]));
+            position->set_offset(trace_step.offset);
+            mapping->set_rank(path->mapping_size());
+
+            if (path->mapping_size() == 1 && start_offset > 0) {
+                Edit* soft_clip = mapping->add_edit();
+                soft_clip->set_to_length(start_offset);
+                soft_clip->set_sequence(sequence.substr(0, start_offset));
+            }
+        }
+
+        Edit* last = mapping->edit_size() > 0 ? mapping->mutable_edit(mapping->edit_size() - 1) : nullptr;
+        bool after_soft_clip = (path->mapping_size() == 1 && start_offset > 0 && mapping->edit_size() == 1);
+        switch (trace_step.op) {
+        case 'M':
+            if (node_sequences[current_node][trace_step.offset] == sequence[read_pos]) {
+                if (last && !after_soft_clip && last->from_length() == last->to_length() && last->sequence().empty()) {
+                    last->set_from_length(last->from_length() + 1);
+                    last->set_to_length(last->to_length() + 1);
+                } else {
+                    Edit* edit = mapping->add_edit();
+                    edit->set_from_length(1);
+                    edit->set_to_length(1);
+                }
+            } else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(1);
+                edit->set_sequence(sequence.substr(read_pos, 1));
+            }
+            read_pos++;
+            break;
+        case 'D':
+            if (last && !after_soft_clip && last->to_length() == 0) {
+                last->set_from_length(last->from_length() + 1);
+            } else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+            }
+            break;
+        default:
+            if (last && !after_soft_clip && last->from_length() == 0) {
+                last->set_to_length(last->to_length() + 1);
+                last->mutable_sequence()->push_back(sequence[read_pos]);
+            } else {
+                Edit* edit = mapping->add_edit();
+                edit->set_to_length(1);
+                edit->set_sequence(sequence.substr(read_pos, 1));
+            }
+            read_pos++;
+            break;
+        }
+    }
+
+    if (end_offset + 1 < read_length) {
+        Edit* soft_clip = mapping->add_edit();
+        soft_clip->set_to_length(read_length - end_offset - 1);
+        soft_clip->set_sequence(sequence.substr(end_offset + 1));
+    }
+
+    alignment.set_identity(identity(alignment.path()));
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef VG_STRIPED_ALIGNER_HPP_INCLUDED
+#define VG_STRIPED_ALIGNER_HPP_INCLUDED
+
+/**
+ * \file striped_aligner.hpp
+ *
+ * Local alignment of a read to a directed acyclic HandleGraph, with a striped
+ * SIMD fill within each node.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "vg.pb.h"
+#include "handle.hpp"
+#include "striped_kernel.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A graph aligner engine that stands in for gssw in local alignment. It reads
+ * node sequences and edges straight from a HandleGraph, so callers don't need
+ * to build a Protobuf Graph, and fills each node with Farrar's striped
+ * algorithm using AVX2 or SSE4.1, whichever the CPU supports. Score matrices
+ * live in per-thread buffers that are reused from one alignment to the next.
+ *
+ * Scoring matches gssw: affine gaps where the first gap base costs gap_open
+ * and each further base costs gap_extension, and the full length bonus is
+ * added to the scores of the first and last read bases.
+ */
+class StripedGraphAligner {
+public:
+
+    /// The kernels that can fill a node
+    enum Engine {SCALAR, SSE41, AVX2};
+
+    /// Make an aligner that uses the given scoring tables, which must outlive
+    /// it. If quality_adjusted is set, score_matrix is a stack of 5x5
+    /// matrices indexed by base quality, as used by QualAdjAligner.
+    StripedGraphAligner(const int8_t* score_matrix, const int8_t* nt_table,
+                        int8_t gap_open, int8_t gap_extension, int8_t full_length_bonus,
+                        bool quality_adjusted = false);
+
+    /// Store the optimal local alignment of the alignment's sequence to the
+    /// graph in the Alignment object. Nodes are visited in topological order,
+    /// and any edge that goes backward in that order is ignored. If
+    /// traceback_aln is false, only the score and the position of the last
+    /// aligned base are stored, as with gssw.
+    void align(Alignment& alignment, const HandleGraph& graph, bool traceback_aln) const;
+
+    /// Get the fastest kernel that the CPU we are running on supports.
+    static Engine best_engine();
+
+    /// The kernel to use. Defaults to best_engine(), and can be set lower to
+    /// compare kernels.
+    Engine engine;
+
+private:
+
+    /// Run the alignment with the given score type, lane count and kernel.
+    template<typename IntType>
+    void align_internal(Alignment& alignment, const HandleGraph& graph, bool traceback_aln,
+                        size_t lanes, void (*fill_node)(StripedNodeFill<IntType>&)) const;
+
+    /// Get the score for aligning read base read_code with quality quality
+    /// to reference base ref_code, without any bonus.
+    inline int32_t substitution_score(uint8_t ref_code, uint8_t read_code, uint8_t quality) const;
+
+    const int8_t* score_matrix;
+    const int8_t* nt_table;
+    int8_t gap_open;
+    int8_t gap_extension;
+    int8_t full_length_bonus;
+    bool quality_adjusted;
+};
+
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef VG_STRIPED_KERNEL_HPP_INCLUDED
+#define VG_STRIPED_KERNEL_HPP_INCLUDED
+
+/**
+ * \file striped_kernel.hpp
+ *
+ * The inner loop of the striped graph aligner: fills the local alignment DP
+ * for the columns of one node with Farrar's striped query layout. The kernel
+ * is written against a small set of vector operations so that the same code
+ * can be compiled once per instruction set. The per-instruction-set entry
+ * points live in their own translation units, which are built with the
+ * matching compiler flags, and are only called after checking the CPU.
+ *
+ * This header deliberately avoids the standard library containers, so that
+ * nothing inline from them gets compiled with extra instruction sets enabled.
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+namespace vg {
+
+/**
+ * The inputs and outputs of filling one node's columns.
+ *
+ * Each column holds seg_len vectors of lanes scores each, and query position
+ * i lives in lane i / seg_len of vector i % seg_len. The profile holds one
+ * such column of substitution scores for each of the 5 reference bases.
+ */
+template<typename IntType>
+struct StripedNodeFill {
+    /// Query profile, 5 columns
+    const IntType* profile;
+    /// Number of vectors per column
+    size_t seg_len;
+    /// Node sequence, encoded as 0-4
+    const uint8_t* ref;
+    size_t ref_len;
+    /// The column before this node's first column (the elementwise maximum
+    /// over the predecessor nodes' last columns)
+    const IntType* H_in;
+    const IntType* E_in;
+    /// Where to write the columns. Column c goes at offset c * col_stride, so
+    /// a stride of 0 computes the node in place in one column, leaving the
+    /// last column there.
+    IntType* H_out;
+    IntType* E_out;
+    size_t col_stride;
+    IntType gap_open;
+    IntType gap_extension;
+    /// Stands in for negative infinity; must leave room to subtract gap
+    /// penalties without wrapping.
+    IntType neg_inf;
+
+    /// Output: the best score in the node, and the first column it occurs in
+    IntType best;
+    size_t best_col;
+};
+
+/**
+ * Fill the DP for one node with local alignment recurrences:
+ *
+ *     E[i][j] = max(H[i][j-1] - gap_open, E[i][j-1] - gap_extension)
+ *     F[i][j] = max(H[i-1][j] - gap_open, F[i-1][j] - gap_extension)
+ *     H[i][j] = max(0, H[i-1][j-1] + s(i, j), E[i][j], F[i][j])
+ *
+ * The F recurrence runs down the query, across lanes, so it is resolved with
+ * Farrar's lazy F loop.
+ *
+ * Ops must provide a vector type V, a score type T, a lanes count, and static
+ * set1, load, store, adds, subs, max, shift_in (move every lane up by one and
+ * put a value in lane 0), any_gt and hmax.
+ */
+template<typename Ops>
+inline void striped_fill_node(StripedNodeFill<typename Ops::T>& fill) {
+    typedef typename Ops::V V;
+    typedef typename Ops::T T;
+
+    const size_t lanes = Ops::lanes;
+    const size_t seg_len = fill.seg_len;
+    const size_t step = seg_len * lanes;
+
+    const V v_open = Ops::set1(fill.gap_open);
+    const V v_extend = Ops::set1(fill.gap_extension);
+    const V v_zero = Ops::set1(0);
+    const V v_neg_inf = Ops::set1(fill.neg_inf);
+
+    fill.best = 0;
+    fill.best_col = 0;
+
+    const T* H_prev = fill.H_in;
+    const T* E_prev = fill.E_in;
+    for (size_t c = 0; c < fill.ref_len; c++) {
+        T* H_cur = fill.H_out + c * fill.col_stride;
+        T* E_cur = fill.E_out + c * fill.col_stride;
+        const T* P = fill.profile + fill.ref[c] * step;
+
+        // The diagonal predecessor of the first vector comes from the last
+        // vector of the previous column, moved up one lane. Load it before
+        // anything is written, in case we are computing in place.
+        V v_diag = Ops::shift_in(Ops::load(H_prev + (seg_len - 1) * lanes), 0);
+        V v_F = v_neg_inf;
+        V v_max = v_zero;
+
+        for (size_t s = 0; s < seg_len; s++) {
+            V v_H_left = Ops::load(H_prev + s * lanes);
+            V v_E = Ops::max(Ops::subs(v_H_left, v_open),
+                             Ops::subs(Ops::load(E_prev + s * lanes), v_extend));
+
+            V v_H = Ops::adds(v_diag, Ops::load(P + s * lanes));
+            v_diag = v_H_left;
+            v_H = Ops::max(v_H, v_E);
+            v_H = Ops::max(v_H, v_F);
+            v_H = Ops::max(v_H, v_zero);
+
+            Ops::store(H_cur + s * lanes, v_H);
+            Ops::store(E_cur + s * lanes, v_E);
+            v_max = Ops::max(v_max, v_H);
+
+            v_F = Ops::max(Ops::subs(v_H, v_open), Ops::subs(v_F, v_extend));
+        }
+
+        // Carry F across the lane boundaries until it can no longer improve
+        // anything
+        for (size_t k = 0; k < lanes; k++) {
+            v_F = Ops::shift_in(v_F, fill.neg_inf);
+            bool converged = false;
+            for (size_t s = 0; s < seg_len; s++) {
+                V v_H = Ops::max(Ops::load(H_cur + s * lanes), v_F);
+                Ops::store(H_cur + s * lanes, v_H);
+                v_max = Ops::max(v_max, v_H);
+
+                v_F = Ops::subs(v_F, v_extend);
+                if (!Ops::any_gt(v_F, Ops::subs(v_H, v_open))) {
+                    converged = true;
+                    break;
+                }
+            }
+            if (converged) {
+                break;
+            }
+        }
+
+        T col_max = Ops::hmax(v_max);
+        if (col_max > fill.best) {
+            fill.best = col_max;
+            fill.best_col = c;
+        }
+
+        H_prev = H_cur;
+        E_prev = E_cur;
+    }
+}
+
+/// Fill a node with 8 16-bit lanes. Only call if the CPU supports SSE4.1.
+void striped_fill_node_sse41(StripedNodeFill<int16_t>& fill);
+
+/// Fill a node with 16 16-bit lanes. Only call if the CPU supports AVX2.
+void striped_fill_node_avx2(StripedNodeFill<int16_t>& fill);
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * \file striped_kernel_avx2.cpp
+ *
+ * AVX2 instantiation of the striped graph aligner kernel. This file is
+ * compiled with -mavx2 and must only be entered after a CPU check.
+ */
+
+#include <immintrin.h>
+
+#include "striped_kernel.hpp"
+
+namespace vg {
+
+namespace {
+
+/// 16 lanes of saturating 16-bit scores
+struct AVX2Ops {
+    typedef __m256i V;
+    typedef int16_t T;
+    static const size_t lanes = 16;
+
+    static inline V set1(T value) { return _mm256_set1_epi16(value); }
+    static inline V load(const T* ptr) { return _mm256_load_si256((const __m256i*) ptr); }
+    static inline void store(T* ptr, V v) { _mm256_store_si256((__m256i*) ptr, v); }
+    static inline V adds(V a, V b) { return _mm256_adds_epi16(a, b); }
+    static inline V subs(V a, V b) { return _mm256_subs_epi16(a, b); }
+    static inline V max(V a, V b) { return _mm256_max_epi16(a, b); }
+    static inline V shift_in(V v, T fill) {
+        // Byte shifts only work within 128-bit halves, so bring the top lane
+        // of the low half across with alignr against the halves swapped down.
+        V carry = _mm256_permute2x128_si256(v, v, 0x08);
+        V shifted = _mm256_alignr_epi8(v, carry, 14);
+        return _mm256_insert_epi16(shifted, fill, 0);
+    }
+    static inline bool any_gt(V a, V b) {
+        V gt = _mm256_cmpgt_epi16(a, b);
+        return !_mm256_testz_si256(gt, gt);
+    }
+    static inline T hmax(V v) {
+        __m128i m = _mm_max_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        m = _mm_max_epi16(m, _mm_srli_si128(m, 8));
+        m = _mm_max_epi16(m, _mm_srli_si128(m, 4));
+        m = _mm_max_epi16(m, _mm_srli_si128(m, 2));
+        return (T) _mm_extract_epi16(m, 0);
+    }
+};
+
+}
+
+void striped_fill_node_avx2(StripedNodeFill<int16_t>& fill) {
+    striped_fill_node<AVX2Ops>(fill);
+}
+
+}
@@ -0,0 +1,49 @@
+/**
+ * \file striped_kernel_sse41.cpp
+ *
+ * SSE4.1 instantiation of the striped graph aligner kernel. This file is
+ * compiled with -msse4.1 and must only be entered after a CPU check.
+ */
+
+#include <smmintrin.h>
+
+#include "striped_kernel.hpp"
+
+namespace vg {
+
+namespace {
+
+/// 8 lanes of saturating 16-bit scores
+struct SSE41Ops {
+    typedef __m128i V;
+    typedef int16_t T;
+    static const size_t lanes = 8;
+
+    static inline V set1(T value) { return _mm_set1_epi16(value); }
+    static inline V load(const T* ptr) { return _mm_load_si128((const __m128i*) ptr); }
+    static inline void store(T* ptr, V v) { _mm_store_si128((__m128i*) ptr, v); }
+    static inline V adds(V a, V b) { return _mm_adds_epi16(a, b); }
+    static inline V subs(V a, V b) { return _mm_subs_epi16(a, b); }
+    static inline V max(V a, V b) { return _mm_max_epi16(a, b); }
+    static inline V shift_in(V v, T fill) {
+        return _mm_insert_epi16(_mm_slli_si128(v, 2), fill, 0);
+    }
+    static inline bool any_gt(V a, V b) {
+        V gt = _mm_cmpgt_epi16(a, b);
+        return !_mm_testz_si128(gt, gt);
+    }
+    static inline T hmax(V v) {
+        v = _mm_max_epi16(v, _mm_srli_si128(v, 8));
+        v = _mm_max_epi16(v, _mm_srli_si128(v, 4));
+        v = _mm_max_epi16(v, _mm_srli_si128(v, 2));
+        return (T) _mm_extract_epi16(v, 0);
+    }
+};
+
+}
+
+void striped_fill_node_sse41(StripedNodeFill<int16_t>& fill) {
+    striped_fill_node<SSE41Ops>(fill);
+}
+
+}
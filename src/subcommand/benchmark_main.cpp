@@ -16,6 +16,9 @@
 
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../mapper.hpp"
+#include "../build_index.hpp"
+#include "../banded_global_aligner.hpp"
 #include "../algorithms/extract_connecting_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/weakly_connected_components.hpp"
@@ -167,6 +170,166 @@ int main_benchmark(int argc, char** argv) {
     
     }));
     
+    // Build GCSA2/LCP indexes for MEM finding
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsa_index = nullptr;
+    gcsa::LCPArray* lcp_index = nullptr;
+    build_gcsa_lcp(vg_mut, gcsa_index, lcp_index, 16, 3);
+    Mapper mapper(const_cast<xg::XG*>(&xg_index), gcsa_index, lcp_index);
+    
+    // Make some reads by walking the graph, taking the first edge out that
+    // isn't back to a node we just left
+    vector<string> reads;
+    for (size_t i = 1; i < 101; i += 3) {
+        handle_t here = xg_index.get_handle(i, false);
+        string read;
+        while (read.size() < 100) {
+            read += xg_index.get_sequence(here);
+            bool moved = false;
+            xg_index.follow_edges(here, false, [&](const handle_t& next) {
+                here = next;
+                moved = true;
+                return false;
+            });
+            if (!moved) {
+                break;
+            }
+        }
+        reads.push_back(read.substr(0, 100));
+    }
+    
+    results.push_back(run_benchmark("BaseMapper::find_mems_deep", 100, [&]() {
+        double longest_lcp, fraction_filtered;
+        for (auto& read : reads) {
+            mapper.find_mems_deep(read.begin(), read.end(), longest_lcp, fraction_filtered, 0, 8, 16, false, true, true, false);
+        }
+    }));
+    
+    // This runs all the reads' searches interleaved at once, which is wider
+    // than the 16 reads per thread that vg map and vg mpmap batch. It shows
+    // how far the interleaving can go.
+    results.push_back(run_benchmark("BaseMapper::find_mems_deep_batch", 100, [&]() {
+        vector<pair<string::const_iterator, string::const_iterator>> seqs;
+        for (auto& read : reads) {
+            seqs.emplace_back(read.begin(), read.end());
+        }
+        vector<double> longest_lcps, fractions_filtered;
+        mapper.find_mems_deep_batch(seqs, longest_lcps, fractions_filtered, 0, 8, 16, false, true, true, false);
+    }));
+    
+    // Whole single-end mapping, one read at a time and in the batches vg map uses
+    vector<Alignment> read_alns(reads.size());
+    for (size_t i = 0; i < reads.size(); i++) {
+        read_alns[i].set_sequence(reads[i]);
+    }
+    
+    results.push_back(run_benchmark("Mapper::align_multi", 10, [&]() {
+        for (auto& aln : read_alns) {
+            mapper.align_multi(aln);
+        }
+    }));
+    
+    results.push_back(run_benchmark("Mapper::align_multi_batch", 10, [&]() {
+        for (size_t i = 0; i < read_alns.size(); i += 16) {
+            vector<Alignment> batch(read_alns.begin() + i, read_alns.begin() + min(i + 16, read_alns.size()));
+            mapper.align_multi_batch(batch);
+        }
+    }));
+
+    // Hold the mapped reads' alignments as candidates the way align_mem_multi
+    // used to, as copied and serialized Alignments, and the way it does now,
+    // in a reused pool
+    vector<vector<Alignment>> candidate_sets;
+    for (auto& aln : read_alns) {
+        candidate_sets.push_back(mapper.align_multi(aln));
+    }
+
+    results.push_back(run_benchmark("Alignment candidate copies", 100, [&]() {
+        for (size_t i = 0; i < read_alns.size(); i++) {
+            vector<Alignment> candidates(candidate_sets[i].begin(), candidate_sets[i].end());
+            set<string> seen;
+            for (auto& candidate : candidates) {
+                string serialized;
+                candidate.SerializeToString(&serialized);
+                seen.insert(serialized);
+            }
+        }
+    }));
+
+    results.push_back(run_benchmark("CompactAlignmentPool candidates", 100, [&]() {
+        for (size_t i = 0; i < read_alns.size(); i++) {
+            CompactAlignmentPool::Borrow candidates;
+            for (auto& aln : candidate_sets[i]) {
+                candidates->add(aln);
+            }
+            vector<Alignment> unique;
+            for (size_t j = 0; j < candidates->size(); j++) {
+                bool duplicate = false;
+                for (size_t k = 0; k < j && !duplicate; k++) {
+                    duplicate = candidates->same_alignment(j, k);
+                }
+                if (!duplicate) {
+                    unique.push_back(candidates->to_alignment(j, read_alns[i]));
+                }
+            }
+        }
+    }));
+
+    // Make a chain of SNP bubbles and a read through it with some errors, for
+    // banded global alignment
+    VG bubble_chain;
+    string bubble_read;
+    {
+        Node* prev = bubble_chain.create_node("GATTACA");
+        bubble_read = prev->sequence();
+        for (size_t i = 0; i < 30; i++) {
+            Node* ref = bubble_chain.create_node(string(1, "ACGT"[i % 4]));
+            Node* alt = bubble_chain.create_node(string(1, "ACGT"[(i + 1) % 4]));
+            Node* next = bubble_chain.create_node(i % 3 == 0 ? "CCTGAGTT" : "TTAGCCAG");
+            bubble_chain.create_edge(prev, ref);
+            bubble_chain.create_edge(prev, alt);
+            bubble_chain.create_edge(ref, next);
+            bubble_chain.create_edge(alt, next);
+            bubble_read += (i % 2 ? ref : alt)->sequence() + next->sequence();
+            prev = next;
+        }
+        bubble_read[50] = bubble_read[50] == 'A' ? 'C' : 'A';
+        bubble_read.erase(120, 2);
+        bubble_read.insert(200, "GG");
+    }
+    string bubble_quality;
+    for (size_t i = 0; i < bubble_read.size(); i++) {
+        bubble_quality.push_back("+5?I"[i % 4]);
+    }
+    
+    Aligner aligner;
+    QualAdjAligner qual_adj_aligner;
+    
+    // Time the banded global fill with and without the vector kernel
+    for (bool use_vector_kernel : {true, false}) {
+        string kernel_name = use_vector_kernel ? "vector" : "scalar";
+        
+        results.push_back(run_benchmark("BandedGlobalAligner<int16_t> " + kernel_name + " fill", 1000, [&]() {
+            Alignment aln;
+            aln.set_sequence(bubble_read);
+            BandedGlobalAligner<int16_t> band_graph(aln, bubble_chain.graph, 40, false, false);
+            band_graph.use_vector_kernel = use_vector_kernel;
+            band_graph.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+        }));
+        
+        results.push_back(run_benchmark("BandedGlobalAligner<int16_t> " + kernel_name + " fill, base quality adjusted", 1000, [&]() {
+            Alignment aln;
+            aln.set_sequence(bubble_read);
+            aln.set_quality(bubble_quality);
+            alignment_quality_char_to_short(aln);
+            BandedGlobalAligner<int16_t> band_graph(aln, bubble_chain.graph, 40, false, true);
+            band_graph.use_vector_kernel = use_vector_kernel;
+            band_graph.align(qual_adj_aligner.score_matrix, qual_adj_aligner.nt_table,
+                             qual_adj_aligner.gap_open, qual_adj_aligner.gap_extension);
+        }));
+    }
+    
     // Do the control against itself
     results.push_back(run_benchmark("control", 1000, benchmark_control));
 
@@ -176,6 +339,9 @@ int main_benchmark(int argc, char** argv) {
         cout << result << endl;
     }
 
+    delete gcsa_index;
+    delete lcp_index;
+
     return 0;
 }
 
@@ -36,7 +36,8 @@ void help_chunk(char** argv) {
          << "options:" << endl
          << "    -x, --xg-name FILE       use this xg index to chunk subgraphs" << endl
          << "    -G, --gbwt-name FILE     use this GBWT haplotype index for haplotype extraction" << endl
-         << "    -a, --gam-index FILE     chunk this gam index (made with vg index -a) instead of the graph" << endl
+         << "    -a, --gam-index FILE     chunk this gam index (made with vg index -a) instead of the graph." << endl
+         << "                             FILE may also be a sorted GAM with a FILE.gai index (made with vg gamsort -i)" << endl
          << "    -g, --gam-and-graph      when used in combination with -a, both gam and graph will be chunked" << endl 
          << "path chunking:" << endl
          << "    -p, --path TARGET        write the chunk in the specified (0-based inclusive)\n"
@@ -298,8 +299,26 @@ int main_chunk(int argc, char** argv) {
 
     // This holds the RocksDB index that has all our reads, indexed by the nodes they visit.
     Index gam_index;
+    // Or, if we were given a sorted GAM with a .gai, its lightweight index,
+    // and a stream on the GAM for each thread.
+    bool use_sorted_gam = false;
+    GAMIndex sorted_gam_index;
+    vector<unique_ptr<ifstream>> sorted_gam_streams;
     if (chunk_gam) {
-        gam_index.open_read_only(gam_file);
+        ifstream gai_in(gam_file + ".gai", ios::binary);
+        if (gai_in) {
+            use_sorted_gam = true;
+            sorted_gam_index.load(gai_in);
+            for (int i = 0; i < threads; ++i) {
+                sorted_gam_streams.emplace_back(new ifstream(gam_file, ios::binary));
+                if (!*sorted_gam_streams.back()) {
+                    cerr << "error:[vg chunk] unable to open sorted gam file " << gam_file << endl;
+                    return 1;
+                }
+            }
+        } else {
+            gam_index.open_read_only(gam_file);
+        }
     }
     
     // parse the regions into a list
@@ -531,7 +550,18 @@ int main_chunk(int argc, char** argv) {
                 cerr << "error[vg chunk]: can't open output gam file " << gam_name << endl;
                 exit(1);
             }
-            if (subgraph != NULL) {
+            if (use_sorted_gam) {
+                // The index always searches all positions
+                istream& sorted_gam = *sorted_gam_streams[tid];
+                if (subgraph != NULL) {
+                    chunker.extract_gam_for_subgraph(*subgraph, sorted_gam_index, sorted_gam,
+                                                     &out_gam_file, fully_contained);
+                } else {
+                    vector<vg::id_t> region_id_range = {region.start, region.end};
+                    chunker.extract_gam_for_ids(region_id_range, sorted_gam_index, sorted_gam,
+                                                &out_gam_file, true, fully_contained);
+                }
+            } else if (subgraph != NULL) {
                 chunker.extract_gam_for_subgraph(*subgraph, gam_index, &out_gam_file,
                                                  fully_contained, search_all_positions);
             } else {
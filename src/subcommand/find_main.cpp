@@ -3,6 +3,7 @@
 #include "../utility.hpp"
 #include "../mapper.hpp"
 #include "../stream.hpp"
+#include "../gam_index.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -29,7 +30,9 @@ void help_find(char** argv) {
          << "    -X, --approx-pos ID    get the approximate position of this node" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
-         << "alignments: (rocksdb only)" << endl
+         << "alignments: (rocksdb, or a sorted GAM with -l)" << endl
+         << "    -l, --sorted-gam FILE  use this sorted GAM and its FILE.gai index (from vg gamsort -i) for -i, -o" << endl
+         << "                           and -A, where -i finds alignments touching any node in the range" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
          << "    -o, --alns-on N:M      writes alignments which align to any of the nodes between N and M (inclusive)" << endl
@@ -100,6 +103,7 @@ int main_find(int argc, char** argv) {
     vector<string> extract_patterns;
     vg::id_t approx_id = 0;
     bool list_path_names = false;
+    string sorted_gam_name;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -143,11 +147,12 @@ int main_find(int argc, char** argv) {
                 {"threads-named", required_argument, 0, 'q'},
                 {"approx-pos", required_argument, 0, 'X'},
                 {"list-paths", no_argument, 0, 'I'},
+                {"sorted-gam", required_argument, 0, 'l'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:I",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:Il:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -164,6 +169,10 @@ int main_find(int argc, char** argv) {
             xg_name = optarg;
             break;
 
+        case 'l':
+            sorted_gam_name = optarg;
+            break;
+
         case 'g':
             gcsa_in = optarg;
             break;
@@ -319,8 +328,8 @@ int main_find(int argc, char** argv) {
         return 1;
     }
 
-    if (db_name.empty() && gcsa_in.empty() && xg_name.empty()) {
-        cerr << "[vg find] find requires -d, -g, or -x to know where to find its database" << endl;
+    if (db_name.empty() && gcsa_in.empty() && xg_name.empty() && sorted_gam_name.empty()) {
+        cerr << "[vg find] find requires -d, -g, -x, or -l to know where to find its database" << endl;
         return 1;
     }
 
@@ -354,12 +363,27 @@ int main_find(int argc, char** argv) {
     // open index
     Index* vindex = nullptr;
     if (db_name.empty()) {
-        assert(!gcsa_in.empty() || !xg_name.empty());
+        assert(!gcsa_in.empty() || !xg_name.empty() || !sorted_gam_name.empty());
     } else {
         vindex = new Index;
         vindex->open_read_only(db_name);
     }
 
+    // open the sorted GAM and its index, if we were given one
+    unique_ptr<GAMIndex> gam_index;
+    ifstream sorted_gam_in;
+    if (!sorted_gam_name.empty()) {
+        sorted_gam_in.open(sorted_gam_name, ios::binary);
+        ifstream gai_in(sorted_gam_name + ".gai", ios::binary);
+        if (!sorted_gam_in || !gai_in) {
+            cerr << "[vg find] error, unable to open sorted GAM " << sorted_gam_name
+                 << " and its index " << sorted_gam_name << ".gai" << endl;
+            exit(1);
+        }
+        gam_index = unique_ptr<GAMIndex>(new GAMIndex());
+        gam_index->load(gai_in);
+    }
+
     xg::XG xindex;
     if (!xg_name.empty()) {
         ifstream in(xg_name.c_str());
@@ -378,7 +402,7 @@ int main_find(int argc, char** argv) {
     }
 
     if (!node_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(!db_name.empty() || gam_index);
         vector<string> parts = split_delims(node_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -392,12 +416,16 @@ int main_find(int argc, char** argv) {
             output_buf.push_back(aln);
             stream::write_buffered(cout, output_buf, 100);
         };
-        vindex->for_alignment_in_range(start_id, end_id, lambda);
+        if (gam_index) {
+            gam_index->for_alignment_in_range(sorted_gam_in, start_id, end_id, lambda);
+        } else {
+            vindex->for_alignment_in_range(start_id, end_id, lambda);
+        }
         stream::write_buffered(cout, output_buf, 0);
     }
 
     if (!aln_on_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(!db_name.empty() || gam_index);
         vector<string> parts = split_delims(aln_on_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -415,12 +443,16 @@ int main_find(int argc, char** argv) {
             output_buf.push_back(aln);
             stream::write_buffered(cout, output_buf, 100);
         };
-        vindex->for_alignment_to_nodes(ids, lambda);
+        if (gam_index) {
+            gam_index->for_alignment_to_nodes(sorted_gam_in, ids, lambda);
+        } else {
+            vindex->for_alignment_to_nodes(ids, lambda);
+        }
         stream::write_buffered(cout, output_buf, 0);
     }
 
     if (!to_graph_file.empty()) {
-        assert(vindex != nullptr);
+        assert(vindex != nullptr || gam_index);
         ifstream tgi(to_graph_file);
         VG graph(tgi);
         vector<vg::id_t> ids;
@@ -430,7 +462,11 @@ int main_find(int argc, char** argv) {
             output_buf.push_back(aln);
             stream::write_buffered(cout, output_buf, 100);
         };
-        vindex->for_alignment_to_nodes(ids, lambda);
+        if (gam_index) {
+            gam_index->for_alignment_to_nodes(sorted_gam_in, ids, lambda);
+        } else {
+            vindex->for_alignment_to_nodes(ids, lambda);
+        }
         stream::write_buffered(cout, output_buf, 0);
     }
 
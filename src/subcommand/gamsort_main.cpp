@@ -1,8 +1,10 @@
 #include "gamsorter.hpp"
 #include "stream.hpp"
 #include <getopt.h>
+#include <omp.h>
 #include "subcommand.hpp"
 #include "index.hpp"
+#include "utility.hpp"
 #include "stream.hpp"
 
 /**
@@ -18,11 +20,15 @@ void help_gamsort(char **argv)
          << "Usage: " << argv[1] << " [Options] gamfile" << endl
          << "Options:" << endl
          << "  -p / --paired           Index a paired-end GAM." << endl
-         << "  -s / --sorted           Input GAM is already sorted." << endl
-         << "  -i / --index <INDEX>    produce a node-to-alignment index" << endl
+         << "  -s / --sorted           Input GAM is already sorted; just index it with -i." << endl
+         << "  -i / --index            also write a node ID index (.gai) of the sorted GAM" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
          << "  -r / --rocks            Just use the old RocksDB-style indexing scheme for sorting." << endl
          << "  -a / --aln-index        Create the old RocksDB-style node-to-alignment index." << endl
+         << "  -m / --max-memory N     use up to N MB of memory for sorted runs [2048]" << endl
+         << "  -b / --temp-dir DIR     use DIR for temporary files" << endl
+         << "  -P / --progress         report sorting time and throughput on stderr" << endl
+         << "  -t / --threads N        use N threads" << endl
          << endl;
 }
 
@@ -35,6 +41,8 @@ int main_gamsort(int argc, char **argv)
     bool is_sorted = false;
     bool just_use_rocks = false;
     bool do_aln_index = false;
+    bool show_progress = false;
+    size_t max_memory_mb = 2048;
     int c;
     optind = 2; // force optind past command positional argument
     while (true)
@@ -47,9 +55,13 @@ int main_gamsort(int argc, char **argv)
                 {"rocks", no_argument, 0, 'r'},
                 {"aln-index", no_argument, 0, 'a'},
                 {"is-sorted", no_argument, 0, 's'},
+                {"max-memory", required_argument, 0, 'm'},
+                {"temp-dir", required_argument, 0, 'b'},
+                {"progress", no_argument, 0, 'P'},
+                {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}};
         int option_index = 0;
-        c = getopt_long(argc, argv, "idhraps",
+        c = getopt_long(argc, argv, "idhrapsm:b:Pt:",
                         long_options, &option_index);
 
         // Detect the end of the options.
@@ -76,6 +88,18 @@ int main_gamsort(int argc, char **argv)
         case 'p':
             is_paired = true;
             break;
+        case 'm':
+            max_memory_mb = std::stoull(optarg);
+            break;
+        case 'b':
+            temp_file::set_dir(optarg);
+            break;
+        case 'P':
+            show_progress = true;
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
         case 'h':
         case '?':
         default:
@@ -92,7 +116,8 @@ int main_gamsort(int argc, char **argv)
 
     gamfile = argv[optind];
 
-    GAMSorter gs;
+    GAMSorter gs(show_progress);
+    gs.max_buf_bytes = max_memory_mb * 1024 * 1024;
 
     if (just_use_rocks && !do_index)
     {
@@ -124,13 +149,21 @@ int main_gamsort(int argc, char **argv)
         index.close();
     }
 
-    if (dumb_sort)
+    // The GAM that ends up sorted
+    string sorted_gamfile = gamfile;
+    if (is_sorted)
+    {
+        // Nothing to do
+    }
+    else if (dumb_sort)
     {
         gs.dumb_sort(gamfile);
+        sorted_gamfile = gamfile + ".sorted.gam";
     }
-    else if (!dumb_sort)
+    else
     {
         gs.stream_sort(gamfile);
+        sorted_gamfile = gamfile + ".sorted.gam";
     }
 
     if (do_index && just_use_rocks)
@@ -161,9 +194,8 @@ int main_gamsort(int argc, char **argv)
     }
     
     else if (do_index){
-        // Write a super simple index file of format
-        // node_d \tab firstAlnLineNumber \tab secondAlnLineNumber ...
-        gs.write_index(gamfile, gamfile + ".gai", false);
+        // Write a binned node ID index that can seek into the sorted GAM
+        gs.write_index(sorted_gamfile, sorted_gamfile + ".gai", is_sorted);
     }
 
     return 1;
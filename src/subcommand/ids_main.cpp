@@ -14,6 +14,7 @@
 
 #include "../vg.hpp"
 #include "../vg_set.hpp"
+#include "../compact_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 
 #include <gcsa/support.h>
@@ -110,9 +111,10 @@ int main_ids(int argc, char** argv) {
     }
 
     if (!join && mapping_name.empty()) {
-        VG* graph;
+        // We only renumber and reorder nodes, so we don't need a full VG
+        CompactGraph* graph;
         get_input_file(optind, argc, argv, [&](istream& in) {
-            graph = new VG(in);
+            graph = new CompactGraph(in);
         });
 
         if (sort) {
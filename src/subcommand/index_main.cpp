@@ -15,6 +15,8 @@
 #include "../vg_set.hpp"
 #include "../utility.hpp"
 #include "../path_index.hpp"
+#include "../distance_index.hpp"
+#include "../minimizer_index.hpp"
 
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
@@ -35,6 +37,15 @@ void help_index(char** argv) {
          << "xg options:" << endl
          << "    -x, --xg-name FILE     use this file to store a succinct, queryable version of the graph(s)" << endl
          << "    -F, --thread-db FILE   read thread database from FILE (may repeat)" << endl
+         << "    -e, --xg-max-mem N     keep at most N GB of graph records in memory while building the xg," << endl
+         << "                           spilling sorted runs to temporary files past that (default: no limit)" << endl
+         << "distance index options:" << endl
+         << "    -j, --dist-name FILE   store a minimum distance index for the graph in FILE (requires -s)" << endl
+         << "    -s, --snarl-name FILE  read the snarls of the graph from FILE (as made by vg snarls)" << endl
+         << "minimizer options:" << endl
+         << "    -I, --minimizer-name FILE  store a (w,k)-minimizer seed index for the graph in FILE" << endl
+         << "    -K, --minimizer-k N    length of the minimizer kmers (default 21, at most " << MinimizerIndex::MAX_K << ")" << endl
+         << "    -w, --minimizer-w N    number of kmers in each minimizer window (default 11)" << endl
          << "gbwt options:" << endl
          << "    -v, --vcf-phasing FILE generate threads from the haplotypes in the VCF file FILE" << endl
          << "    -T, --store-threads    generate threads from the embedded paths" << endl
@@ -130,11 +141,20 @@ int main_index(int argc, char** argv) {
     vector<string> dbg_names;
 
     // Files we should write.
-    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name;
+    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name, dist_name, minimizer_name;
 
     // General
     bool show_progress = false;
 
+    // XG
+    size_t xg_max_bytes = 0;
+
+    // Distance index
+    string snarls_name;
+
+    // Minimizer index
+    size_t minimizer_k = 21, minimizer_w = 11;
+
     // GBWT
     bool index_haplotypes = false, index_paths = false;
     size_t samples_in_batch = 200; // Samples per batch.
@@ -175,6 +195,14 @@ int main_index(int argc, char** argv) {
             // XG
             {"xg-name", required_argument, 0, 'x'},
             {"thread-db", required_argument, 0, 'F'},
+            {"xg-max-mem", required_argument, 0, 'e'},
+
+            // Distance index
+            {"dist-name", required_argument, 0, 'j'},
+            {"snarl-name", required_argument, 0, 's'},
+            {"minimizer-name", required_argument, 0, 'I'},
+            {"minimizer-k", required_argument, 0, 'K'},
+            {"minimizer-w", required_argument, 0, 'w'},
 
             // GBWT
             {"vcf-phasing", required_argument, 0, 'v'},
@@ -214,7 +242,7 @@ int main_index(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "b:t:px:F:v:TG:H:B:R:r:Eo:g:i:f:k:X:Z:Vd:maANDP:MLSCh",
+        c = getopt_long (argc, argv, "b:t:px:F:e:j:s:I:K:w:v:TG:H:B:R:r:Eo:g:i:f:k:X:Z:Vd:maANDP:MLSCh",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -242,6 +270,30 @@ int main_index(int argc, char** argv) {
         case 'F':
             thread_db_names.push_back(optarg);
             break;
+        case 'e':
+            xg_max_bytes = std::stod(optarg) * 1024 * 1024 * 1024;
+            break;
+
+        // Distance index
+        case 'j':
+            build_xg = true;
+            dist_name = optarg;
+            break;
+        case 's':
+            snarls_name = optarg;
+            break;
+
+        // Minimizer index
+        case 'I':
+            build_xg = true;
+            minimizer_name = optarg;
+            break;
+        case 'K':
+            minimizer_k = std::stoul(optarg);
+            break;
+        case 'w':
+            minimizer_w = std::stoul(optarg);
+            break;
 
         // GBWT
         case 'v':
@@ -378,11 +430,23 @@ int main_index(int argc, char** argv) {
         file_names.push_back(file_name);
     }
 
-    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()) {
+    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty() && dist_name.empty()
+        && minimizer_name.empty()) {
         cerr << "error: [vg index] index type not specified" << endl;
         return 1;
     }
 
+    if (!minimizer_name.empty() && (minimizer_k == 0 || minimizer_k > MinimizerIndex::MAX_K || minimizer_w == 0)) {
+        cerr << "error: [vg index] minimizer kmer length must be 1 to " << MinimizerIndex::MAX_K
+             << " and window length at least 1" << endl;
+        return 1;
+    }
+
+    if (!dist_name.empty() && snarls_name.empty()) {
+        cerr << "error: [vg index] building a distance index requires snarls (-s)" << endl;
+        return 1;
+    }
+
     if ((build_gbwt || write_threads) && !(index_haplotypes || index_paths)) {
         cerr << "error: [vg index] cannot build GBWT without threads" << endl;
         return 1;
@@ -420,6 +484,7 @@ int main_index(int argc, char** argv) {
         }
         VGset graphs(file_names);
         build_gpbwt = !build_gbwt & !write_threads;
+        xg_index->max_construction_bytes = xg_max_bytes;
         graphs.to_xg(*xg_index, index_paths & build_gpbwt, Paths::is_alt, alt_paths);
         if (show_progress) {
             cerr << "Built base XG index" << endl;
@@ -1030,6 +1095,40 @@ int main_index(int argc, char** argv) {
         }
     }
 
+    // Build the distance index on the XG
+    if (!dist_name.empty()) {
+        ifstream snarl_stream(snarls_name);
+        if (!snarl_stream) {
+            cerr << "error: [vg index] cannot open snarls file " << snarls_name << endl;
+            return 1;
+        }
+        SnarlManager snarl_manager(snarl_stream);
+        if (show_progress) {
+            cerr << "Building distance index..." << endl;
+        }
+        DistanceIndex distance_index(xg_index, &snarl_manager);
+        ofstream dist_out(dist_name);
+        distance_index.save(dist_out);
+    }
+
+    // Build the minimizer index on the XG
+    if (!minimizer_name.empty()) {
+        if (show_progress) {
+            cerr << "Building minimizer index..." << endl;
+        }
+        try {
+            MinimizerIndex minimizer_index(*xg_index, minimizer_k, minimizer_w);
+            if (show_progress) {
+                cerr << minimizer_index.size() << " distinct minimizers" << endl;
+            }
+            ofstream minimizer_out(minimizer_name);
+            minimizer_index.save(minimizer_out);
+        } catch (const runtime_error& e) {
+            cerr << "error: [vg index] " << e.what() << endl;
+            return 1;
+        }
+    }
+
     // Save XG
     if (!xg_name.empty()) {
         if (!thread_db_names.empty()) {
@@ -3,7 +3,9 @@
 #include "../utility.hpp"
 #include "../mapper.hpp"
 #include "../surjector.hpp"
+#include "../hts_alignment_writer.hpp"
 #include "../stream.hpp"
+#include "../stream_writer.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -74,6 +76,8 @@ void help_map(char** argv) {
          << "output:" << endl
          << "    -j, --output-json       output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    --surject-to TYPE       surject the output into the graph's paths, writing TYPE := bam |sam | cram" << endl
+         << "    --compression INT       compress surjected BAM or CRAM output at this level [9]" << endl
+         << "    --sort-by-position      sort surjected output by position on the paths" << endl
          << "    --buffer-size INT       buffer this many alignments together before outputting in GAM [512]" << endl
          << "    -X, --compare           realign GAM input (-G), writing alignment with \"correct\" field set to overlap with input" << endl
          << "    -v, --refpos-table      for efficient testing output a table of name, chr, pos, mq, score" << endl
@@ -92,6 +96,8 @@ int main_map(int argc, char** argv) {
     }
 
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_COMPRESSION 1001
+    #define OPT_SORT_BY_POSITION 1002
     string matrix_file_name;
     string seq;
     string qual;
@@ -109,6 +115,8 @@ int main_map(int argc, char** argv) {
     int thread_count = 1;
     bool output_json = false;
     string surject_type;
+    int compress_level = 9;
+    bool sort_by_position = false;
     bool debug = false;
     float min_score = 0;
     string sample_name;
@@ -231,6 +239,8 @@ int main_map(int argc, char** argv) {
                 {"id-mq-weight", required_argument, 0, '7'},
                 {"refpos-table", no_argument, 0, 'v'},
                 {"surject-to", required_argument, 0, '5'},
+                {"compression", required_argument, 0, OPT_COMPRESSION},
+                {"sort-by-position", no_argument, 0, OPT_SORT_BY_POSITION},
                 {"no-patch-aln", no_argument, 0, '8'},
                 {"drop-full-l-bonus", no_argument, 0, '2'},
                 {"unpaired-cost", required_argument, 0, 'S'},
@@ -461,6 +471,22 @@ int main_map(int argc, char** argv) {
 
         case '5':
             surject_type = optarg;
+            if (surject_type != "sam" && surject_type != "bam" && surject_type != "cram") {
+                cerr << "error:[vg map] Cannot surject to unknown format " << surject_type << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_COMPRESSION:
+            compress_level = atoi(optarg);
+            if (compress_level < 0 || compress_level > 9) {
+                cerr << "error:[vg map] Compression level must be from 0 to 9." << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_SORT_BY_POSITION:
+            sort_by_position = true;
             break;
 
         case '8':
@@ -646,21 +672,28 @@ int main_map(int argc, char** argv) {
     mapper.resize(thread_count);
     vector<vector<Alignment> > output_buffer;
     output_buffer.resize(thread_count);
+    // alignments waiting to be surjected, and their mates if paired, so the
+    // surjector gets batches big enough to share path lookups across
+    vector<vector<Alignment> > surject_buffer;
+    vector<vector<Alignment> > surject_mate_buffer;
+    surject_buffer.resize(thread_count);
+    surject_mate_buffer.resize(thread_count);
     vector<Alignment> empty_alns;
     
-    // If we need to do surjection
-    Surjector surjector(xgidx);
-
-    // bam/sam/cram output
-    samFile* sam_out = 0;
-    int buffer_limit = 100;
-    bam_hdr_t* hdr = nullptr;
-    int compress_level = 9; // hard coded
-    map<string, string> rg_sample;
-    string sam_header;
-    
+    // bam/sam/cram output, written from all the mapping threads
+    unique_ptr<HTSAlignmentWriter> hts_writer;
     vector<Surjector*> surjectors;
     if (!surject_type.empty()) {
+        map<string, int64_t> path_length;
+        int num_paths = xgidx->max_path_rank();
+        for (int i = 1; i <= num_paths; ++i) {
+            auto name = xgidx->path_name(i);
+            path_length[name] = xgidx->path_length(name);
+        }
+        hts_writer = unique_ptr<HTSAlignmentWriter>(new HTSAlignmentWriter(surject_type, path_length,
+                                                                           surject_type == "sam" ? -1 : compress_level,
+                                                                           thread_count, sort_by_position));
+        
         surjectors.resize(thread_count);
         for (int i = 0; i < surjectors.size(); i++) {
             surjectors[i] = new Surjector(xgidx);
@@ -675,174 +708,30 @@ int main_map(int argc, char** argv) {
         }
     }
 
-    // for SAM header generation
-    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header] (void) {
-#pragma omp critical (hts_header)
-        if (!hdr) {
-            char out_mode[5];
-            string out_format = "";
-            strcpy(out_mode, "w");
-            if (surject_type == "bam") { out_format = "b"; }
-            else if (surject_type == "cram") { out_format = "c"; }
-            else { out_format = ""; }
-            strcat(out_mode, out_format.c_str());
-            if (compress_level >= 0) {
-                char tmp[2];
-                tmp[0] = compress_level + '0'; tmp[1] = '\0';
-                strcat(out_mode, tmp);
-            }
-            map<string, int64_t> path_length;
-            int num_paths = xgidx->max_path_rank();
-            for (int i = 1; i <= num_paths; ++i) {
-                auto name = xgidx->path_name(i);
-                path_length[name] = xgidx->path_length(name);
-            }
-            hdr = hts_string_header(sam_header, path_length, rg_sample);
-            if ((sam_out = sam_open("-", out_mode)) == 0) {
-                cerr << "[vg map] failed to open stdout for writing HTS output" << endl;
-                exit(1);
-            } else {
-                // write the header
-                if (sam_hdr_write(sam_out, hdr) != 0) {
-                    cerr << "[vg map] error: failed to write the SAM header" << endl;
-                }
-            }
-        }
-    };
-
-    // TODO: Refactor the surjection code out of surject_main and intto somewhere where we can just use it here!
-
-    auto surject_alignments = [&hdr, &sam_header, &mapper, &rg_sample, &setup_sam_header, &path_names, &sam_out, &xgidx, &surjectors] (const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+    auto surject_alignments = [&hts_writer, &path_names, &surjectors] (const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
         
         if (alns1.empty()) return;
-        setup_sam_header();
-        vector<tuple<string, int64_t, bool, Alignment> > surjects1, surjects2;
-        int tid = omp_get_thread_num();
-        for (auto& aln : alns1) {
-            // Surject each alignment of the first read in the pair
-            string path_name;
-            int64_t path_pos = -1;
-            bool path_reverse = false;
-            
-            auto surj = surjectors[omp_get_thread_num()]->path_anchored_surject(aln, path_names, path_name, path_pos, path_reverse);
-            surjects1.push_back(make_tuple(path_name, path_pos, path_reverse, surj));
-            
-            // hack: if we haven't established the header, we look at the reads to guess which read groups to put in it
-            if (!hdr && !surj.read_group().empty() && !surj.sample_name().empty()) {
-#pragma omp critical (hts_header)
-                rg_sample[surj.read_group()] = surj.sample_name();
-            }
-        }
+        // Surject all the alignments of both reads in the pairs together, so
+        // they can share lookups along the paths they are on
+        vector<Alignment> alns(alns1);
+        alns.insert(alns.end(), alns2.begin(), alns2.end());
+        vector<Surjector::surjection_t> surjected;
+        surjectors[omp_get_thread_num()]->path_anchored_surject_batch(alns, path_names, surjected);
         
-        for (auto& aln : alns2) {
-            // Surject each alignment of the second read in the pair, if any
-            string path_name;
-            int64_t path_pos = -1;
-            bool path_reverse = false;
-            
-            auto surj = surjectors[omp_get_thread_num()]->path_anchored_surject(aln, path_names, path_name, path_pos, path_reverse);
-            surjects2.push_back(make_tuple(path_name, path_pos, path_reverse, surj));
-            
-            // Don't try and populate the header; it should have happened already
-        }
-        
-        if (surjects2.empty()) {
+        if (alns2.empty()) {
             // Write out surjected single-end reads
-        
-            for (auto& s : surjects1) {
-                auto& path_name = get<0>(s);
-                auto& path_pos = get<1>(s);
-                auto& path_reverse = get<2>(s);
-                auto& surj = get<3>(s);
-                
-                size_t path_len = 0;
-                if (path_name != "") {
-                    path_len = xgidx->path_length(path_name);
-                }
-                string cigar = cigar_against_path(surj, path_reverse, path_pos, path_len, 0);
-                bam1_t* b = alignment_to_bam(sam_header,
-                                             surj,
-                                             path_name,
-                                             path_pos,
-                                             path_reverse,
-                                             cigar);
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b);
-            }
+            hts_writer->write(surjected);
         } else {
-            // Write out surjected paired-end reads
-            
-            // Paired-end reads come in corresponding pairs, allowing duplicate reads.
-            assert(surjects1.size() == surjects2.size());
-            
-            for (size_t i = 0; i < surjects1.size(); i++) {
-                // For each corresponding pair
-                auto& s1 = surjects1[i];
-                auto& s2 = surjects2[i];
-
-                // Unpack each read
-                auto& path_name1 = get<0>(s1);
-                auto& path_pos1 = get<1>(s1);
-                auto& path_reverse1 = get<2>(s1);
-                auto& surj1 = get<3>(s1);
-                
-                auto& path_name2 = get<0>(s2);
-                auto& path_pos2 = get<1>(s2);
-                auto& path_reverse2 = get<2>(s2);
-                auto& surj2 = get<3>(s2);
-                
-                // Compute CIGARs
-                size_t path_len1, path_len2;
-                if (path_name1 != "") {
-                    path_len1 = xgidx->path_length(path_name1);
-                }
-                if (path_name2 != "") {
-                    path_len2 = xgidx->path_length(path_name2);
-                }
-                string cigar1 = cigar_against_path(surj1, path_reverse1, path_pos1, path_len1, 0);
-                string cigar2 = cigar_against_path(surj2, path_reverse2, path_pos2, path_len2, 0);
-                
-                // TODO: compute template length based on
-                // pair distance and alignment content.
-                int template_length = 0;
-                
-                // Make BAM records
-                bam1_t* b1 = alignment_to_bam(sam_header,
-                                              surj1,
-                                              path_name1,
-                                              path_pos1,
-                                              path_reverse1,
-                                              cigar1,
-                                              path_name2,
-                                              path_pos2,
-                                              template_length);
-                bam1_t* b2 = alignment_to_bam(sam_header,
-                                              surj2,
-                                              path_name2,
-                                              path_pos2,
-                                              path_reverse2,
-                                              cigar2,
-                                              path_name1,
-                                              path_pos1,
-                                              template_length);
-                
-                // Write the records
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b1);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b1);
-                r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b2);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b2);
+            // Paired-end reads come in corresponding pairs, allowing duplicate
+            // reads. The writer wants each pair together.
+            assert(alns1.size() == alns2.size());
+            vector<Surjector::surjection_t> pairs;
+            pairs.reserve(surjected.size());
+            for (size_t i = 0; i < alns1.size(); i++) {
+                pairs.emplace_back(std::move(surjected[i]));
+                pairs.emplace_back(std::move(surjected[alns1.size() + i]));
             }
-            
-            
+            hts_writer->write(pairs, true);
         }
     };
 
@@ -867,9 +756,19 @@ int main_map(int argc, char** argv) {
         }
     };
 
+    // GAM output goes through a background writer, so threads compress their
+    // own buffers and don't queue up behind each other's gzip work
+    unique_ptr<stream::AsyncWriter> gam_writer;
+    if (!output_json && !refpos_table && surject_type.empty()) {
+        gam_writer = unique_ptr<stream::AsyncWriter>(new stream::AsyncWriter(cout));
+    }
+
     // We have one function to dump alignments into
     // Make sure to flush the buffer at the end of the program!
     auto output_alignments = [&output_buffer,
+                              &surject_buffer,
+                              &surject_mate_buffer,
+                              &gam_writer,
                               &output_json,
                               &surject_type,
                               &surject_alignments,
@@ -892,8 +791,19 @@ int main_map(int argc, char** argv) {
                 write_refpos(alns2);
             }
         } else if (!surject_type.empty()) {
-            // surject
-            surject_alignments(alns1, alns2);
+            // surject a buffer's worth at a time for our thread
+            int tid = omp_get_thread_num();
+            auto& surject_buf = surject_buffer[tid];
+            auto& surject_mate_buf = surject_mate_buffer[tid];
+            
+            copy(alns1.begin(), alns1.end(), back_inserter(surject_buf));
+            copy(alns2.begin(), alns2.end(), back_inserter(surject_mate_buf));
+            
+            if (surject_buf.size() + surject_mate_buf.size() >= buffer_size) {
+                surject_alignments(surject_buf, surject_mate_buf);
+                surject_buf.clear();
+                surject_mate_buf.clear();
+            }
         } else {
             // Otherwise write them through the buffer for our thread
             int tid = omp_get_thread_num();
@@ -903,7 +813,7 @@ int main_map(int argc, char** argv) {
             copy(alns1.begin(), alns1.end(), back_inserter(output_buf));
             copy(alns2.begin(), alns2.end(), back_inserter(output_buf));
 
-            stream::write_buffered(cout, output_buf, buffer_size);
+            gam_writer->write_buffered(output_buf, buffer_size);
         }
     };
 
@@ -965,6 +875,38 @@ int main_map(int argc, char** argv) {
         mapper[i] = m;
     }
 
+    // Single-end reads from FASTQ or GAM are mapped in small batches per
+    // thread, so that the GCSA2 searches for their MEMs can be interleaved.
+    // Make sure to flush the batches once the input runs out!
+    const size_t read_batch_size = 16;
+    vector<vector<Alignment>> read_batches(thread_count);
+    auto map_read_batch = [&](int tid) {
+        auto& batch = read_batches[tid];
+        vector<vector<Alignment>> batch_alignments = mapper[tid]->align_multi_batch(batch, kmer_size, kmer_stride,
+                                                                                    max_mem_length, band_width);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (compare_gam) {
+                batch_alignments[i].front().set_correct(overlap(batch[i].path(), batch_alignments[i].front().path()));
+            }
+            // Output the alignments in JSON or protobuf as appropriate.
+            output_alignments(batch_alignments[i], empty_alns);
+        }
+        batch.clear();
+    };
+    function<void(Alignment&)> queue_read = [&](Alignment& alignment) {
+        int tid = omp_get_thread_num();
+        read_batches[tid].emplace_back(std::move(alignment));
+        if (read_batches[tid].size() >= read_batch_size) {
+            map_read_batch(tid);
+        }
+    };
+    auto flush_read_batches = [&]() {
+#pragma omp parallel
+        {
+            map_read_batch(omp_get_thread_num());
+        }
+    };
+
     if (!seq.empty()) {
         int tid = omp_get_thread_num();
 
@@ -1147,22 +1089,8 @@ int main_map(int argc, char** argv) {
             }
         } else if (fastq2.empty()) {
             // single
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &empty_alns]
-                    (Alignment& alignment) {
-
-                        int tid = omp_get_thread_num();
-                        vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-                        //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
-                        output_alignments(alignments, empty_alns);
-                    };
-            fastq_unpaired_for_each_parallel(fastq1, lambda);
+            fastq_unpaired_for_each_parallel(fastq1, queue_read);
+            flush_read_batches();
         } else {
             // paired two-file
             auto output_func = [&output_alignments,
@@ -1299,33 +1227,20 @@ int main_map(int argc, char** argv) {
                 our_mapper->imperfect_pairs_to_retry.clear();
             }
         } else {
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &compare_gam,
-                 &empty_alns]
-                (Alignment& alignment) {
-                int tid = omp_get_thread_num();
-                std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
-                vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-                std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-                std::chrono::duration<double> elapsed_seconds = end-start;
-                // Output the alignments in JSON or protobuf as appropriate.
-                if (compare_gam) {
-                    alignments.front().set_correct(overlap(alignment.path(), alignments.front().path()));
-                }
-                output_alignments(alignments, empty_alns);
-            };
-            stream::for_each_parallel(gam_in, lambda);
+            stream::for_each_parallel(gam_in, queue_read);
+            flush_read_batches();
         }
         gam_in.close();
     }
 
+    if (gam_writer) {
+        // write out whatever is left in the buffers, and wait for it all to hit the stream
+        for (auto& output_buf : output_buffer) {
+            gam_writer->write(output_buf);
+        }
+        gam_writer->finish();
+    }
+
     if (print_fragment_model) {
         if (mapper[0]->frag_stats.fragment_size) {
             // we've calculated our fragment size, so print it and bail out
@@ -1338,17 +1253,15 @@ int main_map(int argc, char** argv) {
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
-        auto& output_buf = output_buffer[i];
-        if (!output_json && !refpos_table && surject_type.empty()) {
-            stream::write_buffered(cout, output_buf, 0);
-        }
     }
 
     // special cleanup for htslib outputs
-    if (!surject_type.empty()) {
-        if (hdr != nullptr) bam_hdr_destroy(hdr);
-        sam_close(sam_out);
-        cout.flush();
+    if (hts_writer) {
+        // surject whatever is left in the buffers
+        for (int i = 0; i < thread_count; ++i) {
+            surject_alignments(surject_buffer[i], surject_mate_buffer[i]);
+        }
+        hts_writer->finish();
     }
     
     if (haplo_score_provider) {
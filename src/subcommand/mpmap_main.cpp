@@ -10,6 +10,9 @@
 
 #include "../multipath_mapper.hpp"
 #include "../path.hpp"
+#include "../stream_writer.hpp"
+#include "../surjector.hpp"
+#include "../hts_alignment_writer.hpp"
 
 //#define record_read_run_times
 
@@ -31,10 +34,12 @@ void help_mpmap(char** argv) {
     << "basic options:" << endl
     << "graph/index:" << endl
     << "  -x, --xg-name FILE        use this xg index (required)" << endl
-    << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required; both FILE and FILE.lcp)" << endl
+    << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required unless using --minimizer-name; both FILE and FILE.lcp)" << endl
+    << "      --minimizer-name FILE use this minimizer index (from vg index -I) to find seeds instead of GCSA2 MEMs" << endl
     << "  -H, --gbwt-name FILE      use this GBWT haplotype index for population-based MAPQs" << endl
     << "      --linear-index FILE   use this sublinear Li and Stephens index file for population-based MAPQs" << endl
     << "      --linear-path PATH    use the given path name as the path that the linear index is against" << endl
+    << "      --dist-name FILE      use this minimum distance index (from vg index -j) to cluster hits and pair reads" << endl
     << "input:" << endl
     << "  -f, --fastq FILE          input FASTQ (possibly compressed), can be given twice for paired ends (for stdin use -)" << endl
     << "  -G, --gam-input FILE      input GAM (for stdin, use -)" << endl
@@ -42,6 +47,10 @@ void help_mpmap(char** argv) {
     << "  -N, --sample NAME         add this sample name to output GAM" << endl
     << "  -R, --read-group NAME     add this read group to output GAM" << endl
     << "  -e, --same-strand         read pairs are from the same strand of the DNA molecule" << endl
+    << "output:" << endl
+    << "      --surject-to TYPE     surject single path alignments into the graph's paths, writing TYPE := sam | bam | cram (implies -S)" << endl
+    << "      --compression INT     compress surjected BAM or CRAM output at this level [9]" << endl
+    << "      --sort-by-position    sort surjected output by position on the paths" << endl
     << "algorithm:" << endl
     << "  -S, --single-path-mode    produce single-path alignments (GAM) instead of multipath alignments (GAMP) (ignores -sua)" << endl
     << "  -s, --snarls FILE         align to alternate paths in these snarls" << endl
@@ -83,7 +92,8 @@ void help_mpmap(char** argv) {
     << "  -m, --remove-bonuses      remove full length alignment bonuses in reported scores" << endl
     << "computational parameters:" << endl
     << "  -t, --threads INT         number of compute threads to use" << endl
-    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl;
+    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl
+    << "      --verbose             report statistics about the mapping run to stderr when finished" << endl;
     
 }
 
@@ -96,6 +106,12 @@ int main_mpmap(int argc, char** argv) {
 
     // initialize parameters with their default options
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_DIST_NAME 1001
+    #define OPT_MINIMIZER_NAME 1002
+    #define OPT_VERBOSE 1003
+    #define OPT_SURJECT_TO 1004
+    #define OPT_COMPRESSION 1005
+    #define OPT_SORT_BY_POSITION 1006
     string matrix_file_name;
     string xg_name;
     string gcsa_name;
@@ -103,6 +119,8 @@ int main_mpmap(int argc, char** argv) {
     string sublinearLS_name;
     string sublinearLS_ref_path;
     string snarls_name;
+    string dist_name;
+    string minimizer_name;
     string fastq_name_1;
     string fastq_name_2;
     string gam_file_name;
@@ -118,6 +136,7 @@ int main_mpmap(int argc, char** argv) {
     int max_rescue_attempts = 32;
     int max_num_mappings = 1;
     int buffer_size = 100;
+    bool verbose = false;
     int hit_max = 256;
     int min_mem_length = 1;
     int min_clustering_mem_length = 0;
@@ -135,6 +154,9 @@ int main_mpmap(int argc, char** argv) {
     double suboptimal_path_exponent = 1.25;
     double likelihood_approx_exp = 6.5;
     bool single_path_alignment_mode = false;
+    string surject_type;
+    int compress_level = 9;
+    bool sort_by_position = false;
     int max_mapq = 60;
     size_t frag_length_sample_size = 1000;
     double frag_length_robustness_fraction = 0.95;
@@ -169,6 +191,8 @@ int main_mpmap(int argc, char** argv) {
             {"gbwt-name", required_argument, 0, 'H'},
             {"linear-index", required_argument, 0, 1},
             {"linear-path", required_argument, 0, 2},
+            {"dist-name", required_argument, 0, OPT_DIST_NAME},
+            {"minimizer-name", required_argument, 0, OPT_MINIMIZER_NAME},
             {"fastq", required_argument, 0, 'f'},
             {"gam-input", required_argument, 0, 'G'},
             {"sample", required_argument, 0, 'N'},
@@ -210,6 +234,10 @@ int main_mpmap(int argc, char** argv) {
             {"no-qual-adjust", no_argument, 0, 'A'},
             {"threads", required_argument, 0, 't'},
             {"buffer-size", required_argument, 0, 'Z'},
+            {"verbose", no_argument, 0, OPT_VERBOSE},
+            {"surject-to", required_argument, 0, OPT_SURJECT_TO},
+            {"compression", required_argument, 0, OPT_COMPRESSION},
+            {"sort-by-position", no_argument, 0, OPT_SORT_BY_POSITION},
             {0, 0, 0, 0}
         };
 
@@ -252,6 +280,22 @@ int main_mpmap(int argc, char** argv) {
                 sublinearLS_ref_path = optarg;
                 break;
                 
+            case OPT_DIST_NAME:
+                dist_name = optarg;
+                if (dist_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide distance index file with --dist-name." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_MINIMIZER_NAME:
+                minimizer_name = optarg;
+                if (minimizer_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide minimizer index file with --minimizer-name." << endl;
+                    exit(1);
+                }
+                break;
+                
             case 'f':
                 if (fastq_name_1.empty()) {
                     fastq_name_1 = optarg;
@@ -478,6 +522,32 @@ int main_mpmap(int argc, char** argv) {
                 buffer_size = atoi(optarg);
                 break;
                 
+            case OPT_VERBOSE:
+                verbose = true;
+                break;
+                
+            case OPT_SURJECT_TO:
+                surject_type = optarg;
+                if (surject_type != "sam" && surject_type != "bam" && surject_type != "cram") {
+                    cerr << "error:[vg mpmap] Cannot surject to unknown format " << surject_type << "." << endl;
+                    exit(1);
+                }
+                // we can only surject single path alignments
+                single_path_alignment_mode = true;
+                break;
+                
+            case OPT_COMPRESSION:
+                compress_level = atoi(optarg);
+                if (compress_level < 0 || compress_level > 9) {
+                    cerr << "error:[vg mpmap] Compression level (--compression) set to " << compress_level << ", must be from 0 to 9." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_SORT_BY_POSITION:
+                sort_by_position = true;
+                break;
+                
             case 'h':
             case '?':
             default:
@@ -672,8 +742,8 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    if (gcsa_name.empty()) {
-        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 index, must provide GCSA2 file" << endl;
+    if (gcsa_name.empty() && minimizer_name.empty()) {
+        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 index or a minimizer index, must provide GCSA2 file" << endl;
         exit(1);
     }
     
@@ -685,17 +755,21 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    ifstream gcsa_stream(gcsa_name);
-    if (!gcsa_stream) {
-        cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
-        exit(1);
-    }
-    
-    string lcp_name = gcsa_name + ".lcp";
-    ifstream lcp_stream(lcp_name);
-    if (!lcp_stream) {
-        cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
-        exit(1);
+    ifstream gcsa_stream;
+    ifstream lcp_stream;
+    if (!gcsa_name.empty()) {
+        gcsa_stream.open(gcsa_name);
+        if (!gcsa_stream) {
+            cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
+            exit(1);
+        }
+        
+        string lcp_name = gcsa_name + ".lcp";
+        lcp_stream.open(lcp_name);
+        if (!lcp_stream) {
+            cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
+            exit(1);
+        }
     }
 
     ifstream matrix_stream;
@@ -714,10 +788,14 @@ int main_mpmap(int argc, char** argv) {
     gcsa::TempFile::setDirectory(temp_file::get_dir());
     
     xg::XG xg_index(xg_stream);
-    gcsa::GCSA gcsa_index;
-    gcsa_index.load(gcsa_stream);
-    gcsa::LCPArray lcp_array;
-    lcp_array.load(lcp_stream);
+    gcsa::GCSA* gcsa_index = nullptr;
+    gcsa::LCPArray* lcp_array = nullptr;
+    if (!gcsa_name.empty()) {
+        gcsa_index = new gcsa::GCSA();
+        gcsa_index->load(gcsa_stream);
+        lcp_array = new gcsa::LCPArray();
+        lcp_array->load(lcp_stream);
+    }
     
     gbwt::GBWT* gbwt = nullptr;
     haplo::linear_haplo_structure* sublinearLS = nullptr;
@@ -758,8 +836,28 @@ int main_mpmap(int argc, char** argv) {
         }
         snarl_manager = new SnarlManager(snarl_stream);
     }
+    
+    DistanceIndex* distance_index = nullptr;
+    if (!dist_name.empty()) {
+        ifstream dist_stream(dist_name);
+        if (!dist_stream) {
+            cerr << "error:[vg mpmap] Cannot open distance index file " << dist_name << endl;
+            exit(1);
+        }
+        distance_index = new DistanceIndex(dist_stream);
+    }
+    
+    MinimizerIndex* minimizer_index = nullptr;
+    if (!minimizer_name.empty()) {
+        ifstream minimizer_stream(minimizer_name);
+        if (!minimizer_stream) {
+            cerr << "error:[vg mpmap] Cannot open minimizer index file " << minimizer_name << endl;
+            exit(1);
+        }
+        minimizer_index = new MinimizerIndex(minimizer_stream);
+    }
         
-    MultipathMapper multipath_mapper(&xg_index, &gcsa_index, &lcp_array, haplo_score_provider, snarl_manager);
+    MultipathMapper multipath_mapper(&xg_index, gcsa_index, lcp_array, haplo_score_provider, snarl_manager);
     
     // set alignment parameters
     multipath_mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
@@ -803,6 +901,8 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.log_likelihood_approx_factor = likelihood_approx_exp;
     multipath_mapper.num_mapping_attempts = max_map_attempts ? max_map_attempts : numeric_limits<int>::max();
     multipath_mapper.unstranded_clustering = unstranded_clustering;
+    multipath_mapper.distance_index = distance_index;
+    multipath_mapper.minimizer_index = minimizer_index;
     
     // set pair rescue parameters
     multipath_mapper.secondary_rescue_score_diff = secondary_rescue_score_diff;
@@ -855,6 +955,41 @@ int main_mpmap(int argc, char** argv) {
     
     vector<vector<Alignment> > single_path_output_buffer(thread_count);
     vector<vector<MultipathAlignment> > multipath_output_buffer(thread_count);
+    // when surjecting, pairs are kept apart from unpaired reads until they're written
+    vector<vector<Alignment> > single_path_paired_output_buffer(thread_count);
+    
+    // compressed output is handed off to a background writer thread
+    stream::AsyncWriter output_writer(cout);
+    
+    // or, if we're surjecting, to an HTS writer that builds records on the mapping threads
+    unique_ptr<HTSAlignmentWriter> hts_writer;
+    vector<unique_ptr<Surjector>> surjectors;
+    set<string> path_names;
+    if (!surject_type.empty()) {
+        map<string, int64_t> path_length;
+        for (size_t i = 1; i <= xg_index.max_path_rank(); i++) {
+            string name = xg_index.path_name(i);
+            path_length[name] = xg_index.path_length(name);
+            path_names.insert(name);
+        }
+        hts_writer = unique_ptr<HTSAlignmentWriter>(new HTSAlignmentWriter(surject_type, path_length,
+                                                                           surject_type == "sam" ? -1 : compress_level,
+                                                                           thread_count, sort_by_position));
+        for (int i = 0; i < thread_count; i++) {
+            surjectors.emplace_back(new Surjector(&xg_index));
+        }
+    }
+    
+    // surject single path alignments into the reference paths and write them as HTS records
+    auto surject_single_path_alignments = [&](vector<Alignment>& alns, bool paired) {
+        if (alns.empty()) {
+            return;
+        }
+        vector<Surjector::surjection_t> surjected;
+        surjectors[omp_get_thread_num()]->path_anchored_surject_batch(alns, path_names, surjected);
+        hts_writer->write(surjected, paired);
+        alns.clear();
+    };
     
     // write unpaired multipath alignments to stdout buffer
     auto output_multipath_alignments = [&](vector<MultipathAlignment>& mp_alns) {
@@ -873,7 +1008,7 @@ int main_mpmap(int argc, char** argv) {
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        output_writer.write_buffered(output_buf, buffer_size);
     };
     
     // convert to unpaired single path alignments and write stdout buffer
@@ -895,7 +1030,15 @@ int main_mpmap(int argc, char** argv) {
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        if (hts_writer) {
+            // surject a buffer's worth at a time, so the surjector can share path lookups
+            if (output_buf.size() >= buffer_size) {
+                surject_single_path_alignments(output_buf, false);
+            }
+        }
+        else {
+            output_writer.write_buffered(output_buf, buffer_size);
+        }
     };
     
     // write paired multipath alignments to stdout buffer
@@ -934,12 +1077,12 @@ int main_mpmap(int argc, char** argv) {
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        output_writer.write_buffered(output_buf, buffer_size);
     };
     
     // convert to paired single path alignments and write stdout buffer
     auto output_single_path_paired_alignments = [&](vector<pair<MultipathAlignment, MultipathAlignment>>& mp_aln_pairs) {
-        auto& output_buf = single_path_output_buffer[omp_get_thread_num()];
+        auto& output_buf = (hts_writer ? single_path_paired_output_buffer : single_path_output_buffer)[omp_get_thread_num()];
         
         // add optimal alignments to the output buffer
         for (pair<MultipathAlignment, MultipathAlignment>& mp_aln_pair : mp_aln_pairs) {
@@ -980,27 +1123,55 @@ int main_mpmap(int argc, char** argv) {
             // arbitrarily decide that this is the "next" fragment
             output_buf.back().mutable_fragment_prev()->set_name(mp_aln_pair.first.name());
         }
-        stream::write_buffered(cout, output_buf, buffer_size);
+        if (hts_writer) {
+            if (output_buf.size() >= buffer_size) {
+                surject_single_path_alignments(output_buf, true);
+            }
+        }
+        else {
+            output_writer.write_buffered(output_buf, buffer_size);
+        }
     };
     
-    // do unpaired multipath alignment and write to buffer
-    function<void(Alignment&)> do_unpaired_alignments = [&](Alignment& alignment) {
+    // unpaired reads are mapped in small batches per thread, so that the GCSA2 searches for
+    // their MEMs can be interleaved
+    const size_t read_batch_size = 16;
+    vector<vector<Alignment>> read_batches(thread_count);
+    
+    // do unpaired multipath alignment on a thread's batch of reads and write to buffer
+    auto map_read_batch = [&](int tid) {
+        auto& batch = read_batches[tid];
 #ifdef record_read_run_times
         clock_t start = clock();
 #endif
-        vector<MultipathAlignment> mp_alns;
-        multipath_mapper.multipath_map(alignment, mp_alns, max_num_mappings);
-        if (single_path_alignment_mode) {
-            output_single_path_alignments(mp_alns);
-        }
-        else {
-            output_multipath_alignments(mp_alns);
+        vector<vector<MultipathAlignment>> batch_mp_alns;
+        multipath_mapper.multipath_map_batch(batch, batch_mp_alns, max_num_mappings);
+        for (vector<MultipathAlignment>& mp_alns : batch_mp_alns) {
+            if (single_path_alignment_mode) {
+                output_single_path_alignments(mp_alns);
+            }
+            else {
+                output_multipath_alignments(mp_alns);
+            }
         }
 #ifdef record_read_run_times
         clock_t finish = clock();
+        // the reads share the batch's time
 #pragma omp critical
-        read_time_file << alignment.name() << "\t" << double(finish - start) / CLOCKS_PER_SEC << endl;
+        for (const Alignment& alignment : batch) {
+            read_time_file << alignment.name() << "\t" << double(finish - start) / CLOCKS_PER_SEC / batch.size() << endl;
+        }
 #endif
+        batch.clear();
+    };
+    
+    // queue an unpaired read, mapping the thread's batch once it fills up
+    function<void(Alignment&)> do_unpaired_alignments = [&](Alignment& alignment) {
+        int tid = omp_get_thread_num();
+        read_batches[tid].emplace_back(std::move(alignment));
+        if (read_batches[tid].size() >= read_batch_size) {
+            map_read_batch(tid);
+        }
     };
     
     // do paired multipath alignment and write to buffer
@@ -1106,20 +1277,46 @@ int main_mpmap(int argc, char** argv) {
         }
     }
     
+    // map the unpaired reads, including unresolved pairs, left over in partly filled batches
+#pragma omp parallel
+    {
+        map_read_batch(omp_get_thread_num());
+    }
+    
     // flush output buffers
+    if (hts_writer) {
+        for (int i = 0; i < thread_count; i++) {
+            surject_single_path_alignments(single_path_output_buffer[i], false);
+            surject_single_path_alignments(single_path_paired_output_buffer[i], true);
+        }
+    }
     for (int i = 0; i < thread_count; i++) {
-        vector<Alignment>& single_path_buffer = single_path_output_buffer[i];
-        stream::write_buffered(cout, single_path_buffer, 0);
-        
-        vector<MultipathAlignment>& multipath_buffer = multipath_output_buffer[i];
-        stream::write_buffered(cout, multipath_buffer, 0);
+        output_writer.write(single_path_output_buffer[i]);
+        output_writer.write(multipath_output_buffer[i]);
+    }
+    output_writer.finish();
+    if (hts_writer) {
+        hts_writer->finish();
     }
-    cout.flush();
     
 #ifdef record_read_run_times
     read_time_file.close();
 #endif
     
+    if (verbose) {
+        auto report_memo = [](const string& name, size_t hits, size_t misses, size_t size) {
+            size_t lookups = hits + misses;
+            cerr << "[vg mpmap] shared " << name << " memo: " << hits << " hits in " << lookups << " lookups ("
+                 << (lookups ? 100.0 * hits / lookups : 0.0) << "%), " << size << " entries held" << endl;
+        };
+        report_memo("paths of node", multipath_mapper.shared_paths_of_node_memo.hits(),
+                    multipath_mapper.shared_paths_of_node_memo.misses(), multipath_mapper.shared_paths_of_node_memo.size());
+        report_memo("oriented occurrences", multipath_mapper.shared_oriented_occurences_memo.hits(),
+                    multipath_mapper.shared_oriented_occurences_memo.misses(), multipath_mapper.shared_oriented_occurences_memo.size());
+        report_memo("handle", multipath_mapper.shared_handle_memo.hits(),
+                    multipath_mapper.shared_handle_memo.misses(), multipath_mapper.shared_handle_memo.size());
+    }
+    
     //cerr << "MEM length filtering efficiency: " << ((double) OrientedDistanceClusterer::MEM_FILTER_COUNTER) / OrientedDistanceClusterer::MEM_TOTAL << " (" << OrientedDistanceClusterer::MEM_FILTER_COUNTER << "/" << OrientedDistanceClusterer::MEM_TOTAL << ")" << endl;
     //cerr << "MEM cluster filtering efficiency: " << ((double) OrientedDistanceClusterer::PRUNE_COUNTER) / OrientedDistanceClusterer::CLUSTER_TOTAL << " (" << OrientedDistanceClusterer::PRUNE_COUNTER << "/" << OrientedDistanceClusterer::CLUSTER_TOTAL << ")" << endl;
     //cerr << "subgraph filtering efficiency: " << ((double) MultipathMapper::PRUNE_COUNTER) / MultipathMapper::SUBGRAPH_TOTAL << " (" << MultipathMapper::PRUNE_COUNTER << "/" << MultipathMapper::SUBGRAPH_TOTAL << ")" << endl;
@@ -1127,6 +1324,22 @@ int main_mpmap(int argc, char** argv) {
     if (snarl_manager != nullptr) {
         delete snarl_manager;
     }
+    
+    if (distance_index != nullptr) {
+        delete distance_index;
+    }
+    
+    if (minimizer_index != nullptr) {
+        delete minimizer_index;
+    }
+    
+    if (lcp_array != nullptr) {
+        delete lcp_array;
+    }
+    
+    if (gcsa_index != nullptr) {
+        delete gcsa_index;
+    }
    
     if (haplo_score_provider != nullptr) {
         delete haplo_score_provider;
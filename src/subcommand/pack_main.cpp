@@ -19,6 +19,7 @@ void help_pack(char** argv) {
          << "    -g, --gam FILE         read alignments from this file (could be '-' for stdin)" << endl
          << "    -d, --as-table         write table on stdout representing packs" << endl
          << "    -e, --with-edits       record and write edits rather than only recording graph-matching coverage" << endl
+         << "    -R, --node-range N:M   write only the table rows for nodes N through M (by sequence order)" << endl
          << "    -b, --bin-size N       number of sequence bases per CSA bin [default: inf]" << endl
          << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
 }
@@ -33,6 +34,7 @@ int main_pack(int argc, char** argv) {
     int thread_count = 1;
     bool record_edits = false;
     size_t bin_size = 0;
+    string node_range;
 
     if (argc == 2) {
         help_pack(argv);
@@ -53,11 +55,12 @@ int main_pack(int argc, char** argv) {
             {"threads", required_argument, 0, 't'},
             {"with-edits", no_argument, 0, 'e'},
             {"bin-size", required_argument, 0, 'b'},
+            {"node-range", required_argument, 0, 'R'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:o:i:g:dt:eb:",
+        c = getopt_long (argc, argv, "hx:o:i:g:dt:eb:R:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -92,6 +95,9 @@ int main_pack(int argc, char** argv) {
         case 'b':
             bin_size = atoll(optarg);
             break;
+        case 'R':
+            node_range = optarg;
+            break;
         case 't':
             thread_count = atoi(optarg);
             break;
@@ -112,43 +118,48 @@ int main_pack(int argc, char** argv) {
         xgidx.load(in);
     }
 
-    // todo one packer per thread and merge
+    // find the range of the sequence basis to write, if restricted
+    size_t table_begin = 0;
+    size_t table_end = xgidx.seq_length;
+    if (!node_range.empty()) {
+        auto parts = split_delims(node_range, ":");
+        if (parts.size() != 2) {
+            cerr << "error:[vg pack] node range must be given as N:M" << endl;
+            exit(1);
+        }
+        id_t first = stoll(parts[0]);
+        id_t last = stoll(parts[1]);
+        if (!xgidx.has_node(first) || !xgidx.has_node(last)) {
+            cerr << "error:[vg pack] node range " << node_range << " is not in the graph" << endl;
+            exit(1);
+        }
+        table_begin = xgidx.node_start(first);
+        table_end = xgidx.node_start(last) + xgidx.node_length(last);
+    }
 
-    vg::Packer packer(&xgidx, bin_size);
+    // all the threads add to the same packer
+    vg::Packer packer(&xgidx, bin_size, thread_count > 1);
     if (packs_in.size() == 1) {
         packer.load_from_file(packs_in.front());
+        if (!gam_in.empty()) {
+            // we will add to what we loaded
+            packer.make_dynamic();
+        }
     } else if (packs_in.size() > 1) {
         packer.merge_from_files(packs_in);
     }
 
     if (!gam_in.empty()) {
-        vector<vg::Packer*> packers;
-        if (thread_count == 1) {
-            packers.push_back(&packer);
-        } else {
-            for (size_t i = 0; i < thread_count; ++i) {
-                packers.push_back(new Packer(&xgidx, bin_size));
-            }
-        }
-        std::function<void(Alignment&)> lambda = [&packer,&record_edits,&packers](Alignment& aln) {
-            packers[omp_get_thread_num()]->add(aln, record_edits);
+        std::function<void(Alignment&)> lambda = [&packer,&record_edits](Alignment& aln) {
+            packer.add(aln, record_edits);
         };
         if (gam_in == "-") {
-            stream::for_each_parallel(std::cin, lambda);
+            stream::for_each_parallel_arena(std::cin, lambda);
         } else {
             ifstream gam_stream(gam_in);
-            stream::for_each_parallel(gam_stream, lambda);
+            stream::for_each_parallel_arena(gam_stream, lambda);
             gam_stream.close();
         }
-        if (thread_count == 1) {
-            packers.clear();
-        } else {
-            packer.merge_from_dynamic(packers);
-            for (auto& p : packers) {
-                delete p;
-            }
-            packers.clear();
-        }
     }
 
     if (!packs_out.empty()) {
@@ -156,7 +167,7 @@ int main_pack(int argc, char** argv) {
     }
     if (write_table) {
         packer.make_compact();
-        packer.as_table(cout, record_edits);
+        packer.as_table(cout, record_edits, table_begin, table_end);
     }
 
     return 0;
@@ -18,6 +18,7 @@
 #include "../vg.hpp"
 #include "../distributions.hpp"
 #include "../genotypekit.hpp"
+#include "../alignment_stats.hpp"
 
 using namespace std;
 using namespace vg;
@@ -41,6 +42,11 @@ void help_stats(char** argv) {
          << "    -d, --to-head         show distance to head for each provided node" << endl
          << "    -t, --to-tail         show distance to head for each provided node" << endl
          << "    -a, --alignments FILE compute stats for reads aligned to the graph" << endl
+         << "                          multiple allowed; stats are computed over all the files" << endl
+         << "    -M, --merge-stats FILE  add in alignment stats saved with -W" << endl
+         << "                          multiple allowed; use with or instead of -a" << endl
+         << "    -W, --write-stats FILE  also save the alignment stats to FILE, so stats for" << endl
+         << "                          parts of a set of reads can be merged later with -M" << endl
          << "    -r, --node-id-range   X:Y where X and Y are the smallest and largest "
         "node id in the graph, respectively" << endl
          << "    -o, --overlap PATH    for each overlapping path mapping in the graph write a table:" << endl
@@ -73,9 +79,13 @@ int main_stats(int argc, char** argv) {
     bool is_acyclic = false;
     bool stats_range = false;
     set<vg::id_t> ids;
-    // What alignments GAM file should we read and compute stats on with the
+    // What alignments GAM files should we read and compute stats on with the
     // graph?
-    string alignments_filename;
+    vector<string> alignments_filenames;
+    // What saved alignment stats should we add in, and where should we save
+    // the stats we report?
+    vector<string> stats_to_merge_filenames;
+    string write_stats_filename;
     vector<string> paths_to_overlap;
     bool overlap_all_paths = false;
     bool snarl_stats = false;
@@ -99,6 +109,8 @@ int main_stats(int argc, char** argv) {
             {"to-tail", no_argument, 0, 't'},
             {"node", required_argument, 0, 'n'},
             {"alignments", required_argument, 0, 'a'},
+            {"merge-stats", required_argument, 0, 'M'},
+            {"write-stats", required_argument, 0, 'W'},
             {"is-acyclic", no_argument, 0, 'A'},
             {"node-id-range", no_argument, 0, 'r'},
             {"verbose", no_argument, 0, 'v'},
@@ -109,7 +121,7 @@ int main_stats(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hzlsHTScdtn:NEa:vAro:OR",
+        c = getopt_long (argc, argv, "hzlsHTScdtn:NEa:M:W:vAro:OR",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -171,7 +183,15 @@ int main_stats(int argc, char** argv) {
             break;
 
         case 'a':
-            alignments_filename = optarg;
+            alignments_filenames.push_back(optarg);
+            break;
+
+        case 'M':
+            stats_to_merge_filenames.push_back(optarg);
+            break;
+
+        case 'W':
+            write_stats_filename = optarg;
             break;
 
         case 'r':
@@ -379,10 +399,7 @@ int main_stats(int argc, char** argv) {
         }
     }
 
-    if (!alignments_filename.empty()) {
-        // Read in the given GAM
-        ifstream alignment_stream(alignments_filename);
-
+    if (!alignments_filenames.empty() || !stats_to_merge_filenames.empty()) {
         // We need some allele parsing functions
 
         // This one decided if a path is really an allele path
@@ -475,152 +492,64 @@ int main_stats(int argc, char** argv) {
         });
 
 
-        // These are the general stats we will compute.
-        size_t total_alignments = 0;
-        size_t total_aligned = 0;
-        size_t total_primary = 0;
-        size_t total_secondary = 0;
-
         // These are for counting significantly allele-biased hets
         size_t total_hets = 0;
         size_t significantly_biased_hets = 0;
 
-        // These are for tracking which nodes are covered and which are not
-        map<vg::id_t, size_t> node_visit_counts;
-
-        // And for counting indels
-        // Inserted bases also counts softclips
-        size_t total_insertions = 0;
-        size_t total_inserted_bases = 0;
-        size_t total_deletions = 0;
-        size_t total_deleted_bases = 0;
-        // And substitutions
-        size_t total_substitutions = 0;
-        size_t total_substituted_bases = 0;
-        // And softclips
-        size_t total_softclips = 0;
-        size_t total_softclipped_bases = 0;
-
-        // In verbose mode we want to report details of insertions, deletions,
-        // and substitutions, and soft clips.
-        vector<pair<vg::id_t, Edit>> insertions;
-        vector<pair<vg::id_t, Edit>> deletions;
-        vector<pair<vg::id_t, Edit>> substitutions;
-        vector<pair<vg::id_t, Edit>> softclips;
+        // Each thread counts into its own shard of the stats, and we merge
+        // them once all the reads are in. In verbose mode we want to report
+        // details of insertions, deletions, and substitutions, and soft clips.
+        AlignmentStatsAccumulator accumulator(&allele_path_for_node, verbose);
 
         function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            int tid = omp_get_thread_num();
-
-            // We ought to be able to do many stats on the alignments.
-
-            // Now do all the non-mapping stats
-            #pragma omp critical (total_alignments)
-            total_alignments++;
-            if(aln.is_secondary()) {
-                #pragma omp critical (total_secondary)
-                total_secondary++;
-            } else {
-                #pragma omp critical (total_primary)
-                total_primary++;
-                if(aln.score() > 0) {
-                    // We only count aligned primary reads in "total aligned";
-                    // the primary can't be unaligned if the secondary is
-                    // aligned.
-                    #pragma omp critical (total_aligned)
-                    total_aligned++;
-                }
-
-                // Which sites and alleles does this read support. TODO: if we hit
-                // unique nodes from multiple alleles of the same site, we should...
-                // do something. Discard the read? Not just count it on both sides
-                // like we do now.
-                set<pair<string, string>> alleles_supported;
-
-                for(size_t i = 0; i < aln.path().mapping_size(); i++) {
-                    // For every mapping...
-                    auto& mapping = aln.path().mapping(i);
-                    vg::id_t node_id = mapping.position().node_id();
-
-                    if(allele_path_for_node.count(node_id)) {
-                        // We hit a unique node for this allele. Add it to the set,
-                        // in case we hit another unique node for it later in the
-                        // read.
-                        alleles_supported.insert(allele_path_for_node.at(node_id));
-                    }
+            accumulator.add(aln);
+        };
 
-                    // Record that there was a visit to this node.
-                    #pragma omp critical (node_visit_counts)
-                    node_visit_counts[node_id]++;
-
-                    for(size_t j = 0; j < mapping.edit_size(); j++) {
-                        // Go through edits and look for each type.
-                        auto& edit = mapping.edit(j);
-
-                        if(edit.to_length() > edit.from_length()) {
-                            if((j == 0 && i == 0) || (j == mapping.edit_size() - 1 && i == aln.path().mapping_size() - 1)) {
-                                // We're at the very end of the path, so this is a soft clip.
-                                #pragma omp critical (total_softclipped_bases)
-                                total_softclipped_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_softclips)
-                                total_softclips++;
-                                if(verbose) {
-                                    // Record the actual insertion
-                                    #pragma omp critical (softclips)
-                                    softclips.push_back(make_pair(node_id, edit));
-                                }
-                            } else {
-                                // Record this insertion
-                                #pragma omp critical (total_inserted_bases)
-                                total_inserted_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_insertions)
-                                total_insertions++;
-                                if(verbose) {
-                                    // Record the actual insertion
-                                    #pragma omp critical (insertions)
-                                    insertions.push_back(make_pair(node_id, edit));
-                                }
-                            }
-
-                        } else if(edit.from_length() > edit.to_length()) {
-                            // Record this deletion
-                            #pragma omp critical (total_deleted_bases)
-                            total_deleted_bases += edit.from_length() - edit.to_length();
-                            #pragma omp critical (total_deletions)
-                            total_deletions++;
-                            if(verbose) {
-                                // Record the actual deletion
-                                #pragma omp critical (deletions)
-                                deletions.push_back(make_pair(node_id, edit));
-                            }
-                        } else if(!edit.sequence().empty()) {
-                            // Record this substitution
-                            // TODO: a substitution might also occur as part of a deletion/insertion above!
-                            #pragma omp critical (total_substituted_bases)
-                            total_substituted_bases += edit.from_length();
-                            #pragma omp critical (total_substitutions)
-                            total_substitutions++;
-                            if(verbose) {
-                                // Record the actual substitution
-                                #pragma omp critical (substitutions)
-                                substitutions.push_back(make_pair(node_id, edit));
-                            }
-                        }
+        // Actually go through all the reads and count stuff up.
+        for (auto& alignments_filename : alignments_filenames) {
+            ifstream alignment_stream(alignments_filename);
+            if (!alignment_stream) {
+                cerr << "error:[vg stats] could not open alignments file " << alignments_filename << endl;
+                exit(1);
+            }
+            stream::for_each_parallel_arena(alignment_stream, lambda);
+        }
 
-                    }
-                }
+        AlignmentStats stats = accumulator.reduce();
 
-                for(auto& site_and_allele : alleles_supported) {
-                    // This read is informative for an allele of a site.
-                    // Up the reads on that allele of that site.
-                    #pragma omp critical (reads_on_allele)
-                    reads_on_allele[site_and_allele.first][site_and_allele.second]++;
-                }
+        // Add in the stats saved from other runs
+        for (auto& stats_filename : stats_to_merge_filenames) {
+            ifstream stats_stream(stats_filename);
+            if (!stats_stream) {
+                cerr << "error:[vg stats] could not open alignment stats file " << stats_filename << endl;
+                exit(1);
             }
+            AlignmentStats saved;
+            try {
+                saved.deserialize(stats_stream);
+            } catch (const runtime_error& e) {
+                cerr << "error:[vg stats] could not load alignment stats from " << stats_filename
+                     << ": " << e.what() << endl;
+                exit(1);
+            }
+            stats.merge(saved);
+        }
 
-        };
+        if (!write_stats_filename.empty()) {
+            ofstream stats_stream(write_stats_filename);
+            stats.serialize(stats_stream);
+            if (!stats_stream) {
+                cerr << "error:[vg stats] could not write alignment stats to " << write_stats_filename << endl;
+                exit(1);
+            }
+        }
 
-        // Actually go through all the reads and count stuff up.
-        stream::for_each_parallel(alignment_stream, lambda);
+        for (auto& site_and_alleles : stats.reads_on_allele) {
+            for (auto& allele_and_count : site_and_alleles.second) {
+                reads_on_allele[site_and_alleles.first][allele_and_count.first] += allele_and_count.second;
+            }
+        }
+        auto& node_visit_counts = stats.node_visit_counts;
 
         // Calculate stats about the reads per allele data
         for(auto& site_and_alleles : reads_on_allele) {
@@ -704,40 +633,54 @@ int main_stats(int argc, char** argv) {
             }
         });
 
-        cout << "Total alignments: " << total_alignments << endl;
-        cout << "Total primary: " << total_primary << endl;
-        cout << "Total secondary: " << total_secondary << endl;
-        cout << "Total aligned: " << total_aligned << endl;
+        cout << "Total alignments: " << stats.total_alignments << endl;
+        cout << "Total primary: " << stats.total_primary << endl;
+        cout << "Total secondary: " << stats.total_secondary << endl;
+        cout << "Total aligned: " << stats.total_aligned << endl;
 
-        cout << "Insertions: " << total_inserted_bases << " bp in " << total_insertions << " read events" << endl;
+        cout << "Insertions: " << stats.total_inserted_bases << " bp in " << stats.total_insertions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : insertions) {
+            for(auto& id_and_edit : stats.insertions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Deletions: " << total_deleted_bases << " bp in " << total_deletions << " read events" << endl;
+        cout << "Deletions: " << stats.total_deleted_bases << " bp in " << stats.total_deletions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : deletions) {
+            for(auto& id_and_edit : stats.deletions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.to_length()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Substitutions: " << total_substituted_bases << " bp in " << total_substitutions << " read events" << endl;
+        cout << "Substitutions: " << stats.total_substituted_bases << " bp in " << stats.total_substitutions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : substitutions) {
+            for(auto& id_and_edit : stats.substitutions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Softclips: " << total_softclipped_bases << " bp in " << total_softclips << " read events" << endl;
+        cout << "Softclips: " << stats.total_softclipped_bases << " bp in " << stats.total_softclips << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : softclips) {
+            for(auto& id_and_edit : stats.softclips) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
 
+        if(verbose) {
+            // Report the distributions too, as value and count
+            auto show_histogram = [](const string& title, const Histogram& histogram) {
+                cout << title << ": " << histogram.total() << " values" << endl;
+                histogram.for_each([](size_t value, size_t count) {
+                    cout << "\t" << value << "\t" << count << endl;
+                });
+            };
+            show_histogram("Primary mapping qualities", stats.mapping_qualities);
+            show_histogram("Insertion lengths", stats.insertion_lengths);
+            show_histogram("Deletion lengths", stats.deletion_lengths);
+            show_histogram("Softclip lengths", stats.softclip_lengths);
+        }
+
         cout << "Unvisited nodes: " << unvisited_nodes << "/" << graph.node_count()
             << " (" << unvisited_node_bases << " bp)" << endl;
         if(verbose) {
@@ -15,6 +15,7 @@
 
 #include "../multipath_alignment.hpp"
 #include "../vg.hpp"
+#include "../gfa.hpp"
 
 using namespace std;
 using namespace vg;
@@ -439,6 +440,12 @@ int main_view(int argc, char** argv) {
                 stream::for_each(in, lambda);
             });
             return 0;
+        } else if (output_type == "gfa" && !expect_duplicates) {
+            // Convert a chunk at a time, without building the whole graph
+            get_input_file(file_name, [&](istream& in) {
+                graph_stream_to_gfa(in, cout);
+            });
+            return 0;
         } else {
             get_input_file(file_name, [&](istream& in) {
                 graph = new VG(in, false, !expect_duplicates);
@@ -5,6 +5,10 @@
 
 #include "surjector.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <omp.h>
+
 //#define debug_surject
 //#define debug_anchored_surject
 //#define debug_validate_anchored_multipath_alignment
@@ -13,6 +17,8 @@ namespace vg {
 
 using namespace std;
     
+    const size_t Surjector::PATH_WINDOW_STEPS;
+    
     Surjector::Surjector(xg::XG* xg_index) : Mapper(xg_index, nullptr, nullptr) {
         
     }
@@ -417,19 +423,74 @@ using namespace std;
         cerr << endl;
 #endif
         
+        // memos for expensive succinct operations that may be repeated
+        surjection_memo_t memo;
+        
+        return path_anchored_surject(source, get_path_ranks(path_names), memo, path_name_out, path_pos_out, path_rev_out);
+    }
+    
+    void Surjector::path_anchored_surject_batch(const vector<Alignment>& sources, const set<string>& path_names,
+                                                vector<surjection_t>& surjected_out) {
+        
+        unordered_map<size_t, string> path_rank_to_name = get_path_ranks(path_names);
+        
+        // visit the alignments in node ID order, which for most graphs is close to their order along
+        // the reference, so each thread gets runs of alignments in the same part of the paths
+        vector<size_t> order(sources.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        auto first_node = [&](size_t i) {
+            const Path& path = sources[i].path();
+            // unaligned reads go last
+            return path.mapping_size() ? path.mapping(0).position().node_id() : numeric_limits<id_t>::max();
+        };
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return first_node(a) < first_node(b);
+        });
+        
+        surjected_out.clear();
+        surjected_out.resize(sources.size());
+        
+        // one memo per thread, which lives as long as the batch
+        vector<surjection_memo_t> memos(omp_get_max_threads());
+        // if we're already in a parallel region, the loop below will only get this thread
+        size_t team_size = omp_in_parallel() ? 1 : memos.size();
+        if (sources.size() > team_size) {
+            // threads will see more than one alignment apiece, so it's worth reading ahead on the paths
+            for (surjection_memo_t& memo : memos) {
+                memo.use_path_windows = true;
+            }
+        }
+        
+#pragma omp parallel for schedule(dynamic, 16)
+        for (size_t i = 0; i < order.size(); i++) {
+            surjection_t& surjected = surjected_out[order[i]];
+            // unmapped reads need to come out at position -1 on no path
+            get<1>(surjected) = -1;
+            get<2>(surjected) = false;
+            get<3>(surjected) = path_anchored_surject(sources[order[i]], path_rank_to_name, memos[omp_get_thread_num()],
+                                                      get<0>(surjected), get<1>(surjected), get<2>(surjected));
+        }
+    }
+    
+    unordered_map<size_t, string> Surjector::get_path_ranks(const set<string>& path_names) const {
         // translate the path names into ranks for the XG
         unordered_map<size_t, string> path_rank_to_name;
         for (const string& path_name : path_names) {
             path_rank_to_name[xindex->path_rank(path_name)] = path_name;
         }
-        
-        
-        // memos for expensive succinct operations that may be repeated
-        unordered_map<int64_t, vector<size_t>> paths_of_node_memo;
-        unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>> oriented_occurrences_memo;
+        return path_rank_to_name;
+    }
+    
+    Alignment Surjector::path_anchored_surject(const Alignment& source,
+                                               const unordered_map<size_t, string>& path_rank_to_name,
+                                               surjection_memo_t& memo,
+                                               string& path_name_out, int64_t& path_pos_out, bool& path_rev_out) {
         
         // get the chunks of the aligned path that overlap the ref path
-        auto path_overlapping_anchors = extract_overlapping_paths(source, path_rank_to_name, &paths_of_node_memo, &oriented_occurrences_memo);
+        auto path_overlapping_anchors = extract_overlapping_paths(source, path_rank_to_name, &memo.paths_of_node_memo,
+                                                                  &memo.oriented_occurrences_memo);
         
 #ifdef debug_anchored_surject
         cerr << "got path overlapping segments" << endl;
@@ -453,11 +514,11 @@ using namespace std;
             cerr << "found overlaps on path " << path_record.first << ", performing surjection" << endl;
 #endif
             
-            const xg::XGPath& xpath = xindex->get_path(path_rank_to_name[path_record.first]);
+            const xg::XGPath& xpath = xindex->get_path(path_rank_to_name.at(path_record.first));
             
             // find the interval of the ref path we need to consider
             pair<size_t, size_t> ref_path_interval = compute_path_interval(source, path_record.first, xpath, path_record.second,
-                                                                           &oriented_occurrences_memo);
+                                                                           &memo.oriented_occurrences_memo);
             
 #ifdef debug_anchored_surject
             cerr << "final path interval is " << ref_path_interval.first << ":" << ref_path_interval.second << endl;
@@ -465,7 +526,8 @@ using namespace std;
             
             // get the path graph corresponding to this interval
             unordered_map<id_t, pair<id_t, bool>> path_trans;
-            VG path_graph = extract_linearized_path_graph(ref_path_interval.first, ref_path_interval.second, xpath, path_trans);
+            VG path_graph = extract_linearized_path_graph(ref_path_interval.first, ref_path_interval.second, xpath, path_trans,
+                                                          memo.use_path_windows ? &memo.path_windows[path_record.first] : nullptr);
             
             unordered_map<id_t, pair<id_t, bool>> split_trans;
             VG split_path_graph = path_graph.split_strands(split_trans);
@@ -547,13 +609,15 @@ using namespace std;
         }
         
         // which path was it?
-        path_name_out = path_rank_to_name[best_path_rank];
+        auto best_path_name = path_rank_to_name.find(best_path_rank);
+        path_name_out = best_path_name == path_rank_to_name.end() ? "" : best_path_name->second;
         
         Alignment& best_surjection = path_surjections[best_path_rank];
         
         // find the position along the path
         const xg::XGPath& best_xpath = xindex->get_path(path_name_out);
-        set_path_position(best_surjection, best_path_rank, best_xpath, path_name_out, path_pos_out, path_rev_out, &oriented_occurrences_memo);
+        set_path_position(best_surjection, best_path_rank, best_xpath, path_name_out, path_pos_out, path_rev_out,
+                          &memo.oriented_occurrences_memo);
         
 #ifdef debug_anchored_surject
         cerr << "chose path " << path_name_out << " at position " << path_pos_out << (path_rev_out ? "-" : "+") << endl;
@@ -563,8 +627,8 @@ using namespace std;
     
     unordered_map<size_t, vector<Surjector::path_chunk_t>>
     Surjector::extract_overlapping_paths(const Alignment& source, const unordered_map<size_t, string>& path_rank_to_name,
-                                         unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                         unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) {
+                                         xg::paths_of_node_memo_t* paths_of_node_memo,
+                                         xg::oriented_occurrences_memo_t* oriented_occurrences_memo) {
         
         
         unordered_map<size_t, vector<path_chunk_t>> to_return;
@@ -678,7 +742,7 @@ using namespace std;
     
     pair<size_t, size_t>
     Surjector::compute_path_interval(const Alignment& source, size_t path_rank, const xg::XGPath& xpath, const vector<path_chunk_t>& path_chunks,
-                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) {
+                                     xg::oriented_occurrences_memo_t* oriented_occurrences_memo) {
         
         pair<size_t, size_t> interval(numeric_limits<size_t>::max(), numeric_limits<size_t>::min());
         
@@ -739,7 +803,8 @@ using namespace std;
     }
     
     VG Surjector::extract_linearized_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
-                                                unordered_map<id_t, pair<id_t, bool>>& node_trans) {
+                                                unordered_map<id_t, pair<id_t, bool>>& node_trans,
+                                                path_window_t* window) {
         
 #ifdef debug_anchored_surject
         cerr << "extracting path graph for position interval " << first << ":" << last << " in path of length " << xpath.positions[xpath.positions.size() - 1] + xindex->node_length(xpath.node(xpath.ids.size() - 1)) << endl;
@@ -750,19 +815,47 @@ using namespace std;
         size_t begin = xpath.offset_at_position(first);
         size_t end = min<size_t>(xpath.positions.size(), xpath.offset_at_position(last) + 1);
         
+        if (window != nullptr && (begin < window->begin || end > window->begin + window->node_ids.size())) {
+            // the window doesn't cover this interval, so move it here, and cache some of the path past
+            // the interval too since alignments in a batch tend to move along the path
+            size_t window_end = min<size_t>(xpath.positions.size(), max<size_t>(end, begin + PATH_WINDOW_STEPS));
+            window->begin = begin;
+            window->node_ids.clear();
+            window->is_reverse.clear();
+            window->sequences.clear();
+            for (size_t i = begin; i < window_end; i++) {
+                id_t node_id = xpath.node(i);
+                bool rev = xpath.directions[i];
+                window->node_ids.push_back(node_id);
+                window->is_reverse.push_back(rev);
+                window->sequences.push_back(rev ? reverse_complement(xindex->node_sequence(node_id))
+                                                : xindex->node_sequence(node_id));
+            }
+        }
+        
         Node* prev_node = nullptr;
         for (size_t i = begin; i < end; i++) {
             
-            id_t node_id = xpath.node(i);
-            string seq = xindex->node_sequence(node_id);
-            bool rev = xpath.directions[i];
-            
+            id_t node_id;
+            bool rev;
             Node* node;
-            if (rev) {
-                node = path_graph.create_node(reverse_complement(seq));
+            if (window != nullptr) {
+                size_t j = i - window->begin;
+                node_id = window->node_ids[j];
+                rev = window->is_reverse[j];
+                node = path_graph.create_node(window->sequences[j]);
             }
             else {
-                node = path_graph.create_node(seq);
+                node_id = xpath.node(i);
+                string seq = xindex->node_sequence(node_id);
+                rev = xpath.directions[i];
+                
+                if (rev) {
+                    node = path_graph.create_node(reverse_complement(seq));
+                }
+                else {
+                    node = path_graph.create_node(seq);
+                }
             }
             
             if (prev_node) {
@@ -778,7 +871,7 @@ using namespace std;
     
     void Surjector::set_path_position(const Alignment& surjected, size_t best_path_rank, const xg::XGPath& xpath,
                                       string& path_name_out, int64_t& path_pos_out, bool& path_rev_out,
-                                      unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) {
+                                      xg::oriented_occurrences_memo_t* oriented_occurrences_memo) {
         
         const Path& path = surjected.path();
         
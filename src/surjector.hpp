@@ -7,6 +7,9 @@
  */
 
 #include <set>
+#include <tuple>
+#include <vector>
+#include <unordered_map>
 
 #include "alignment.hpp"
 #include "mapper.hpp"
@@ -43,32 +46,78 @@ using namespace std;
                                         int64_t& path_pos_out,
                                         bool& path_rev_out);
         
+        /// a surjected alignment with the path name, position, and strand it was surjected to,
+        /// or "", -1, and false if it couldn't be placed on any of the paths
+        using surjection_t = tuple<string, int64_t, bool, Alignment>;
+        
+        /// path_anchored_surject a batch of alignments in parallel. alignments are processed in
+        /// order of where they are in the graph, so that nearby alignments on the same thread share
+        /// lookups of path positions and path sequence. surjected_out is filled in the same order as
+        /// sources, regardless of the thread count.
+        void path_anchored_surject_batch(const vector<Alignment>& sources,
+                                         const set<string>& path_names,
+                                         vector<surjection_t>& surjected_out);
         
         /// a local type that represents a read interval matched to a portion of the alignment path
         using path_chunk_t = pair<pair<string::const_iterator, string::const_iterator>, Path>;
         
     private:
         
+        /// a stretch of consecutive steps of a path, with their sequences in path orientation
+        struct path_window_t {
+            size_t begin = 0;
+            vector<id_t> node_ids;
+            vector<bool> is_reverse;
+            vector<string> sequences;
+        };
+        
+        /// lookups that can be reused between surjections of nearby alignments on one thread
+        struct surjection_memo_t {
+            xg::paths_of_node_memo_t paths_of_node_memo;
+            xg::oriented_occurrences_memo_t oriented_occurrences_memo;
+            /// the most recently extracted window of each path, by path rank
+            unordered_map<size_t, path_window_t> path_windows;
+            /// whether to extract and keep path windows at all, which only pays off if the
+            /// memo will see more alignments along the same stretch of path
+            bool use_path_windows = false;
+        };
+        
+        /// how many path steps to cache at a time when extracting path graphs
+        static const size_t PATH_WINDOW_STEPS = 1024;
+        
+        /// path_anchored_surject with the path ranks already looked up, and using the given memo
+        Alignment path_anchored_surject(const Alignment& source,
+                                        const unordered_map<size_t, string>& path_rank_to_name,
+                                        surjection_memo_t& memo,
+                                        string& path_name_out,
+                                        int64_t& path_pos_out,
+                                        bool& path_rev_out);
+        
+        /// translate path names into the path ranks used by the XG
+        unordered_map<size_t, string> get_path_ranks(const set<string>& path_names) const;
+        
         /// get the chunks of the alignment path that follow the given reference paths
         unordered_map<size_t, vector<path_chunk_t>>
         extract_overlapping_paths(const Alignment& source, const unordered_map<size_t, string>& path_rank_to_name,
-                                  unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                  unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
+                                  xg::paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                  xg::oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr);
         
         /// compute the widest interval of path positions that the realigned sequence could align to
         pair<size_t, size_t>
         compute_path_interval(const Alignment& source, size_t path_rank, const xg::XGPath& xpath, const vector<path_chunk_t>& path_chunks,
-                              unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
+                              xg::oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr);
         
-        /// make a linear graph that corresponds to a path interval, possibly duplicating nodes in case of cycles
+        /// make a linear graph that corresponds to a path interval, possibly duplicating nodes in case of cycles,
+        /// taking the path steps from (and refilling) the given window if there is one
         VG extract_linearized_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
-                                         unordered_map<id_t, pair<id_t, bool>>& node_trans);
+                                         unordered_map<id_t, pair<id_t, bool>>& node_trans,
+                                         path_window_t* window = nullptr);
         
         
         /// associate a path position and strand to a surjected alignment against this path
         void set_path_position(const Alignment& surjected, size_t best_path_rank, const xg::XGPath& xpath,
                                string& path_name_out, int64_t& path_pos_out, bool& path_rev_out,
-                               unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
+                               xg::oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr);
         
         // make a sentinel meant to indicate an unmapped read
         Alignment make_null_alignment(const Alignment& source);
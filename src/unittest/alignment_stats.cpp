@@ -0,0 +1,211 @@
+/// \file alignment_stats.cpp
+///
+/// unit tests for the alignment statistics accumulator
+///
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <omp.h>
+#include "../json2pb.h"
+#include "../vg.pb.h"
+#include "../alignment_stats.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// List the values in a histogram with their counts
+static vector<pair<size_t, size_t>> histogram_contents(const Histogram& histogram) {
+    vector<pair<size_t, size_t>> contents;
+    histogram.for_each([&](size_t value, size_t count) {
+        contents.emplace_back(value, count);
+    });
+    return contents;
+}
+
+/// Describe edits and their nodes, so they can be compared
+static vector<string> describe_edits(const vector<pair<id_t, Edit>>& edits) {
+    vector<string> descriptions;
+    for (auto& id_and_edit : edits) {
+        descriptions.push_back(to_string(id_and_edit.first) + " " + pb2json(id_and_edit.second));
+    }
+    return descriptions;
+}
+
+TEST_CASE("Histograms count and merge small and large values", "[stats][alignment]") {
+    Histogram a;
+    a.add(3);
+    a.add(3);
+    a.add(100000);
+
+    Histogram b;
+    b.add(3, 5);
+    b.add(7);
+    b.add(100000);
+
+    a.merge(b);
+
+    REQUIRE(a.total() == 10);
+    REQUIRE(a.count(3) == 7);
+    REQUIRE(a.count(7) == 1);
+    REQUIRE(a.count(100000) == 2);
+    REQUIRE(a.count(4) == 0);
+
+    vector<pair<size_t, size_t>> seen;
+    a.for_each([&](size_t value, size_t count) {
+        seen.emplace_back(value, count);
+    });
+    vector<pair<size_t, size_t>> expected {{3, 7}, {7, 1}, {100000, 2}};
+    REQUIRE(seen == expected);
+
+    SECTION("Histograms survive a round trip through a stream") {
+        stringstream buffer;
+        a.serialize(buffer);
+        Histogram loaded;
+        loaded.add(12);
+        loaded.deserialize(buffer);
+        REQUIRE(loaded.total() == 10);
+        REQUIRE(histogram_contents(loaded) == expected);
+    }
+}
+
+TEST_CASE("Alignment stats from many threads add up to the stats from one", "[stats][alignment]") {
+
+    string aln_string = R"(
+        {
+            "sequence": "AGATTACACC",
+            "mapping_quality": 60,
+            "score": 5,
+            "path": {"mapping": [
+                {"position": {"node_id": 1}, "edit": [
+                    {"from_length": 0, "to_length": 1, "sequence": "A"},
+                    {"from_length": 3, "to_length": 3},
+                    {"from_length": 1, "to_length": 1, "sequence": "C"}
+                ]},
+                {"position": {"node_id": 2}, "edit": [
+                    {"from_length": 2, "to_length": 0},
+                    {"from_length": 2, "to_length": 2},
+                    {"from_length": 0, "to_length": 2, "sequence": "TA"},
+                    {"from_length": 3, "to_length": 3}
+                ]}
+            ]}
+        }
+    )";
+
+    Alignment aln;
+    json2pb(aln, aln_string.c_str(), aln_string.size());
+    Alignment secondary = aln;
+    secondary.set_is_secondary(true);
+
+    map<id_t, pair<string, string>> allele_path_for_node;
+    allele_path_for_node[2] = make_pair("_alt_site", "1");
+
+    AlignmentStatsAccumulator accumulator(&allele_path_for_node, true);
+    size_t reads = 1000;
+#pragma omp parallel for
+    for (size_t i = 0; i < reads; i++) {
+        accumulator.add(aln);
+        accumulator.add(secondary);
+    }
+    AlignmentStats stats = accumulator.reduce();
+
+    REQUIRE(stats.total_alignments == 2 * reads);
+    REQUIRE(stats.total_primary == reads);
+    REQUIRE(stats.total_secondary == reads);
+    REQUIRE(stats.total_aligned == reads);
+    REQUIRE(stats.node_visit_counts[1] == reads);
+    REQUIRE(stats.node_visit_counts[2] == reads);
+
+    REQUIRE(stats.total_softclips == reads);
+    REQUIRE(stats.total_softclipped_bases == reads);
+    REQUIRE(stats.total_insertions == reads);
+    REQUIRE(stats.total_inserted_bases == 2 * reads);
+    REQUIRE(stats.total_deletions == reads);
+    REQUIRE(stats.total_deleted_bases == 2 * reads);
+    REQUIRE(stats.total_substitutions == reads);
+    REQUIRE(stats.total_substituted_bases == reads);
+
+    REQUIRE(stats.mapping_qualities.count(60) == reads);
+    REQUIRE(stats.insertion_lengths.count(2) == reads);
+    REQUIRE(stats.deletion_lengths.count(2) == reads);
+    REQUIRE(stats.softclip_lengths.count(1) == reads);
+
+    REQUIRE(stats.reads_on_allele["_alt_site"]["1"] == reads);
+    REQUIRE(stats.insertions.size() == reads);
+    REQUIRE(stats.softclips.size() == reads);
+
+    SECTION("Stats merge like they were accumulated together") {
+        AlignmentStats doubled = stats;
+        doubled.merge(stats);
+        REQUIRE(doubled.total_alignments == 4 * reads);
+        REQUIRE(doubled.node_visit_counts[2] == 2 * reads);
+        REQUIRE(doubled.mapping_qualities.count(60) == 2 * reads);
+        REQUIRE(doubled.reads_on_allele["_alt_site"]["1"] == 2 * reads);
+        REQUIRE(doubled.deletions.size() == 2 * reads);
+    }
+
+    SECTION("Stats survive a round trip through a file") {
+        stringstream buffer;
+        stats.serialize(buffer);
+        AlignmentStats loaded;
+        loaded.deserialize(buffer);
+
+        REQUIRE(loaded.total_alignments == stats.total_alignments);
+        REQUIRE(loaded.total_aligned == stats.total_aligned);
+        REQUIRE(loaded.total_primary == stats.total_primary);
+        REQUIRE(loaded.total_secondary == stats.total_secondary);
+        REQUIRE(loaded.node_visit_counts == stats.node_visit_counts);
+        REQUIRE(loaded.total_insertions == stats.total_insertions);
+        REQUIRE(loaded.total_inserted_bases == stats.total_inserted_bases);
+        REQUIRE(loaded.total_deletions == stats.total_deletions);
+        REQUIRE(loaded.total_deleted_bases == stats.total_deleted_bases);
+        REQUIRE(loaded.total_substitutions == stats.total_substitutions);
+        REQUIRE(loaded.total_substituted_bases == stats.total_substituted_bases);
+        REQUIRE(loaded.total_softclips == stats.total_softclips);
+        REQUIRE(loaded.total_softclipped_bases == stats.total_softclipped_bases);
+        REQUIRE(histogram_contents(loaded.mapping_qualities) == histogram_contents(stats.mapping_qualities));
+        REQUIRE(histogram_contents(loaded.insertion_lengths) == histogram_contents(stats.insertion_lengths));
+        REQUIRE(histogram_contents(loaded.deletion_lengths) == histogram_contents(stats.deletion_lengths));
+        REQUIRE(histogram_contents(loaded.softclip_lengths) == histogram_contents(stats.softclip_lengths));
+        REQUIRE(loaded.mapping_qualities.total() == stats.mapping_qualities.total());
+        REQUIRE(loaded.reads_on_allele == stats.reads_on_allele);
+        REQUIRE(describe_edits(loaded.insertions) == describe_edits(stats.insertions));
+        REQUIRE(describe_edits(loaded.deletions) == describe_edits(stats.deletions));
+        REQUIRE(describe_edits(loaded.substitutions) == describe_edits(stats.substitutions));
+        REQUIRE(describe_edits(loaded.softclips) == describe_edits(stats.softclips));
+
+        SECTION("Loaded stats merge like the originals") {
+            loaded.merge(stats);
+            REQUIRE(loaded.total_alignments == 4 * reads);
+            REQUIRE(loaded.mapping_qualities.count(60) == 2 * reads);
+            REQUIRE(loaded.reads_on_allele["_alt_site"]["1"] == 2 * reads);
+        }
+    }
+
+    SECTION("Truncated stats files are rejected") {
+        stringstream buffer;
+        stats.serialize(buffer);
+        string truncated = buffer.str();
+        truncated.resize(truncated.size() / 2);
+        stringstream truncated_buffer(truncated);
+        AlignmentStats loaded;
+        REQUIRE_THROWS_AS(loaded.deserialize(truncated_buffer), runtime_error);
+    }
+
+    SECTION("Other files are rejected") {
+        stringstream buffer("GAI!not alignment stats");
+        AlignmentStats loaded;
+        REQUIRE_THROWS_AS(loaded.deserialize(buffer), runtime_error);
+    }
+
+    SECTION("The accumulator is empty after reducing") {
+        AlignmentStats again = accumulator.reduce();
+        REQUIRE(again.total_alignments == 0);
+        REQUIRE(again.node_visit_counts.empty());
+    }
+}
+
+}
+}
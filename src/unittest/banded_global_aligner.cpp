@@ -3438,6 +3438,172 @@ namespace vg {
                 }
             }
         }
+        
+        TEST_CASE( "Banded global aligner reuses its arena between alignments",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Aligner aligner;
+            
+            Node* n0 = graph.create_node("AGTG");
+            Node* n1 = graph.create_node("C");
+            Node* n2 = graph.create_node("A");
+            Node* n3 = graph.create_node("TGAAGT");
+            
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            BandedAlignerArena& arena = BandedAlignerArena::for_this_thread();
+            
+            size_t first_bytes;
+            {
+                Alignment aln;
+                aln.set_sequence("AGTGCTGAAGT");
+                BandedGlobalAligner<int16_t> band_graph(aln, graph.graph, 1, false, false);
+                band_graph.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                first_bytes = band_graph.arena_bytes();
+                
+                REQUIRE(first_bytes > 0);
+                REQUIRE(aln.score() == 11);
+            }
+            
+            size_t capacity = arena.capacity();
+            REQUIRE(capacity >= first_bytes);
+            
+            SECTION( "The same alignment again uses the same memory") {
+                Alignment aln;
+                aln.set_sequence("AGTGCTGAAGT");
+                BandedGlobalAligner<int16_t> band_graph(aln, graph.graph, 1, false, false);
+                band_graph.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                
+                REQUIRE(band_graph.arena_bytes() == first_bytes);
+                REQUIRE(arena.capacity() == capacity);
+                REQUIRE(aln.score() == 11);
+            }
+            
+            SECTION( "Aligners alive at the same time get separate memory") {
+                Alignment aln1;
+                aln1.set_sequence("AGTGCTGAAGT");
+                Alignment aln2;
+                aln2.set_sequence("AGTGATGAAGT");
+                BandedGlobalAligner<int16_t> band_graph1(aln1, graph.graph, 1, false, false);
+                BandedGlobalAligner<int16_t> band_graph2(aln2, graph.graph, 1, false, false);
+                band_graph1.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                band_graph2.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                
+                REQUIRE(aln1.score() == 11);
+                REQUIRE(aln2.score() == 11);
+                REQUIRE(aln1.path().mapping(1).position().node_id() == n1->id());
+                REQUIRE(aln2.path().mapping(1).position().node_id() == n2->id());
+            }
+        }
+        
+        TEST_CASE( "Banded global aligner gives the same alignments with and without the vector kernel",
+                  "[alignment][banded][mapping]" ) {
+            
+            // a chain of SNP bubbles, long enough that a band is several vectors tall
+            auto make_bubble_chain = [](VG& graph, size_t num_bubbles) -> string {
+                Node* prev = graph.create_node("GATTACA");
+                string read = prev->sequence();
+                string alleles = "ACGT";
+                for (size_t i = 0; i < num_bubbles; i++) {
+                    Node* ref = graph.create_node(string(1, alleles[i % 4]));
+                    Node* alt = graph.create_node(string(1, alleles[(i + 1) % 4]));
+                    Node* next = graph.create_node(i % 3 == 0 ? "CCTGAGTT" : "TTAGCCAG");
+                    graph.create_edge(prev, ref);
+                    graph.create_edge(prev, alt);
+                    graph.create_edge(ref, next);
+                    graph.create_edge(alt, next);
+                    read += (i % 2 ? ref : alt)->sequence() + next->sequence();
+                    prev = next;
+                }
+                return read;
+            };
+            
+            VG graph;
+            string read = make_bubble_chain(graph, 12);
+            // add a mismatch, a deletion and an insertion
+            read[20] = read[20] == 'A' ? 'C' : 'A';
+            read.erase(45, 2);
+            read.insert(80, "GG");
+            
+            string qual;
+            for (size_t i = 0; i < read.size(); i++) {
+                qual.push_back("+5?I"[i % 4]);
+            }
+            
+            auto align_both_ways = [&](Alignment& vector_aln, Alignment& scalar_aln, int8_t* score_matrix,
+                                       int8_t* nt_table, int8_t gap_open, int8_t gap_extension, bool qual_adjusted) {
+                {
+                    BandedGlobalAligner<int16_t> band_graph(vector_aln, graph.graph, 30, false, qual_adjusted);
+                    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+                }
+                {
+                    BandedGlobalAligner<int16_t> band_graph(scalar_aln, graph.graph, 30, false, qual_adjusted);
+                    band_graph.use_vector_kernel = false;
+                    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+                }
+                
+                REQUIRE(vector_aln.score() == scalar_aln.score());
+                REQUIRE(pb2json(vector_aln.path()) == pb2json(scalar_aln.path()));
+            };
+            
+            SECTION( "Alignments match with a regular score matrix" ) {
+                Aligner aligner;
+                
+                Alignment vector_aln, scalar_aln;
+                vector_aln.set_sequence(read);
+                scalar_aln.set_sequence(read);
+                
+                align_both_ways(vector_aln, scalar_aln, aligner.score_matrix, aligner.nt_table,
+                                aligner.gap_open, aligner.gap_extension, false);
+            }
+            
+            SECTION( "Alignments match with a base quality adjusted score matrix" ) {
+                QualAdjAligner aligner;
+                
+                Alignment vector_aln, scalar_aln;
+                vector_aln.set_sequence(read);
+                vector_aln.set_quality(qual);
+                alignment_quality_char_to_short(vector_aln);
+                scalar_aln.set_sequence(read);
+                scalar_aln.set_quality(qual);
+                alignment_quality_char_to_short(scalar_aln);
+                
+                align_both_ways(vector_aln, scalar_aln, aligner.score_matrix, aligner.nt_table,
+                                aligner.gap_open, aligner.gap_extension, true);
+            }
+            
+            SECTION( "Alignments match with 8 bit scores" ) {
+                Aligner aligner;
+                
+                // keep the scores small enough for 8 bits
+                VG small_graph;
+                string small_read = make_bubble_chain(small_graph, 5);
+                small_read[20] = small_read[20] == 'A' ? 'C' : 'A';
+                small_read.erase(30, 1);
+                
+                Alignment vector_aln, scalar_aln;
+                vector_aln.set_sequence(small_read);
+                scalar_aln.set_sequence(small_read);
+                
+                {
+                    BandedGlobalAligner<int8_t> band_graph(vector_aln, small_graph.graph, 20, false, false);
+                    band_graph.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                }
+                {
+                    BandedGlobalAligner<int8_t> band_graph(scalar_aln, small_graph.graph, 20, false, false);
+                    band_graph.use_vector_kernel = false;
+                    band_graph.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                }
+                
+                REQUIRE(vector_aln.score() == scalar_aln.score());
+                REQUIRE(pb2json(vector_aln.path()) == pb2json(scalar_aln.path()));
+            }
+        }
     }
 }
 
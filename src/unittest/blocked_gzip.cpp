@@ -0,0 +1,327 @@
+/// \file blocked_gzip.cpp
+///  
+/// unit tests for BGZF blocked gzip streams and the stream functions that use them
+
+#include <iostream>
+#include <sstream>
+#include <set>
+#include "../blocked_gzip.hpp"
+#include "../stream.hpp"
+#include "vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("BlockedGzipOutputStream output round-trips through BlockedGzipInputStream", "[stream][bgzf]") {
+    
+    // Make more data than fits in one block
+    string data;
+    for (size_t i = 0; i < 200000; i++) {
+        data.push_back("ACGT"[(i * 7 + i / 13) % 4]);
+    }
+    
+    stringstream file;
+    {
+        stream::BlockedGzipOutputStream bgzip_out(file);
+        ::google::protobuf::io::CodedOutputStream coded_out(&bgzip_out);
+        coded_out.WriteRaw(data.data(), data.size());
+    }
+    
+    stream::BlockedGzipInputStream bgzip_in(file);
+    REQUIRE(bgzip_in.IsBlocked());
+    
+    string read_back;
+    const void* buffer;
+    int size;
+    while (bgzip_in.Next(&buffer, &size)) {
+        REQUIRE((size_t) size <= stream::BGZF_BLOCK_DATA_SIZE);
+        read_back.append((const char*) buffer, size);
+    }
+    REQUIRE(read_back == data);
+    REQUIRE((size_t) bgzip_in.ByteCount() == data.size());
+}
+
+TEST_CASE("BlockedGzipInputStream read-ahead produces the same data and offsets", "[stream][bgzf]") {
+    
+    stringstream file;
+    std::function<Alignment(uint64_t)> lambda = [&](uint64_t i) {
+        Alignment aln;
+        aln.set_name(to_string(i));
+        aln.set_sequence(string(100 + i % 300, "ACGT"[i % 4]));
+        return aln;
+    };
+    stream::write(file, 5000, lambda);
+    string contents = file.str();
+    
+    stringstream plain_file(contents);
+    stream::BlockedGzipInputStream plain_in(plain_file);
+    stringstream ahead_file(contents);
+    stream::BlockedGzipInputStream ahead_in(ahead_file);
+    ahead_in.SetReadAhead(4);
+    
+    const void* plain_data;
+    int plain_size;
+    const void* ahead_data;
+    int ahead_size;
+    while (plain_in.Next(&plain_data, &plain_size)) {
+        REQUIRE(ahead_in.Next(&ahead_data, &ahead_size));
+        REQUIRE(string((const char*) plain_data, plain_size) == string((const char*) ahead_data, ahead_size));
+        REQUIRE(plain_in.Tell() == ahead_in.Tell());
+    }
+    REQUIRE(!ahead_in.Next(&ahead_data, &ahead_size));
+    
+    SECTION("for_each_parallel sees every object from a multi-block file") {
+        stringstream in(contents);
+        size_t seen = 0;
+        size_t name_total = 0;
+        stream::for_each_parallel<Alignment>(in, [&](Alignment& aln) {
+            #pragma omp critical (test_seen)
+            {
+                seen++;
+                name_total += stoull(aln.name());
+            }
+        });
+        REQUIRE(seen == 5000);
+        REQUIRE(name_total == 4999 * 5000 / 2);
+    }
+}
+
+TEST_CASE("Blocked GAM data is readable by a plain gzip reader", "[stream][bgzf]") {
+    
+    stringstream file;
+    vector<Alignment> group(3);
+    for (size_t i = 0; i < group.size(); i++) {
+        group[i].set_name("read" + to_string(i));
+    }
+    file << stream::compress_group(group);
+    
+    ::google::protobuf::io::IstreamInputStream raw_in(&file);
+    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+    
+    uint64_t count;
+    REQUIRE(coded_in.ReadVarint64((::google::protobuf::uint64*) &count));
+    REQUIRE(count == 3);
+    uint32_t size;
+    REQUIRE(coded_in.ReadVarint32(&size));
+    string s;
+    REQUIRE(coded_in.ReadString(&s, size));
+    Alignment first;
+    REQUIRE(first.ParseFromString(s));
+    REQUIRE(first.name() == "read0");
+}
+
+TEST_CASE("Plain gzip GAM data is still readable by for_each", "[stream][bgzf]") {
+    
+    string compressed;
+    {
+        ::google::protobuf::io::StringOutputStream raw_out(&compressed);
+        ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+        ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+        
+        coded_out.WriteVarint64(2);
+        for (size_t i = 0; i < 2; i++) {
+            Alignment aln;
+            aln.set_name("old" + to_string(i));
+            string s;
+            aln.SerializeToString(&s);
+            coded_out.WriteVarint32(s.size());
+            coded_out.WriteRaw(s.data(), s.size());
+        }
+    }
+    
+    stringstream file(compressed);
+    vector<string> names;
+    stream::for_each<Alignment>(file, [&](Alignment& aln) {
+        names.push_back(aln.name());
+    });
+    REQUIRE(names == vector<string>({"old0", "old1"}));
+    
+    stringstream file2(compressed);
+    stream::BlockedGzipInputStream bgzip_in(file2);
+    REQUIRE(!bgzip_in.IsBlocked());
+    REQUIRE(bgzip_in.Tell() == -1);
+}
+
+TEST_CASE("BGZF data followed by plain gzip data is read all the way through", "[stream][bgzf]") {
+    
+    stringstream file;
+    std::function<Alignment(uint64_t)> lambda = [&](uint64_t i) {
+        Alignment aln;
+        aln.set_name("new" + to_string(i));
+        return aln;
+    };
+    stream::write(file, 3, lambda);
+    
+    {
+        // Tack on an old-style plain gzip GAM, as cat would
+        string compressed;
+        ::google::protobuf::io::StringOutputStream raw_out(&compressed);
+        {
+            ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+            ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+            
+            coded_out.WriteVarint64(2);
+            for (size_t i = 0; i < 2; i++) {
+                Alignment aln;
+                aln.set_name("old" + to_string(i));
+                string s;
+                aln.SerializeToString(&s);
+                coded_out.WriteVarint32(s.size());
+                coded_out.WriteRaw(s.data(), s.size());
+            }
+        }
+        file << compressed;
+    }
+    string contents = file.str();
+    
+    stringstream in(contents);
+    vector<string> names;
+    stream::for_each<Alignment>(in, [&](Alignment& aln) {
+        names.push_back(aln.name());
+    });
+    REQUIRE(names == vector<string>({"new0", "new1", "new2", "old0", "old1"}));
+    
+    SECTION("Read-ahead switches over at the same place") {
+        stringstream plain_file(contents);
+        stream::BlockedGzipInputStream plain_in(plain_file);
+        stringstream ahead_file(contents);
+        stream::BlockedGzipInputStream ahead_in(ahead_file);
+        ahead_in.SetReadAhead(4);
+        
+        REQUIRE(plain_in.IsBlocked());
+        REQUIRE(ahead_in.IsBlocked());
+        
+        string plain_data;
+        string ahead_data;
+        const void* data;
+        int size;
+        while (plain_in.Next(&data, &size)) {
+            plain_data.append((const char*) data, size);
+        }
+        while (ahead_in.Next(&data, &size)) {
+            ahead_data.append((const char*) data, size);
+        }
+        REQUIRE(plain_data == ahead_data);
+        REQUIRE((size_t) plain_in.ByteCount() == plain_data.size());
+        REQUIRE((size_t) ahead_in.ByteCount() == ahead_data.size());
+        
+        // Once we're in the plain gzip part we can't seek
+        REQUIRE(!plain_in.IsBlocked());
+        REQUIRE(!ahead_in.IsBlocked());
+        REQUIRE(plain_in.Tell() == -1);
+    }
+}
+
+TEST_CASE("Group virtual offsets can be used to seek into a GAM", "[stream][bgzf]") {
+    
+    stringstream file;
+    for (size_t i = 0; i < 10; i++) {
+        // Make groups big enough to span blocks
+        std::function<Alignment(uint64_t)> lambda = [&](uint64_t j) {
+            Alignment aln;
+            aln.set_name(to_string(i) + "_" + to_string(j));
+            aln.set_sequence(string(1000 + (i * 31 + j * 17) % 500, 'A' + (j % 26)));
+            return aln;
+        };
+        stream::write(file, 100, lambda);
+    }
+    
+    vector<pair<int64_t, string>> seen;
+    stream::for_each_with_group_offsets<Alignment>(file, [&](int64_t group_offset, Alignment& aln) {
+        seen.emplace_back(group_offset, aln.name());
+    });
+    REQUIRE(seen.size() == 1000);
+    REQUIRE(seen.front().first == 0);
+    
+    for (size_t i : {0, 3, 9}) {
+        int64_t group_offset = seen[i * 100].first;
+        REQUIRE(group_offset >= 0);
+        
+        file.clear();
+        file.seekg(0);
+        
+        vector<string> names;
+        stream::for_each_from<Alignment>(file, group_offset, [&](int64_t offset, Alignment& aln) {
+            REQUIRE(offset == group_offset);
+            names.push_back(aln.name());
+            return names.size() < 100;
+        });
+        
+        REQUIRE(names.size() == 100);
+        REQUIRE(names.front() == to_string(i) + "_0");
+        REQUIRE(names.back() == to_string(i) + "_99");
+    }
+}
+
+TEST_CASE("Arena-backed readers see the same objects as the ordinary ones", "[stream]") {
+    
+    vector<Alignment> alns(1000);
+    for (size_t i = 0; i < alns.size(); i++) {
+        alns[i].set_name(to_string(i));
+        alns[i].set_sequence(string(100 + i % 50, 'A' + (i % 26)));
+        for (size_t j = 0; j < 3; j++) {
+            Mapping* mapping = alns[i].mutable_path()->add_mapping();
+            mapping->mutable_position()->set_node_id(i + j);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(10);
+            edit->set_to_length(10);
+        }
+    }
+    
+    stringstream file;
+    file << stream::compress_group(alns);
+    
+    // Summarize each object as a string that uses its nested fields
+    auto describe = [](const Alignment& aln) {
+        return aln.name() + ":" + to_string(aln.sequence().size()) + ":"
+            + to_string(aln.path().mapping(2).position().node_id());
+    };
+    
+    set<string> expected;
+    for (auto& aln : alns) {
+        expected.insert(describe(aln));
+    }
+    
+    SECTION("Serial reading works") {
+        set<string> seen;
+        stream::for_each_arena<Alignment>(file, [&](Alignment& aln) {
+            seen.insert(describe(aln));
+        });
+        REQUIRE(seen == expected);
+    }
+    
+    SECTION("Parallel reading works") {
+        set<string> seen;
+        stream::for_each_parallel_arena<Alignment>(file, [&](Alignment& aln) {
+            string description = describe(aln);
+#pragma omp critical
+            seen.insert(description);
+        });
+        REQUIRE(seen == expected);
+    }
+    
+    SECTION("Paired reading works") {
+        set<string> seen;
+        size_t bad_pairs = 0;
+        stream::for_each_interleaved_pair_parallel_arena<Alignment>(file, [&](Alignment& aln1, Alignment& aln2) {
+            string description1 = describe(aln1);
+            string description2 = describe(aln2);
+#pragma omp critical
+            {
+                if (stoi(aln1.name()) % 2 != 0 || stoi(aln2.name()) != stoi(aln1.name()) + 1) {
+                    bad_pairs++;
+                }
+                seen.insert(description1);
+                seen.insert(description2);
+            }
+        });
+        REQUIRE(bad_pairs == 0);
+        REQUIRE(seen == expected);
+    }
+}
+
+}
+}
@@ -0,0 +1,91 @@
+/// \file compact_alignment.cpp
+///
+/// unit tests for the flat alignment candidate pool
+///
+
+#include <iostream>
+#include <string>
+#include "../json2pb.h"
+#include "../vg.pb.h"
+#include "../compact_alignment.hpp"
+#include "../position.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Compact alignment pools convert candidates back to the same Alignments", "[alignment][compact]") {
+
+    string read_string = R"({"name": "read", "sequence": "GATTACA"})";
+
+    string candidate_string = R"(
+        {
+            "name": "read",
+            "sequence": "GATTACA",
+            "score": 9,
+            "identity": 0.857,
+            "path": {"mapping": [
+                {"position": {"node_id": 1, "offset": 2}, "rank": 1, "edit": [
+                    {"from_length": 3, "to_length": 3},
+                    {"from_length": 1, "to_length": 1, "sequence": "T"}
+                ]},
+                {"position": {"node_id": 4, "is_reverse": true}, "rank": 2, "edit": [
+                    {"from_length": 3, "to_length": 3}
+                ]}
+            ]}
+        }
+    )";
+
+    Alignment read;
+    json2pb(read, read_string.c_str(), read_string.size());
+    Alignment aln;
+    json2pb(aln, candidate_string.c_str(), candidate_string.size());
+
+    CompactAlignmentPool pool;
+    size_t i = pool.add(aln);
+    size_t unaligned = pool.add(read);
+
+    REQUIRE(pool.size() == 2);
+    REQUIRE(pool[i].score == 9);
+    REQUIRE(pool.mapping_count(i) == 2);
+    REQUIRE(pool.mapping_count(unaligned) == 0);
+
+    SECTION("The Alignment round trips") {
+        REQUIRE(pb2json(pool.to_alignment(i, read)) == pb2json(aln));
+        REQUIRE(pb2json(pool.to_alignment(unaligned, read)) == pb2json(read));
+    }
+
+    SECTION("Path ends are found") {
+        REQUIRE(pool.start(i) == make_pos_t(1, false, 2));
+        REQUIRE(pool.end(i) == make_pos_t(4, true, 3));
+        REQUIRE(is_empty(pool.start(unaligned)));
+    }
+
+    SECTION("Duplicates are recognized") {
+        size_t copy = pool.add(aln);
+        REQUIRE(pool.same_alignment(i, copy));
+
+        pool[copy].score = 8;
+        REQUIRE(pool.same_path(i, copy));
+        REQUIRE(!pool.same_alignment(i, copy));
+
+        aln.mutable_path()->mutable_mapping(0)->mutable_edit(1)->set_sequence("C");
+        size_t different = pool.add(aln);
+        REQUIRE(!pool.same_path(i, different));
+        REQUIRE(!pool.same_path(unaligned, different));
+    }
+
+    SECTION("Dropping the last candidate leaves the others intact") {
+        pool.add(aln);
+        pool.pop_back();
+        REQUIRE(pool.size() == 2);
+        REQUIRE(pb2json(pool.to_alignment(i, read)) == pb2json(aln));
+
+        size_t again = pool.add(aln);
+        REQUIRE(pool.same_alignment(i, again));
+    }
+}
+
+}
+}
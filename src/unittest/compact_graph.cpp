@@ -0,0 +1,169 @@
+/// \file compact_graph.cpp
+///
+/// unit tests for CompactGraph, checking that the ID operations vg ids uses
+/// give the same graphs, paths included, as they do on VG
+
+#include <iostream>
+#include <sstream>
+#include <set>
+#include "../compact_graph.hpp"
+#include "../vg.hpp"
+#include "../stream.hpp"
+#include "../json2pb.h"
+#include "../algorithms/topological_sort.hpp"
+#include "vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+/// Describe a serialized graph in a form that doesn't depend on chunking,
+/// element order, or which way round each edge is written.
+static set<string> describe_graph(const string& serialized) {
+    set<string> description;
+    stringstream in(serialized);
+    map<string, map<int64_t, Mapping>> paths;
+    stream::for_each<Graph>(in, [&](Graph& chunk) {
+        for (auto& node : chunk.node()) {
+            description.insert("node " + to_string(node.id()) + " " + node.sequence());
+        }
+        for (auto& edge : chunk.edge()) {
+            // An edge reads the same backward with its ends swapped and flipped
+            auto forward = make_tuple(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+            auto backward = make_tuple(edge.to(), !edge.to_end(), edge.from(), !edge.from_start());
+            auto canonical = min(forward, backward);
+            description.insert("edge " + to_string(get<0>(canonical)) + (get<1>(canonical) ? "-" : "+") +
+                               " " + to_string(get<2>(canonical)) + (get<3>(canonical) ? "-" : "+"));
+        }
+        for (auto& path : chunk.path()) {
+            // Path mappings for a path can be split over chunks
+            for (auto& mapping : path.mapping()) {
+                paths[path.name()][mapping.rank()] = mapping;
+            }
+        }
+    });
+    for (auto& path : paths) {
+        string steps;
+        for (auto& ranked : path.second) {
+            const Mapping& mapping = ranked.second;
+            steps += " " + to_string(mapping.position().node_id()) + (mapping.position().is_reverse() ? "-" : "+") +
+                     "@" + to_string(mapping.position().offset()) + ":" + to_string(mapping_from_length(mapping)) +
+                     "/" + to_string(mapping_to_length(mapping));
+        }
+        description.insert("path " + path.first + steps);
+    }
+    return description;
+}
+
+TEST_CASE("CompactGraph renumbers nodes and paths the way VG does", "[compactgraph][handle][vg]") {
+
+    // A chain with a skip edge, so it has only one topological order, with
+    // IDs that have gaps and are out of order. One path goes forward, one goes
+    // backward, and one has an edit.
+    string graph_json = R"(
+    {"node":[{"id":20,"sequence":"GAT"},{"id":9,"sequence":"TACA"},{"id":5,"sequence":"CA"},
+    {"id":31,"sequence":"TTAG"},{"id":12,"sequence":"G"}],
+    "edge":[{"from":5,"to":9},{"from":9,"to":12},{"from":12,"to":20},{"from":20,"to":31},{"from":5,"to":12}],
+    "path":[{"name":"forward","mapping":[
+    {"position":{"node_id":5},"edit":[{"from_length":2,"to_length":2}],"rank":1},
+    {"position":{"node_id":9},"edit":[{"from_length":4,"to_length":4}],"rank":2},
+    {"position":{"node_id":12},"edit":[{"from_length":1,"to_length":1}],"rank":3},
+    {"position":{"node_id":20},"edit":[{"from_length":3,"to_length":3}],"rank":4}]},
+    {"name":"backward","mapping":[
+    {"position":{"node_id":31,"is_reverse":true},"edit":[{"from_length":4,"to_length":4}],"rank":1},
+    {"position":{"node_id":20,"is_reverse":true},"edit":[{"from_length":3,"to_length":3}],"rank":2},
+    {"position":{"node_id":12,"is_reverse":true},"edit":[{"from_length":1,"to_length":1}],"rank":3}]},
+    {"name":"edited","mapping":[
+    {"position":{"node_id":9,"offset":1},"edit":[{"from_length":2,"to_length":2},{"from_length":1,"to_length":1,"sequence":"T"}],"rank":1},
+    {"position":{"node_id":12},"edit":[{"from_length":1,"to_length":1}],"rank":2}]}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+
+    // Both implementations load the same serialized graph, as vg ids does
+    string serialized;
+    {
+        VG source;
+        source.extend(proto_graph);
+        stringstream out;
+        source.serialize_to_ostream(out);
+        serialized = out.str();
+    }
+    stringstream vg_in(serialized);
+    VG vg_graph(vg_in);
+    stringstream compact_in(serialized);
+    CompactGraph compact_graph(compact_in);
+
+    // Compare what they write out
+    auto check_same = [&]() {
+        stringstream vg_out;
+        vg_graph.serialize_to_ostream(vg_out);
+        stringstream compact_out;
+        compact_graph.serialize_to_ostream(compact_out);
+
+        set<string> expected = describe_graph(vg_out.str());
+        REQUIRE(expected.size() == 5 + 5 + 3);
+        REQUIRE(describe_graph(compact_out.str()) == expected);
+    };
+
+    SECTION("Loading and saving changes nothing") {
+        check_same();
+
+        stringstream compact_out;
+        compact_graph.serialize_to_ostream(compact_out);
+        REQUIRE(describe_graph(compact_out.str()) == describe_graph(serialized));
+
+        SECTION("Saved graphs can be loaded again") {
+            stringstream reloaded_in(compact_out.str());
+            CompactGraph reloaded(reloaded_in);
+            stringstream reloaded_out;
+            reloaded.serialize_to_ostream(reloaded_out);
+            REQUIRE(describe_graph(reloaded_out.str()) == describe_graph(serialized));
+        }
+    }
+
+    SECTION("Compacting IDs matches vg ids -c") {
+        vg_graph.compact_ids();
+        compact_graph.compact_ids();
+        check_same();
+        REQUIRE(compact_graph.min_node_id() == 1);
+        REQUIRE(compact_graph.max_node_id() == 5);
+    }
+
+    SECTION("Sorting and compacting IDs matches vg ids -s") {
+        algorithms::sort(&vg_graph);
+        vg_graph.compact_ids();
+        algorithms::sort(&compact_graph);
+        compact_graph.compact_ids();
+        check_same();
+        // The chain comes out in order
+        REQUIRE(compact_graph.get_sequence(compact_graph.get_handle(1)) == "CA");
+        REQUIRE(compact_graph.get_sequence(compact_graph.get_handle(5)) == "TTAG");
+    }
+
+    SECTION("Incrementing IDs matches vg ids -i") {
+        vg_graph.increment_node_ids(1000);
+        compact_graph.increment_node_ids(1000);
+        check_same();
+        REQUIRE(compact_graph.min_node_id() == 1005);
+    }
+
+    SECTION("Decrementing IDs matches vg ids -d") {
+        vg_graph.decrement_node_ids(4);
+        compact_graph.decrement_node_ids(4);
+        check_same();
+        REQUIRE(compact_graph.min_node_id() == 1);
+    }
+
+    SECTION("Incrementing and then compacting matches vg ids -i N | vg ids -c") {
+        vg_graph.increment_node_ids(1000);
+        vg_graph.compact_ids();
+        compact_graph.increment_node_ids(1000);
+        compact_graph.compact_ids();
+        check_same();
+    }
+}
+
+}
+}
@@ -0,0 +1,111 @@
+/// \file concurrent_memo.cpp
+///
+/// Unit tests for the bounded memo shared between threads.
+///
+
+#include <omp.h>
+
+#include <vector>
+#include "../concurrent_memo.hpp"
+#include "../hash_map.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Concurrent memo remembers values and counts hits", "[memo]") {
+
+    ConcurrentMemo<int64_t, vector<size_t>> memo(1000, 4);
+
+    vector<size_t> value;
+    REQUIRE(!memo.find(1, value));
+    REQUIRE(memo.misses() == 1);
+    REQUIRE(memo.hit_rate() == 0.0);
+
+    memo.insert(1, {2, 3});
+    REQUIRE(memo.find(1, value));
+    REQUIRE(value == vector<size_t>({2, 3}));
+    REQUIRE(memo.hits() == 1);
+    REQUIRE(memo.hit_rate() == 0.5);
+    REQUIRE(memo.size() == 1);
+
+    SECTION("Inserting again replaces the value") {
+        memo.insert(1, {4});
+        REQUIRE(memo.find(1, value));
+        REQUIRE(value == vector<size_t>({4}));
+        REQUIRE(memo.size() == 1);
+    }
+
+    SECTION("Clearing drops the entries but keeps the counts") {
+        memo.clear();
+        REQUIRE(memo.size() == 0);
+        REQUIRE(!memo.find(1, value));
+        REQUIRE(memo.hits() == 1);
+        REQUIRE(memo.misses() == 2);
+    }
+
+    SECTION("Pair keys work") {
+        ConcurrentMemo<pair<int64_t, bool>, int> pair_memo;
+        pair_memo.insert(make_pair(5, true), 7);
+        int found = 0;
+        REQUIRE(pair_memo.find(make_pair(5, true), found));
+        REQUIRE(found == 7);
+        REQUIRE(!pair_memo.find(make_pair(5, false), found));
+    }
+}
+
+TEST_CASE("Concurrent memo stays within its size bound", "[memo]") {
+
+    // one shard that holds 10 entries per generation
+    ConcurrentMemo<int64_t, int64_t> memo(20, 1);
+
+    for (int64_t i = 0; i < 1000; i++) {
+        memo.insert(i, i);
+        REQUIRE(memo.size() <= 20);
+    }
+
+    int64_t value;
+    SECTION("The most recent entries are kept") {
+        REQUIRE(memo.find(999, value));
+        REQUIRE(value == 999);
+        REQUIRE(!memo.find(0, value));
+    }
+
+    SECTION("Entries that keep being used survive eviction") {
+        for (int64_t i = 1000; i < 1100; i++) {
+            REQUIRE(memo.find(999, value));
+            memo.insert(i, i);
+        }
+        REQUIRE(memo.find(999, value));
+        REQUIRE(memo.size() <= 20);
+    }
+}
+
+TEST_CASE("Concurrent memo can be used from many threads at once", "[memo]") {
+
+    ConcurrentMemo<int64_t, int64_t> memo(100000);
+
+    size_t wrong = 0;
+#pragma omp parallel for reduction(+:wrong)
+    for (int64_t i = 0; i < 20000; i++) {
+        int64_t key = i % 500;
+        int64_t value;
+        if (memo.find(key, value)) {
+            if (value != key * key) {
+                wrong++;
+            }
+        }
+        else {
+            memo.insert(key, key * key);
+        }
+    }
+
+    REQUIRE(wrong == 0);
+    REQUIRE(memo.size() == 500);
+    REQUIRE(memo.hits() + memo.misses() == 20000);
+    REQUIRE(memo.misses() >= 500);
+}
+
+}
+}
@@ -229,8 +229,10 @@ ConstructedChunk construct_test_chunk(string ref_sequence, string ref_name, stri
 
 /**
  * Testing wrapper to build a whole graph from a VCF string. Adds alt paths by default.
+ * Chunking parameters left at 0 use the Constructor defaults.
  */
-Graph construct_test_graph(string fasta_data, string vcf_data) {
+Graph construct_test_graph(string fasta_data, string vcf_data, size_t bases_per_chunk = 0,
+                           size_t chunks_in_parallel = 0) {
     
     // Merge all the graphs we get into this graph
     Graph built;
@@ -272,6 +274,10 @@ Graph construct_test_graph(string fasta_data, string vcf_data) {
     constructor.alt_paths = true;
     // Make sure we can test the node splitting behavior at reasonable sizes
     constructor.max_node_size = 50;
+    if (bases_per_chunk != 0) {
+        constructor.bases_per_chunk = bases_per_chunk;
+    }
+    constructor.chunks_in_parallel = chunks_in_parallel;
 
     // Construct the graph    
     constructor.construct_graph(fasta_pointers, vcf_pointers, ins_pointers, callback);
@@ -1264,5 +1270,39 @@ GATTACACATTAG
 
 }
 
+TEST_CASE( "Constructing chunks in parallel gives the same graph as constructing them one at a time", "[constructor]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT
+ref1	3	.	T	C	29	PASS	.	GT
+ref1	12	.	CA	C	29	PASS	.	GT
+ref1	25	.	A	G	29	PASS	.	GT
+ref1	33	.	C	CTT	29	PASS	.	GT
+ref2	5	.	A	T	29	PASS	.	GT
+ref2	6	rs1338	C	G	29	PASS	.	GT
+ref2	20	.	TAG	T	29	PASS	.	GT
+)";
+
+    auto fasta_data = R"(>ref1
+GATTACACATTAGGATTACACATTAGGATTACACATTAG
+>ref2
+GATTACACATTAGGATTACACATTAG
+)";
+
+    // Use tiny chunks so each contig is split into many of them
+    Graph serial = construct_test_graph(fasta_data, vcf_data, 4, 1);
+    Graph parallel = construct_test_graph(fasta_data, vcf_data, 4, 8);
+    
+    // Emission order is fixed, so the graphs should match exactly
+    REQUIRE(pb2json(serial) == pb2json(parallel));
+}
+
 }
 }
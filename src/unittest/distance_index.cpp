@@ -0,0 +1,179 @@
+/// \file distance_index.cpp
+///
+/// Unit tests for the snarl-based minimum distance index, checked against a
+/// search of the whole graph.
+///
+
+#include <iostream>
+#include <sstream>
+#include <queue>
+#include "../vg.hpp"
+#include "../genotypekit.hpp"
+#include "../distance_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Find the minimum distance between two positions by searching the graph.
+static int64_t search_distance(const HandleGraph& graph, const pos_t& pos_1, const pos_t& pos_2) {
+    int64_t best = -1;
+    if (id(pos_1) == id(pos_2) && is_rev(pos_1) == is_rev(pos_2) && offset(pos_2) >= offset(pos_1)) {
+        best = offset(pos_2) - offset(pos_1);
+    }
+
+    // Distances to the first base of each handle
+    map<pair<id_t, bool>, int64_t> reached;
+    priority_queue<pair<int64_t, pair<id_t, bool>>, vector<pair<int64_t, pair<id_t, bool>>>,
+                   greater<pair<int64_t, pair<id_t, bool>>>> queue;
+    auto enqueue_next = [&](const handle_t& handle, int64_t distance) {
+        graph.follow_edges(handle, false, [&](const handle_t& next) {
+            auto key = make_pair(graph.get_id(next), graph.get_is_reverse(next));
+            if (!reached.count(key) || reached[key] > distance) {
+                reached[key] = distance;
+                queue.emplace(distance, key);
+            }
+            return true;
+        });
+    };
+    handle_t start = graph.get_handle(id(pos_1), is_rev(pos_1));
+    enqueue_next(start, graph.get_length(start) - offset(pos_1));
+
+    while (!queue.empty()) {
+        int64_t distance = queue.top().first;
+        auto key = queue.top().second;
+        queue.pop();
+        if (reached[key] < distance) {
+            continue;
+        }
+        if (key.first == id(pos_2) && key.second == is_rev(pos_2)) {
+            if (best == -1 || distance + offset(pos_2) < best) {
+                best = distance + offset(pos_2);
+            }
+        }
+        handle_t handle = graph.get_handle(key.first, key.second);
+        enqueue_next(handle, distance + graph.get_length(handle));
+    }
+    return best;
+}
+
+/// Check the index against a search between every pair of positions.
+static void check_all_distances(VG& graph, const DistanceIndex& index) {
+    vector<pos_t> positions;
+    graph.for_each_handle([&](const handle_t& handle) {
+        for (size_t i = 0; i < graph.get_length(handle); i++) {
+            positions.push_back(make_pos_t(graph.get_id(handle), false, i));
+            positions.push_back(make_pos_t(graph.get_id(handle), true, i));
+        }
+        return true;
+    });
+    for (auto& pos_1 : positions) {
+        for (auto& pos_2 : positions) {
+            REQUIRE(index.min_distance(pos_1, pos_2) == search_distance(graph, pos_1, pos_2));
+        }
+    }
+}
+
+TEST_CASE("Distance index finds minimum distances in nested snarls", "[distance][snarls]") {
+
+    // Snarls from 1 to 8, 2 to 7 and 3 to 5, nested in each other, with a
+    // chain of two snarls inside the middle one
+    VG graph;
+
+    Node* n1 = graph.create_node("GCA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("G");
+    Node* n4 = graph.create_node("CTGA");
+    Node* n5 = graph.create_node("GCA");
+    Node* n6 = graph.create_node("T");
+    Node* n7 = graph.create_node("G");
+    Node* n8 = graph.create_node("CTGA");
+    Node* n9 = graph.create_node("AC");
+    Node* n10 = graph.create_node("GGT");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n8);
+    graph.create_edge(n2, n3);
+    graph.create_edge(n2, n6);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n3, n5);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n5, n9);
+    graph.create_edge(n5, n10);
+    graph.create_edge(n9, n7);
+    graph.create_edge(n10, n7);
+    graph.create_edge(n6, n7);
+    graph.create_edge(n7, n8);
+
+    CactusSnarlFinder bubble_finder(graph);
+    SnarlManager snarl_manager = bubble_finder.find_snarls();
+
+    DistanceIndex index(&graph, &snarl_manager);
+
+    SECTION("Distances along one strand are exact") {
+        REQUIRE(index.min_distance(make_pos_t(n1->id(), false, 0), make_pos_t(n1->id(), false, 2)) == 2);
+        REQUIRE(index.min_distance(make_pos_t(n1->id(), false, 2), make_pos_t(n8->id(), false, 0)) == 1);
+        REQUIRE(index.min_distance(make_pos_t(n3->id(), false, 0), make_pos_t(n7->id(), false, 0)) == 6);
+        REQUIRE(index.min_distance(make_pos_t(n8->id(), true, 0), make_pos_t(n1->id(), true, 0)) == 4);
+    }
+
+    SECTION("Unreachable positions have no distance") {
+        REQUIRE(index.min_distance(make_pos_t(n8->id(), false, 0), make_pos_t(n1->id(), false, 0)) == -1);
+        REQUIRE(index.min_distance(make_pos_t(n1->id(), false, 0), make_pos_t(n4->id(), true, 0)) == -1);
+    }
+
+    SECTION("Oriented distances are signed") {
+        REQUIRE(index.oriented_distance(make_pos_t(n1->id(), false, 0), make_pos_t(n2->id(), false, 0)) == 3);
+        REQUIRE(index.oriented_distance(make_pos_t(n2->id(), false, 0), make_pos_t(n1->id(), false, 0)) == -3);
+        REQUIRE(index.oriented_distance(make_pos_t(n1->id(), false, 0), make_pos_t(n2->id(), true, 0)) ==
+                numeric_limits<int64_t>::max());
+    }
+
+    SECTION("All distances match a search of the graph") {
+        check_all_distances(graph, index);
+    }
+
+    SECTION("The index can be saved and loaded") {
+        stringstream stream;
+        index.save(stream);
+        DistanceIndex loaded(stream);
+        check_all_distances(graph, loaded);
+    }
+}
+
+TEST_CASE("Distance index finds distances through loops and reversals", "[distance][snarls]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCA");
+    Node* n2 = graph.create_node("TT");
+    Node* n3 = graph.create_node("G");
+    Node* n4 = graph.create_node("CTGA");
+    Node* n5 = graph.create_node("GCAT");
+    Node* n6 = graph.create_node("A");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n2, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n5);
+    graph.create_edge(n4, n5);
+    // An inversion of node 3
+    graph.create_edge(n2, n3, false, true);
+    graph.create_edge(n3, n5, true, false);
+    // A loop back around the middle
+    graph.create_edge(n5, n2);
+    graph.create_edge(n5, n6);
+    // And a reversing edge at the end
+    graph.create_edge(n6, n6, false, true);
+
+    CactusSnarlFinder bubble_finder(graph);
+    SnarlManager snarl_manager = bubble_finder.find_snarls();
+
+    DistanceIndex index(&graph, &snarl_manager);
+
+    check_all_distances(graph, index);
+}
+
+}
+}
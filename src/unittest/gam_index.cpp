@@ -0,0 +1,151 @@
+/// \file gam_index.cpp
+///  
+/// unit tests for the node ID index over sorted GAM files
+
+#include <iostream>
+#include <sstream>
+#include <set>
+#include "../gam_index.hpp"
+#include "../gamsorter.hpp"
+#include "../stream.hpp"
+#include "vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE("GAMIndex bins nest properly", "[gam][gamindex]") {
+    
+    // A single node gets the most specific bin for it
+    REQUIRE(GAMIndex::common_bin(5, 5) != GAMIndex::common_bin(4, 4));
+    // Ranges within a power-of-two block share a bin
+    REQUIRE(GAMIndex::common_bin(8, 15) == GAMIndex::common_bin(9, 14));
+    // Ranges that cross one get a coarser bin
+    REQUIRE(GAMIndex::common_bin(7, 8) != GAMIndex::common_bin(8, 15));
+    REQUIRE(GAMIndex::common_bin(7, 8) == GAMIndex::common_bin(1, 15));
+}
+
+TEST_CASE("GAMIndex finds exactly the alignments touching queried nodes", "[gam][gamindex]") {
+    
+    vector<Alignment> alns(3000);
+    for (size_t i = 0; i < alns.size(); i++) {
+        alns[i].set_name("read" + to_string(i));
+        alns[i].set_sequence(string(100, 'G'));
+        if (i % 13 != 0) {
+            // Visit a few nodes, sometimes jumping far away
+            id_t start = 1 + (i * 7919) % 5000;
+            for (size_t j = 0; j < 1 + i % 4; j++) {
+                id_t id = (i % 5 == 0 && j == 1) ? start + 700 : start + j;
+                alns[i].mutable_path()->add_mapping()->mutable_position()->set_node_id(id);
+            }
+        }
+    }
+    
+    stringstream unsorted;
+    {
+        vector<Alignment> to_write = alns;
+        stream::write_buffered(unsorted, to_write, 0);
+    }
+    
+    // Sort in small groups so the file has many blocks
+    stringstream sorted;
+    GAMSorter sorter;
+    sorter.max_buf_bytes = 64 * 1024;
+    sorter.stream_sort(unsorted, sorted);
+    
+    GAMIndex index;
+    index.index(sorted);
+    
+    // Round-trip the index
+    stringstream saved;
+    index.save(saved);
+    GAMIndex loaded;
+    loaded.load(saved);
+    REQUIRE(loaded.chunk_count() == index.chunk_count());
+    
+    auto expected_for = [&](const function<bool(id_t)>& wanted) {
+        set<string> names;
+        for (auto& aln : alns) {
+            for (auto& mapping : aln.path().mapping()) {
+                if (wanted(mapping.position().node_id())) {
+                    names.insert(aln.name());
+                    break;
+                }
+            }
+        }
+        return names;
+    };
+    
+    for (id_t min_id : {1, 17, 2500, 4990, 5600, 9000}) {
+        for (id_t length : {1, 10, 300}) {
+            id_t max_id = min_id + length - 1;
+            
+            vector<string> found;
+            loaded.for_alignment_in_range(sorted, min_id, max_id, [&](const Alignment& aln) {
+                found.push_back(aln.name());
+            });
+            
+            set<string> found_set(found.begin(), found.end());
+            REQUIRE(found_set.size() == found.size());
+            REQUIRE(found_set == expected_for([&](id_t id) { return id >= min_id && id <= max_id; }));
+        }
+    }
+    
+    vector<id_t> ids {3, 4, 5, 1200, 4000, 4700};
+    vector<string> found;
+    loaded.for_alignment_to_nodes(sorted, ids, [&](const Alignment& aln) {
+        found.push_back(aln.name());
+    });
+    set<string> found_set(found.begin(), found.end());
+    REQUIRE(found_set.size() == found.size());
+    REQUIRE(found_set == expected_for([&](id_t id) { return find(ids.begin(), ids.end(), id) != ids.end(); }));
+}
+
+TEST_CASE("GAMIndex handles alignments spanning huge node ID ranges", "[gam][gamindex]") {
+    
+    // Alignments in sorted order, some of which jump a very long way
+    vector<Alignment> alns;
+    for (id_t i = 1; i <= 1000; i++) {
+        Alignment aln;
+        aln.set_name("read" + to_string(i));
+        aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(i);
+        if (i % 100 == 0) {
+            aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(i * 1000000000000LL);
+        }
+        alns.push_back(aln);
+    }
+    
+    stringstream sorted;
+    {
+        vector<Alignment> to_write = alns;
+        stream::write_buffered(sorted, to_write, 0);
+    }
+    
+    // This has to finish without filling billions of windows
+    GAMIndex index;
+    index.index(sorted);
+    
+    stringstream saved;
+    index.save(saved);
+    GAMIndex loaded;
+    loaded.load(saved);
+    
+    for (id_t wanted : {(id_t) 5, (id_t) 300, (id_t) 300000000000000LL, (id_t) 1000000000000000LL}) {
+        vector<string> found;
+        loaded.for_alignment_in_range(sorted, wanted, wanted, [&](const Alignment& aln) {
+            found.push_back(aln.name());
+        });
+        REQUIRE(found.size() == 1);
+        REQUIRE(found.front() == "read" + to_string(wanted >= 1000000000000LL ? wanted / 1000000000000LL : wanted));
+    }
+    
+    // Nothing is between the far nodes
+    vector<string> found;
+    loaded.for_alignment_in_range(sorted, 300000000000001LL, 300000000000100LL, [&](const Alignment& aln) {
+        found.push_back(aln.name());
+    });
+    REQUIRE(found.empty());
+}
+
+}
+}
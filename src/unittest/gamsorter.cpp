@@ -0,0 +1,84 @@
+/// \file gamsorter.cpp
+///  
+/// unit tests for GAM sorting
+
+#include <iostream>
+#include <sstream>
+#include "../gamsorter.hpp"
+#include "vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE("GAMSorter stream_sort matches an in-memory sort", "[gamsort][stream]") {
+    
+    vector<Alignment> alns(2000);
+    for (size_t i = 0; i < alns.size(); i++) {
+        alns[i].set_name("read" + to_string(i));
+        alns[i].set_sequence(string(50, 'A'));
+        if (i % 7 != 0) {
+            // Leave some reads unmapped, and make plenty of ties
+            for (size_t j = 0; j < 1 + i % 3; j++) {
+                Position* pos = alns[i].mutable_path()->add_mapping()->mutable_position();
+                pos->set_node_id(1 + (i * 37 + j * 11) % 100);
+                pos->set_offset(i % 4);
+            }
+        }
+    }
+    
+    stringstream unsorted;
+    {
+        // Writing clears the buffer
+        vector<Alignment> to_write = alns;
+        stream::write_buffered(unsorted, to_write, 0);
+    }
+    string unsorted_data = unsorted.str();
+    
+    GAMSorter sorter;
+    vector<Alignment> expected = alns;
+    sorter.sort(expected);
+    
+    // Mapped reads come first, in position order
+    for (size_t i = 1; i < expected.size(); i++) {
+        if (expected[i].path().mapping_size() != 0) {
+            REQUIRE(expected[i - 1].path().mapping_size() != 0);
+        }
+    }
+    REQUIRE(expected.back().path().mapping_size() == 0);
+    
+    auto check_sort = [&](size_t max_buf_bytes, size_t max_fan_in) {
+        GAMSorter stream_sorter;
+        stream_sorter.max_buf_bytes = max_buf_bytes;
+        stream_sorter.max_fan_in = max_fan_in;
+        
+        stringstream in(unsorted_data);
+        stringstream out;
+        stream_sorter.stream_sort(in, out);
+        
+        vector<string> names;
+        stream::for_each<Alignment>(out, [&](Alignment& aln) {
+            names.push_back(aln.name());
+        });
+        
+        REQUIRE(names.size() == expected.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            REQUIRE(names[i] == expected[i].name());
+        }
+    };
+    
+    SECTION("Sorting in memory works") {
+        check_sort(1024 * 1024 * 1024, 64);
+    }
+    
+    SECTION("Sorting through temporary runs works") {
+        check_sort(16 * 1024, 64);
+    }
+    
+    SECTION("Merging in several levels works") {
+        check_sort(8 * 1024, 2);
+    }
+}
+
+}
+}
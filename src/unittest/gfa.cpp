@@ -0,0 +1,144 @@
+/// \file gfa.cpp
+///
+/// unit tests for streaming GFA input and output
+///
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../gfa.hpp"
+#include "../stream.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("GFA chunks name segments in file order across blocks", "[gfa]") {
+
+    string graph_gfa = "H\tVN:Z:1.0\n"
+        "S\tfirst\tGAT\n"
+        "L\tfirst\t+\tsecond\t-\t0M\n"
+        "S\tsecond\tTACA\tLN:i:4\n"
+        "S\t7\tCC\n"
+        "L\tsecond\t-\t7\t+\t2M\n"
+        "P\tp\tfirst+,second-,7+\t*\n"
+        "P\tfirst\tq\t2\t-\t3M\n"
+        "P\t7\tq\t1\t+\t2M\n";
+
+    // Use tiny blocks so lines land in different chunks
+    for (size_t block_bytes : {1, 16, 1 << 20}) {
+        vector<Graph> chunks;
+        stringstream in(graph_gfa);
+        for_each_gfa_chunk(in, [&](Graph& chunk) {
+            chunks.push_back(chunk);
+        }, block_bytes);
+
+        Graph all;
+        for (auto& chunk : chunks) {
+            all.MergeFrom(chunk);
+        }
+
+        REQUIRE(all.node_size() == 3);
+        REQUIRE(all.node(0).id() == 1);
+        REQUIRE(all.node(0).name() == "first");
+        REQUIRE(all.node(1).id() == 2);
+        REQUIRE(all.node(1).sequence() == "TACA");
+        REQUIRE(all.node(2).id() == 7);
+
+        REQUIRE(all.edge_size() == 2);
+        REQUIRE(all.edge(0).from() == 1);
+        REQUIRE(all.edge(0).to() == 2);
+        REQUIRE(!all.edge(0).from_start());
+        REQUIRE(all.edge(0).to_end());
+        REQUIRE(all.edge(0).overlap() == 0);
+        REQUIRE(all.edge(1).from() == 2);
+        REQUIRE(all.edge(1).from_start());
+        REQUIRE(all.edge(1).to() == 7);
+        REQUIRE(all.edge(1).overlap() == 2);
+
+        REQUIRE(all.path_size() == 3);
+        const Path& p = all.path(0);
+        REQUIRE(p.name() == "p");
+        REQUIRE(p.mapping_size() == 3);
+        REQUIRE(p.mapping(1).position().node_id() == 2);
+        REQUIRE(p.mapping(1).position().is_reverse());
+        REQUIRE(p.mapping(2).rank() == 3);
+
+        // The one-step lines keep their ranks
+        REQUIRE(all.path(1).name() == "q");
+        REQUIRE(all.path(1).mapping(0).position().node_id() == 1);
+        REQUIRE(all.path(1).mapping(0).rank() == 2);
+        REQUIRE(all.path(2).mapping(0).position().node_id() == 7);
+        REQUIRE(all.path(2).mapping(0).rank() == 1);
+    }
+}
+
+TEST_CASE("Graph chunks convert to GFA with paths in rank order", "[gfa]") {
+
+    Graph first;
+    Node* node = first.add_node();
+    node->set_id(2);
+    node->set_sequence("TACA");
+    node = first.add_node();
+    node->set_id(1);
+    node->set_sequence("GAT");
+    Edge* edge = first.add_edge();
+    edge->set_from(1);
+    edge->set_to(2);
+    edge->set_to_end(true);
+    Path* path = first.add_path();
+    path->set_name("x");
+    Mapping* mapping = path->add_mapping();
+    mapping->mutable_position()->set_node_id(2);
+    mapping->mutable_position()->set_is_reverse(true);
+    mapping->set_rank(2);
+
+    Graph second;
+    node = second.add_node();
+    node->set_id(3);
+    node->set_sequence("C");
+    path = second.add_path();
+    path->set_name("x");
+    mapping = path->add_mapping();
+    mapping->mutable_position()->set_node_id(1);
+    mapping->set_rank(1);
+    mapping = path->add_mapping();
+    mapping->mutable_position()->set_node_id(3);
+    mapping->set_rank(3);
+
+    stringstream vg_stream;
+    vector<Graph> buffer {first};
+    stream::write_buffered(vg_stream, buffer, 0);
+    buffer = {second};
+    stream::write_buffered(vg_stream, buffer, 0);
+
+    stringstream gfa;
+    graph_stream_to_gfa(vg_stream, gfa);
+
+    string expected = "H\tVN:Z:1.0\n"
+        "S\t1\tGAT\n"
+        "S\t2\tTACA\n"
+        "L\t1\t+\t2\t-\t0M\n"
+        "S\t3\tC\n"
+        "P\tx\t1+,2-,3+\t*\n";
+    REQUIRE(gfa.str() == expected);
+
+    SECTION("The GFA reads back in as the same graph") {
+        Graph all;
+        for_each_gfa_chunk(gfa, [&](Graph& chunk) {
+            all.MergeFrom(chunk);
+        });
+        REQUIRE(all.node_size() == 3);
+        REQUIRE(all.edge_size() == 1);
+        REQUIRE(all.edge(0).to_end());
+        REQUIRE(all.path_size() == 1);
+        REQUIRE(all.path(0).mapping_size() == 3);
+        REQUIRE(all.path(0).mapping(1).position().node_id() == 2);
+        REQUIRE(all.path(0).mapping(1).position().is_reverse());
+    }
+}
+
+}
+}
@@ -8,6 +8,7 @@
 #include "../handle.hpp"
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../compact_graph.hpp"
 #include "../json2pb.h"
 
 #include <iostream>
@@ -325,6 +326,10 @@ TEST_CASE("Mutable handle graphs work", "[handle][vg]") {
     VG vg;
     implementations.push_back(&vg);
     
+    // And the CompactGraph implementation
+    CompactGraph cg;
+    implementations.push_back(&cg);
+    
     for(auto* g : implementations) {
     
         SECTION("No nodes exist by default") {
@@ -88,6 +88,56 @@ TEST_CASE( "Mapper can map to a one-node graph", "[mapping][mapper]" ) {
         }
     }
     
+    SECTION( "Batched MEM finding agrees with MEM finding one sequence at a time" ) {
+        
+        vector<string> reads{"GAT", "TTACA", "GATTACA", "TGTAATC", "GANTACA"};
+        
+        vector<pair<string::const_iterator, string::const_iterator>> seqs;
+        for (auto& read : reads) {
+            seqs.emplace_back(read.begin(), read.end());
+        }
+        vector<double> longest_lcps, fractions_filtered;
+        auto batch_mems = mapper.find_mems_deep_batch(seqs, longest_lcps, fractions_filtered, 0, 1, 0,
+                                                      false, true, true, true);
+        
+        REQUIRE(batch_mems.size() == reads.size());
+        REQUIRE(longest_lcps.size() == reads.size());
+        for (size_t i = 0; i < reads.size(); i++) {
+            double longest_lcp, fraction_filtered;
+            auto mems = mapper.find_mems_deep(reads[i].begin(), reads[i].end(), longest_lcp, fraction_filtered, 0, 1, 0,
+                                              false, true, true, true);
+            REQUIRE(batch_mems[i].size() == mems.size());
+            for (size_t j = 0; j < mems.size(); j++) {
+                REQUIRE(batch_mems[i][j].begin == mems[j].begin);
+                REQUIRE(batch_mems[i][j].end == mems[j].end);
+                REQUIRE(batch_mems[i][j].match_count == mems[j].match_count);
+                REQUIRE(batch_mems[i][j].nodes == mems[j].nodes);
+            }
+            REQUIRE(longest_lcps[i] == longest_lcp);
+        }
+    }
+
+    SECTION( "Mapping a batch of reads agrees with mapping them one at a time" ) {
+
+        vector<Alignment> reads(4);
+        reads[0].set_sequence("GAT");
+        reads[1].set_sequence("TTACA");
+        reads[2].set_sequence("TGTAATC");
+        // this one is longer than a band, so it is seeded on its own
+        reads[3].set_sequence("GATTACA");
+
+        auto batch_results = mapper.align_multi_batch(reads, 0, 0, 0, 5);
+
+        REQUIRE(batch_results.size() == reads.size());
+        for (size_t i = 0; i < reads.size(); i++) {
+            auto results = mapper.align_multi(reads[i], 0, 0, 0, 5);
+            REQUIRE(batch_results[i].size() == results.size());
+            for (size_t j = 0; j < results.size(); j++) {
+                REQUIRE(pb2json(batch_results[i][j]) == pb2json(results[j]));
+            }
+        }
+    }
+
     SECTION( "Mapper can map two tiny paired reads" ) {
     
         // Here are two reads in opposing, inward-facing directions
@@ -0,0 +1,151 @@
+/// \file minimizer_index.cpp
+///
+/// Unit tests for the minimizer seed index, checking that the minimizers of
+/// reads drawn from a graph are found where the reads came from.
+///
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include "../vg.hpp"
+#include "../minimizer_index.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Check that every minimizer of the sequence along a walk is indexed at the
+/// position where it starts on the walk.
+static void check_walk(const HandleGraph& graph, const MinimizerIndex& index, const vector<handle_t>& walk) {
+    string sequence;
+    vector<gcsa::node_type> positions;
+    for (const handle_t& handle : walk) {
+        string node_sequence = graph.get_sequence(handle);
+        for (size_t i = 0; i < node_sequence.size(); i++) {
+            sequence.push_back(node_sequence[i]);
+            positions.push_back(gcsa::Node::encode(graph.get_id(handle), i, graph.get_is_reverse(handle)));
+        }
+    }
+
+    auto minimizers = index.minimizers(sequence.begin(), sequence.end());
+    REQUIRE(!minimizers.empty());
+    for (auto& minimizer : minimizers) {
+        auto hits = index.find(minimizer.key);
+        REQUIRE(hits.second > 0);
+        REQUIRE(find(hits.first, hits.first + hits.second, positions[minimizer.offset]) != hits.first + hits.second);
+    }
+}
+
+TEST_CASE("Minimizer index finds the minimizers of walks on both strands", "[minimizer][mapping]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCATTAGCCA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("G");
+    Node* n4 = graph.create_node("CTGACCAGTT");
+    Node* n5 = graph.create_node("ACGTAGGACCATTA");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n4, n5);
+    // An inversion of node 4
+    graph.create_edge(n2, n4, false, true);
+    graph.create_edge(n4, n5, true, false);
+
+    MinimizerIndex index(graph, 5, 3);
+
+    REQUIRE(index.k() == 5);
+    REQUIRE(index.w() == 3);
+    REQUIRE(index.size() > 0);
+
+    auto forward = [&](id_t id) { return graph.get_handle(id, false); };
+    auto reverse = [&](id_t id) { return graph.get_handle(id, true); };
+
+    SECTION("Walks on the forward strand are found") {
+        check_walk(graph, index, {forward(1), forward(2), forward(4), forward(5)});
+        check_walk(graph, index, {forward(1), forward(3), forward(4), forward(5)});
+    }
+
+    SECTION("Walks through the inversion are found") {
+        check_walk(graph, index, {forward(1), forward(2), reverse(4), forward(5)});
+    }
+
+    SECTION("Walks on the reverse strand are found") {
+        check_walk(graph, index, {reverse(5), reverse(4), reverse(3), reverse(1)});
+    }
+
+    SECTION("Sequences shorter than a window have no minimizers") {
+        string sequence = "GCATTAG";
+        REQUIRE(index.minimizers(sequence.begin(), sequence.end()).empty());
+    }
+
+    SECTION("Kmers that aren't minimizers in the graph aren't found") {
+        // TTTTT is not in the graph
+        REQUIRE(index.find(0x3FF).second == 0);
+    }
+
+    SECTION("The index can be saved and loaded") {
+        stringstream stream;
+        index.save(stream);
+        MinimizerIndex loaded(stream);
+        REQUIRE(loaded.k() == index.k());
+        REQUIRE(loaded.w() == index.w());
+        REQUIRE(loaded.size() == index.size());
+        check_walk(graph, loaded, {forward(1), forward(2), reverse(4), forward(5)});
+    }
+}
+
+TEST_CASE("Minimizer index limits the walks it follows", "[minimizer][mapping]") {
+
+    SECTION("Dense bubbles are only walked up to the limit") {
+        // A window spans about 20 of these SNPs, so each start has about 2^20
+        // walks
+        VG graph;
+        Node* last = graph.create_node("GATTACA");
+        for (size_t i = 0; i < 40; i++) {
+            Node* ref = graph.create_node("A");
+            Node* alt = graph.create_node("C");
+            Node* next = graph.create_node(i % 2 ? "TG" : "GT");
+            graph.create_edge(last, ref);
+            graph.create_edge(last, alt);
+            graph.create_edge(ref, next);
+            graph.create_edge(alt, next);
+            last = next;
+        }
+
+        // This has to finish, and still index the walks it did follow
+        MinimizerIndex index(graph, 5, 60, 16);
+        REQUIRE(index.size() > 0);
+    }
+
+    SECTION("Loops of empty nodes don't walk forever") {
+        VG graph;
+        Node* n1 = graph.create_node("GCATTAGCCA");
+        Node* n2 = graph.create_node("");
+        Node* n3 = graph.create_node("");
+        Node* n4 = graph.create_node("CTGACCAGTT");
+
+        graph.create_edge(n1, n2);
+        graph.create_edge(n2, n3);
+        graph.create_edge(n3, n2);
+        graph.create_edge(n3, n4);
+
+        MinimizerIndex index(graph, 5, 3);
+
+        auto forward = [&](id_t id) { return graph.get_handle(id, false); };
+        check_walk(graph, index, {forward(1), forward(2), forward(3), forward(4)});
+    }
+
+    SECTION("At least one walk has to be allowed") {
+        VG graph;
+        graph.create_node("GCATTAGCCA");
+        REQUIRE_THROWS(MinimizerIndex(graph, 5, 3, 0));
+    }
+}
+
+}
+}
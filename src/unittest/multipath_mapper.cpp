@@ -7,6 +7,7 @@
 #include "vg.pb.h"
 #include "../multipath_mapper.hpp"
 #include "../build_index.hpp"
+#include "../genotypekit.hpp"
 #include "catch.hpp"
 
 namespace vg {
@@ -26,6 +27,7 @@ public:
     using MultipathMapper::sort_and_compute_mapping_quality;
     using MultipathMapper::read_coverage;
     using MultipathMapper::read_coverage_z_score;        
+    using MultipathMapper::distance_between;
 };
 
 TEST_CASE( "MultipathMapper::read_coverage works", "[multipath][mapping][multipathmapper]" ) {
@@ -628,6 +630,158 @@ TEST_CASE( "MultipathMapper can work on a bigger graph", "[multipath][mapping][m
     delete lcpidx;
 }
 
+TEST_CASE( "MultipathMapper can pair reads using a distance index when there are no paths", "[multipath][mapping][multipathmapper][distance]" ) {
+    
+    // Two 100 bp nodes with a SNP bubble between them, and no embedded paths,
+    // so only the distance index can say how far apart the reads are
+    string graph_json = R"({"node":[{"sequence":"CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTGGTTCCTGGTGCTATGTGTAACTAGTAATGGTAATGGATATGTTGGGCTTT","id":1},{"sequence":"A","id":2},{"sequence":"G","id":3},{"sequence":"TTTCTTTGATTTATTTGAAGTGACGTTTGACAATCTATCACTAGGGGTAATGTGGGGAAATGGAAAGAATACAAGATTTGGAGCCAGACAAATCTGGGTT","id":4}],"edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":2,"to":4},{"from":3,"to":4}]})";
+    
+    // Load the JSON
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    
+    // Make it into a VG
+    VG graph;
+    graph.extend(proto_graph);
+    
+    // Configure GCSA temp directory to the system temp directory
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    // And make it quiet
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    
+    // Make pointers to fill in
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    
+    // Build the GCSA index
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+    
+    // Build the xg index
+    xg::XG xg_index(proto_graph);
+    
+    // Build the distance index
+    CactusSnarlFinder bubble_finder(graph);
+    SnarlManager snarl_manager = bubble_finder.find_snarls();
+    DistanceIndex distance_index(&graph, &snarl_manager);
+    
+    // Make a multipath mapper to map against the graph.
+    MultipathMapper mapper(&xg_index, gcsaidx, lcpidx);
+    mapper.distance_index = &distance_index;
+    // Lower the max mapping quality so that it thinks it can find unambiguous mappings of
+    // short sequences
+    mapper.max_mapping_quality = 10;
+    // The reads start 121 bp apart
+    mapper.force_fragment_length_distr(121, 10);
+    
+    SECTION( "MultipathMapper pairs reads on either side of a bubble" ) {
+        // Here are two reads on the same strand
+        Alignment read1, read2;
+        read1.set_sequence("CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTC");
+        read2.set_sequence("TGACGTTTGACAATCTATCACTAGGGGTAATGTGGGGAAA");
+        
+        // Have a list to fill with results
+        vector<pair<MultipathAlignment, MultipathAlignment>> results;
+        vector<pair<Alignment, Alignment>> buffer;
+        
+        // Align for just one pair of alignments
+        mapper.multipath_map_paired(read1, read2, results, buffer, 1);
+        
+        // The pair should be found together rather than buffered
+        REQUIRE(results.size() == 1);
+        REQUIRE(buffer.empty());
+        
+        // And each read should be in the right place
+        REQUIRE(results[0].first.subpath_size() > 0);
+        REQUIRE(results[0].second.subpath_size() > 0);
+        const Position& position1 = results[0].first.subpath(0).path().mapping(0).position();
+        const Position& position2 = results[0].second.subpath(0).path().mapping(0).position();
+        REQUIRE(position1.node_id() == 1);
+        REQUIRE(position1.offset() == 0);
+        REQUIRE(position2.node_id() == 4);
+        REQUIRE(position2.offset() == 20);
+    }
+    
+    // Clean up the GCSA/LCP index
+    delete gcsaidx;
+    delete lcpidx;
+}
+
+TEST_CASE( "MultipathMapper measures the same distances with a distance index as along paths", "[multipath][mapping][multipathmapper][distance]" ) {
+    
+    // The same graph with a reference path through it, so the path distance
+    // can be checked against the distance index
+    string graph_json = R"({"node":[{"sequence":"CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTGGTTCCTGGTGCTATGTGTAACTAGTAATGGTAATGGATATGTTGGGCTTT","id":1},{"sequence":"A","id":2},{"sequence":"G","id":3},{"sequence":"TTTCTTTGATTTATTTGAAGTGACGTTTGACAATCTATCACTAGGGGTAATGTGGGGAAATGGAAAGAATACAAGATTTGGAGCCAGACAAATCTGGGTT","id":4}],"edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":2,"to":4},{"from":3,"to":4}],"path":[{"name":"ref","mapping":[{"position":{"node_id":1},"edit":[{"from_length":100,"to_length":100}],"rank":1},{"position":{"node_id":2},"edit":[{"from_length":1,"to_length":1}],"rank":2},{"position":{"node_id":4},"edit":[{"from_length":100,"to_length":100}],"rank":3}]}]})";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+    
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+    
+    xg::XG xg_index(proto_graph);
+    
+    CactusSnarlFinder bubble_finder(graph);
+    SnarlManager snarl_manager = bubble_finder.find_snarls();
+    DistanceIndex distance_index(&graph, &snarl_manager);
+    
+    // One mapper measures along the path and the other uses the index
+    TestMultipathMapper path_mapper(&xg_index, gcsaidx, lcpidx);
+    TestMultipathMapper index_mapper(&xg_index, gcsaidx, lcpidx);
+    index_mapper.distance_index = &distance_index;
+    
+    // Make a 10 bp exact match multipath alignment at a position
+    auto make_aln = [&](id_t node_id, bool is_reverse, size_t offset) {
+        MultipathAlignment multipath_aln;
+        multipath_aln.set_sequence(string(10, 'A'));
+        Subpath* subpath = multipath_aln.add_subpath();
+        subpath->set_score(10);
+        Mapping* mapping = subpath->mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(node_id);
+        mapping->mutable_position()->set_is_reverse(is_reverse);
+        mapping->mutable_position()->set_offset(offset);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(10);
+        edit->set_to_length(10);
+        multipath_aln.add_start(0);
+        return multipath_aln;
+    };
+    
+    MultipathAlignment left_forward = make_aln(1, false, 0);
+    MultipathAlignment right_forward = make_aln(4, false, 20);
+    MultipathAlignment right_reverse = make_aln(4, true, 0);
+    MultipathAlignment left_reverse = make_aln(1, true, 50);
+    
+    auto check = [&](const MultipathAlignment& aln_1, const MultipathAlignment& aln_2, bool forward_strand) {
+        int64_t expected = path_mapper.distance_between(aln_1, aln_2, true, forward_strand);
+        REQUIRE(expected != numeric_limits<int64_t>::max());
+        REQUIRE(index_mapper.distance_between(aln_1, aln_2, true, forward_strand) == expected);
+        return expected;
+    };
+    
+    SECTION( "Mates in order on the forward strand are a positive distance apart" ) {
+        REQUIRE(check(left_forward, right_forward, false) > 0);
+        REQUIRE(check(left_forward, right_forward, true) > 0);
+    }
+    
+    SECTION( "Dovetailed mates are a negative distance apart" ) {
+        REQUIRE(check(right_forward, left_forward, false) < 0);
+        REQUIRE(check(right_forward, left_forward, true) < 0);
+    }
+    
+    SECTION( "Mates on the reverse strand are negative on the forward strand" ) {
+        REQUIRE(check(right_reverse, left_reverse, false) > 0);
+        REQUIRE(check(right_reverse, left_reverse, true) < 0);
+    }
+    
+    delete gcsaidx;
+    delete lcpidx;
+}
+
 }
 
 }
@@ -0,0 +1,129 @@
+/// \file packer.cpp
+///
+/// unit tests for the Packer coverage and edit index
+
+#include <iostream>
+#include <sstream>
+#include "../packer.hpp"
+#include "../json2pb.h"
+#include "vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Split a table into its rows, dropping the header
+static vector<string> table_rows(const string& table) {
+    vector<string> rows;
+    stringstream in(table);
+    string row;
+    getline(in, row);
+    while (getline(in, row)) {
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+/// Pull out a tab-separated column of a table row
+static string table_column(const string& row, size_t column) {
+    stringstream in(row);
+    string field;
+    for (size_t i = 0; i <= column; ++i) {
+        getline(in, field, '\t');
+    }
+    return field;
+}
+
+TEST_CASE("Packer can add to a pack it has saved and loaded", "[pack][packer]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATTACA"},
+    {"id":2,"sequence":"CATTAG"}],
+    "edge":[{"from":1,"to":2}]}
+    )";
+
+    // Load the JSON
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+
+    // Build the xg index
+    xg::XG xg_index(proto_graph);
+
+    // Make a read across both nodes with a SNP at sequence position 3
+    string aln_json = R"(
+    {"sequence":"GATGACACATTAG","path":{"mapping":[
+    {"position":{"node_id":1},"edit":[{"from_length":3,"to_length":3},{"from_length":1,"to_length":1,"sequence":"G"},{"from_length":3,"to_length":3}]},
+    {"position":{"node_id":2},"edit":[{"from_length":6,"to_length":6}]}]}}
+    )";
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+
+    // Try unbinned and binned packs, from one thread and from many
+    size_t bin_size = 0;
+    bool thread_safe = false;
+    SECTION("Unbinned") {
+    }
+    SECTION("Binned") {
+        bin_size = 5;
+    }
+    SECTION("Thread safe") {
+        bin_size = 5;
+        thread_safe = true;
+    }
+
+    Packer packer(&xg_index, bin_size, thread_safe);
+    packer.add(aln, true);
+    stringstream saved;
+    packer.serialize(saved);
+
+    Packer loaded(&xg_index, bin_size, thread_safe);
+    loaded.load(saved);
+
+    REQUIRE(loaded.get_bin_size() == bin_size);
+    REQUIRE(loaded.graph_length() == 13);
+    REQUIRE(loaded.coverage_at_position(0) == 1);
+    REQUIRE(loaded.coverage_at_position(3) == 0);
+    REQUIRE(loaded.coverage_at_position(12) == 1);
+    REQUIRE(loaded.edits_at_position(3).size() == 1);
+    REQUIRE(loaded.edits_at_position(3).front().sequence() == "G");
+
+    // Add the read again on top of what we loaded
+    loaded.make_dynamic();
+    REQUIRE(loaded.is_dynamic());
+    loaded.add(aln, true);
+    loaded.make_compact();
+
+    REQUIRE(loaded.coverage_at_position(0) == 2);
+    REQUIRE(loaded.coverage_at_position(3) == 0);
+    REQUIRE(loaded.coverage_at_position(12) == 2);
+    REQUIRE(loaded.edits_at_position(2).empty());
+    REQUIRE(loaded.edits_at_position(3).size() == 2);
+
+    SECTION("The table has a row per base with its coverage and edits") {
+        stringstream table;
+        loaded.as_table(table, true);
+        auto rows = table_rows(table.str());
+        REQUIRE(rows.size() == 13);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            REQUIRE(table_column(rows[i], 0) == to_string(i));
+            REQUIRE(table_column(rows[i], 1) == (i < 7 ? "1" : "2"));
+            REQUIRE(table_column(rows[i], 2) == to_string(i < 7 ? i : i - 7));
+            REQUIRE(table_column(rows[i], 3) == (i == 3 ? "0" : "2"));
+            REQUIRE(table_column(rows[i], 4).substr(0, 2) == (i == 3 ? "2 " : "0"));
+        }
+
+        SECTION("A range of the table matches the same rows of the whole table") {
+            stringstream range_table;
+            loaded.as_table(range_table, true, 2, 9);
+            auto range_rows = table_rows(range_table.str());
+            REQUIRE(range_rows.size() == 7);
+            for (size_t i = 0; i < range_rows.size(); ++i) {
+                REQUIRE(range_rows[i] == rows[i + 2]);
+            }
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,111 @@
+/// \file stream_writer.cpp
+///  
+/// unit tests for the background protobuf stream writer
+
+#include <iostream>
+#include <sstream>
+#include "../stream_writer.hpp"
+#include "vg.pb.h"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("AsyncWriter output can be read back with for_each", "[stream]") {
+    
+    stringstream out;
+    
+    // Catch can't check things from inside an OpenMP loop, and exceptions
+    // can't leave one, so we record what happened and check it afterward
+    vector<char> emptied(100, false);
+    string error;
+    
+    {
+        stream::AsyncWriter writer(out);
+        
+        #pragma omp parallel for
+        for (size_t i = 0; i < 100; i++) {
+            vector<Alignment> buffer(3);
+            for (size_t j = 0; j < buffer.size(); j++) {
+                buffer[j].set_name(to_string(i * 3 + j));
+            }
+            try {
+                writer.write(buffer);
+            } catch (const exception& e) {
+                #pragma omp critical (error)
+                error = e.what();
+            }
+            emptied[i] = buffer.empty();
+        }
+        
+        writer.finish();
+    }
+    
+    REQUIRE(error.empty());
+    for (size_t i = 0; i < emptied.size(); i++) {
+        REQUIRE(emptied[i]);
+    }
+    
+    set<string> seen;
+    stream::for_each<Alignment>(out, [&](Alignment& aln) {
+        seen.insert(aln.name());
+    });
+    REQUIRE(seen.size() == 300);
+}
+
+TEST_CASE("AsyncWriter can preserve the order of numbered groups", "[stream]") {
+    
+    stringstream out;
+    
+    string error;
+    
+    {
+        // Use a tiny queue so producers have to wait on each other
+        stream::AsyncWriter writer(out, true, 16);
+        
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < 100; i++) {
+            vector<Alignment> buffer;
+            if (i % 10 != 0) {
+                // Leave some groups empty
+                buffer.emplace_back();
+                buffer.back().set_name(to_string(i));
+            }
+            try {
+                writer.write(buffer, i);
+            } catch (const exception& e) {
+                #pragma omp critical (error)
+                error = e.what();
+            }
+        }
+        
+        writer.finish();
+    }
+    
+    REQUIRE(error.empty());
+    
+    vector<string> names;
+    stream::for_each<Alignment>(out, [&](Alignment& aln) {
+        names.push_back(aln.name());
+    });
+    
+    REQUIRE(names.size() == 90);
+    size_t k = 0;
+    for (size_t i = 0; i < 100; i++) {
+        if (i % 10 != 0) {
+            REQUIRE(names[k++] == to_string(i));
+        }
+    }
+}
+
+TEST_CASE("AsyncWriter reports missing groups in ordered mode", "[stream]") {
+    stringstream out;
+    stream::AsyncWriter writer(out, true);
+    vector<Alignment> buffer(1);
+    writer.write(buffer, 1);
+    REQUIRE_THROWS(writer.finish());
+}
+
+}
+}
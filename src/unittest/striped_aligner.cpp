@@ -0,0 +1,187 @@
+/// \file striped_aligner.cpp
+///
+/// Unit tests for the striped SIMD graph aligner, checked against gssw.
+///
+
+#include <iostream>
+#include <string>
+#include "../json2pb.h"
+#include "../vg.pb.h"
+#include "../gssw_aligner.hpp"
+#include "../striped_aligner.hpp"
+#include "../alignment.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Striped aligner finds the same alignment as gssw on a bubble", "[aligner][alignment][striped]") {
+
+    VG graph;
+
+    Aligner aligner(1, 4, 6, 1, 5);
+
+    Node* n0 = graph.create_node("AGTG");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGT");
+
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+
+    string read = string("AGTGCTGAAGT");
+    Alignment gssw_aln, striped_aln;
+    gssw_aln.set_sequence(read);
+    striped_aln.set_sequence(read);
+
+    aligner.align(gssw_aln, graph.graph, true, false);
+    aligner.align(striped_aln, graph, true);
+
+    SECTION("score matches") {
+        REQUIRE(striped_aln.score() == gssw_aln.score());
+        REQUIRE(striped_aln.score() == 21);
+    }
+
+    SECTION("path matches") {
+        REQUIRE(pb2json(striped_aln.path()) == pb2json(gssw_aln.path()));
+        REQUIRE(striped_aln.path().mapping_size() == 3);
+        REQUIRE(striped_aln.path().mapping(1).position().node_id() == n1->id());
+    }
+}
+
+TEST_CASE("Striped aligner handles edits and soft clips like gssw", "[aligner][alignment][striped]") {
+
+    VG graph;
+
+    Aligner aligner(1, 4, 6, 1, 0);
+
+    Node* n0 = graph.create_node("GATTACAGATTACA");
+    Node* n1 = graph.create_node("CCTTGA");
+    Node* n2 = graph.create_node("TTTTTTTTTTTTTTTTTTTT");
+    Node* n3 = graph.create_node("ACGTACGTACGTACGT");
+
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+
+    vector<string> reads {
+        // mismatch
+        "GATTACAGATTACACCATGAACGTACGTACG",
+        // deletion across a node boundary
+        "GATTACAGATTACACCTTACGTACGTACGTACGT",
+        // insertion
+        "GATTACAGATTACAGGGGGGGGCCTTGAACGTACGTACGTACGT",
+        // soft clips on both ends
+        "CCCCCCCCTTTTTTTTTTTTTTTTTTTTACGTACGGGGGG",
+        // no good alignment at all
+        "GGGGGGGG"
+    };
+
+    for (const string& read : reads) {
+        Alignment gssw_aln, striped_aln;
+        gssw_aln.set_sequence(read);
+        striped_aln.set_sequence(read);
+
+        aligner.align(gssw_aln, graph.graph, true, false);
+        aligner.align(striped_aln, graph, true);
+
+        REQUIRE(striped_aln.score() == gssw_aln.score());
+        if (striped_aln.score() > 0) {
+            // Whatever path we found has to get the score we claim
+            REQUIRE(aligner.score_ungapped_alignment(striped_aln) == striped_aln.score());
+            REQUIRE(alignment_to_length(striped_aln) == (int) read.size());
+        }
+    }
+}
+
+TEST_CASE("Striped aligner kernels all agree", "[aligner][alignment][striped]") {
+
+    VG graph;
+
+    Aligner aligner(1, 4, 6, 1, 5);
+
+    Node* n0 = graph.create_node("CATGCAGACTACGATCAGCAGCTTAC");
+    Node* n1 = graph.create_node("GA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("CGACTAGCACCGACTAGCATGCTACGACT");
+    Node* n4 = graph.create_node("AACG");
+    Node* n5 = graph.create_node("TTTCAGCAGCATCAGCACGACTAGC");
+
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n3, n5);
+    graph.create_edge(n4, n5);
+
+    // Long enough to need several vectors per column in every kernel
+    string read = "ACGATCAGCAGCTTACGACGACTAGCACCGACTACATGCTACGACTAACGTTTCAGCAGCATAGCACGA";
+
+    StripedGraphAligner::Engine best = StripedGraphAligner::best_engine();
+
+    vector<Alignment> alns;
+    for (int engine = StripedGraphAligner::SCALAR; engine <= best; engine++) {
+        StripedGraphAligner striped(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                    aligner.gap_extension, aligner.full_length_bonus);
+        striped.engine = (StripedGraphAligner::Engine) engine;
+
+        alns.emplace_back();
+        alns.back().set_sequence(read);
+        striped.align(alns.back(), graph, true);
+    }
+
+    Alignment gssw_aln;
+    gssw_aln.set_sequence(read);
+    aligner.align(gssw_aln, graph.graph, true, false);
+
+    for (auto& aln : alns) {
+        REQUIRE(aln.score() == gssw_aln.score());
+        REQUIRE(pb2json(aln.path()) == pb2json(alns.front().path()));
+    }
+
+    SECTION("score without traceback matches") {
+        Alignment score_only;
+        score_only.set_sequence(read);
+        aligner.align(score_only, graph, false);
+        REQUIRE(score_only.score() == gssw_aln.score());
+    }
+}
+
+TEST_CASE("Striped aligner supports base quality adjusted alignment", "[aligner][alignment][striped]") {
+
+    VG graph;
+
+    QualAdjAligner aligner(1, 4, 6, 1, 5);
+
+    Node* n0 = graph.create_node("AGTG");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGT");
+
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+
+    string read = string("AGTGCTGTAGT");
+    string qual = string("HHHHHHH#HHH");
+    Alignment gssw_aln, striped_aln;
+    gssw_aln.set_sequence(read);
+    gssw_aln.set_quality(qual);
+    alignment_quality_char_to_short(gssw_aln);
+    striped_aln = gssw_aln;
+
+    aligner.align(gssw_aln, graph.graph, true, false);
+    aligner.align(striped_aln, graph, true);
+
+    REQUIRE(striped_aln.score() == gssw_aln.score());
+    REQUIRE(pb2json(striped_aln.path()) == pb2json(gssw_aln.path()));
+}
+
+}
+}
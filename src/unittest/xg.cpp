@@ -678,5 +678,96 @@ TEST_CASE("Path component memoization produces expected results", "[xg]") {
     }
 }
 
+TEST_CASE("XG handle sequence access works without allocating strings", "[xg]") {
+
+    // Use enough sequence, with an N, that the packed codes cross word boundaries
+    string long_seq = "GATTACAGATTACAGATTACANGATTACAGATTACAGATTACAGATTACA";
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":")" + long_seq + R"("}],
+    "edge":[{"to":2,"from":1}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    for (id_t node_id : {1, 2}) {
+        for (bool is_rev : {false, true}) {
+            handle_t handle = xg_index.get_handle(node_id, is_rev);
+            string seq = xg_index.get_sequence(handle);
+            
+            // Single bases agree with the whole sequence
+            for (size_t i = 0; i < seq.size(); i++) {
+                REQUIRE(xg_index.get_base(handle, i) == seq[i]);
+            }
+            
+            // Every substring decodes the same way
+            for (size_t i = 0; i < seq.size(); i++) {
+                string buffer(seq.size(), 'X');
+                size_t written = xg_index.get_subsequence(handle, i, seq.size(), &buffer[0]);
+                REQUIRE(written == seq.size() - i);
+                REQUIRE(buffer.substr(0, written) == seq.substr(i));
+            }
+            
+            // Running off the end gives nothing
+            char c = 'X';
+            REQUIRE(xg_index.get_subsequence(handle, seq.size(), 1, &c) == 0);
+            REQUIRE(c == 'X');
+        }
+    }
+    
+    REQUIRE(xg_index.node_sequence(2) == long_seq);
+    REQUIRE(xg_index.get_sequence(xg_index.get_handle(1, true)) == "AATC");
+}
+
+TEST_CASE("XG construction spilled to disk under a memory limit builds the same index", "[xg]") {
+
+    string chunk1_json = R"(
+    {"node":[{"id":3,"sequence":"GATT"},
+    {"id":1,"sequence":"ACA"},
+    {"id":2,"sequence":"TTTG"}],
+    "edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":3,"to":2,"to_end":true},{"from":1,"to":2}],
+    "path":[{"name":"p","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":3},"rank":2}]}]}
+    )";
+    string chunk2_json = R"(
+    {"node":[{"id":5,"sequence":"C"},
+    {"id":4,"sequence":"AAG"},
+    {"id":2,"sequence":"TTTG"}],
+    "edge":[{"from":2,"to":4,"from_start":true},{"from":3,"to":2,"to_end":true},{"from":4,"to":5},{"from":3,"to":4}],
+    "path":[{"name":"q","mapping":[{"position":{"node_id":4},"rank":1},{"position":{"node_id":5},"rank":2}]}]}
+    )";
+    
+    vector<Graph> chunks(2);
+    json2pb(chunks[0], chunk1_json.c_str(), chunk1_json.size());
+    json2pb(chunks[1], chunk2_json.c_str(), chunk2_json.size());
+    
+    auto get_chunks = [&](function<void(Graph&)> handle_chunk) {
+        for (auto& chunk : chunks) {
+            handle_chunk(chunk);
+        }
+    };
+    
+    xg::XG in_memory;
+    in_memory.from_callback(get_chunks);
+    
+    xg::XG spilled;
+    // Spill after every record
+    spilled.max_construction_bytes = 1;
+    spilled.from_callback(get_chunks);
+    
+    REQUIRE(spilled.node_count == 5);
+    REQUIRE(spilled.edge_count == 6);
+    REQUIRE(spilled.node_sequence(2) == "TTTG");
+    REQUIRE(spilled.has_edge(xg::make_edge(3, false, 2, true)));
+    REQUIRE(spilled.path_length("q") == 4);
+    
+    stringstream in_memory_bytes;
+    in_memory.serialize(in_memory_bytes);
+    stringstream spilled_bytes;
+    spilled.serialize(spilled_bytes);
+    REQUIRE(spilled_bytes.str() == in_memory_bytes.str());
+}
+
 }
 }
@@ -31,15 +31,27 @@ void VG::from_istream(istream& in, bool showp, bool warn_on_duplicates) {
         create_progress("loading graph", count);
     };
 
-    // the graph is read in chunks, which are attached to this graph
+    // the graph is read in chunks, which are parsed in parallel a batch at a
+    // time and then attached to this graph in order
     uint64_t i = 0;
-    function<void(Graph&)> lambda = [this, &i, &warn_on_duplicates](Graph& g) {
-        update_progress(++i);
-        // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
-        extend(g, warn_on_duplicates);
+    function<void(vector<Graph>&)> lambda = [this, &i, &warn_on_duplicates](vector<Graph>& batch) {
+        // make room for the whole batch up front, so the indexes don't
+        // rehash chunk by chunk
+        size_t batch_nodes = 0;
+        size_t batch_edges = 0;
+        for (auto& g : batch) {
+            batch_nodes += g.node_size();
+            batch_edges += g.edge_size();
+        }
+        reserve(graph.node_size() + batch_nodes, graph.edge_size() + batch_edges);
+        for (auto& g : batch) {
+            update_progress(++i);
+            // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
+            extend(g, warn_on_duplicates);
+        }
     };
 
-    stream::for_each(in, lambda, handle_count);
+    stream::for_each_batch(in, lambda, handle_count);
 
     // Collate all the path mappings we got from all the different chunks. A
     // mapping from any chunk might fall anywhere in a path (because paths may
@@ -498,6 +510,17 @@ void VG::add_edges(const vector<Edge>& edges) {
     }
 }
 
+void VG::reserve(size_t node_count, size_t edge_count) {
+    graph.mutable_node()->Reserve(node_count);
+    graph.mutable_edge()->Reserve(edge_count);
+    node_by_id.resize(node_count);
+    node_index.resize(node_count);
+    edge_by_sides.resize(edge_count);
+    edge_index.resize(edge_count);
+    edges_on_start.resize(node_count);
+    edges_on_end.resize(node_count);
+}
+
 void VG::add_node(const Node& node) {
     if (!has_node(node)) {
         Node* new_node = graph.add_node(); // add it to the graph
@@ -2673,75 +2696,22 @@ void VG::dice_nodes(int max_node_size) {
 }
 
 void VG::from_gfa(istream& in, bool showp) {
-    // c++... split...
-    // for line in stdin
-    string line;
-    auto too_many_fields = [&line]() {
-        cerr << "[vg] error: too many fields in line " << endl << line << endl;
-        exit(1);
-    };
-
+    // Blocks of the file are parsed in parallel and come back as chunks in
+    // file order, so we never hold more than a few blocks of the text
     bool reduce_overlaps = false;
-    GFAKluge gg;
-    gg.parse_gfa_file(in);
-
-    map<string, sequence_elem, custom_key> name_to_seq = gg.get_name_to_seq();
-    map<std::string, vector<edge_elem> > seq_to_edges = gg.get_seq_to_edges();
-    map<string, sequence_elem>::iterator it;
-    id_t curr_id = 1;
-    map<string, id_t> id_names;
-    std::function<id_t(const string&)> get_add_id = [&](const string& name) -> id_t {
-        if (is_number(name)) {
-            return std::stol(name);
-        } else {
-            auto id = id_names.find(name);
-            if (id == id_names.end()) {
-                id_names[name] = curr_id;
-                return curr_id++;
-            } else {
-                return id->second;
+    for_each_gfa_chunk(in, [&](Graph& chunk) {
+        for (auto& edge : chunk.edge()) {
+            if (edge.overlap() > 0) {
+                reduce_overlaps = true;
             }
         }
-    };
-    for (it = name_to_seq.begin(); it != name_to_seq.end(); it++){
-        auto source_id = get_add_id((it->second).name);
-        //Make us some nodes
-        Node n;
-        n.set_sequence((it->second).sequence);
-        n.set_id(source_id);
-        n.set_name((it->second).name);
-        add_node(n);
-        // Now some edges. Since they're placed in this map
-        // by their from_node, it's no big deal to just iterate
-        // over them.
-        for (edge_elem l : seq_to_edges[(it->second).name]){
-            auto sink_id = get_add_id(l.sink_name);
-            Edge e;
-            e.set_from(source_id);
-            e.set_to(sink_id);
-            e.set_from_start(!l.source_orientation_forward);
-            e.set_to_end(!l.sink_orientation_forward);
-            // get the cigar
-            auto cigar_elems = vcflib::splitCigar(l.alignment);
-            if (cigar_elems.size() == 1
-                && cigar_elems.front().first > 0
-                && cigar_elems.front().second == "M") {
-                    reduce_overlaps = true;
-                    e.set_overlap(cigar_elems.front().first);
-            }
-            add_edge(e);
-        }
-        // for (path_elem p: seq_to_paths[(it->second).name]){
-        //     paths.append_mapping(p.name, source_id, p.rank ,p.is_reverse);
-        // }
-        // remove overlapping sequences from the graph
-    }
-    map<string, path_elem> n_to_p = gg.get_name_to_path();
-    for (auto name_path : n_to_p){
-        for (int np = 0; np < name_path.second.segment_names.size(); np++){
-            paths.append_mapping(name_path.first, stol(name_path.second.segment_names[np]), np + 1, !name_path.second.orientations[np]);
-        }
-    }
+        extend(chunk);
+    });
+
+    // Path steps are ranked, but may have come from any chunk
+    paths.sort_by_mapping_rank();
+    paths.rebuild_mapping_aux();
+
     if (reduce_overlaps) {
         bluntify();
     }
@@ -6188,55 +6158,17 @@ void VG::to_dot(ostream& out,
 
 
 void VG::to_gfa(ostream& out) {
-  GFAKluge gg;
-  gg.set_version(1.0);
+    write_gfa_header(out);
+    write_gfa_nodes_and_edges(graph, out);
 
-    // TODO moving to GFAKluge
-    // problem: protobuf longs don't easily go to strings....
-    for (int i = 0; i < graph.node_size(); ++i){
-        sequence_elem s_elem;
-        Node* n = graph.mutable_node(i);
-        // Fill seq element for a node
-        s_elem.name = to_string(n->id());
-        s_elem.sequence = n->sequence();
-        gg.add_sequence(s_elem);
-    }
-    
-    auto& pathmap = this->paths._paths;
-    for (auto p : pathmap){
-        path_elem p_elem;
-        p_elem.name = p.first;
-        for (auto m : p.second){
-            p_elem.segment_names.push_back( std::to_string(m.node_id()) );
-            p_elem.orientations.push_back( m.is_reverse() );
-            Node* n = get_node( m.node_id() );
-            stringstream cigaro;
-            //cigaro << n->sequence().size() << (p.mapping(m_ind.position().is_reverse()) ? "M" : "M");
-            cigaro << n->sequence().size() << (m.is_reverse() ? "M" : "M");
-            p_elem.overlaps.push_back( cigaro.str() );
-        }
-        gg.add_path(p_elem.name, p_elem);
-    }
-
-    for (int i = 0; i < graph.edge_size(); ++i) {
-        Edge* e = graph.mutable_edge(i);
-        edge_elem ee;
-        ee.type = 1;
-        ee.source_name = to_string(e->from());
-        ee.sink_name = to_string(e->to());
-        ee.source_orientation_forward = ! e->from_start();
-        ee.sink_orientation_forward =  ! e->to_end();
-        ee.alignment = std::to_string(e->overlap()) + "M";
-        gg.add_edge(ee.source_name, ee);
-        //link_elem l;
-        //l.source_name = to_string(e->from());
-        //l.sink_name = to_string(e->to());
-        //l.source_orientation_forward = ! e->from_start();
-        //l.sink_orientation_forward =  ! e->to_end();
-        //l.cigar = std::to_string(e->overlap()) + "M";
-        //gg.add_link(l.source_name, l);
-    }
-    out << gg;
+    vector<pair<id_t, bool>> steps;
+    paths.for_each_name([&](const string& name) {
+        steps.clear();
+        for (auto& mapping : paths.get_path(name)) {
+            steps.emplace_back(mapping.node_id(), mapping.is_reverse());
+        }
+        write_gfa_path(name, steps, out);
+    });
 }
 
 void VG::to_turtle(ostream& out, const string& rdf_base_uri, bool precompress) {
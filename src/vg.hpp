@@ -40,7 +40,7 @@
 #include "colors.hpp"
 
 #include "types.hpp"
-#include "gfakluge.hpp"
+#include "gfa.hpp"
 
 #include "nodetraversal.hpp"
 #include "nodeside.hpp"
@@ -599,6 +599,10 @@ public:
                                          const map<Node*, Path>& added_nodes,
                                          const map<id_t, size_t>& orig_node_sizes);
 
+    /// Make room for the given total numbers of nodes and edges in the graph
+    /// and its indexes, so adding up to that many doesn't reallocate.
+    void reserve(size_t node_count, size_t edge_count);
+
     /// Add in the given node, by value.
     void add_node(const Node& node);
     /// Add in the given nodes, by value.
@@ -1,6 +1,7 @@
 #include "xg.hpp"
 #include "stream.hpp"
 #include "alignment.hpp"
+#include "utility.hpp"
 
 #include <bitset>
 #include <arpa/inet.h>
@@ -396,6 +397,9 @@ XGPath::XGPath(const string& path_name,
     util::assign(directions, sd_vector<>(directions_bv));
     // handle entity lookup structure (wavelet tree)
     util::bit_compress(ids_iv);
+    // construct_im goes through SDSL's global in-memory file system, which
+    // isn't thread safe, and XG::build makes paths in parallel.
+#pragma omp critical (xgpath_construct_im)
     construct_im(ids, ids_iv);
     // bit compress the positional offset info
     util::bit_compress(positions);
@@ -554,6 +558,362 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     
 }
 
+namespace {
+
+/// Sort a vector on the OpenMP threads: each thread sorts a chunk, and then
+/// pairs of sorted chunks are merged until one is left.
+template<typename T, typename Compare>
+void parallel_sort(vector<T>& items, const Compare& compare) {
+    size_t parts = omp_get_max_threads();
+    if (parts < 2 || items.size() < 65536) {
+        std::sort(items.begin(), items.end(), compare);
+        return;
+    }
+    size_t width = (items.size() + parts - 1) / parts;
+#pragma omp parallel for schedule(static, 1)
+    for (size_t k = 0; k < parts; ++k) {
+        size_t start = min(k * width, items.size());
+        size_t end = min(start + width, items.size());
+        std::sort(items.begin() + start, items.begin() + end, compare);
+    }
+    for (; width < items.size(); width *= 2) {
+        size_t pairs = (items.size() + 2 * width - 1) / (2 * width);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t k = 0; k < pairs; ++k) {
+            size_t start = k * 2 * width;
+            size_t mid = min(start + width, items.size());
+            size_t end = min(start + 2 * width, items.size());
+            std::inplace_merge(items.begin() + start, items.begin() + mid,
+                               items.begin() + end, compare);
+        }
+    }
+}
+
+/// A node as collected during construction.
+struct NodeRecord {
+    id_t id;
+    string sequence;
+};
+
+/// An edge as collected during construction, with the order in which it was
+/// first seen, so that the index can list edges in input order.
+struct EdgeRecord {
+    side_t from;
+    side_t to;
+    size_t seen;
+};
+
+size_t record_bytes(const NodeRecord& record) {
+    return sizeof(NodeRecord) + record.sequence.size();
+}
+
+size_t record_bytes(const EdgeRecord& record) {
+    return sizeof(EdgeRecord);
+}
+
+void write_record(ostream& out, const NodeRecord& record) {
+    size_t length = record.sequence.size();
+    out.write((const char*) &record.id, sizeof(record.id));
+    out.write((const char*) &length, sizeof(length));
+    out.write(record.sequence.data(), length);
+}
+
+bool read_record(istream& in, NodeRecord& record) {
+    size_t length;
+    if (!in.read((char*) &record.id, sizeof(record.id)) ||
+        !in.read((char*) &length, sizeof(length))) {
+        return false;
+    }
+    record.sequence.resize(length);
+    return (bool) in.read(&record.sequence[0], length);
+}
+
+void write_record(ostream& out, const EdgeRecord& record) {
+    out.write((const char*) &record, sizeof(record));
+}
+
+bool read_record(istream& in, EdgeRecord& record) {
+    return (bool) in.read((char*) &record, sizeof(record));
+}
+
+/// Sort key for a side that puts both sides of a node together, start first.
+inline int64_t side_order(side_t side) {
+    return side_id(side) * 2 + side_is_end(side);
+}
+
+struct NodeIdLess {
+    bool operator()(const NodeRecord& a, const NodeRecord& b) const {
+        return a.id < b.id;
+    }
+};
+
+struct NodeIdEqual {
+    bool operator()(const NodeRecord& a, const NodeRecord& b) const {
+        return a.id == b.id;
+    }
+};
+
+struct EdgeSidesLess {
+    bool operator()(const EdgeRecord& a, const EdgeRecord& b) const {
+        return make_tuple(a.from, a.to, a.seen) < make_tuple(b.from, b.to, b.seen);
+    }
+};
+
+struct EdgeSidesEqual {
+    bool operator()(const EdgeRecord& a, const EdgeRecord& b) const {
+        return a.from == b.from && a.to == b.to;
+    }
+};
+
+struct EdgeFromLess {
+    bool operator()(const EdgeRecord& a, const EdgeRecord& b) const {
+        return make_pair(side_order(a.from), a.seen) < make_pair(side_order(b.from), b.seen);
+    }
+};
+
+struct EdgeToLess {
+    bool operator()(const EdgeRecord& a, const EdgeRecord& b) const {
+        return make_pair(side_order(a.to), a.seen) < make_pair(side_order(b.to), b.seen);
+    }
+};
+
+struct EdgeSeenEqual {
+    bool operator()(const EdgeRecord& a, const EdgeRecord& b) const {
+        return a.seen == b.seen;
+    }
+};
+
+/**
+ * A collection of records that is kept sorted in runs. Records are buffered
+ * in memory; spill() sorts the buffer and writes it to a temporary file as a
+ * run. Once finish() has been called, cursors read the records back in sorted
+ * order, merged across all the runs, with records that Equal considers the
+ * same as the one before them dropped.
+ */
+template<typename Record, typename Less, typename Equal>
+class RecordRuns {
+public:
+    
+    RecordRuns() = default;
+    ~RecordRuns() {
+        clear();
+    }
+    
+    void push(Record&& record) {
+        buffered_bytes += record_bytes(record);
+        buffer.emplace_back(std::move(record));
+    }
+    
+    /// How many bytes of records are buffered in memory
+    size_t bytes() const {
+        return buffered_bytes;
+    }
+    
+    /// Write the buffered records out as a sorted run.
+    void spill() {
+        if (buffer.empty()) {
+            return;
+        }
+        sort_buffer();
+        run_files.push_back(temp_file::create("xg-build"));
+        ofstream out(run_files.back(), ios::binary);
+        for (auto& record : buffer) {
+            write_record(out, record);
+        }
+        if (!out) {
+            cerr << "[xg] error: could not write temporary file " << run_files.back() << endl;
+            exit(1);
+        }
+        vector<Record>().swap(buffer);
+        buffered_bytes = 0;
+    }
+    
+    /// Stop taking records and get ready to read them back. If nothing was
+    /// ever spilled, the records stay in memory.
+    void finish() {
+        if (run_files.empty()) {
+            sort_buffer();
+        } else {
+            spill();
+        }
+    }
+    
+    /// Drop all the records and remove any temporary files.
+    void clear() {
+        for (auto& filename : run_files) {
+            temp_file::remove(filename);
+        }
+        run_files.clear();
+        vector<Record>().swap(buffer);
+        buffered_bytes = 0;
+    }
+    
+    class Cursor {
+    public:
+        Cursor(const RecordRuns& runs) : runs(&runs) {
+            heads.resize(runs.run_files.size());
+            for (size_t i = 0; i < runs.run_files.size(); ++i) {
+                streams.emplace_back(new ifstream(runs.run_files[i], ios::binary));
+                if (!*streams.back()) {
+                    cerr << "[xg] error: could not read temporary file " << runs.run_files[i] << endl;
+                    exit(1);
+                }
+                if (read_record(*streams[i], heads[i])) {
+                    heap.push_back(i);
+                    push_heap(heap.begin(), heap.end(), head_greater());
+                }
+            }
+        }
+        
+        /// Get the next distinct record, or nullptr if there are no more. The
+        /// record is only valid until the next call.
+        const Record* next() {
+            Equal equal;
+            if (runs->run_files.empty()) {
+                // Everything is in one sorted and deduplicated buffer
+                if (buffer_index == runs->buffer.size()) {
+                    return nullptr;
+                }
+                return &runs->buffer[buffer_index++];
+            }
+            while (!heap.empty()) {
+                pop_heap(heap.begin(), heap.end(), head_greater());
+                size_t run = heap.back();
+                heap.pop_back();
+                bool duplicate = emitted_any && equal(emitted, heads[run]);
+                if (!duplicate) {
+                    swap(emitted, heads[run]);
+                    emitted_any = true;
+                }
+                if (read_record(*streams[run], heads[run])) {
+                    heap.push_back(run);
+                    push_heap(heap.begin(), heap.end(), head_greater());
+                }
+                if (!duplicate) {
+                    return &emitted;
+                }
+            }
+            return nullptr;
+        }
+        
+    private:
+        /// Order runs so the one with the least head record is on top of a
+        /// heap.
+        function<bool(size_t, size_t)> head_greater() const {
+            const vector<Record>& heads = this->heads;
+            return [&heads](size_t a, size_t b) {
+                return Less()(heads[b], heads[a]);
+            };
+        }
+    
+        const RecordRuns* runs;
+        size_t buffer_index = 0;
+        bool emitted_any = false;
+        Record emitted;
+        vector<Record> heads;
+        vector<unique_ptr<ifstream>> streams;
+        vector<size_t> heap;
+    };
+    
+    Cursor cursor() const {
+        return Cursor(*this);
+    }
+    
+private:
+    
+    void sort_buffer() {
+        parallel_sort(buffer, Less());
+        buffer.erase(std::unique(buffer.begin(), buffer.end(), Equal()), buffer.end());
+    }
+    
+    vector<Record> buffer;
+    size_t buffered_bytes = 0;
+    vector<string> run_files;
+};
+
+}
+
+/**
+ * The nodes and edges of a graph being indexed, as collected from its chunks.
+ * Nodes come back out sorted by ID. Edges are deduplicated, keeping the first
+ * copy seen, and come back out both by from side and by to side, in the order
+ * they were first seen within each side. If max_bytes is nonzero, records are
+ * spilled to disk to keep the memory use near it.
+ */
+class ConstructionRecords {
+public:
+    
+    ConstructionRecords(size_t max_bytes) : max_bytes(max_bytes) {}
+    
+    void add_node(const Node& node) {
+        nodes.push(NodeRecord{node.id(), node.sequence()});
+        enforce_budget();
+    }
+    
+    /// Add an edge, which must be canonical.
+    void add_edge(const Edge& edge) {
+        edges.push(EdgeRecord{make_side(edge.from(), edge.from_start()),
+                              make_side(edge.to(), edge.to_end()),
+                              edges_seen++});
+        enforce_budget();
+    }
+    
+    /// Sort and deduplicate everything, and count the nodes, sequence, and
+    /// edges.
+    void finish() {
+        nodes.finish();
+        auto node_cursor = nodes.cursor();
+        while (const NodeRecord* node = node_cursor.next()) {
+            if (node_count == 0) {
+                min_id = node->id;
+            }
+            max_id = node->id;
+            ++node_count;
+            seq_length += node->sequence.size();
+        }
+        
+        edges.finish();
+        auto edge_cursor = edges.cursor();
+        while (const EdgeRecord* edge = edge_cursor.next()) {
+            ++edge_count;
+            EdgeRecord copy = *edge;
+            edges_by_from.push(std::move(copy));
+            copy = *edge;
+            edges_by_to.push(std::move(copy));
+            if (max_bytes != 0 && edges_by_from.bytes() + edges_by_to.bytes() > max_bytes) {
+                edges_by_from.spill();
+                edges_by_to.spill();
+            }
+        }
+        edges.clear();
+        edges_by_from.finish();
+        edges_by_to.finish();
+    }
+    
+    RecordRuns<NodeRecord, NodeIdLess, NodeIdEqual> nodes;
+    RecordRuns<EdgeRecord, EdgeFromLess, EdgeSeenEqual> edges_by_from;
+    RecordRuns<EdgeRecord, EdgeToLess, EdgeSeenEqual> edges_by_to;
+    
+    size_t node_count = 0;
+    size_t seq_length = 0;
+    size_t edge_count = 0;
+    id_t min_id = 0;
+    id_t max_id = 0;
+    
+private:
+    
+    void enforce_budget() {
+        if (max_bytes != 0 && nodes.bytes() + edges.bytes() > max_bytes) {
+            nodes.spill();
+            edges.spill();
+        }
+    }
+    
+    size_t max_bytes;
+    size_t edges_seen = 0;
+    RecordRuns<EdgeRecord, EdgeSidesLess, EdgeSidesEqual> edges;
+};
+
 void XG::from_stream(istream& in, bool validate_graph, bool print_graph,
     bool store_threads, bool is_sorted_dag) {
 
@@ -578,39 +938,20 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     bool validate_graph, bool print_graph, bool store_threads, bool is_sorted_dag) {
 
     // temporaries for construction
-    vector<pair<id_t, string> > node_label;
-    // need to store node sides
-    unordered_map<side_t, vector<side_t> > from_to;
-    unordered_map<side_t, vector<side_t> > to_from;
+    ConstructionRecords records(max_construction_bytes);
     map<string, vector<trav_t> > path_nodes;
 
     // This takes in graph chunks and adds them into our temporary storage.
-    function<void(Graph&)> lambda = [this,
-                                     &node_label,
-                                     &from_to,
-                                     &to_from,
+    function<void(Graph&)> lambda = [&records,
                                      &path_nodes](Graph& graph) {
 
         for (int64_t i = 0; i < graph.node_size(); ++i) {
-            const Node& n = graph.node(i);
-            node_label.push_back(make_pair(n.id(), n.sequence()));
+            records.add_node(graph.node(i));
         }
         for (int64_t i = 0; i < graph.edge_size(); ++i) {
             // Canonicalize every edge, so only canonical edges are in the index.
-            Edge e = canonicalize(graph.edge(i));
-            bool new_from = from_to.find(make_side(e.from(), e.from_start())) == from_to.end();
-            bool new_edge = true;
-            if (!new_from) {
-                side_t to_add = make_side(e.to(), e.to_end());
-                for (auto& side : from_to[make_side(e.from(), e.from_start())]) {
-                    if (side == to_add) { new_edge = false; break; }
-                }
-            }
-            if (new_edge) {
-                ++edge_count;
-                from_to[make_side(e.from(), e.from_start())].push_back(make_side(e.to(), e.to_end()));
-                to_from[make_side(e.to(), e.to_end())].push_back(make_side(e.from(), e.from_start()));
-            }
+            // Duplicates are dropped when the records are sorted.
+            records.add_edge(canonicalize(graph.edge(i)));
         }
 
         // Print out all the paths in the graph we are loading
@@ -639,13 +980,11 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     // The other end handles figuring out how much to loop.
     get_chunks(lambda);
 
-    // sort the node labels and remove any duplicates
-    std::sort(node_label.begin(), node_label.end());
-    node_label.erase(std::unique(node_label.begin(), node_label.end()), node_label.end());
-    for (auto& p : node_label) {
-        ++node_count;
-        seq_length += p.second.size();
-    }
+    // sort the nodes and edges and remove any duplicates
+    records.finish();
+    node_count = records.node_count;
+    seq_length = records.seq_length;
+    edge_count = records.edge_count;
     
     if (node_count == 0) {
         // Catch the empty graph with a sensible message instead of an assert fail
@@ -657,8 +996,14 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     
     // sort the paths using mapping rank
     // and remove duplicates
+    vector<pair<const string, vector<trav_t> >*> path_list;
     for (auto& p : path_nodes) {
-        vector<trav_t>& path = path_nodes[p.first];
+        path_list.push_back(&p);
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_list.size(); ++i) {
+        auto& p = *path_list[i];
+        vector<trav_t>& path = p.second;
         if (!std::is_sorted(path.begin(), path.end(),
                             [](const trav_t& m1, const trav_t& m2) { return trav_rank(m1) < trav_rank(m2); })) {
             std::sort(path.begin(), path.end(),
@@ -675,14 +1020,12 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
         }
     }
 
-    build(node_label, from_to, to_from, path_nodes, validate_graph, print_graph,
+    build(records, path_nodes, validate_graph, print_graph,
         store_threads, is_sorted_dag);
     
 }
 
-void XG::build(vector<pair<id_t, string> >& node_label,
-               unordered_map<side_t, vector<side_t> >& from_to,
-               unordered_map<side_t, vector<side_t> >& to_from,
+void XG::build(ConstructionRecords& records,
                map<string, vector<trav_t> >& path_nodes,
                bool validate_graph,
                bool print_graph,
@@ -700,9 +1043,9 @@ void XG::build(vector<pair<id_t, string> >& node_label,
 #endif
 
     // for mapping of ids to ranks using a vector rather than wavelet tree
-    assert(!node_label.empty());
-    min_id = node_label.begin()->first;
-    max_id = node_label.rbegin()->first;
+    assert(records.node_count > 0);
+    min_id = records.min_id;
+    max_id = records.max_id;
     
     // set up our compressed representation
     util::assign(s_iv, int_vector<>(seq_length, 0, 3));
@@ -717,9 +1060,10 @@ void XG::build(vector<pair<id_t, string> >& node_label,
 #endif
     size_t i = 0; // insertion point
     size_t r = 1;
-    for (auto& p : node_label) {
-        int64_t id = p.first;
-        const string& l = p.second;
+    auto node_cursor = records.nodes.cursor();
+    while (const NodeRecord* record = node_cursor.next()) {
+        int64_t id = record->id;
+        const string& l = record->sequence;
         s_bv[i] = 1; // record node start
         i_iv[r-1] = id;
         // store ids to rank mapping
@@ -730,7 +1074,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         }
     }
     // keep only if we need to validate the graph
-    if (!validate_graph) node_label.clear();
+    if (!validate_graph) records.nodes.clear();
 
     // we have to process all the nodes before we do the edges
     // because we need to ensure full coverage of node space
@@ -823,45 +1167,58 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     util::assign(g_iv, int_vector<>(g_iv_size));
     util::assign(g_bv, bit_vector(g_iv_size));
     int64_t g = 0; // pointer into g_iv and g_bv
+    // walk the edges sorted by the side they come to and by the side they
+    // leave from alongside the nodes, which are in id order
+    auto to_cursor = records.edges_by_to.cursor();
+    auto from_cursor = records.edges_by_from.cursor();
+    const EdgeRecord* to_edge = to_cursor.next();
+    const EdgeRecord* from_edge = from_cursor.next();
     // for each node
     for (int64_t i = 0; i < i_iv.size(); ++i) {
-        Node n = node(i_iv[i]);
+        id_t id = i_iv[i];
+        // skip any edges to nodes that are not in the graph
+        while (to_edge != nullptr && side_id(to_edge->to) < id) {
+            to_edge = to_cursor.next();
+        }
+        while (from_edge != nullptr && side_id(from_edge->from) < id) {
+            from_edge = from_cursor.next();
+        }
         // now build up the record
         g_bv[g] = 1; // mark record start for later query
-        g_iv[g++] = n.id(); // save id
-        g_iv[g++] = node_start(n.id());
-        g_iv[g++] = n.sequence().size(); // sequence length
+        g_iv[g++] = id; // save id
+        g_iv[g++] = node_start(id);
+        g_iv[g++] = node_length(id); // sequence length
         size_t to_edge_count = 0;
         size_t from_edge_count = 0;
         size_t to_edge_count_idx = g++;
         size_t from_edge_count_idx = g++;
         // write the edges in id-based format
         // we will next convert these into relative format
-        for (auto end : { false, true }) {
-            auto& to_sides = to_from[make_side(n.id(), end)];
-            for (auto& e : to_sides) {
-                g_iv[g++] = side_id(e);
-                g_iv[g++] = edge_type(side_is_end(e), end);
-                ++to_edge_count;
-            }
+        // edges come to the start side of the node before the end side
+        for (; to_edge != nullptr && side_id(to_edge->to) == id; to_edge = to_cursor.next()) {
+            g_iv[g++] = side_id(to_edge->from);
+            g_iv[g++] = edge_type(side_is_end(to_edge->from), side_is_end(to_edge->to));
+            ++to_edge_count;
         }
         g_iv[to_edge_count_idx] = to_edge_count;
-        for (auto end : { false, true }) {
-            auto& from_sides = from_to[make_side(n.id(), end)];
-            for (auto& e : from_sides) {
-                g_iv[g++] = side_id(e);
-                g_iv[g++] = edge_type(end, side_is_end(e));
-                ++from_edge_count;
-            }
+        for (; from_edge != nullptr && side_id(from_edge->from) == id; from_edge = from_cursor.next()) {
+            g_iv[g++] = side_id(from_edge->to);
+            g_iv[g++] = edge_type(side_is_end(from_edge->from), side_is_end(from_edge->to));
+            ++from_edge_count;
         }
         g_iv[from_edge_count_idx] = from_edge_count;
     }
+    records.edges_by_to.clear();
+    records.edges_by_from.clear();
 
     // set up rank and select supports on g_bv so we can locate nodes in g_iv
     util::assign(g_bv_rank, rank_support_v<1>(&g_bv));
     util::assign(g_bv_select, bit_vector::select_1_type(&g_bv));
 
     // convert the edges in g_iv to relativistic form
+    // each node's record is separate, and g_iv is not bit compressed yet, so
+    // nodes can be done in parallel
+#pragma omp parallel for schedule(dynamic, 1024)
     for (int64_t i = 0; i < i_iv.size(); ++i) {
         int64_t id = i_iv[i];
         // find the start of the node's record in g_iv
@@ -895,15 +1252,26 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     // paths
     string path_names;
     size_t path_node_count = 0; // count of node path memberships
+    vector<pair<const string, vector<trav_t> >*> path_list;
     for (auto& pathpair : path_nodes) {
         // add path name
         const string& path_name = pathpair.first;
         //cerr << path_name << endl;
         path_names += start_marker + path_name + end_marker;
+        path_list.push_back(&pathpair);
+    }
+    // The paths only read the graph indexes built so far, so we can build
+    // them all at once, each into its own slot. Their wavelet trees are still
+    // constructed one at a time; see XGPath::XGPath.
+    paths.resize(path_list.size());
+    vector<size_t> unique_member_counts(path_list.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_list.size(); ++i) {
         // The path constructor helpfully counts unique path members for us
-        size_t unique_member_count;
-        XGPath* path = new XGPath(path_name, pathpair.second, node_count, *this, &unique_member_count);
-        paths.push_back(path);
+        paths[i] = new XGPath(path_list[i]->first, path_list[i]->second, node_count, *this,
+                              &unique_member_counts[i]);
+    }
+    for (auto& unique_member_count : unique_member_counts) {
         path_node_count += unique_member_count;
     }
 
@@ -928,18 +1296,36 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     // node -> paths
     util::assign(np_iv, int_vector<>(path_node_count+node_count));
     util::assign(np_bv, bit_vector(path_node_count+node_count));
-    size_t np_off = 0;
+    // count each node's paths in parallel, so we know where its entry goes
+    vector<size_t> np_starts(node_count + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < node_count; ++i) {
+        id_t id = rank_to_id(i+1);
+        size_t node_paths = 0;
+        for (size_t j = 1; j <= paths.size(); ++j) {
+            if (node_occs_in_path(id, j) > 0) {
+                ++node_paths;
+            }
+        }
+        np_starts[i+1] = node_paths + 1;
+    }
     for (size_t i = 0; i < node_count; ++i) {
-        np_bv[np_off] = 1;
-        np_iv[np_off] = 0; // null so we can detect entities with no path membership
-        ++np_off;
+        np_starts[i+1] += np_starts[i];
+        np_bv[np_starts[i]] = 1;
+    }
+    // np_iv is not bit compressed yet, so each node can fill its own entry
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < node_count; ++i) {
+        size_t off = np_starts[i];
+        np_iv[off++] = 0; // null so we can detect entities with no path membership
         id_t id = rank_to_id(i+1);
         for (size_t j = 1; j <= paths.size(); ++j) {
             if (node_occs_in_path(id, j) > 0) {
-                np_iv[np_off++] = j;
+                np_iv[off++] = j;
             }
         }
     }
+    size_t np_off = np_starts[node_count];
 
     util::bit_compress(np_iv);
     //cerr << ep_off << " " << path_entities << " " << entity_count << endl;
@@ -1131,9 +1517,10 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     if (validate_graph) {
         cerr << "validating graph sequence" << endl;
         int max_id = s_bv_rank(s_bv.size());
-        for (auto& p : node_label) {
-            int64_t id = p.first;
-            const string& l = p.second;
+        auto node_cursor = records.nodes.cursor();
+        while (const NodeRecord* record = node_cursor.next()) {
+            int64_t id = record->id;
+            const string& l = record->sequence;
             //size_t rank = node_rank[id];
             size_t rank = id_to_rank(id);
             //cerr << rank << endl;
@@ -1161,7 +1548,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
                 }
             }
         }
-        node_label.clear();
+        records.nodes.clear();
 
         // -1 here seems weird
         // what?
@@ -1505,10 +1892,8 @@ string XG::node_sequence(int64_t id) const {
     assert(rank != 0); // We can crash if we try to look up rank 0.
     size_t start = s_bv_select(rank);
     size_t end = rank == node_count ? s_bv.size() : s_bv_select(rank+1);
-    string s; s.resize(end-start);
-    for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-        s[i-start] = revdna3bit(s_iv[i]);
-    }
+    string s(end-start, '\0');
+    decode_sequence(start, end-start, false, &s[0]);
     return s;
 }
 
@@ -1549,10 +1934,8 @@ string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
             end = min(start + len, (size_t)s_bv_select(rank+1));
         }
         assert(end < s_iv.size());
-        string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
-        }
+        string s(end-start, '\0');
+        decode_sequence(start, end-start, false, &s[0]);
         return s;
     } else {
         size_t rank = id_to_rank(id);
@@ -1566,11 +1949,9 @@ string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
             start = max(end - len, (size_t)s_bv_select(rank));
         }
         assert(end < s_iv.size());
-        string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
-        }
-        return reverse_complement(s);
+        string s(end-start, '\0');
+        decode_sequence(start, end-start, true, &s[0]);
+        return s;
     }
 }
 
@@ -1791,15 +2172,79 @@ string XG::get_sequence(const handle_t& handle) const {
     size_t g = as_integer(handle) & LOW_BITS;
     // Figure out where the sequence starts
     size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
-    for (int64_t i = 0; i < sequence_size; i++) {
-        // Blit the sequence out
-        sequence[i] = revdna3bit(s_iv[sequence_start + i]);
+    // Blit the sequence out, in the right orientation
+    decode_sequence(sequence_start, sequence_size, as_integer(handle) & HIGH_BIT, &sequence[0]);
+    return sequence;
+}
+
+char XG::get_base(const handle_t& handle, size_t index) const {
+    size_t g = as_integer(handle) & LOW_BITS;
+    size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
+    if (as_integer(handle) & HIGH_BIT) {
+        size_t sequence_size = g_iv[g + G_NODE_LENGTH_OFFSET];
+        return reverse_complement(revdna3bit(s_iv[sequence_start + sequence_size - index - 1]));
+    } else {
+        return revdna3bit(s_iv[sequence_start + index]);
     }
-    
+}
+
+size_t XG::get_subsequence(const handle_t& handle, size_t index, size_t length, char* out) const {
+    size_t g = as_integer(handle) & LOW_BITS;
+    size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
+    size_t sequence_size = g_iv[g + G_NODE_LENGTH_OFFSET];
+    if (index >= sequence_size) {
+        return 0;
+    }
+    length = min(length, sequence_size - index);
     if (as_integer(handle) & HIGH_BIT) {
-        return reverse_complement(sequence);
+        // Reading forward on the reverse strand is reading backward from the
+        // end of the forward strand.
+        decode_sequence(sequence_start + sequence_size - index - length, length, true, out);
     } else {
-        return sequence;
+        decode_sequence(sequence_start + index, length, false, out);
+    }
+    return length;
+}
+
+void XG::decode_sequence(size_t start, size_t length, bool is_reverse, char* out) const {
+    // Lookup tables from the 3-bit codes (see dna3bit) to bases and their
+    // complements.
+    static const char forward_bases[8] = {'A', 'T', 'C', 'G', 'N', 'N', 'N', 'N'};
+    static const char complement_bases[8] = {'T', 'A', 'G', 'C', 'N', 'N', 'N', 'N'};
+    
+    if (length == 0) {
+        return;
+    }
+    
+    // s_iv is bit-compressed, so its width depends on the largest code stored
+    const uint8_t width = s_iv.width();
+    const uint64_t mask = sdsl::bits::lo_set[width];
+    const uint64_t* data = s_iv.data();
+    
+    // Walk along the packed words instead of calling operator[] per base
+    size_t bit = start * width;
+    const uint64_t* word = data + (bit >> 6);
+    uint8_t shift = bit & 63;
+    
+    const char* table = is_reverse ? complement_bases : forward_bases;
+    // Write backward when reverse complementing
+    char* cursor = is_reverse ? out + length - 1 : out;
+    ptrdiff_t step = is_reverse ? -1 : 1;
+    
+    for (size_t i = 0; i < length; i++) {
+        uint64_t value = *word >> shift;
+        if (shift + width > 64) {
+            // This entry straddles a word boundary
+            value |= word[1] << (64 - shift);
+        }
+        *cursor = table[value & mask];
+        cursor += step;
+        
+        shift += width;
+        if (shift >= 64) {
+            shift -= 64;
+            ++word;
+        }
     }
 }
 
@@ -2644,15 +3089,22 @@ int64_t XG::min_approx_path_distance(int64_t id1, int64_t id2) const {
     return min_distance;
 }
     
-vector<size_t> XG::memoized_paths_of_node(int64_t id, unordered_map<int64_t, vector<size_t>>* paths_of_node_memo) const {
+vector<size_t> XG::memoized_paths_of_node(int64_t id, paths_of_node_memo_t* paths_of_node_memo) const {
     if (paths_of_node_memo) {
         auto iter = paths_of_node_memo->find(id);
         if (iter != paths_of_node_memo->end()) {
             return iter->second;
         }
         else {
-            (*paths_of_node_memo)[id] = paths_of_node(id);
-            return paths_of_node_memo->at(id);
+            vector<size_t>& paths = (*paths_of_node_memo)[id];
+            // fall back on the shared memo before querying
+            if (!paths_of_node_memo->shared || !paths_of_node_memo->shared->find(id, paths)) {
+                paths = paths_of_node(id);
+                if (paths_of_node_memo->shared) {
+                    paths_of_node_memo->shared->insert(id, paths);
+                }
+            }
+            return paths;
         }
     }
     else {
@@ -2661,15 +3113,22 @@ vector<size_t> XG::memoized_paths_of_node(int64_t id, unordered_map<int64_t, vec
 }
 
 vector<pair<size_t, bool>> XG::memoized_oriented_occurrences_on_path(int64_t id, size_t path,
-                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) const {
+                                                                     oriented_occurrences_memo_t* oriented_occurrences_memo) const {
     if (oriented_occurrences_memo) {
         auto iter = oriented_occurrences_memo->find(make_pair(id, path));
         if (iter != oriented_occurrences_memo->end()) {
             return iter->second;
         }
         else {
-            (*oriented_occurrences_memo)[make_pair(id, path)] = oriented_occurrences_on_path(id, path);
-            return oriented_occurrences_memo->at(make_pair(id, path));
+            vector<pair<size_t, bool>>& occurrences = (*oriented_occurrences_memo)[make_pair(id, path)];
+            // fall back on the shared memo before querying
+            if (!oriented_occurrences_memo->shared || !oriented_occurrences_memo->shared->find(make_pair(id, path), occurrences)) {
+                occurrences = oriented_occurrences_on_path(id, path);
+                if (oriented_occurrences_memo->shared) {
+                    oriented_occurrences_memo->shared->insert(make_pair(id, path), occurrences);
+                }
+            }
+            return occurrences;
         }
     }
     else {
@@ -2679,23 +3138,30 @@ vector<pair<size_t, bool>> XG::memoized_oriented_occurrences_on_path(int64_t id,
     
     
 vector<pair<size_t, vector<pair<size_t, bool>>>> XG::memoized_oriented_paths_of_node(int64_t id,
-                                                                                     unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) const {
+                                                                                     paths_of_node_memo_t* paths_of_node_memo,
+                                                                                     oriented_occurrences_memo_t* oriented_occurrences_memo) const {
     vector<pair<size_t, vector<pair<size_t, bool>>>> oriented_path_occurrences;
     for (size_t path : memoized_paths_of_node(id, paths_of_node_memo)) {
-        oriented_path_occurrences.emplace_back(path, memoized_oriented_occurrences_on_path(id, path));
+        oriented_path_occurrences.emplace_back(path, memoized_oriented_occurrences_on_path(id, path, oriented_occurrences_memo));
     }
     return oriented_path_occurrences;
 }
     
-handle_t XG::memoized_get_handle(int64_t id, bool rev, unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+handle_t XG::memoized_get_handle(int64_t id, bool rev, handle_memo_t* handle_memo) const {
     if (handle_memo) {
         auto iter = handle_memo->find(make_pair(id, rev));
         if (iter != handle_memo->end()) {
             return iter->second;
         }
         else {
-            handle_t handle = get_handle(id, rev);
+            handle_t handle;
+            // fall back on the shared memo before querying
+            if (!handle_memo->shared || !handle_memo->shared->find(make_pair(id, rev), handle)) {
+                handle = get_handle(id, rev);
+                if (handle_memo->shared) {
+                    handle_memo->shared->insert(make_pair(id, rev), handle);
+                }
+            }
             (*handle_memo)[make_pair(id, rev)] = handle;
             return handle;
         }
@@ -2708,9 +3174,9 @@ handle_t XG::memoized_get_handle(int64_t id, bool rev, unordered_map<pair<int64_
 int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1, bool rev1,
                                                     int64_t id2, size_t offset2, bool rev2,
                                                     size_t max_search_dist,
-                                                    unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                    unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                    unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+                                                    paths_of_node_memo_t* paths_of_node_memo,
+                                                    oriented_occurrences_memo_t* oriented_occurrences_memo,
+                                                    handle_memo_t* handle_memo) const {
     
     unordered_map<size_t, tuple<int64_t, bool, int64_t>> path_dists_1, path_dists_2;
     unordered_set<size_t> shared_paths;
@@ -2917,9 +3383,9 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
                                                   int64_t id2, size_t offset2, bool rev2,
                                                   bool forward_strand,
                                                   size_t max_search_dist,
-                                                  unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                  unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                  unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+                                                  paths_of_node_memo_t* paths_of_node_memo,
+                                                  oriented_occurrences_memo_t* oriented_occurrences_memo,
+                                                  handle_memo_t* handle_memo) const {
     
 #ifdef debug_algorithms
     cerr << "[XG] estimating oriented distance between " << id1 << "[" << offset1 << "]" << (rev1 ? "-" : "+") << " and " << id2 << "[" << offset2 << "]" << (rev2 ? "-" : "+") << " with max search distance of " << max_search_dist << endl;
@@ -3189,9 +3655,9 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
 }
     
 vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, bool is_rev, size_t offset, int64_t jump_dist, size_t max_search_dist,
-                                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+                                                                 paths_of_node_memo_t* paths_of_node_memo,
+                                                                 oriented_occurrences_memo_t* oriented_occurrences_memo,
+                                                                 handle_memo_t* handle_memo) const {
     
 #ifdef debug_algorithms
     cerr << "[XG] jumping " << jump_dist << " from position " << id << (is_rev ? " rev:" : " fwd:") << offset << " with a max search dist of " << max_search_dist << endl;
@@ -3329,9 +3795,9 @@ vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, boo
 pair<bool, bool> XG::validate_strand_consistency(int64_t id1, size_t offset1, bool rev1,
                                                  int64_t id2, size_t offset2, bool rev2,
                                                  size_t max_search_dist,
-                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const{
+                                                 paths_of_node_memo_t* paths_of_node_memo,
+                                                 oriented_occurrences_memo_t* oriented_occurrences_memo,
+                                                 handle_memo_t* handle_memo) const{
     
     unordered_set<pair<size_t, bool>> path_strands_1;
     unordered_set<pair<size_t, bool>> path_strands_2;
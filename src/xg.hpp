@@ -20,6 +20,7 @@
 #include "graph.hpp"
 #include "path.hpp"
 #include "handle.hpp"
+#include "concurrent_memo.hpp"
 
 // We can have DYNAMIC or SDSL-based gPBWTs
 #define MODE_DYNAMIC 1
@@ -38,6 +39,7 @@ using namespace sdsl;
 using namespace vg;
 
 class XGPath;
+class ConstructionRecords;
 //typedef pair<int64_t, bool> Side;
 typedef int64_t id_t; // generic id type
 // node sides
@@ -60,6 +62,31 @@ class XGFormatError : public runtime_error {
     using runtime_error::runtime_error;
 };
 
+/**
+ * A memo for the results of a succinct query, for use within one read. It can
+ * be backed by a memo shared between threads, which is checked for queries
+ * this memo hasn't seen before they go to the index.
+ */
+template<typename Key, typename Value>
+class QueryMemo : public unordered_map<Key, Value> {
+public:
+    using shared_memo_t = ConcurrentMemo<Key, Value>;
+    
+    QueryMemo(shared_memo_t* shared = nullptr) : shared(shared) {}
+    
+    /// Memo shared with other reads, or null if there is none
+    shared_memo_t* shared;
+};
+
+/// A memo for the results of XG::paths_of_node
+using paths_of_node_memo_t = QueryMemo<int64_t, vector<size_t>>;
+
+/// A memo for the results of XG::oriented_occurrences_on_path
+using oriented_occurrences_memo_t = QueryMemo<pair<int64_t, size_t>, vector<pair<size_t, bool>>>;
+
+/// A memo for the results of XG::get_handle
+using handle_memo_t = QueryMemo<pair<int64_t, bool>, handle_t>;
+
 /**
  * Provides succinct storage for a graph, its positional paths, and a set of
  * embedded threads.
@@ -101,14 +128,19 @@ public:
     void from_callback(function<void(function<void(Graph&)>)> get_chunks,
         bool validate_graph = false, bool print_graph = false,
         bool store_threads = false, bool is_sorted_dag = false); 
-    void build(vector<pair<id_t, string> >& node_label,
-               unordered_map<side_t, vector<side_t> >& from_to,
-               unordered_map<side_t, vector<side_t> >& to_from,
+    // Build the index from the sorted, deduplicated node and edge records
+    // that from_callback() collected.
+    void build(ConstructionRecords& records,
                map<string, vector<trav_t> >& path_nodes,
                bool validate_graph,
                bool print_graph,
                bool store_threads,
                bool is_sorted_dag);
+    
+    // How many bytes of node and edge records from_callback() may hold in
+    // memory. Past this, records are sorted and spilled to temporary files,
+    // and merged back when the index is built. 0 means no limit.
+    size_t max_construction_bytes = 0;
                
     // What's the maximum XG version number we can read with this code?
     const static uint32_t MAX_INPUT_VERSION = 8;
@@ -219,6 +251,14 @@ public:
     /// Get the sequence of a node, presented in the handle's local forward
     /// orientation.
     virtual string get_sequence(const handle_t& handle) const;
+    /// Get the base at the given offset along the handle's local forward
+    /// orientation, without allocating.
+    char get_base(const handle_t& handle, size_t index) const;
+    /// Decode up to length bases of the handle's sequence, starting at the
+    /// given offset in its local forward orientation, into the caller's
+    /// buffer. Stops at the end of the node. Returns the number of bases
+    /// written.
+    size_t get_subsequence(const handle_t& handle, size_t index, size_t length, char* out) const;
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue.
@@ -328,20 +368,20 @@ public:
     vector<pair<size_t, vector<pair<size_t, bool>>>> oriented_paths_of_node(int64_t id) const;
     
     /// same as paths_of_node, but with an optional memo to avoid repeated recalculation
-    vector<size_t> memoized_paths_of_node(int64_t id, unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr) const;
+    vector<size_t> memoized_paths_of_node(int64_t id, paths_of_node_memo_t* paths_of_node_memo = nullptr) const;
     
     /// same as oriented_occurrences_on_path, but with an optional memo to avoid repeated recalculation
     vector<pair<size_t, bool>> memoized_oriented_occurrences_on_path(int64_t id, size_t path,
-                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr) const;
+                                                                     oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr) const;
     
     /// same as oriented_paths_of_node, but with an optional memo to avoid repeated recalculation
     vector<pair<size_t, vector<pair<size_t, bool>>>> memoized_oriented_paths_of_node(int64_t id,
-                                                                                     unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr) const;
+                                                                                     paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                                                                     oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr) const;
     
     /// returns a the memoized result from get_handle if a memo is provided that the result has been queried previously
     /// otherwise, returns the result of get_handle directly and stores it in the memo if one is provided
-    handle_t memoized_get_handle(int64_t id, bool rev, unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+    handle_t memoized_get_handle(int64_t id, bool rev, handle_memo_t* handle_memo = nullptr) const;
     
     /// the oriented distance (positive if pos2 is further along the path than pos1, otherwise negative)
     /// estimated by the distance along the nearest shared path to the two positions. returns numeric_limits<int64_t>::max()
@@ -350,9 +390,9 @@ public:
     int64_t closest_shared_path_unstranded_distance(int64_t id1, size_t offset1, bool rev1,
                                                     int64_t id2, size_t offset2, bool rev2,
                                                     size_t max_search_dist,
-                                                    unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                    unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                    unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                    paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                                    oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr,
+                                                    handle_memo_t* handle_memo = nullptr) const;
     
     /// the oriented distance (positive if pos2 is further along the path than pos1, otherwise negative)
     /// estimated by the distance along the nearest shared path to the two positions plus the distance
@@ -363,18 +403,18 @@ public:
                                                   int64_t id2, size_t offset2, bool rev2,
                                                   bool forward_strand = false,
                                                   size_t max_search_dist = 100,
-                                                  unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                  unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                  unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                  paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                                  oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr,
+                                                  handle_memo_t* handle_memo = nullptr) const;
     
     /// returns a vector of (node id, is reverse, offset) tuples that are found by jumping a fixed oriented distance
     /// along path(s) from the given position. if the position is not on a path, searches from the position to a path
     /// and adds/subtracts the search distance to the jump depending on the search direction. returns an empty vector
     /// if there is no path within the max search distance or if the jump distance goes past the end of the path
     vector<tuple<int64_t, bool, size_t>> jump_along_closest_path(int64_t id, bool is_rev, size_t offset, int64_t jump_dist, size_t max_search_dist,
-                                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                                 paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                                                 oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr,
+                                                                 handle_memo_t* handle_memo = nullptr) const;
     
     /// checks whether two positions are on or near the same strand of some path. if the position can reach both strands of a
     /// path, it is only considered to be on the nearer of the two strands. positions are also considered consistent if they
@@ -383,9 +423,9 @@ public:
     pair<bool, bool> validate_strand_consistency(int64_t id1, size_t offset1, bool rev1,
                                                  int64_t id2, size_t offset2, bool rev2,
                                                  size_t max_search_dist,
-                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                 paths_of_node_memo_t* paths_of_node_memo = nullptr,
+                                                 oriented_occurrences_memo_t* oriented_occurrences_memo = nullptr,
+                                                 handle_memo_t* handle_memo = nullptr) const;
     ////////////////////////////////////////////////////////////////////////////
     // Sample database API
     ////////////////////////////////////////////////////////////////////////////
@@ -611,6 +651,11 @@ private:
     bool do_edges(const size_t& g, const size_t& start, const size_t& count,
         bool is_to, bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const;
     
+    /// Unpack length bases of s_iv starting at the given position into out,
+    /// reading whole words of the packed vector at a time. If is_reverse is
+    /// set, write the reverse complement instead.
+    void decode_sequence(size_t start, size_t length, bool is_reverse, char* out) const;
+    
     ////////////////////////////////////////////////////////////////////////////
     // Here are the bits we need to keep around to talk about the sequence
     ////////////////////////////////////////////////////////////////////////////
@@ -47,15 +47,12 @@ char xg_pos_char(pos_t pos, xg::XG* xgidx) {
 map<pos_t, char> xg_next_pos_chars(pos_t pos, xg::XG* xgidx) {
 
     map<pos_t, char> nexts;
-    // See if the node is cached (did we just visit it?)
-    Node node = xgidx->node(id(pos));
+    // Look at the node through a handle so we don't have to unpack its sequence
+    handle_t handle = xgidx->get_handle(id(pos), is_rev(pos));
     // if we are still in the node, return the next position and character
-    if (offset(pos) < node.sequence().size()-1) {
+    if (offset(pos) < xgidx->get_length(handle)-1) {
         ++get_offset(pos);
-        //nexts[pos] = xg_pos_char(pos, xgidx, node_cache);
-        char c = node.sequence().at(offset(pos));
-        if (is_rev(pos)) c = reverse_complement(c);
-        nexts[pos] = c;
+        nexts[pos] = xgidx->get_base(handle, offset(pos));
     } else {
         // helper
         auto is_inverting = [](const Edge& e) {
@@ -63,7 +60,7 @@ map<pos_t, char> xg_next_pos_chars(pos_t pos, xg::XG* xgidx) {
             && (e.from_start() || e.to_end());
         };
         // check our cache
-        vector<Edge> edges = xgidx->edges_of(node.id());
+        vector<Edge> edges = xgidx->edges_of(id(pos));
         // look at the next positions we could reach
         if (!is_rev(pos)) {
             // we are on the forward strand, the next things from this node come off the end
@@ -94,10 +91,8 @@ map<pos_t, char> xg_next_pos_chars(pos_t pos, xg::XG* xgidx) {
 
 set<pos_t> xg_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx) {
     set<pos_t> nexts;
-    // See if the node is cached (did we just visit it?)
-    Node node = xgidx->node(id(pos));
-    // if we are still in the node, return the next position and character
-    if (!whole_node && offset(pos) < node.sequence().size()-1) {
+    // if we are still in the node, return the next position
+    if (!whole_node && offset(pos) < xgidx->node_length(id(pos))-1) {
         ++get_offset(pos);
         nexts.insert(pos);
     } else {
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 14
+plan tests 15
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -d - | wc -l) 505 "view produces the expected number of lines of dot output"
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - | wc -l) 503 "view produces the expected number of lines of GFA output"
@@ -25,6 +25,9 @@ is $? 0 "view can reconstruct a VG graph from JSON"
 vg view -v x.vg | cmp -s - x.vg
 is $? 0 "view can pass through VG"
 
+vg view -g x.vg | vg view -Fv - | vg view -g - | diff - <(vg view -g x.vg)
+is $? 0 "view round trips GFA with paths through VG"
+
 rm -f x.vg
 
 is $(samtools view -u minigiab/NA12878.chr22.tiny.bam | vg view -bG - | vg view -a - | jq .sample_name | grep -v '^"1"$' | wc -l ) 0 "view parses sample names"
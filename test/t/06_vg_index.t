@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="en_US.utf8" # force ekg's favorite sort order 
 
-plan tests 48
+plan tests 51
 
 
 # Single graph without haplotypes
@@ -25,9 +25,22 @@ is $? 0 "building both indexes at once"
 cmp x.xg x2.xg && cmp x.gcsa x2.gcsa && cmp x.gcsa.lcp x2.gcsa.lcp
 is $? 0 "the indexes are identical"
 
+vg index -x x3.xg -e 0.00001 -t 2 x.vg
+cmp x.xg x3.xg
+is $? 0 "building an XG index under a memory limit gives the same index"
+
+vg snarls x.vg > x.snarls
+vg index -j x.dist -s x.snarls x.vg
+is $? 0 "building a distance index of a graph"
+
+vg index -I x.min -K 15 -w 5 x.vg
+is $? 0 "building a minimizer index of a graph"
+
 rm -f x.vg
 rm -f x.xg x.gcsa x.gcsa.lcp
 rm -f x2.xg x2.gcsa x2.gcsa.lcp
+rm -f x3.xg
+rm -f x.snarls x.dist x.min
 
 
 # Single graph with haplotypes
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 7
+plan tests 11
 
 num_nodes=$(vg construct -r small/x.fa -v small/x.vcf.gz | vg ids -c - | vg view -g - | grep ^S | wc -l)
 
@@ -38,6 +38,22 @@ rm sorted.vg
 
 is $(vg ids -s ids/unordered.vg | vg view -j - | jq -c '.node[1] == {"id":2,"sequence":"T"}') "true" "sorting assigns node IDs in topological order"
 
+# Describe a graph independently of element order, for comparing against vg
+# mod, which still renumbers through VG
+describe() {
+    vg view -j - | jq -cS '.node |= sort_by(.id) | .edge |= (. // [] | sort_by([.from, .to])) | .path |= (. // [] | sort_by(.name))'
+}
+
+vg construct -r small/x.fa -v small/x.vcf.gz -a >x.vg
+vg ids -i 1000 x.vg >shifted.vg
+
+is "$(vg ids -s shifted.vg | describe)" "$(vg mod -c shifted.vg | describe)" "sorting matches vg mod -c, paths included"
+is "$(vg ids -s ids/unordered.vg | describe)" "$(vg mod -c ids/unordered.vg | describe)" "sorting an unordered graph matches vg mod -c"
+is "$(vg ids -c shifted.vg | describe)" "$(describe < x.vg)" "compacting undoes incrementing, paths included"
+is "$(vg ids -d 1000 shifted.vg | describe)" "$(describe < x.vg)" "decrementing undoes incrementing, paths included"
+
+rm x.vg shifted.vg
+
 # this test now breaks under the current VG.paths semantics, which require our paths to record the exact match lengths of the nodes
 #vg ids -s graphs/snp1kg-brca2-unsorted.vg | vg validate -
 #is $? 0 "can handle graphs with out-of-order mappings"
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 10
+plan tests 11
 
 vg construct -r 1mb1kgp/z.fa -v 1mb1kgp/z.vcf.gz >z.vg
 #is $? 0 "construction of a 1 megabase graph from the 1000 Genomes succeeds"
@@ -41,7 +41,12 @@ vg index -x x.xg -g x.gcsa -k 16 x.vg
 vg sim -s 1337 -n 100 -x x.xg >x.reads
 vg map -x x.xg -g x.gcsa -T x.reads >x.gam
 is "$(vg stats -a x.gam x.vg | md5sum | cut -f 1 -d\ )" "$(md5sum correct/10_vg_stats/15.txt | cut -f 1 -d\ )" "aligned read stats are computed correctly"
-rm -f x.vg x.xg x.gcsa x.gam x.reads
+vg view -a x.gam | head -n 40 | vg view -JaG - >first.gam
+vg view -a x.gam | tail -n +41 | vg view -JaG - >rest.gam
+vg stats -a first.gam -W first.stats x.vg >/dev/null
+vg stats -a rest.gam -W rest.stats x.vg >/dev/null
+is "$(vg stats -M first.stats -M rest.stats x.vg | md5sum | cut -f 1 -d\ )" "$(md5sum correct/10_vg_stats/15.txt | cut -f 1 -d\ )" "aligned read stats saved in parts merge to the stats for all the reads"
+rm -f x.vg x.xg x.gcsa x.gam x.reads first.gam rest.gam first.stats rest.stats
 
 vg msga -g <(vg msga -f msgas/cycle.fa -b s1 -w 32 -t 1 | vg mod -D - | vg mod -U 10 -) -f msgas/cycle.fa -t 1 | vg mod -N - | vg mod -U 10 - >c.vg
 is $(vg stats -O c.vg | wc -l) 77 "a path overlap description of a cyclic graph built by msga has the expected length"
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 23
+plan tests 27
 
 vg construct -r small/x.fa >j.vg
 vg index -x j.xg j.vg
@@ -36,6 +36,18 @@ is $(vg surject -p x -x x.xg -t 1 x.gam | vg view -a - | wc -l) \
 is $(vg surject -p x -x x.xg -s x.gam | grep -v ^@ | wc -l) \
     100 "vg surject produces valid SAM output"
 
+is "$(vg surject -p x -x x.xg -t 4 -s x.gam | md5sum)" "$(vg surject -p x -x x.xg -t 1 -s x.gam | md5sum)" \
+    "vg surject output is the same in the same order with any number of threads"
+
+is "$(vg surject -p x -x x.xg -t 4 -b -S x.gam | samtools view - | cut -f4 | md5sum)" "$(vg surject -p x -x x.xg -s x.gam | grep -v ^@ | cut -f4 | sort -n | md5sum)" \
+    "vg surject can sort its output by position"
+
+is "$(vg surject -p x -x x.xg -b -S x.gam | samtools view - | sort | md5sum)" "$(vg surject -p x -x x.xg -b x.gam | samtools view - | sort | md5sum)" \
+    "sorting surjected output keeps the same records"
+
+is "$(vg map -G <(vg sim -a -s 1337 -n 100 -x x.xg) -g x.gcsa -x x.xg --surject-to bam --sort-by-position | samtools view -H - | grep -c SO:coordinate)" \
+    1 "vg map marks sorted surjected output as sorted"
+
 is $(vg map -G <(vg sim -a -s 1337 -n 100 -x x.xg) -g x.gcsa -x x.xg --surject-to sam | grep -v ^@ | wc -l) \
     100 "vg map may surject reads to produce valid SAM output"
 
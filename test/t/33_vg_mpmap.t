@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 11
+plan tests 13
 
 
 # Exercise the GBWT
@@ -57,6 +57,10 @@ is $(printf "%s\t%s\n" $paired_range $distant_range | awk '{if ($1 < $2) print 1
 
 rm -f temp_paired_alignment.json temp_distant_alignment.json temp_independent_alignment.json
 
+is "$(vg mpmap -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i -S --verbose 2>&1 >/dev/null | grep -c 'shared .* memo: .* hits in .* lookups')" "3" "verbose mapping reports the hit rates of the shared memos"
+
+is "$(vg mpmap -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i --surject-to bam | samtools view - | wc -l)" "$(vg mpmap -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i -S | vg view -a - | wc -l)" "mpmap can surject paired reads to BAM"
+
 rm -f graphs/refonly-lrc_kir.vg.xg graphs/refonly-lrc_kir.vg.gcsa graphs/refonly-lrc_kir.vg.gcsa.lcp
 
 
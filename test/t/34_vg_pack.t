@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 6
+plan tests 9
 
 vg construct -r tiny/tiny.fa >flat.vg
 vg view flat.vg| sed 's/CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTG/CAAATAAGGCTTGGAAATTTTCTGGAGATCTATTATACTCCAACTCTCTG/' | vg view -Fv - >2snp.vg
@@ -39,4 +39,19 @@ y=$(vg pack -x flat.xg -di 2snp.gam.cx.3x | wc -c)
 
 is $x $y "pack index merging produces the expected result"
 
+vg construct -r tiny/tiny.fa -m 8 >chop.vg
+vg index -x chop.xg -g chop.gcsa -k 16 chop.vg
+vg map -g chop.gcsa -x chop.xg -G 2snp.sim -k 8 >chop.gam
+vg pack -x chop.xg -o chop.gam.cx -b 10 -g chop.gam -e
+vg pack -x chop.xg -o chop.gam.cx.t4 -b 10 -g chop.gam -e -t 4
+is $(vg pack -x chop.xg -di chop.gam.cx.t4 -e | md5sum | cut -f 1 -d\ ) $(vg pack -x chop.xg -di chop.gam.cx -e | md5sum | cut -f 1 -d\ ) "packing with many threads produces the same table as packing with one"
+
+is $(vg pack -x chop.xg -di chop.gam.cx -e -R 3:5 | tail -n+2 | md5sum | cut -f 1 -d\ ) $(vg pack -x chop.xg -di chop.gam.cx -e | tail -n+2 | awk '$2 >= 3 && $2 <= 5' | md5sum | cut -f 1 -d\ ) "a node range of the table matches the same rows of the whole table"
+
+cat chop.gam chop.gam >chop.2x.gam
+vg pack -x chop.xg -o chop.gam.cx.2x -b 10 -g chop.2x.gam -e
+vg pack -x chop.xg -o chop.gam.cx.added -i chop.gam.cx -g chop.gam -e -t 4
+is $(vg pack -x chop.xg -di chop.gam.cx.added -e | md5sum | cut -f 1 -d\ ) $(vg pack -x chop.xg -di chop.gam.cx.2x -e | md5sum | cut -f 1 -d\ ) "alignments can be added to a loaded pack"
+
+rm -f chop.vg chop.xg chop.gcsa chop.gcsa.lcp chop.gam chop.2x.gam chop.gam.cx chop.gam.cx.t4 chop.gam.cx.2x chop.gam.cx.added
 rm -f flat.vg 2snp.vg 2snp.xg 2snp.sim flat.gcsa flat.gcsa.lcp flat.xg 2snp.xg 2snp.gam 2snp.gam.cx 2snp.gam.cx.3x 2snp.gam.vgpu